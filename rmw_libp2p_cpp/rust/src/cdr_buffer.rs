@@ -38,6 +38,40 @@ pub extern "C" fn rs_libp2p_cdr_buffer_free(ptr: *mut Cursor<Vec<u8>>) {
     unsafe { Box::from_raw(ptr) };
 }
 
+/// Gets the bytes of a `Cursor<Vec<u8>>`, without copying them.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers. The bytes are valid until the buffer is
+/// written to or freed.
+///
+/// # Arguments
+///
+/// * `ptr` - A raw pointer to a `Cursor<Vec<u8>>`.
+/// * `data` - A raw pointer to where the pointer to the bytes is stored.
+/// * `length` - A raw pointer to where the number of bytes is stored.
+///
+/// # Panics
+///
+/// This function will panic if any of the provided pointers is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_cdr_buffer_get_data(
+    ptr: *const Cursor<Vec<u8>>,
+    data: *mut *const u8,
+    length: *mut usize,
+) {
+    let libp2p2_cdr_buffer = unsafe {
+        assert!(!ptr.is_null());
+        &*ptr
+    };
+    unsafe {
+        assert!(!data.is_null());
+        assert!(!length.is_null());
+        *data = libp2p2_cdr_buffer.get_ref().as_ptr();
+        *length = libp2p2_cdr_buffer.get_ref().len();
+    }
+}
+
 /// Creates a new `Cursor<Vec<u8>>` from a raw pointer to a byte array.
 ///
 /// # Safety
@@ -495,6 +529,40 @@ pub extern "C" fn rs_libp2p_cdr_buffer_write_new() -> *mut Cursor<Vec<u8>> {
     Box::into_raw(Box::new(libp2p2_cdr_buffer))
 }
 
+/// Empties a `Cursor<Vec<u8>>` so that it can be written to again, keeping its allocation.
+///
+/// The allocation is grown to `capacity` bytes if it is smaller, and shrunk to it if it is more
+/// than twice as large, so that a buffer reused for messages of varying size neither reallocates
+/// on every message nor holds on to the memory of an occasional large one.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr` - A raw pointer to a `Cursor<Vec<u8>>`.
+/// * `capacity` - The number of bytes the buffer is expected to need.
+///
+/// # Panics
+///
+/// This function will panic if the provided pointer is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_cdr_buffer_write_reset(ptr: *mut Cursor<Vec<u8>>, capacity: usize) {
+    let libp2p2_cdr_buffer = unsafe {
+        assert!(!ptr.is_null());
+        &mut *ptr
+    };
+    libp2p2_cdr_buffer.set_position(0);
+    let bytes = libp2p2_cdr_buffer.get_mut();
+    bytes.clear();
+    if bytes.capacity() < capacity {
+        bytes.reserve_exact(capacity);
+    } else if bytes.capacity() / 2 > capacity {
+        bytes.shrink_to(capacity);
+    }
+}
+
 /// Writes a `u64` to a `Cursor<Vec<u8>>`.
 ///
 /// This function serializes a `u64` into a `Cursor<Vec<u8>>` using the `cdr::serialize_into` function.
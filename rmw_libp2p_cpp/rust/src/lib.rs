@@ -13,11 +13,16 @@
 // limitations under the License.
 
 mod cdr_buffer;
+mod messages;
 mod node;
+mod outgoing;
 mod publisher;
+mod reliability;
+mod service;
 mod subscription;
 
 pub use cdr_buffer::*;
 pub use node::*;
 pub use publisher::*;
+pub use service::*;
 pub use subscription::*;
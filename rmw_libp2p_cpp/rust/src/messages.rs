@@ -0,0 +1,103 @@
+// Copyright 2024 Esteve Fernandez
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Messages lent to the C++ side without copying them.
+//!
+//! Once serialized, a message is a `Bytes` shared by the history of its publisher, the outgoing
+//! queue and the local subscriptions it is delivered to, and received messages are shared the
+//! same way by every local subscription of their topic. The C++ side only knows a message by the
+//! address and the length of its bytes, so each message it holds is kept alive here, along with
+//! the number of times it was lent, until every one of them is released with
+//! `rs_libp2p_message_free`.
+//!
+//! Every delivery and every release goes through this table, from the event loop and from the
+//! executor threads alike, so it is split in shards picked by the address of the message.
+
+use std::collections::HashMap;
+use std::ptr::NonNull;
+use std::sync::{Mutex, OnceLock};
+
+use bytes::Bytes;
+
+type LentMessages = HashMap<(usize, usize), (Bytes, usize)>;
+
+const SHARD_BITS: u32 = 4;
+const SHARDS: usize = 1 << SHARD_BITS;
+
+/// The shard of the table that keeps the message at `ptr`.
+fn lent_messages(ptr: usize) -> &'static Mutex<LentMessages> {
+    static LENT_MESSAGES: OnceLock<[Mutex<LentMessages>; SHARDS]> = OnceLock::new();
+    let shards = LENT_MESSAGES.get_or_init(|| std::array::from_fn(|_| Mutex::new(HashMap::new())));
+    // Large messages are page aligned, the top bits of a Fibonacci hash spread them anyway
+    let hash = (ptr as u64).wrapping_mul(0x9e37_79b9_7f4a_7c15);
+    &shards[(hash >> (64 - SHARD_BITS)) as usize]
+}
+
+/// Lends a message to the C++ side, which must release it with `release`.
+///
+/// # Returns
+///
+/// The address and the length of the bytes of the message. They must not be written to, other
+/// receivers may be reading them.
+pub(crate) fn lend(message: &Bytes) -> (*mut u8, usize) {
+    // Empty messages have nothing to keep alive, like empty boxed slices
+    if message.is_empty() {
+        return (NonNull::dangling().as_ptr(), 0);
+    }
+    let ptr = message.as_ptr() as *mut u8;
+    lent_messages(ptr as usize)
+        .lock()
+        .unwrap()
+        .entry((ptr as usize, message.len()))
+        .or_insert_with(|| (message.clone(), 0))
+        .1 += 1;
+    (ptr, message.len())
+}
+
+/// Allocates a zeroed message lent to the C++ side, which fills it in before anyone else reads
+/// it and must release it with `release`.
+pub(crate) fn allocate(len: usize) -> *mut u8 {
+    if len == 0 {
+        return NonNull::dangling().as_ptr();
+    }
+    let mut buffer = vec![0u8; len];
+    let ptr = buffer.as_mut_ptr();
+    // Bytes takes over the allocation of the vector, the address of the bytes doesn't change
+    lent_messages(ptr as usize)
+        .lock()
+        .unwrap()
+        .insert((ptr as usize, len), (Bytes::from(buffer), 1));
+    ptr
+}
+
+/// Releases a message lent to the C++ side, it is freed once nothing else references it.
+pub(crate) fn release(ptr: *mut u8, len: usize) {
+    if ptr.is_null() || len == 0 {
+        return;
+    }
+    let key = (ptr as usize, len);
+    let released = {
+        let mut shard = lent_messages(ptr as usize).lock().unwrap();
+        match shard.get_mut(&key) {
+            Some((_, count)) if *count > 1 => {
+                *count -= 1;
+                None
+            }
+            Some(_) => shard.remove(&key),
+            None => None,
+        }
+    };
+    // Large messages are freed outside the lock
+    drop(released);
+}
@@ -16,21 +16,37 @@ use std::collections::hash_map::DefaultHasher;
 use std::ffi::c_void;
 use std::hash::{Hash, Hasher};
 use std::sync::Arc;
-use std::time::{Duration, SystemTime, UNIX_EPOCH};
-use std::collections::HashMap;
+use std::time::{Duration, Instant};
+use std::collections::{HashMap, HashSet};
+
+use bytes::Bytes;
 
 use libp2p::{
-    futures::StreamExt, gossipsub, identity, mdns, swarm::NetworkBehaviour, swarm::SwarmEvent,
-    PeerId,
+    futures::StreamExt, gossipsub, identity, mdns, ping, request_response,
+    swarm::NetworkBehaviour, swarm::SwarmEvent, PeerId,
 };
 
 use tokio::runtime::Runtime;
 use tokio::sync::Notify;
 use tokio::sync::Mutex;
+use tokio::time::MissedTickBehavior;
 use tokio::{select, task};
 
+use uuid::Uuid;
+
 use deadqueue::unlimited::Queue;
 
+use crate::messages;
+use crate::outgoing::OutgoingQueue;
+use crate::reliability::{
+    self, MessageHeader, PublisherHistories, ReceiverState, ReliableCodec, ReliableProtocol,
+    ReliableRequest, ReliableResponse,
+};
+use crate::service::{
+    self, AvailabilityCallback, PendingResponses, ServerDirectory, ServerWindows, ServiceCodec,
+    ServiceProtocol, ServiceRequest, ServiceResponse,
+};
+
 #[repr(C)]
 pub(crate) struct CustomSubscriptionHandle{
     pub ptr: *const c_void
@@ -39,17 +55,256 @@ pub(crate) struct CustomSubscriptionHandle{
 unsafe impl Send for CustomSubscriptionHandle {}
 unsafe impl Sync for CustomSubscriptionHandle {}
 
+type SubscriptionCallback = unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize);
+
+/// A local subscription and the QoS it asked for.
+struct SubscriptionEntry {
+    obj: CustomSubscriptionHandle,
+    callback: SubscriptionCallback,
+    // Messages of reliable publishers are delivered in order, with retransmissions
+    reliable: bool,
+    // Histories of transient local publishers are replayed to it
+    transient_local: bool,
+}
+
+/// Subscriptions registered for each topic, keyed by the topic hash.
+///
+/// The map is shared between the node and its event loop and is only accessed under the lock,
+/// so that once a subscription has been removed its callback is guaranteed not to be called anymore.
+type SubscriptionCallbacks = Arc<std::sync::Mutex<HashMap<String, Vec<SubscriptionEntry>>>>;
+
+/// Sequence number of the last message of each publisher handed to each transient local
+/// subscription, keyed by the subscription handle pointer and the publisher GID.
+///
+/// Histories may be replayed more than once, and after newer messages have been delivered, so
+/// anything at or below it is dropped. Only accessed by the event loop.
+type DurableProgress = HashMap<(usize, Uuid), u64>;
+
+/// Builds a message out of its header and its payload.
+///
+/// The payload is copied once, right after the header, into the buffer handed to gossipsub. Its
+/// pieces are gathered there, they are only split to avoid copying large arrays twice.
+fn encode_message(header: &MessageHeader, payload: &[&[u8]]) -> Bytes {
+    let payload_len: usize = payload.iter().map(|piece| piece.len()).sum();
+    let mut buffer = Vec::<u8>::with_capacity(reliability::HEADER_SIZE + payload_len);
+    header.encode(&mut buffer);
+    for piece in payload {
+        buffer.extend_from_slice(piece);
+    }
+    Bytes::from(buffer)
+}
+
+/// Lends a message to a subscription.
+///
+/// Every subscription the message is delivered to shares its bytes, each of them releases it with
+/// rs_libp2p_message_free
+fn deliver_to(entry: &SubscriptionEntry, progress: &mut DurableProgress, message: &Bytes) {
+    if entry.transient_local {
+        if let Some(header) = MessageHeader::decode(message) {
+            let last = progress
+                .entry((entry.obj.ptr as usize, header.gid))
+                .or_insert(0);
+            if header.sequence_number <= *last {
+                return;
+            }
+            *last = header.sequence_number;
+        }
+    }
+    let (ptr, len) = messages::lend(message);
+    unsafe {
+        (entry.callback)(&entry.obj, ptr, len);
+    }
+}
+
+/// Lends a message to every local subscription of a topic.
+fn deliver(callbacks: &SubscriptionCallbacks, progress: &mut DurableProgress, topic: &str, message: &Bytes) {
+    let callbacks = callbacks.lock().unwrap();
+    if let Some(entries) = callbacks.get(topic) {
+        for entry in entries.iter() {
+            deliver_to(entry, progress, message);
+        }
+    }
+}
+
+/// Hands the history of transient local publishers to the transient local subscriptions of a
+/// topic, or only to the one whose handle pointer is `only`.
+fn replay(
+    callbacks: &SubscriptionCallbacks,
+    progress: &mut DurableProgress,
+    topic: &str,
+    messages: &[Bytes],
+    only: Option<usize>,
+) {
+    let callbacks = callbacks.lock().unwrap();
+    if let Some(entries) = callbacks.get(topic) {
+        for entry in entries.iter().filter(|entry| {
+            entry.transient_local && only.map_or(true, |ptr| ptr == entry.obj.ptr as usize)
+        }) {
+            for message in messages {
+                deliver_to(entry, progress, message);
+            }
+        }
+    }
+}
+
+fn has_reliable_subscription(callbacks: &SubscriptionCallbacks, topic: &str) -> bool {
+    callbacks
+        .lock()
+        .unwrap()
+        .get(topic)
+        .map_or(false, |entries| entries.iter().any(|entry| entry.reliable))
+}
+
+/// Remote peers subscribed to each topic, which reliable publishers wait for.
+#[derive(Default)]
+struct TopicMatches {
+    peers: HashMap<String, HashSet<PeerId>>,
+}
+
+impl TopicMatches {
+    fn peer_subscribed(&mut self, topic: String, peer: PeerId) {
+        self.peers.entry(topic).or_default().insert(peer);
+    }
+
+    fn peer_unsubscribed(&mut self, topic: String, peer: PeerId) {
+        if let Some(peers) = self.peers.get_mut(&topic) {
+            peers.remove(&peer);
+            if peers.is_empty() {
+                self.peers.remove(&topic);
+            }
+        }
+    }
+
+    fn peer_disconnected(&mut self, peer: PeerId) {
+        let topics: Vec<String> = self
+            .peers
+            .iter()
+            .filter(|(_, peers)| peers.contains(&peer))
+            .map(|(topic, _)| topic.clone())
+            .collect();
+        for topic in topics {
+            self.peer_unsubscribed(topic, peer);
+        }
+    }
+}
+
+type SharedTopicMatches = Arc<std::sync::Mutex<TopicMatches>>;
+
+#[repr(C)]
+pub(crate) struct CustomNodeHandle{
+    pub ptr: *const c_void
+}
+
+unsafe impl Send for CustomNodeHandle {}
+unsafe impl Sync for CustomNodeHandle {}
+
+type SharedServerDirectory = Arc<std::sync::Mutex<ServerDirectory>>;
+
+#[repr(C)]
+pub(crate) struct CustomServiceHandle{
+    pub ptr: *const c_void
+}
+
+unsafe impl Send for CustomServiceHandle {}
+unsafe impl Sync for CustomServiceHandle {}
+
+#[repr(C)]
+pub(crate) struct CustomClientHandle{
+    pub ptr: *const c_void
+}
+
+unsafe impl Send for CustomClientHandle {}
+unsafe impl Sync for CustomClientHandle {}
+
+/// Called with the GID of the client, the sequence number and the payload of a request (for
+/// services) or of a response (for clients). The payload is released with rs_libp2p_message_free
+pub(crate) type ServiceCallback<T> = unsafe extern "C" fn(&T, *const u8, i64, *mut u8, len: usize);
+
+/// Local servers of each service, keyed by the service name.
+///
+/// Only accessed under the lock, so that once a server has been removed its callback is
+/// guaranteed not to be called anymore. Only the first server of a service gets the requests.
+type ServiceCallbacks =
+    Arc<std::sync::Mutex<HashMap<String, Vec<(CustomServiceHandle, ServiceCallback<CustomServiceHandle>)>>>>;
+
+/// Local clients, keyed by their GID.
+type ClientCallbacks =
+    Arc<std::sync::Mutex<HashMap<Uuid, (CustomClientHandle, ServiceCallback<CustomClientHandle>)>>>;
+
+fn call_service_callback<T>(
+    obj: &T,
+    callback: ServiceCallback<T>,
+    client_gid: &Uuid,
+    sequence_number: i64,
+    payload: Vec<u8>,
+) {
+    let (ptr, len) = messages::lend(&Bytes::from(payload));
+    unsafe {
+        callback(obj, client_gid.as_bytes().as_ptr(), sequence_number, ptr, len);
+    }
+}
+
+/// Hands a request to the local server of its service, or gives it back if there is none.
+fn deliver_request(services: &ServiceCallbacks, request: ServiceRequest) -> Option<ServiceRequest> {
+    let services = services.lock().unwrap();
+    match services.get(&request.service_name).and_then(|entries| entries.first()) {
+        Some((obj, callback)) => {
+            call_service_callback(obj, *callback, &request.client_gid, request.sequence_number, request.payload);
+            None
+        }
+        None => Some(request),
+    }
+}
+
+/// Hands a response to its local client, or gives it back if the client is not in this node.
+fn deliver_response(clients: &ClientCallbacks, response: ServiceResponse) -> Option<ServiceResponse> {
+    let clients = clients.lock().unwrap();
+    match clients.get(&response.client_gid) {
+        Some((obj, callback)) => {
+            call_service_callback(obj, *callback, &response.client_gid, response.sequence_number, response.payload);
+            None
+        }
+        None => Some(response),
+    }
+}
+
+/// Service traffic that the event loop has to put on the network.
+enum ServiceCommand {
+    /// A local server was added to the service
+    Advertise(String),
+    /// A local server was removed from the service
+    Withdraw(String),
+    /// A request without a local server, sent to a peer serving the service chosen by the
+    /// routing policy of the client
+    Request(ServiceRequest, u8),
+    /// A response to a client that is not in this node
+    Respond(ServiceResponse),
+}
+
+/// Changes in the set of local subscriptions that the event loop has to apply to gossipsub,
+/// with the handle pointer of the subscription and whether it is transient local.
+enum SubscriptionChange {
+    Added(gossipsub::IdentTopic, usize, bool),
+    Removed(gossipsub::IdentTopic, usize),
+}
+
 #[derive(NetworkBehaviour)]
 #[behaviour(out_event = "OutEvent")]
 struct RosNetworkBehaviour {
     gossipsub: gossipsub::Behaviour,
     mdns: mdns::tokio::Behaviour,
+    reliable: request_response::Behaviour<ReliableCodec>,
+    service: request_response::Behaviour<ServiceCodec>,
+    ping: ping::Behaviour,
 }
 
 #[derive(Debug)]
 enum OutEvent {
     Gossipsub(gossipsub::Event),
     Mdns(mdns::Event),
+    Reliable(request_response::Event<ReliableRequest, ReliableResponse>),
+    Service(request_response::Event<ServiceRequest, ServiceResponse>),
+    Ping(ping::Event),
 }
 
 impl From<mdns::Event> for OutEvent {
@@ -64,23 +319,44 @@ impl From<gossipsub::Event> for OutEvent {
     }
 }
 
+impl From<request_response::Event<ReliableRequest, ReliableResponse>> for OutEvent {
+    fn from(v: request_response::Event<ReliableRequest, ReliableResponse>) -> Self {
+        Self::Reliable(v)
+    }
+}
+
+impl From<request_response::Event<ServiceRequest, ServiceResponse>> for OutEvent {
+    fn from(v: request_response::Event<ServiceRequest, ServiceResponse>) -> Self {
+        Self::Service(v)
+    }
+}
+
+impl From<ping::Event> for OutEvent {
+    fn from(v: ping::Event) -> Self {
+        Self::Ping(v)
+    }
+}
+
 /// This module contains the implementation of a custom node in the Libp2p network.
 /// The `Libp2pCustomNode` struct represents a custom node and provides methods for creating and interacting with the node.
 /// The node uses the `RosNetworkBehaviour` struct as its network behavior, which combines the `gossipsub` and `mdns` behaviors.
 /// The node can publish messages to the network, subscribe to topics, and handle incoming messages.
 /// The node runs in its own thread and uses a `Swarm` instance to manage the network behavior.
-/// The node also uses a `Queue` to store outgoing messages and a `HashMap` to store subscription callbacks.
+/// The node also uses an `OutgoingQueue` with one lane per priority to store outgoing messages and a `HashMap` to store subscription callbacks.
 /// The `Libp2pCustomNode` struct provides methods for creating a new node, publishing messages, and stopping the node.
 /// The node is designed to be used in a multithreaded environment and provides thread-safe access to its internal data structures.
 pub struct Libp2pCustomNode {
     thread_handle: Option<task::JoinHandle<()>>,
     stop_notify: Arc<Notify>,
-    outgoing_queue: Arc<deadqueue::unlimited::Queue<(gossipsub::IdentTopic, Vec<u8>)>>,
-    new_subscribers_queue: Arc<deadqueue::unlimited::Queue<(
-        gossipsub::IdentTopic,
-        CustomSubscriptionHandle,
-        unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize),)
-    >>,
+    outgoing_queue: Arc<OutgoingQueue>,
+    subscription_changes_queue: Arc<deadqueue::unlimited::Queue<SubscriptionChange>>,
+    subscription_callbacks: SubscriptionCallbacks,
+    topic_matches: SharedTopicMatches,
+    publisher_histories: Arc<PublisherHistories>,
+    service_commands_queue: Arc<deadqueue::unlimited::Queue<ServiceCommand>>,
+    service_callbacks: ServiceCallbacks,
+    client_callbacks: ClientCallbacks,
+    server_directory: SharedServerDirectory,
     reactor: Runtime,
 }
 
@@ -118,9 +394,31 @@ impl Libp2pCustomNode {
 
         let mdns = mdns::tokio::Behaviour::new(mdns::Config::default(), peer_id).unwrap();
 
+        // NACKs and ACKs of reliable endpoints, sent directly to the publishing peer
+        let reliable = request_response::Behaviour::new(
+            ReliableCodec(),
+            std::iter::once((ReliableProtocol(), request_response::ProtocolSupport::Full)),
+            request_response::Config::default(),
+        );
+
+        // Requests and responses of ROS services, sent directly to the serving peer
+        let mut service_config = request_response::Config::default();
+        service_config.set_request_timeout(service::REQUEST_TIMEOUT);
+        let service = request_response::Behaviour::new(
+            ServiceCodec(),
+            std::iter::once((ServiceProtocol(), request_response::ProtocolSupport::Full)),
+            service_config,
+        );
+
+        // Round-trip times to the connected peers, to route service requests to the nearest server
+        let ping = ping::Behaviour::new(ping::Config::new());
+
         let behaviour = RosNetworkBehaviour {
             gossipsub: gossipsub,
             mdns: mdns,
+            reliable: reliable,
+            service: service,
+            ping: ping,
         };
 
         libp2p::Swarm::with_tokio_executor(transport, behaviour, peer_id)
@@ -143,10 +441,7 @@ impl Libp2pCustomNode {
         let _guard = reactor.enter();
 
         let stop_notify = Arc::new(Notify::new());
-        let outgoing_queue = Arc::new(deadqueue::unlimited::Queue::<(
-            gossipsub::IdentTopic,
-            Vec<u8>,
-        )>::new());
+        let outgoing_queue = Arc::new(OutgoingQueue::new());
 
         let mut swarm = Self::create_swarm();
 
@@ -161,13 +456,34 @@ impl Libp2pCustomNode {
             unsafe extern "C" fn(CustomSubscriptionHandle, *mut u8, len: usize),
             Vec<u8>,
         )>::new();
-        let new_subscribers_queue = Arc::new(deadqueue::unlimited::Queue::<(gossipsub::IdentTopic,
-            CustomSubscriptionHandle,
-            unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize),
-        )>::new());
-        let new_subscribers_queue_clone = Arc::clone(&new_subscribers_queue);
+        let subscription_changes_queue =
+            Arc::new(deadqueue::unlimited::Queue::<SubscriptionChange>::new());
+        let subscription_changes_queue_clone = Arc::clone(&subscription_changes_queue);
+        let subscription_callbacks: SubscriptionCallbacks =
+            Arc::new(std::sync::Mutex::new(HashMap::new()));
+        let subscription_callbacks_clone = Arc::clone(&subscription_callbacks);
+        let topic_matches: SharedTopicMatches =
+            Arc::new(std::sync::Mutex::new(TopicMatches::default()));
+        let topic_matches_clone = Arc::clone(&topic_matches);
+        let publisher_histories = Arc::new(PublisherHistories::new());
+        let publisher_histories_clone = Arc::clone(&publisher_histories);
+        let service_commands_queue = Arc::new(deadqueue::unlimited::Queue::<ServiceCommand>::new());
+        let service_commands_queue_clone = Arc::clone(&service_commands_queue);
+        let service_callbacks: ServiceCallbacks = Arc::new(std::sync::Mutex::new(HashMap::new()));
+        let service_callbacks_clone = Arc::clone(&service_callbacks);
+        let client_callbacks: ClientCallbacks = Arc::new(std::sync::Mutex::new(HashMap::new()));
+        let client_callbacks_clone = Arc::clone(&client_callbacks);
+        let server_directory: SharedServerDirectory =
+            Arc::new(std::sync::Mutex::new(ServerDirectory::default()));
+        let server_directory_clone = Arc::clone(&server_directory);
         let thread_handle = tokio::spawn(async move {
-            let mut subscription_callback = HashMap::<String, (CustomSubscriptionHandle, unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize))>::new();
+            // Publishers this node receives reliable messages from, keyed by publisher GID
+            let mut receivers: HashMap<Uuid, ReceiverState> = HashMap::new();
+            let mut pending_responses = PendingResponses::default();
+            let mut server_windows = ServerWindows::default();
+            let mut durable_progress: DurableProgress = HashMap::new();
+            let mut reliability_timer = tokio::time::interval(reliability::TICK_PERIOD);
+            reliability_timer.set_missed_tick_behavior(MissedTickBehavior::Delay);
             loop {
                 select! {
                     // use a Notify that will be triggered to stop the swarm
@@ -177,21 +493,134 @@ impl Libp2pCustomNode {
                         break;
                     },
 
-                    (topic, obj, callback) = new_subscribers_queue_clone.pop() => {
-                        // println!("Subscribing to topic: {}", topic);
-                        swarm.behaviour_mut().gossipsub.subscribe(&topic).unwrap();
-                        subscription_callback.insert(topic.hash().into_string(), (obj, callback));
+                    change = subscription_changes_queue_clone.pop() => match change {
+                        SubscriptionChange::Added(topic, obj_ptr, transient_local) => {
+                            // println!("Subscribing to topic: {}", topic);
+                            let newly_subscribed =
+                                swarm.behaviour_mut().gossipsub.subscribe(&topic).unwrap();
+                            if transient_local {
+                                let key = topic.hash().into_string();
+                                let messages = publisher_histories_clone.durable_messages(&key);
+                                replay(&subscription_callbacks_clone, &mut durable_progress, &key, &messages, Some(obj_ptr));
+                                // Remote publishers push their history when they see this node
+                                // subscribe, which won't happen again if it already was
+                                if !newly_subscribed {
+                                    let peers: Vec<PeerId> = swarm.connected_peers().cloned().collect();
+                                    for peer in peers {
+                                        swarm.behaviour_mut().reliable.send_request(
+                                            &peer,
+                                            ReliableRequest::History { topic: key.clone() },
+                                        );
+                                    }
+                                }
+                            }
+                        }
+                        SubscriptionChange::Removed(topic, obj_ptr) => {
+                            durable_progress.retain(|(ptr, _), _| *ptr != obj_ptr);
+                            // Only leave the topic once the last local subscription is gone
+                            let still_subscribed = subscription_callbacks_clone
+                                .lock()
+                                .unwrap()
+                                .contains_key(&topic.hash().into_string());
+                            if !still_subscribed {
+                                let _ = swarm.behaviour_mut().gossipsub.unsubscribe(&topic);
+                            }
+                        }
+                    },
+
+                    command = service_commands_queue_clone.pop() => match command {
+                        ServiceCommand::Advertise(service_name) => {
+                            let _ = swarm
+                                .behaviour_mut()
+                                .gossipsub
+                                .subscribe(&service::service_topic(&service_name));
+                        }
+                        ServiceCommand::Withdraw(service_name) => {
+                            // Only stop advertising once the last local server is gone
+                            let still_served = service_callbacks_clone
+                                .lock()
+                                .unwrap()
+                                .contains_key(&service_name);
+                            if !still_served {
+                                let _ = swarm
+                                    .behaviour_mut()
+                                    .gossipsub
+                                    .unsubscribe(&service::service_topic(&service_name));
+                            }
+                        }
+                        ServiceCommand::Request(request, routing) => {
+                            let server = server_directory_clone
+                                .lock()
+                                .unwrap()
+                                .remote_server(
+                                    &request.service_name,
+                                    routing,
+                                    &request.client_gid,
+                                    |peer| server_windows.load(peer),
+                                );
+                            // Without a server the request is dropped, like with any other RMW
+                            if let Some(server) = server {
+                                if let Some(request) = server_windows.admit(server, request) {
+                                    swarm.behaviour_mut().service.send_request(&server, request);
+                                }
+                            }
+                        }
+                        ServiceCommand::Respond(response) => {
+                            if let Some(channel) =
+                                pending_responses.remove(&response.client_gid, response.sequence_number)
+                            {
+                                let _ = swarm.behaviour_mut().service.send_response(channel, response);
+                            }
+                        }
                     },
 
-                    // pop messages from the queue and publish them to the network
+                    // pop messages from the queue, highest priority first, and publish them
+                    // to the network
                     (topic, buffer) = outgoing_queue_clone.pop() => {
                         // TODO(esteve): use some sort of debug log
                         // println!("Publishing message on topic {} : {:?}", topic, buffer);
-                        if let Err(e) = swarm.behaviour_mut().gossipsub.publish(topic.clone(), buffer.clone()) {
-                            println!("Publish error: {e:?}");
+                        // gossipsub never delivers our own messages, so subscriptions of this
+                        // node are served directly
+                        deliver(&subscription_callbacks_clone, &mut durable_progress, topic.as_str(), &buffer);
+                        // gossipsub takes a Vec, which gets the allocation of the message as is
+                        // unless the history of the publisher or a local subscription still
+                        // references it
+                        if let Err(e) = swarm.behaviour_mut().gossipsub.publish(topic, Vec::from(buffer)) {
+                            // InsufficientPeers is expected when only local subscriptions exist
+                            if !matches!(e, gossipsub::PublishError::InsufficientPeers) {
+                                println!("Publish error: {e:?}");
+                            }
                         }
                     },
 
+                    _ = reliability_timer.tick() => {
+                        let now = Instant::now();
+                        for (gid, receiver) in receivers.iter_mut() {
+                            for message in receiver.tick(now) {
+                                deliver(&subscription_callbacks_clone, &mut durable_progress, &receiver.topic, &message);
+                            }
+                            if let Some((first, last)) = receiver.nack(now) {
+                                swarm.behaviour_mut().reliable.send_request(
+                                    &receiver.source,
+                                    ReliableRequest::Nack { gid: *gid, first: first, last: last },
+                                );
+                            }
+                            if let Some(sequence_number) = receiver.ack() {
+                                swarm.behaviour_mut().reliable.send_request(
+                                    &receiver.source,
+                                    ReliableRequest::Ack { gid: *gid, sequence_number: sequence_number },
+                                );
+                            }
+                        }
+                        receivers.retain(|_, receiver| !receiver.is_expired(now));
+                        // Publishers that went quiet make sure that their last message didn't get lost
+                        for (peer, heartbeat) in publisher_histories_clone.heartbeats(now) {
+                            swarm.behaviour_mut().reliable.send_request(&peer, heartbeat);
+                        }
+                        // Requests whose client gave up or disconnected can't be answered anymore
+                        pending_responses.retain_open();
+                    },
+
                     event = swarm.select_next_some() => match event {
                         SwarmEvent::Behaviour(OutEvent::Gossipsub(gossipsub::Event::Message {
                             propagation_source: peer_id,
@@ -206,16 +635,206 @@ impl Libp2pCustomNode {
                             //     peer_id,
                             //     message.topic.as_str(),
                             // );
-                            let mut vec = message.data;
-                            vec.shrink_to_fit();
-                            let ptr: *mut u8 = vec.as_mut_ptr();
-                            let len: usize = vec.len();
-                            std::mem::forget(vec);
-                            let (obj, callback) = subscription_callback.get(&message.topic.into_string()).unwrap();
-                            unsafe {
-                                callback(&obj, ptr, len);
+                            let topic = message.topic.into_string();
+                            // Shared by the local subscriptions from here on
+                            let data = Bytes::from(message.data);
+                            let header = MessageHeader::decode(&data);
+                            match (header, message.source) {
+                                // Messages of reliable publishers are delivered in order, gaps
+                                // are NACKed to the publishing peer right away
+                                (Some(header), Some(source))
+                                    if header.is_reliable()
+                                        && has_reliable_subscription(&subscription_callbacks_clone, &topic) =>
+                                {
+                                    let receiver = receivers.entry(header.gid).or_insert_with(|| {
+                                        ReceiverState::new(topic.clone(), source, header.sequence_number)
+                                    });
+                                    for message in receiver.receive(header.sequence_number, data) {
+                                        deliver(&subscription_callbacks_clone, &mut durable_progress, &topic, &message);
+                                    }
+                                    if let Some((first, last)) = receiver.nack(Instant::now()) {
+                                        swarm.behaviour_mut().reliable.send_request(
+                                            &source,
+                                            ReliableRequest::Nack { gid: header.gid, first: first, last: last },
+                                        );
+                                    }
+                                }
+                                _ => deliver(&subscription_callbacks_clone, &mut durable_progress, &topic, &data),
+                            }
+                        }
+                        SwarmEvent::Behaviour(OutEvent::Reliable(request_response::Event::Message {
+                            peer,
+                            message,
+                        })) => match message {
+                            request_response::Message::Request { request, channel, .. } => {
+                                let response = match request {
+                                    ReliableRequest::Nack { gid, first, last } => {
+                                        publisher_histories_clone.retransmit(gid, first, last)
+                                    }
+                                    ReliableRequest::Ack { gid, sequence_number } => {
+                                        publisher_histories_clone.acknowledge(&gid, peer, sequence_number);
+                                        ReliableResponse::Ack
+                                    }
+                                    ReliableRequest::History { topic } => ReliableResponse::Replay {
+                                        messages: publisher_histories_clone.durable_messages(&topic),
+                                        topic: topic,
+                                    },
+                                    ReliableRequest::Replay { topic, messages } => {
+                                        replay(&subscription_callbacks_clone, &mut durable_progress, &topic, &messages, None);
+                                        ReliableResponse::Ack
+                                    }
+                                    ReliableRequest::Heartbeat { gid, topic, first, last } => {
+                                        if has_reliable_subscription(&subscription_callbacks_clone, &topic) {
+                                            let receiver = receivers.entry(gid).or_insert_with(|| {
+                                                ReceiverState::new(topic, peer, first)
+                                            });
+                                            let sequence_number = receiver.heartbeat(last);
+                                            if let Some((first, last)) = receiver.nack(Instant::now()) {
+                                                swarm.behaviour_mut().reliable.send_request(
+                                                    &peer,
+                                                    ReliableRequest::Nack { gid: gid, first: first, last: last },
+                                                );
+                                            }
+                                            ReliableResponse::Acked { gid: gid, sequence_number: sequence_number }
+                                        } else {
+                                            ReliableResponse::Unreliable { gid: gid }
+                                        }
+                                    }
+                                };
+                                let _ = swarm.behaviour_mut().reliable.send_response(channel, response);
+                            }
+                            request_response::Message::Response {
+                                response: ReliableResponse::Retransmit { gid, first_available, messages },
+                                ..
+                            } => {
+                                if let Some(receiver) = receivers.get_mut(&gid) {
+                                    receiver.retransmission_received();
+                                    // Whatever is older than the history of the publisher is lost
+                                    let mut delivered = receiver.skip_to(first_available);
+                                    for message in messages {
+                                        if let Some(header) = MessageHeader::decode(&message) {
+                                            delivered.extend(receiver.receive(header.sequence_number, message));
+                                        }
+                                    }
+                                    for data in delivered {
+                                        deliver(&subscription_callbacks_clone, &mut durable_progress, &receiver.topic, &data);
+                                    }
+                                    if let Some((first, last)) = receiver.nack(Instant::now()) {
+                                        swarm.behaviour_mut().reliable.send_request(
+                                            &receiver.source,
+                                            ReliableRequest::Nack { gid: gid, first: first, last: last },
+                                        );
+                                    }
+                                }
+                            }
+                            request_response::Message::Response {
+                                response: ReliableResponse::Replay { topic, messages },
+                                ..
+                            } => {
+                                replay(&subscription_callbacks_clone, &mut durable_progress, &topic, &messages, None);
+                            }
+                            request_response::Message::Response {
+                                response: ReliableResponse::Acked { gid, sequence_number },
+                                ..
+                            } => {
+                                publisher_histories_clone.acknowledge(&gid, peer, sequence_number);
+                            }
+                            request_response::Message::Response {
+                                response: ReliableResponse::Unreliable { gid },
+                                ..
+                            } => {
+                                publisher_histories_clone.forget_peer(&gid, &peer);
+                            }
+                            _ => {}
+                        },
+                        SwarmEvent::Behaviour(OutEvent::Service(request_response::Event::Message {
+                            peer,
+                            message,
+                        })) => match message {
+                            request_response::Message::Request { request, channel, .. } => {
+                                // Requests over the limit of the service are refused right away,
+                                // which frees a slot of the window of the client
+                                if pending_responses.insert(&request, channel) {
+                                    let (client_gid, sequence_number) = (request.client_gid, request.sequence_number);
+                                    // The server is gone, the request fails
+                                    if deliver_request(&service_callbacks_clone, request).is_some() {
+                                        pending_responses.remove(&client_gid, sequence_number);
+                                    }
+                                }
+                            }
+                            request_response::Message::Response { response, .. } => {
+                                if let Some(request) = server_windows.complete(&peer) {
+                                    swarm.behaviour_mut().service.send_request(&peer, request);
+                                }
+                                // Responses to clients removed in the meantime are dropped
+                                let _ = deliver_response(&client_callbacks_clone, response);
+                            }
+                        },
+                        SwarmEvent::Behaviour(OutEvent::Service(request_response::Event::OutboundFailure {
+                            peer,
+                            ..
+                        })) => {
+                            // The request is lost (e.g. timed out or refused), the ROS client
+                            // never gets a response to it
+                            if let Some(request) = server_windows.complete(&peer) {
+                                swarm.behaviour_mut().service.send_request(&peer, request);
                             }
                         }
+                        SwarmEvent::Behaviour(OutEvent::Gossipsub(gossipsub::Event::Subscribed {
+                            peer_id,
+                            topic,
+                        })) => {
+                            let topic = topic.into_string();
+                            if let Some(service_name) = service::service_name(&topic) {
+                                server_directory_clone.lock().unwrap().add_peer(service_name, peer_id);
+                            }
+                            // Late joiners get the history of transient local publishers directly,
+                            // instead of republishing it to the whole mesh
+                            let messages = publisher_histories_clone.durable_messages(&topic);
+                            if !messages.is_empty() {
+                                swarm.behaviour_mut().reliable.send_request(
+                                    &peer_id,
+                                    ReliableRequest::Replay { topic: topic.clone(), messages: messages },
+                                );
+                            }
+                            // Under the lock, like publishers registering their history
+                            let mut topic_matches = topic_matches_clone.lock().unwrap();
+                            publisher_histories_clone.add_peer(&topic, peer_id);
+                            topic_matches.peer_subscribed(topic, peer_id);
+                        }
+                        SwarmEvent::Behaviour(OutEvent::Gossipsub(gossipsub::Event::Unsubscribed {
+                            peer_id,
+                            topic,
+                        })) => {
+                            let topic = topic.into_string();
+                            if let Some(service_name) = service::service_name(&topic) {
+                                server_directory_clone.lock().unwrap().remove_peer(service_name, &peer_id);
+                            }
+                            publisher_histories_clone.remove_peer(Some(&topic), &peer_id);
+                            topic_matches_clone
+                                .lock()
+                                .unwrap()
+                                .peer_unsubscribed(topic, peer_id);
+                        }
+                        SwarmEvent::ConnectionClosed {
+                            peer_id,
+                            num_established: 0,
+                            ..
+                        } => {
+                            // gossipsub forgets the topics of a disconnected peer without
+                            // emitting Unsubscribed
+                            topic_matches_clone.lock().unwrap().peer_disconnected(peer_id);
+                            publisher_histories_clone.remove_peer(None, &peer_id);
+                            receivers.retain(|_, receiver| receiver.source != peer_id);
+                            server_windows.remove_peer(&peer_id);
+                            server_directory_clone.lock().unwrap().peer_disconnected(&peer_id);
+                        }
+                        SwarmEvent::Behaviour(OutEvent::Ping(ping::Event {
+                            peer,
+                            result: Ok(ping::Success::Ping { rtt }),
+                        })) => {
+                            server_directory_clone.lock().unwrap().record_rtt(peer, rtt);
+                        }
                         SwarmEvent::NewListenAddr { address, .. } => {
                             println!("Listening on {:?}", address);
                         }
@@ -254,51 +873,103 @@ impl Libp2pCustomNode {
             thread_handle: Some(thread_handle),
             stop_notify: stop_notify,
             outgoing_queue: outgoing_queue,
-            new_subscribers_queue: new_subscribers_queue,
+            subscription_changes_queue: subscription_changes_queue,
+            subscription_callbacks: subscription_callbacks,
+            topic_matches: topic_matches,
+            publisher_histories: publisher_histories,
+            service_commands_queue: service_commands_queue,
+            service_callbacks: service_callbacks,
+            client_callbacks: client_callbacks,
+            server_directory: server_directory,
             reactor: reactor,
         }
     }
 
     /// Publishes a message to a specific topic.
     ///
-    /// This function serializes the current system time and a provided buffer into a new buffer,
-    /// then pushes the new buffer and the topic into the outgoing queue.
+    /// This function serializes the message header and a provided payload into a new buffer,
+    /// then pushes the new buffer and the topic into the outgoing queue. Messages of reliable
+    /// publishers are also kept in their history for retransmission.
     ///
     /// # Arguments
     ///
     /// * `topic` - The topic to publish the message to.
-    /// * `buffer` - The message to publish.
-    ///
-    /// # Panics
-    ///
-    /// This function will panic if the system time is before the UNIX_EPOCH.
-    pub(crate) fn publish_message(&self, topic: gossipsub::IdentTopic, buffer: Vec<u8>) -> () {
-        let mut out_buffer = Vec::<u8>::new();
+    /// * `header` - The header of the message, see `MessageHeader`.
+    /// * `payload` - The serialized message to publish, in one or more consecutive pieces.
+    /// * `full_payload` - For a delta, the payload it was computed from. The history keeps it
+    ///   instead of the delta, so that late joiners, which never got the keyframe, can use it.
+    /// * `priority` - The outgoing lane of the message, see `OutgoingQueue`.
+    pub(crate) fn publish_message(&self, topic: &gossipsub::IdentTopic, header: MessageHeader, payload: &[&[u8]], full_payload: Option<&[u8]>, priority: u8) -> () {
+        // The history, the outgoing queue and local subscriptions share it from here on
+        let message = encode_message(&header, payload);
+        if header.is_kept() {
+            let kept = match full_payload {
+                Some(full_payload) => {
+                    // An ordinary message as far as subscriptions are concerned
+                    let mut kept_header = header;
+                    kept_header.flags &= !reliability::FLAG_DELTA;
+                    encode_message(&kept_header, &[full_payload])
+                }
+                None => message.clone(),
+            };
+            self.publisher_histories
+                .push(&header.gid, header.sequence_number, kept);
+        }
+        self.outgoing_queue.push(priority, topic.hash(), message);
+    }
 
-        let start = SystemTime::now();
-        let since_the_epoch = start
-            .duration_since(UNIX_EPOCH)
-            .expect("Time went backwards");
+    /// Starts keeping the last `depth` messages of a reliable or transient local publisher, for
+    /// retransmission and for replay to late joiners.
+    ///
+    /// Reliable publishers wait for the acknowledgements of the peers subscribed to the topic,
+    /// those already known are taken under the lock of the topic matches so that none is missed.
+    pub(crate) fn register_publisher_history(&self, gid: Uuid, topic: gossipsub::IdentTopic, depth: usize, reliable: bool, transient_local: bool) -> () {
+        let key = topic.hash().into_string();
+        let topic_matches = self.topic_matches.lock().unwrap();
+        let peers = topic_matches.peers.get(&key).into_iter().flatten();
+        self.publisher_histories
+            .register(gid, key, depth, reliable, transient_local, peers);
+    }
 
-        let secs = since_the_epoch.as_secs();
-        cdr::serialize_into::<_, _, _, cdr::CdrBe>(&mut out_buffer, &secs, cdr::Infinite).unwrap();
+    pub(crate) fn unregister_publisher_history(&self, gid: &Uuid) -> () {
+        self.publisher_histories.unregister(gid);
+    }
 
-        let usecs = since_the_epoch.subsec_micros();
-        cdr::serialize_into::<_, _, _, cdr::CdrBe>(&mut out_buffer, &usecs, cdr::Infinite).unwrap();
+    /// Waits until the reliable subscribers of a publisher have acknowledged all its messages.
+    ///
+    /// Every peer subscribed to the topic is waited for, from the moment it subscribed, unless it
+    /// answered a heartbeat without reliable subscriptions. Returns false if `timeout` expired
+    /// first.
+    pub(crate) fn wait_for_all_acked(&self, gid: &Uuid, timeout: Option<Duration>) -> bool {
+        self.publisher_histories.wait_for_all_acked(gid, timeout)
+    }
 
-        out_buffer.extend(buffer);
-        self.outgoing_queue.push((topic, out_buffer));
+    /// Publishes a message to a specific topic as is, without prepending the timestamp header.
+    ///
+    /// This is used for internal traffic (e.g. discovery) that has its own framing.
+    ///
+    /// # Arguments
+    ///
+    /// * `topic` - The topic to publish the message to.
+    /// * `buffer` - The message to publish.
+    /// * `priority` - The outgoing lane of the message, see `OutgoingQueue`.
+    pub(crate) fn publish_raw_message(&self, topic: &gossipsub::IdentTopic, buffer: Vec<u8>, priority: u8) -> () {
+        self.outgoing_queue.push(priority, topic.hash(), Bytes::from(buffer));
     }
 
     /// Notifies about a new subscriber to a specific topic.
     ///
-    /// This function pushes the topic, a `CustomSubscriptionHandle`, and a callback function into the `new_subscribers_queue`.
+    /// This function registers the `CustomSubscriptionHandle` and the callback function for the topic,
+    /// and asks the event loop to subscribe to the topic. Several subscribers may share the same topic.
     ///
     /// # Arguments
     ///
     /// * `topic` - The topic the new subscriber is interested in.
     /// * `obj` - A `CustomSubscriptionHandle` associated with the new subscriber.
     /// * `callback` - A callback function to be called when a new message is published to the topic.
+    /// * `reliable` - Whether the messages of reliable publishers must be delivered in order and
+    ///   the missing ones retransmitted.
+    /// * `transient_local` - Whether the history of transient local publishers must be replayed.
     ///
     /// # Safety
     ///
@@ -306,14 +977,144 @@ impl Libp2pCustomNode {
     pub(crate) fn notify_new_subscriber(&self, topic: gossipsub::IdentTopic,
         obj: CustomSubscriptionHandle,
         callback: unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize),
+        reliable: bool,
+        transient_local: bool,
     ) -> () {
-        self.new_subscribers_queue.push((topic, obj, callback));
+        let obj_ptr = obj.ptr as usize;
+        self.subscription_callbacks
+            .lock()
+            .unwrap()
+            .entry(topic.hash().into_string())
+            .or_insert_with(Vec::new)
+            .push(SubscriptionEntry {
+                obj: obj,
+                callback: callback,
+                reliable: reliable,
+                transient_local: transient_local,
+            });
+        self.subscription_changes_queue
+            .push(SubscriptionChange::Added(topic, obj_ptr, transient_local));
+    }
+
+    /// Removes a subscriber from a specific topic.
+    ///
+    /// The callback is unregistered before this function returns, so it is safe to release the
+    /// object behind `obj_ptr` afterwards. The topic is left once no local subscriber remains.
+    ///
+    /// # Arguments
+    ///
+    /// * `topic` - The topic the subscriber was interested in.
+    /// * `obj_ptr` - The pointer stored in the `CustomSubscriptionHandle` of the subscriber.
+    pub(crate) fn remove_subscriber(&self, topic: gossipsub::IdentTopic, obj_ptr: *const c_void) -> () {
+        {
+            let mut callbacks = self.subscription_callbacks.lock().unwrap();
+            let key = topic.hash().into_string();
+            if let Some(entries) = callbacks.get_mut(&key) {
+                entries.retain(|entry| entry.obj.ptr != obj_ptr);
+                if entries.is_empty() {
+                    callbacks.remove(&key);
+                }
+            }
+        }
+        self.subscription_changes_queue
+            .push(SubscriptionChange::Removed(topic, obj_ptr as usize));
+    }
+
+    /// Registers a server of a service and advertises it to the other peers.
+    ///
+    /// # Arguments
+    ///
+    /// * `service_name` - The name of the service.
+    /// * `obj` - A `CustomServiceHandle` associated with the server.
+    /// * `callback` - A callback function to be called for every request to the service.
+    pub(crate) fn register_service(&self, service_name: &str,
+        obj: CustomServiceHandle,
+        callback: ServiceCallback<CustomServiceHandle>,
+    ) -> () {
+        self.service_callbacks
+            .lock()
+            .unwrap()
+            .entry(service_name.to_string())
+            .or_insert_with(Vec::new)
+            .push((obj, callback));
+        self.server_directory.lock().unwrap().add_local(service_name);
+        self.service_commands_queue
+            .push(ServiceCommand::Advertise(service_name.to_string()));
+    }
+
+    /// Removes a server previously registered with `register_service`.
+    ///
+    /// The callback is unregistered before this function returns. The service stops being
+    /// advertised once no local server remains.
+    ///
+    /// # Arguments
+    ///
+    /// * `service_name` - The name of the service.
+    /// * `obj_ptr` - The pointer stored in the `CustomServiceHandle` of the server.
+    pub(crate) fn remove_service(&self, service_name: &str, obj_ptr: *const c_void) -> () {
+        {
+            let mut services = self.service_callbacks.lock().unwrap();
+            if let Some(entries) = services.get_mut(service_name) {
+                entries.retain(|(obj, _)| obj.ptr != obj_ptr);
+                if entries.is_empty() {
+                    services.remove(service_name);
+                }
+            }
+        }
+        self.server_directory.lock().unwrap().remove_local(service_name);
+        self.service_commands_queue
+            .push(ServiceCommand::Withdraw(service_name.to_string()));
+    }
+
+    /// Registers a client to be handed the responses to its requests.
+    ///
+    /// # Arguments
+    ///
+    /// * `gid` - The GID of the client, which its requests carry.
+    /// * `obj` - A `CustomClientHandle` associated with the client.
+    /// * `callback` - A callback function to be called for every response.
+    pub(crate) fn register_client(&self, gid: Uuid,
+        obj: CustomClientHandle,
+        callback: ServiceCallback<CustomClientHandle>,
+    ) -> () {
+        self.client_callbacks.lock().unwrap().insert(gid, (obj, callback));
+    }
+
+    /// Removes a client, its callback is not called anymore once this returns.
+    pub(crate) fn remove_client(&self, gid: &Uuid) -> () {
+        self.client_callbacks.lock().unwrap().remove(gid);
+    }
+
+    /// Sends a request to a server of its service, in this node if there is one.
+    pub(crate) fn send_request(&self, request: ServiceRequest, routing: u8) -> () {
+        if let Some(request) = deliver_request(&self.service_callbacks, request) {
+            self.service_commands_queue.push(ServiceCommand::Request(request, routing));
+        }
+    }
+
+    /// Sends a response back to its client, in this node if it lives here.
+    pub(crate) fn send_response(&self, response: ServiceResponse) -> () {
+        if let Some(response) = deliver_response(&self.client_callbacks, response) {
+            self.service_commands_queue.push(ServiceCommand::Respond(response));
+        }
+    }
+
+    /// Whether a server of the service lives in this node or in a connected peer.
+    pub(crate) fn server_available(&self, service_name: &str) -> bool {
+        self.server_directory.lock().unwrap().is_available(service_name)
+    }
+
+    /// Sets the callback notified when a service becomes available or unavailable, replacing
+    /// the previous one. The previous callback is not called anymore once this returns.
+    pub(crate) fn set_availability_callback(&self, callback: Option<(CustomNodeHandle, AvailabilityCallback)>) -> () {
+        self.server_directory.lock().unwrap().set_callback(callback);
     }
 }
 
 impl Drop for Libp2pCustomNode {
     fn drop(&mut self) {
-        self.stop_notify.notify_waiters();
+        // notify_one stores a permit, so the event loop stops even if it is not waiting right now
+        self.stop_notify.notify_one();
         self.reactor.block_on(async {
             if let Some(thread_handle) = self.thread_handle.take() {
                 let _ = thread_handle.await;
@@ -338,6 +1139,37 @@ pub extern "C" fn rs_libp2p_custom_node_new() -> *mut Libp2pCustomNode {
     Box::into_raw(Box::new(Libp2pCustomNode::new()))
 }
 
+/// Sets the callback notified when a service becomes available or unavailable to a node.
+///
+/// The callback is called with the name of the service and whether a server is now available,
+/// from the thread of the event loop or from the thread creating or destroying a local server.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr` - A raw pointer to a `Libp2pCustomNode`.
+/// * `obj` - A `CustomNodeHandle` passed to the callback.
+/// * `callback` - The callback, or null to unset it.
+///
+/// # Panics
+///
+/// This function will panic if `ptr` is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_node_set_availability_callback(
+    ptr: *mut Libp2pCustomNode,
+    obj: CustomNodeHandle,
+    callback: Option<AvailabilityCallback>,
+) {
+    let libp2p2_custom_node = unsafe {
+        assert!(!ptr.is_null());
+        &*ptr
+    };
+    libp2p2_custom_node.set_availability_callback(callback.map(|callback| (obj, callback)));
+}
+
 /// Frees a `Libp2pCustomNode` from memory.
 ///
 /// This function takes a raw pointer to a `Libp2pCustomNode`, converts it back into a `Box`, and then drops the `Box`, freeing the memory.
@@ -356,3 +1188,110 @@ pub extern "C" fn rs_libp2p_custom_node_free(ptr: *mut Libp2pCustomNode) {
     }
     let _ = unsafe { Box::from_raw(ptr) };
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::alloc::{GlobalAlloc, Layout, System};
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    use crate::outgoing::PRIORITY_DEFAULT;
+    use crate::reliability::{ENCODING_CDR, FLAG_RELIABLE};
+
+    const PAYLOAD_SIZE: usize = 1 << 20;
+
+    /// Counts the allocations at least as large as the payload, i.e. the copies of it.
+    struct CountingAllocator;
+
+    static PAYLOAD_ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+    unsafe impl GlobalAlloc for CountingAllocator {
+        unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+            if layout.size() >= PAYLOAD_SIZE {
+                PAYLOAD_ALLOCATIONS.fetch_add(1, Ordering::SeqCst);
+            }
+            System.alloc(layout)
+        }
+
+        unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+            System.dealloc(ptr, layout)
+        }
+    }
+
+    #[global_allocator]
+    static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+    static RECEIVED_PTR: AtomicUsize = AtomicUsize::new(0);
+    static RECEIVED_LEN: AtomicUsize = AtomicUsize::new(0);
+
+    unsafe extern "C" fn on_message(_obj: &CustomSubscriptionHandle, ptr: *mut u8, len: usize) {
+        RECEIVED_PTR.store(ptr as usize, Ordering::SeqCst);
+        RECEIVED_LEN.store(len, Ordering::SeqCst);
+    }
+
+    #[test]
+    fn local_subscription_shares_the_published_message() {
+        let runtime = tokio::runtime::Builder::new_current_thread()
+            .build()
+            .unwrap();
+        let topic = gossipsub::IdentTopic::new("/chatter");
+        let gid = Uuid::new_v4();
+        let histories = PublisherHistories::new();
+        histories.register(
+            gid,
+            topic.hash().into_string(),
+            1,
+            true,
+            false,
+            std::iter::empty(),
+        );
+        let outgoing_queue = OutgoingQueue::new();
+        let callbacks: SubscriptionCallbacks = Arc::new(std::sync::Mutex::new(HashMap::new()));
+        callbacks.lock().unwrap().insert(
+            topic.hash().into_string(),
+            vec![SubscriptionEntry {
+                obj: CustomSubscriptionHandle {
+                    ptr: std::ptr::null(),
+                },
+                callback: on_message,
+                reliable: true,
+                transient_local: false,
+            }],
+        );
+        let mut progress = DurableProgress::new();
+        let payload = vec![42u8; PAYLOAD_SIZE];
+        let header = MessageHeader::new(FLAG_RELIABLE, ENCODING_CDR, 0, 1, gid, 0);
+
+        // Same steps as Libp2pCustomNode::publish_message and the event loop
+        PAYLOAD_ALLOCATIONS.store(0, Ordering::SeqCst);
+        let message = encode_message(&header, &[&payload]);
+        assert_eq!(PAYLOAD_ALLOCATIONS.load(Ordering::SeqCst), 1);
+        histories.push(&gid, header.sequence_number, message.clone());
+        outgoing_queue.push(PRIORITY_DEFAULT, topic.hash(), message);
+        let (topic_hash, buffer) = runtime.block_on(outgoing_queue.pop());
+        deliver(&callbacks, &mut progress, topic_hash.as_str(), &buffer);
+
+        // The subscription got the very bytes that were serialized, nothing was copied
+        assert_eq!(PAYLOAD_ALLOCATIONS.load(Ordering::SeqCst), 1);
+        assert_eq!(
+            RECEIVED_PTR.load(Ordering::SeqCst),
+            buffer.as_ptr() as usize
+        );
+        assert_eq!(
+            RECEIVED_LEN.load(Ordering::SeqCst),
+            reliability::HEADER_SIZE + PAYLOAD_SIZE
+        );
+        let received = unsafe {
+            std::slice::from_raw_parts(
+                RECEIVED_PTR.load(Ordering::SeqCst) as *const u8,
+                RECEIVED_LEN.load(Ordering::SeqCst),
+            )
+        };
+        assert_eq!(&received[reliability::HEADER_SIZE..], payload.as_slice());
+        messages::release(
+            RECEIVED_PTR.load(Ordering::SeqCst) as *mut u8,
+            RECEIVED_LEN.load(Ordering::SeqCst),
+        );
+    }
+}
@@ -0,0 +1,275 @@
+// Copyright 2024 Esteve Fernandez
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Outgoing messages of a node, queued in one lane per priority.
+//!
+//! The event loop hands a single message to gossipsub at a time, so with a single FIFO a burst
+//! of large messages delays every small message queued after it. Lanes are served by weighted
+//! round robin in priority order: within a round, a lane is only served once the lanes above it
+//! are empty or have used up their weight. Control messages therefore wait for at most one
+//! message of another lane, while bulk traffic still gets a share of the bandwidth when control
+//! traffic never stops.
+
+use std::collections::VecDeque;
+use std::sync::Mutex;
+
+use bytes::Bytes;
+
+use libp2p::gossipsub;
+
+use tokio::sync::Notify;
+
+/// Lane of latency sensitive topics (e.g. commands, emergency stops).
+pub const PRIORITY_CONTROL: u8 = 0;
+/// Lane of the topics without a configured priority.
+pub const PRIORITY_DEFAULT: u8 = 1;
+/// Lane of large, throughput oriented topics (e.g. images, point clouds).
+pub const PRIORITY_BULK: u8 = 2;
+
+const LANES: usize = PRIORITY_BULK as usize + 1;
+
+/// Messages served from each lane per round, when all of them are backlogged.
+const LANE_WEIGHTS: [u32; LANES] = [16, 4, 1];
+
+// The message is shared with the history of its publisher, queueing it copies nothing
+type OutgoingMessage = (gossipsub::TopicHash, Bytes);
+
+struct Lanes {
+    queues: [VecDeque<OutgoingMessage>; LANES],
+    // Messages each lane can still send in the current round
+    credits: [u32; LANES],
+}
+
+/// Multi-lane queue of the messages waiting to be published.
+pub(crate) struct OutgoingQueue {
+    lanes: Mutex<Lanes>,
+    notify: Notify,
+}
+
+impl OutgoingQueue {
+    pub(crate) fn new() -> Self {
+        Self {
+            lanes: Mutex::new(Lanes {
+                queues: Default::default(),
+                credits: LANE_WEIGHTS,
+            }),
+            notify: Notify::new(),
+        }
+    }
+
+    /// Queues a message in the lane of the given priority, unknown priorities go to the bulk
+    /// lane.
+    pub(crate) fn push(&self, priority: u8, topic: gossipsub::TopicHash, buffer: Bytes) -> () {
+        let lane = std::cmp::min(priority as usize, LANES - 1);
+        self.lanes.lock().unwrap().queues[lane].push_back((topic, buffer));
+        // Stores a permit if the event loop is not waiting right now
+        self.notify.notify_one();
+    }
+
+    /// Waits for the next message to publish.
+    ///
+    /// This is cancel safe, no message is lost if the future is dropped before completing.
+    pub(crate) async fn pop(&self) -> OutgoingMessage {
+        loop {
+            if let Some(message) = self.try_pop() {
+                return message;
+            }
+            self.notify.notified().await;
+        }
+    }
+
+    fn try_pop(&self) -> Option<OutgoingMessage> {
+        let mut lanes = self.lanes.lock().unwrap();
+        // The second pass starts a new round, if every backlogged lane ran out of credits
+        for _ in 0..2 {
+            let mut backlogged = false;
+            for lane in 0..LANES {
+                if lanes.queues[lane].is_empty() {
+                    continue;
+                }
+                backlogged = true;
+                if lanes.credits[lane] > 0 {
+                    lanes.credits[lane] -= 1;
+                    return lanes.queues[lane].pop_front();
+                }
+            }
+            if !backlogged {
+                return None;
+            }
+            lanes.credits = LANE_WEIGHTS;
+        }
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::Arc;
+    use std::thread;
+    use std::time::{Duration, Instant};
+
+    fn topic(name: &str) -> gossipsub::TopicHash {
+        gossipsub::TopicHash::from_raw(name)
+    }
+
+    fn priorities(queue: &OutgoingQueue, count: usize) -> Vec<u8> {
+        (0..count)
+            .map(|_| {
+                let (topic, _) = queue.try_pop().unwrap();
+                match topic.as_str() {
+                    "/cmd_vel" => PRIORITY_CONTROL,
+                    "/chatter" => PRIORITY_DEFAULT,
+                    _ => PRIORITY_BULK,
+                }
+            })
+            .collect()
+    }
+
+    #[test]
+    fn control_preempts_bulk() {
+        let queue = OutgoingQueue::new();
+        for _ in 0..100 {
+            queue.push(PRIORITY_BULK, topic("/images"), Bytes::new());
+        }
+        assert_eq!(priorities(&queue, 1), [PRIORITY_BULK]);
+        queue.push(PRIORITY_CONTROL, topic("/cmd_vel"), Bytes::new());
+        assert_eq!(priorities(&queue, 1), [PRIORITY_CONTROL]);
+
+        // Once the control lane used up its credits, it waits for a single bulk message
+        let queue = OutgoingQueue::new();
+        let weight = LANE_WEIGHTS[PRIORITY_CONTROL as usize] as usize;
+        for _ in 0..100 {
+            queue.push(PRIORITY_BULK, topic("/images"), Bytes::new());
+        }
+        for _ in 0..weight + 1 {
+            queue.push(PRIORITY_CONTROL, topic("/cmd_vel"), Bytes::new());
+        }
+        let mut expected = vec![PRIORITY_CONTROL; weight];
+        expected.push(PRIORITY_BULK);
+        expected.push(PRIORITY_CONTROL);
+        assert_eq!(priorities(&queue, expected.len()), expected);
+    }
+
+    #[test]
+    fn backlogged_lanes_share_by_weight() {
+        let queue = OutgoingQueue::new();
+        for _ in 0..100 {
+            queue.push(PRIORITY_BULK, topic("/images"), Bytes::new());
+            queue.push(PRIORITY_DEFAULT, topic("/chatter"), Bytes::new());
+            queue.push(PRIORITY_CONTROL, topic("/cmd_vel"), Bytes::new());
+        }
+        let round: u32 = LANE_WEIGHTS.iter().sum();
+        for _ in 0..2 {
+            let served = priorities(&queue, round as usize);
+            for lane in 0..LANES {
+                let count = served.iter().filter(|&&p| p as usize == lane).count();
+                assert_eq!(count as u32, LANE_WEIGHTS[lane]);
+            }
+        }
+    }
+
+    #[test]
+    fn unknown_priorities_go_to_the_bulk_lane() {
+        let queue = OutgoingQueue::new();
+        queue.push(7, topic("/unknown"), Bytes::new());
+        queue.push(PRIORITY_DEFAULT, topic("/chatter"), Bytes::new());
+        assert_eq!(priorities(&queue, 2), [PRIORITY_DEFAULT, PRIORITY_BULK]);
+        assert!(queue.try_pop().is_none());
+    }
+
+    #[test]
+    fn pop_waits_for_a_message() {
+        let runtime = tokio::runtime::Runtime::new().unwrap();
+        let queue = Arc::new(OutgoingQueue::new());
+        let pusher = Arc::clone(&queue);
+        let popped = runtime.spawn(async move { queue.pop().await });
+        thread::sleep(Duration::from_millis(10));
+        pusher.push(
+            PRIORITY_DEFAULT,
+            topic("/chatter"),
+            Bytes::from_static(b"hello"),
+        );
+        let (topic, buffer) = runtime.block_on(popped).unwrap();
+        assert_eq!(topic.as_str(), "/chatter");
+        assert_eq!(buffer, Bytes::from_static(b"hello"));
+    }
+
+    /// Queueing delay of control messages published at 1 kHz while the event loop is busy
+    /// sending a never-ending backlog of 1 MB bulk messages. Sending a message is simulated by
+    /// copying it, a control message should wait for at most the bulk message being sent.
+    ///
+    /// Run with `cargo test --release -- --ignored --nocapture control_latency`.
+    #[test]
+    #[ignore]
+    fn control_latency_under_bulk_load() {
+        const CONTROL_MESSAGES: usize = 1000;
+        const BULK_BACKLOG: usize = 64;
+
+        let queue = Arc::new(OutgoingQueue::new());
+        let bulk = Bytes::from(vec![0u8; 1 << 20]);
+        for _ in 0..BULK_BACKLOG {
+            queue.push(PRIORITY_BULK, topic("/images"), bulk.clone());
+        }
+        let pushed = Arc::new(Mutex::new(Vec::with_capacity(CONTROL_MESSAGES)));
+        let producer = {
+            let queue = Arc::clone(&queue);
+            let pushed = Arc::clone(&pushed);
+            thread::spawn(move || {
+                for _ in 0..CONTROL_MESSAGES {
+                    thread::sleep(Duration::from_millis(1));
+                    pushed.lock().unwrap().push(Instant::now());
+                    queue.push(PRIORITY_CONTROL, topic("/cmd_vel"), Bytes::new());
+                }
+            })
+        };
+
+        let mut sink = vec![0u8; bulk.len()];
+        let mut sends = Vec::new();
+        let mut latencies = Vec::with_capacity(CONTROL_MESSAGES);
+        while latencies.len() < CONTROL_MESSAGES {
+            let (topic, buffer) = match queue.try_pop() {
+                Some(message) => message,
+                None => continue,
+            };
+            if topic.as_str() == "/cmd_vel" {
+                latencies.push(pushed.lock().unwrap()[latencies.len()].elapsed());
+                continue;
+            }
+            let start = Instant::now();
+            sink.copy_from_slice(&buffer);
+            sends.push(start.elapsed());
+            // Keeps the backlog full
+            queue.push(PRIORITY_BULK, topic, buffer);
+        }
+        producer.join().unwrap();
+
+        sends.sort();
+        latencies.sort();
+        let send = sends[sends.len() / 2];
+        let median = latencies[latencies.len() / 2];
+        let p99 = latencies[latencies.len() * 99 / 100];
+        println!(
+            "bulk send {:?}, control latency: median {:?}, p99 {:?}, max {:?}, \
+             a FIFO would wait {:?}",
+            send,
+            median,
+            p99,
+            latencies.last().unwrap(),
+            send * BULK_BACKLOG as u32
+        );
+        assert!(median <= send * 2);
+    }
+}
@@ -12,11 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use crate::reliability::{
+    MessageHeader, ENCODING_CDR, FLAG_DELTA, FLAG_KEYFRAME, FLAG_RELIABLE, FLAG_TRANSIENT_LOCAL,
+};
 use crate::Libp2pCustomNode;
 
 use std::ffi::CStr;
 use std::io::Cursor;
 use std::os::raw::c_char;
+use std::sync::Mutex;
+use std::time::Duration;
 
 use uuid::Uuid;
 
@@ -27,6 +32,26 @@ pub struct Libp2pCustomPublisher {
     gid: Uuid,
     node: *mut Libp2pCustomNode, // We need to store the Node here to have access to the outgoing queue
     topic: gossipsub::IdentTopic,
+    // Reliable publishers keep a history of their messages for retransmission
+    reliable: bool,
+    // Transient local publishers keep a history of their messages for late joiners
+    transient_local: bool,
+    // Sequence number of the last message published, the first one is 1. Held while publishing
+    // so that messages reach the history and the outgoing queue in sequence order
+    sequence_number: Mutex<u64>,
+    // Lifespan of the messages in nanoseconds, 0 if infinite
+    lifespan_ns: u64,
+    // Outgoing lane of the messages, see OutgoingQueue
+    priority: u8,
+}
+
+/// A piece of a serialized message, see `rs_libp2p_custom_publisher_publish_fragments`.
+///
+/// The layout matches `Fragment` in impl/scatter_gather.hpp.
+#[repr(C)]
+pub struct Fragment {
+    data: *const u8,
+    size: usize,
 }
 
 /// Represents a custom publisher for the Libp2p network.
@@ -39,15 +64,42 @@ impl Libp2pCustomPublisher {
     ///
     /// * `libp2p2_custom_node` - A pointer to the Libp2p custom node.
     /// * `topic_str` - The string representation of the topic to publish to.
+    /// * `reliable` - Whether to keep the last `depth` messages to answer retransmission requests.
+    /// * `transient_local` - Whether to keep the last `depth` messages to replay them to late joiners.
+    /// * `depth` - Number of messages kept, ignored if neither `reliable` nor `transient_local`.
+    /// * `lifespan_ns` - Time after which published messages expire in nanoseconds, 0 if never.
+    /// * `priority` - Outgoing lane of the messages, one of the `PRIORITY_*` constants.
     ///
     /// # Returns
     ///
     /// A new instance of `Libp2pCustomPublisher`.
-    fn new(libp2p2_custom_node: *mut Libp2pCustomNode, topic_str: &str) -> Self {
+    fn new(
+        libp2p2_custom_node: *mut Libp2pCustomNode,
+        topic_str: &str,
+        reliable: bool,
+        transient_local: bool,
+        depth: usize,
+        lifespan_ns: u64,
+        priority: u8,
+    ) -> Self {
+        let node = unsafe {
+            assert!(!libp2p2_custom_node.is_null());
+            &mut *libp2p2_custom_node
+        };
+        let gid = Uuid::new_v4();
+        let topic = gossipsub::IdentTopic::new(topic_str);
+        if reliable || transient_local {
+            node.register_publisher_history(gid, topic.clone(), depth, reliable, transient_local);
+        }
         Self {
-            gid: Uuid::new_v4(),
+            gid: gid,
             node: libp2p2_custom_node,
-            topic: gossipsub::IdentTopic::new(topic_str),
+            topic: topic,
+            reliable: reliable,
+            transient_local: transient_local,
+            sequence_number: Mutex::new(0),
+            lifespan_ns: lifespan_ns,
+            priority: priority,
         }
     }
 
@@ -55,20 +107,81 @@ impl Libp2pCustomPublisher {
     ///
     /// # Arguments
     ///
+    /// * `payload` - The serialized message to be published, in one or more consecutive pieces.
+    /// * `encoding` - The encoding of `payload`, recorded in the header of the message.
+    /// * `delta_flags` - `FLAG_KEYFRAME` or `FLAG_DELTA` if `payload` is delta encoded, 0 otherwise.
+    /// * `keyframe` - The keyframe id of a delta encoded `payload`.
+    /// * `full_payload` - The message a delta was computed from, kept in the history instead.
+    fn publish(
+        &self,
+        payload: &[&[u8]],
+        encoding: u8,
+        delta_flags: u8,
+        keyframe: u8,
+        full_payload: Option<&[u8]>,
+    ) -> () {
+        let libp2p2_custom_node = unsafe {
+            assert!(!self.node.is_null());
+            &mut *self.node
+        };
+
+        let mut flags = delta_flags & (FLAG_KEYFRAME | FLAG_DELTA);
+        if self.reliable {
+            flags |= FLAG_RELIABLE;
+        }
+        if self.transient_local {
+            flags |= FLAG_TRANSIENT_LOCAL;
+        }
+        let mut sequence_number = self.sequence_number.lock().unwrap();
+        *sequence_number += 1;
+        let header = MessageHeader::new(
+            flags,
+            encoding,
+            keyframe,
+            *sequence_number,
+            self.gid,
+            self.lifespan_ns,
+        );
+        libp2p2_custom_node.publish_message(
+            &self.topic,
+            header,
+            payload,
+            full_payload,
+            self.priority,
+        );
+    }
+
+    /// Publishes a message to the Libp2p network without the timestamp header.
+    ///
+    /// # Arguments
+    ///
     /// * `buffer` - The buffer containing the message to be published.
-    fn publish(&self, buffer: Vec<u8>) -> () {
+    fn publish_raw(&self, buffer: Vec<u8>) -> () {
         let libp2p2_custom_node = unsafe {
             assert!(!self.node.is_null());
             &mut *self.node
         };
 
-        libp2p2_custom_node.publish_message(self.topic.clone(), buffer);
+        libp2p2_custom_node.publish_raw_message(&self.topic, buffer, self.priority);
+    }
+}
+
+impl Drop for Libp2pCustomPublisher {
+    /// Drops the history, if any.
+    fn drop(&mut self) {
+        let libp2p2_custom_node = unsafe {
+            assert!(!self.node.is_null());
+            &mut *self.node
+        };
+        if self.reliable || self.transient_local {
+            libp2p2_custom_node.unregister_publisher_history(&self.gid);
+        }
     }
 }
 
 /// Creates a new `Libp2pCustomPublisher`.
 ///
-/// This function takes a raw pointer to a `Libp2pCustomNode` and a raw pointer to a C string representing the topic.
+/// This function takes a raw pointer to a `Libp2pCustomNode`, a raw pointer to a C string representing the topic and the QoS.
 /// It then creates a new `Libp2pCustomPublisher` for the given node and topic, and returns a raw pointer to the heap-allocated publisher.
 ///
 /// # Safety
@@ -79,6 +192,12 @@ impl Libp2pCustomPublisher {
 ///
 /// * `ptr_node` - A raw pointer to a `Libp2pCustomNode`.
 /// * `topic_str_ptr` - A raw pointer to a C string representing the topic.
+/// * `reliable` - Whether the publisher answers retransmission requests of reliable subscriptions.
+/// * `transient_local` - Whether the publisher replays its last messages to late joining subscriptions.
+/// * `depth` - Number of messages kept, ignored if neither `reliable` nor `transient_local`.
+/// * `lifespan_ns` - Time after which published messages expire in nanoseconds, 0 if never.
+/// * `priority` - Outgoing lane of the messages: 0 for control, 1 for default and 2 for bulk
+///   topics. Lower values preempt higher ones.
 ///
 /// # Returns
 ///
@@ -86,19 +205,31 @@ impl Libp2pCustomPublisher {
 ///
 /// # Panics
 ///
-/// This function will panic if `topic_str_ptr` is null or if it does not point to a valid null-terminated string.
+/// This function will panic if `ptr_node` or `topic_str_ptr` is null or if `topic_str_ptr` does not point to a valid null-terminated string.
 #[no_mangle]
 pub extern "C" fn rs_libp2p_custom_publisher_new(
     ptr_node: *mut Libp2pCustomNode,
     topic_str_ptr: *const c_char,
+    reliable: bool,
+    transient_local: bool,
+    depth: usize,
+    lifespan_ns: u64,
+    priority: u8,
 ) -> *mut Libp2pCustomPublisher {
     let topic_str = unsafe {
         assert!(!topic_str_ptr.is_null());
         CStr::from_ptr(topic_str_ptr)
     };
 
-    let libp2p2_custom_publisher =
-        Libp2pCustomPublisher::new(ptr_node, topic_str.to_str().unwrap());
+    let libp2p2_custom_publisher = Libp2pCustomPublisher::new(
+        ptr_node,
+        topic_str.to_str().unwrap(),
+        reliable,
+        transient_local,
+        depth,
+        lifespan_ns,
+        priority,
+    );
     Box::into_raw(Box::new(libp2p2_custom_publisher))
 }
 
@@ -194,7 +325,279 @@ pub extern "C" fn rs_libp2p_custom_publisher_publish(
         assert!(!ptr_buffer.is_null());
         &*ptr_buffer
     };
-    libp2p2_custom_publisher.publish(buffer.get_ref().to_vec());
+    libp2p2_custom_publisher.publish(&[buffer.get_ref().as_slice()], ENCODING_CDR, 0, 0, None);
     // TODO(esteve): return the number of bytes published
     0
 }
+
+/// Publishes an already serialized message using a `Libp2pCustomPublisher`.
+///
+/// The message gets the same header as the ones published with `rs_libp2p_custom_publisher_publish`,
+/// its bytes are copied once right after it and sent as is, so subscriptions can't tell them apart.
+/// The encoding lets subscriptions decode messages that are not in the classic CDR encoding, the
+/// keyframe flag and id let them reconstruct the deltas published afterwards with
+/// `rs_libp2p_custom_publisher_publish_delta`.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_publisher` - A raw pointer to a `Libp2pCustomPublisher`.
+/// * `ptr_data` - A raw pointer to the serialized message.
+/// * `len` - The length of the serialized message.
+/// * `encoding` - The encoding of the serialized message, see `PayloadEncoding` in
+///   impl/message_header.hpp.
+/// * `delta_flags` - `FLAG_KEYFRAME` if the message is a keyframe, 0 otherwise. Other flags are
+///   ignored.
+/// * `keyframe` - The keyframe id of the keyframe.
+///
+/// # Returns
+///
+/// The number of bytes of the serialized message queued for publication.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_publisher` is null, or if `ptr_data` is null and `len` is not zero.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_publisher_publish_serialized(
+    ptr_publisher: *mut Libp2pCustomPublisher,
+    ptr_data: *const u8,
+    len: usize,
+    encoding: u8,
+    delta_flags: u8,
+    keyframe: u8,
+) -> usize {
+    let libp2p2_custom_publisher = unsafe {
+        assert!(!ptr_publisher.is_null());
+        &mut *ptr_publisher
+    };
+    let payload: &[u8] = if len == 0 {
+        &[]
+    } else {
+        unsafe {
+            assert!(!ptr_data.is_null());
+            std::slice::from_raw_parts(ptr_data, len)
+        }
+    };
+    libp2p2_custom_publisher.publish(
+        &[payload],
+        encoding,
+        delta_flags & FLAG_KEYFRAME,
+        keyframe,
+        None,
+    );
+    len
+}
+
+/// Publishes a delta encoded message using a `Libp2pCustomPublisher`.
+///
+/// The delta is sent like a message published with `rs_libp2p_custom_publisher_publish_serialized`,
+/// flagged as a delta against the given keyframe. The history of reliable and transient local
+/// publishers keeps the full message instead, as an ordinary one: retransmissions don't depend on
+/// any keyframe, and late joiners get usable messages even though they missed the keyframe.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_publisher` - A raw pointer to a `Libp2pCustomPublisher`.
+/// * `ptr_delta` - A raw pointer to the delta.
+/// * `delta_len` - The length of the delta.
+/// * `ptr_data` - A raw pointer to the serialized message the delta was computed from.
+/// * `len` - The length of the serialized message.
+/// * `encoding` - The encoding of the serialized message, see `PayloadEncoding` in
+///   impl/message_header.hpp.
+/// * `keyframe` - The keyframe id of the keyframe the delta is against.
+///
+/// # Returns
+///
+/// The number of bytes of the delta queued for publication.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_publisher` is null, or if `ptr_delta` or `ptr_data` is null
+/// and its length is not zero.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_publisher_publish_delta(
+    ptr_publisher: *mut Libp2pCustomPublisher,
+    ptr_delta: *const u8,
+    delta_len: usize,
+    ptr_data: *const u8,
+    len: usize,
+    encoding: u8,
+    keyframe: u8,
+) -> usize {
+    let libp2p2_custom_publisher = unsafe {
+        assert!(!ptr_publisher.is_null());
+        &mut *ptr_publisher
+    };
+    let delta: &[u8] = if delta_len == 0 {
+        &[]
+    } else {
+        unsafe {
+            assert!(!ptr_delta.is_null());
+            std::slice::from_raw_parts(ptr_delta, delta_len)
+        }
+    };
+    let payload: &[u8] = if len == 0 {
+        &[]
+    } else {
+        unsafe {
+            assert!(!ptr_data.is_null());
+            std::slice::from_raw_parts(ptr_data, len)
+        }
+    };
+    libp2p2_custom_publisher.publish(&[delta], encoding, FLAG_DELTA, keyframe, Some(payload));
+    delta_len
+}
+
+/// Publishes a message serialized in pieces using a `Libp2pCustomPublisher`.
+///
+/// The pieces are gathered right after the header into the message that is sent, so that large
+/// arrays can be referenced where they are instead of being copied into the serialization buffer
+/// first. The message can't be told apart from one published with
+/// `rs_libp2p_custom_publisher_publish_serialized` with the pieces concatenated.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_publisher` - A raw pointer to a `Libp2pCustomPublisher`.
+/// * `ptr_fragments` - A raw pointer to the pieces of the serialized message, in order.
+/// * `count` - The number of pieces.
+/// * `encoding` - The encoding of the serialized message, see `PayloadEncoding` in
+///   impl/message_header.hpp.
+///
+/// # Returns
+///
+/// The number of bytes of the serialized message queued for publication.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_publisher` is null, if `ptr_fragments` is null and `count` is
+/// not zero, or if the data of a piece that is not empty is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_publisher_publish_fragments(
+    ptr_publisher: *mut Libp2pCustomPublisher,
+    ptr_fragments: *const Fragment,
+    count: usize,
+    encoding: u8,
+) -> usize {
+    let libp2p2_custom_publisher = unsafe {
+        assert!(!ptr_publisher.is_null());
+        &mut *ptr_publisher
+    };
+    let fragments: &[Fragment] = if count == 0 {
+        &[]
+    } else {
+        unsafe {
+            assert!(!ptr_fragments.is_null());
+            std::slice::from_raw_parts(ptr_fragments, count)
+        }
+    };
+    let payload: Vec<&[u8]> = fragments
+        .iter()
+        .filter(|fragment| fragment.size > 0)
+        .map(|fragment| unsafe {
+            assert!(!fragment.data.is_null());
+            std::slice::from_raw_parts(fragment.data, fragment.size)
+        })
+        .collect();
+    libp2p2_custom_publisher.publish(&payload, encoding, 0, 0, None);
+    payload.iter().map(|piece| piece.len()).sum()
+}
+
+/// Publishes a raw buffer using a `Libp2pCustomPublisher`.
+///
+/// Unlike `rs_libp2p_custom_publisher_publish`, the buffer is sent as is, without prepending the timestamp header.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_publisher` - A raw pointer to a `Libp2pCustomPublisher`.
+/// * `ptr_data` - A raw pointer to the bytes to publish.
+/// * `len` - The number of bytes to publish.
+///
+/// # Returns
+///
+/// The number of bytes queued for publication.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_publisher` is null, or if `ptr_data` is null and `len` is not zero.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_publisher_publish_raw(
+    ptr_publisher: *mut Libp2pCustomPublisher,
+    ptr_data: *const u8,
+    len: usize,
+) -> usize {
+    let libp2p2_custom_publisher = unsafe {
+        assert!(!ptr_publisher.is_null());
+        &mut *ptr_publisher
+    };
+    let buffer = if len == 0 {
+        Vec::new()
+    } else {
+        unsafe {
+            assert!(!ptr_data.is_null());
+            std::slice::from_raw_parts(ptr_data, len).to_vec()
+        }
+    };
+    libp2p2_custom_publisher.publish_raw(buffer);
+    len
+}
+
+/// Waits until all the messages published by a `Libp2pCustomPublisher` have been acknowledged.
+///
+/// Only reliable subscribers acknowledge messages, so this returns right away for best effort
+/// publishers or when no peer is subscribed to the topic. Peers with best effort subscriptions
+/// only stop being waited for once they answer a heartbeat of the publisher.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr_publisher` - A raw pointer to a `Libp2pCustomPublisher`.
+/// * `timeout_ns` - The maximum time to wait, in nanoseconds. `u64::MAX` waits forever.
+///
+/// # Returns
+///
+/// `true` if all the messages were acknowledged, `false` if the timeout expired first.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_publisher` is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_publisher_wait_for_all_acked(
+    ptr_publisher: *mut Libp2pCustomPublisher,
+    timeout_ns: u64,
+) -> bool {
+    let libp2p2_custom_publisher = unsafe {
+        assert!(!ptr_publisher.is_null());
+        &mut *ptr_publisher
+    };
+    if !libp2p2_custom_publisher.reliable {
+        return true;
+    }
+    let libp2p2_custom_node = unsafe {
+        assert!(!libp2p2_custom_publisher.node.is_null());
+        &mut *libp2p2_custom_publisher.node
+    };
+    let timeout = if timeout_ns == u64::MAX {
+        None
+    } else {
+        Some(Duration::from_nanos(timeout_ns))
+    };
+    libp2p2_custom_node.wait_for_all_acked(&libp2p2_custom_publisher.gid, timeout)
+}
@@ -0,0 +1,1194 @@
+// Copyright 2024 Esteve Fernandez
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+//! Reliable delivery and transient local durability on top of gossipsub.
+//!
+//! Every message carries a `MessageHeader` with the publisher GID and a per-publisher sequence
+//! number. Reliable publishers keep the last `depth` messages they sent. Reliable subscribers
+//! deliver the messages of each publisher in order, and ask the publisher to retransmit the
+//! missing ones (NACK) over a request-response protocol whenever they detect a gap. They also
+//! acknowledge what they have received (ACK), in batches, so that publishers can wait for all
+//! their messages to be acknowledged.
+//!
+//! A gap is only noticed when a later message arrives, so a publisher that goes quiet before
+//! every peer subscribed to its topic has acknowledged its last message periodically tells them
+//! the last sequence number it sent (heartbeat). Receivers NACK whatever they miss up to it and
+//! answer with what they have received, peers without reliable subscriptions answer that they
+//! won't acknowledge anything and are not waited for.
+//!
+//! Transient local publishers also keep their last `depth` messages, which are replayed to late
+//! joining subscribers over the same protocol, directly between the peers involved: the history
+//! is pushed to peers that subscribe to the topic, and pulled from the connected peers when a
+//! transient local subscription is added to a topic the node was already subscribed to.
+
+use std::collections::{BTreeMap, HashMap, VecDeque};
+use std::io;
+use std::sync::{Condvar, Mutex};
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+use async_trait::async_trait;
+use bytes::Bytes;
+use libp2p::core::upgrade::{read_length_prefixed, write_length_prefixed};
+use libp2p::core::ProtocolName;
+use libp2p::futures::{AsyncRead, AsyncWrite, AsyncWriteExt};
+use libp2p::request_response;
+use libp2p::PeerId;
+use uuid::Uuid;
+
+/// Size of the header prepended to every message, must match impl/message_header.hpp
+pub(crate) const HEADER_SIZE: usize = 48;
+const HEADER_VERSION: u8 = 4;
+/// The publisher keeps a history and answers NACKs
+pub(crate) const FLAG_RELIABLE: u8 = 1;
+/// The publisher keeps a history and replays it to late joiners
+pub(crate) const FLAG_TRANSIENT_LOCAL: u8 = 2;
+/// The payload is a keyframe that later deltas of the publisher refer to by its keyframe id
+pub(crate) const FLAG_KEYFRAME: u8 = 4;
+/// The payload is a delta against the keyframe with the same keyframe id, see
+/// impl/delta_encoding.hpp
+pub(crate) const FLAG_DELTA: u8 = 8;
+/// The payload is in the classic encoding of the `cdr` crate, see `PayloadEncoding` in
+/// impl/message_header.hpp for the others
+pub(crate) const ENCODING_CDR: u8 = 0;
+
+/// Period of the reliability timer, which also bounds the latency of ACKs
+pub(crate) const TICK_PERIOD: Duration = Duration::from_millis(20);
+/// Time to wait for a retransmission before asking again
+const NACK_TIMEOUT: Duration = Duration::from_millis(200);
+/// Number of unanswered NACKs after which the missing messages are considered lost
+const MAX_NACK_RETRIES: u32 = 5;
+/// Messages buffered while waiting for a retransmission, beyond which the gap is skipped
+const MAX_PENDING_MESSAGES: usize = 1024;
+/// Time after which the state kept for a silent publisher is dropped
+const RECEIVER_TIMEOUT: Duration = Duration::from_secs(30);
+/// Time a publisher stays quiet with unacknowledged messages before sending a heartbeat, and
+/// between heartbeats
+const HEARTBEAT_PERIOD: Duration = Duration::from_millis(100);
+
+// Replayed histories travel in requests too
+pub(crate) const MAX_MESSAGE_SIZE: usize = 64 * 1024 * 1024;
+
+/// Header prepended to every message by publishers.
+///
+/// Little endian, 48 bytes:
+///
+/// | offset | field                   |
+/// |--------|-------------------------|
+/// | 0      | u8 version              |
+/// | 1      | u8 flags                |
+/// | 2      | u8 payload encoding     |
+/// | 3      | u8 keyframe id          |
+/// | 4      | u32 nanoseconds         |
+/// | 8      | u64 seconds             |
+/// | 16     | u64 sequence number     |
+/// | 24     | u8[16] publisher GID    |
+/// | 40     | u64 lifespan (ns)       |
+///
+/// A lifespan of 0 means the message never expires. The keyframe id is only meaningful with
+/// `FLAG_KEYFRAME` or `FLAG_DELTA`.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct MessageHeader {
+    pub flags: u8,
+    pub encoding: u8,
+    pub keyframe: u8,
+    pub secs: u64,
+    pub nsecs: u32,
+    pub sequence_number: u64,
+    pub gid: Uuid,
+    pub lifespan_ns: u64,
+}
+
+impl MessageHeader {
+    /// Creates a header stamped with the current time.
+    ///
+    /// # Panics
+    ///
+    /// This function will panic if the system time is before the UNIX_EPOCH.
+    pub(crate) fn new(
+        flags: u8,
+        encoding: u8,
+        keyframe: u8,
+        sequence_number: u64,
+        gid: Uuid,
+        lifespan_ns: u64,
+    ) -> Self {
+        let since_the_epoch = SystemTime::now()
+            .duration_since(UNIX_EPOCH)
+            .expect("Time went backwards");
+        Self {
+            flags: flags,
+            encoding: encoding,
+            keyframe: keyframe,
+            secs: since_the_epoch.as_secs(),
+            nsecs: since_the_epoch.subsec_nanos(),
+            sequence_number: sequence_number,
+            gid: gid,
+            lifespan_ns: lifespan_ns,
+        }
+    }
+
+    pub(crate) fn is_reliable(&self) -> bool {
+        self.flags & FLAG_RELIABLE != 0
+    }
+
+    /// Whether the lifespan of the message has elapsed at `now`.
+    pub(crate) fn is_expired(&self, now: SystemTime) -> bool {
+        if self.lifespan_ns == 0 {
+            return false;
+        }
+        let expiration = UNIX_EPOCH
+            + Duration::new(self.secs, self.nsecs)
+            + Duration::from_nanos(self.lifespan_ns);
+        now > expiration
+    }
+
+    /// Whether the message has to be kept in the history of the publisher.
+    pub(crate) fn is_kept(&self) -> bool {
+        self.flags & (FLAG_RELIABLE | FLAG_TRANSIENT_LOCAL) != 0
+    }
+
+    pub(crate) fn encode(&self, buffer: &mut Vec<u8>) {
+        buffer.push(HEADER_VERSION);
+        buffer.push(self.flags);
+        buffer.push(self.encoding);
+        buffer.push(self.keyframe);
+        buffer.extend_from_slice(&self.nsecs.to_le_bytes());
+        buffer.extend_from_slice(&self.secs.to_le_bytes());
+        buffer.extend_from_slice(&self.sequence_number.to_le_bytes());
+        buffer.extend_from_slice(self.gid.as_bytes());
+        buffer.extend_from_slice(&self.lifespan_ns.to_le_bytes());
+    }
+
+    /// Returns `None` if `data` is too short or was written by an unknown version.
+    pub(crate) fn decode(data: &[u8]) -> Option<Self> {
+        if data.len() < HEADER_SIZE || data[0] != HEADER_VERSION {
+            return None;
+        }
+        Some(Self {
+            flags: data[1],
+            encoding: data[2],
+            keyframe: data[3],
+            nsecs: u32::from_le_bytes(data[4..8].try_into().unwrap()),
+            secs: u64::from_le_bytes(data[8..16].try_into().unwrap()),
+            sequence_number: u64::from_le_bytes(data[16..24].try_into().unwrap()),
+            gid: Uuid::from_slice(&data[24..40]).unwrap(),
+            lifespan_ns: u64::from_le_bytes(data[40..48].try_into().unwrap()),
+        })
+    }
+}
+
+#[derive(Debug, Clone)]
+pub(crate) struct ReliableProtocol();
+
+impl ProtocolName for ReliableProtocol {
+    fn protocol_name(&self) -> &[u8] {
+        b"/rmw_libp2p/reliable/1.0.0"
+    }
+}
+
+#[derive(Debug)]
+pub(crate) enum ReliableRequest {
+    /// Retransmit the messages of publisher `gid` from `first` to `last`, inclusive
+    Nack { gid: Uuid, first: u64, last: u64 },
+    /// All the messages of publisher `gid` up to `sequence_number` have been received
+    Ack { gid: Uuid, sequence_number: u64 },
+    /// Send the history of the transient local publishers of `topic`, sent by late joiners
+    History { topic: String },
+    /// History of the transient local publishers of `topic`, pushed to peers that subscribe
+    Replay { topic: String, messages: Vec<Bytes> },
+    /// Publisher `gid` of `topic` sent messages up to `last`, the peer is owed the ones from
+    /// `first`
+    Heartbeat {
+        gid: Uuid,
+        topic: String,
+        first: u64,
+        last: u64,
+    },
+}
+
+#[derive(Debug)]
+pub(crate) enum ReliableResponse {
+    /// The requested messages still in the history, messages older than `first_available`
+    /// are gone
+    Retransmit {
+        gid: Uuid,
+        first_available: u64,
+        messages: Vec<Bytes>,
+    },
+    Ack,
+    /// Answer to `ReliableRequest::History`
+    Replay { topic: String, messages: Vec<Bytes> },
+    /// Answer to `ReliableRequest::Heartbeat`, all the messages of publisher `gid` up to
+    /// `sequence_number` have been received
+    Acked { gid: Uuid, sequence_number: u64 },
+    /// Answer to `ReliableRequest::Heartbeat` from a peer without reliable subscriptions to the
+    /// topic, which never acknowledges the messages of publisher `gid`
+    Unreliable { gid: Uuid },
+}
+
+pub(crate) fn invalid_data(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message)
+}
+
+pub(crate) fn truncated() -> io::Error {
+    invalid_data("truncated message")
+}
+
+pub(crate) fn get_u64(data: &[u8], offset: usize) -> io::Result<u64> {
+    data.get(offset..offset + 8)
+        .map(|bytes| u64::from_le_bytes(bytes.try_into().unwrap()))
+        .ok_or_else(truncated)
+}
+
+pub(crate) fn get_gid(data: &[u8], offset: usize) -> io::Result<Uuid> {
+    data.get(offset..offset + 16)
+        .map(|bytes| Uuid::from_slice(bytes).unwrap())
+        .ok_or_else(truncated)
+}
+
+pub(crate) fn get_bytes(data: &[u8], offset: &mut usize) -> io::Result<Vec<u8>> {
+    let length = get_u64(data, *offset)? as usize;
+    *offset += 8;
+    let bytes = data
+        .get(*offset..offset.saturating_add(length))
+        .ok_or_else(truncated)?;
+    *offset += length;
+    Ok(bytes.to_vec())
+}
+
+pub(crate) fn get_string(data: &[u8], offset: &mut usize) -> io::Result<String> {
+    String::from_utf8(get_bytes(data, offset)?).map_err(|_| invalid_data("invalid name"))
+}
+
+/// The messages share the buffer they were received in, they are not copied.
+fn get_messages(data: &Bytes, offset: &mut usize) -> io::Result<Vec<Bytes>> {
+    let count = get_u64(data, *offset)?;
+    *offset += 8;
+    let mut messages = Vec::new();
+    for _ in 0..count {
+        let length = get_u64(data, *offset)? as usize;
+        *offset += 8;
+        let end = offset.saturating_add(length);
+        if end > data.len() {
+            return Err(truncated());
+        }
+        messages.push(data.slice(*offset..end));
+        *offset = end;
+    }
+    Ok(messages)
+}
+
+pub(crate) fn put_bytes(data: &mut Vec<u8>, bytes: &[u8]) {
+    data.extend_from_slice(&(bytes.len() as u64).to_le_bytes());
+    data.extend_from_slice(bytes);
+}
+
+fn put_messages(data: &mut Vec<u8>, messages: &[Bytes]) {
+    data.extend_from_slice(&(messages.len() as u64).to_le_bytes());
+    for message in messages {
+        put_bytes(data, message);
+    }
+}
+
+fn encode_request(request: &ReliableRequest) -> Vec<u8> {
+    let mut data = Vec::with_capacity(33);
+    match request {
+        ReliableRequest::Nack { gid, first, last } => {
+            data.push(0);
+            data.extend_from_slice(gid.as_bytes());
+            data.extend_from_slice(&first.to_le_bytes());
+            data.extend_from_slice(&last.to_le_bytes());
+        }
+        ReliableRequest::Ack {
+            gid,
+            sequence_number,
+        } => {
+            data.push(1);
+            data.extend_from_slice(gid.as_bytes());
+            data.extend_from_slice(&sequence_number.to_le_bytes());
+        }
+        ReliableRequest::History { topic } => {
+            data.push(2);
+            put_bytes(&mut data, topic.as_bytes());
+        }
+        ReliableRequest::Replay { topic, messages } => {
+            data.push(3);
+            put_bytes(&mut data, topic.as_bytes());
+            put_messages(&mut data, messages);
+        }
+        ReliableRequest::Heartbeat {
+            gid,
+            topic,
+            first,
+            last,
+        } => {
+            data.push(4);
+            data.extend_from_slice(gid.as_bytes());
+            data.extend_from_slice(&first.to_le_bytes());
+            data.extend_from_slice(&last.to_le_bytes());
+            put_bytes(&mut data, topic.as_bytes());
+        }
+    }
+    data
+}
+
+fn decode_request(data: &Bytes) -> io::Result<ReliableRequest> {
+    let mut offset = 1;
+    match data.first() {
+        Some(0) => Ok(ReliableRequest::Nack {
+            gid: get_gid(data, 1)?,
+            first: get_u64(data, 17)?,
+            last: get_u64(data, 25)?,
+        }),
+        Some(1) => Ok(ReliableRequest::Ack {
+            gid: get_gid(data, 1)?,
+            sequence_number: get_u64(data, 17)?,
+        }),
+        Some(2) => Ok(ReliableRequest::History {
+            topic: get_string(data, &mut offset)?,
+        }),
+        Some(3) => Ok(ReliableRequest::Replay {
+            topic: get_string(data, &mut offset)?,
+            messages: get_messages(data, &mut offset)?,
+        }),
+        Some(4) => {
+            let mut offset = 33;
+            Ok(ReliableRequest::Heartbeat {
+                gid: get_gid(data, 1)?,
+                first: get_u64(data, 17)?,
+                last: get_u64(data, 25)?,
+                topic: get_string(data, &mut offset)?,
+            })
+        }
+        _ => Err(invalid_data("unknown reliability request")),
+    }
+}
+
+fn encode_response(response: &ReliableResponse) -> Vec<u8> {
+    let mut data = Vec::new();
+    match response {
+        ReliableResponse::Retransmit {
+            gid,
+            first_available,
+            messages,
+        } => {
+            data.push(0);
+            data.extend_from_slice(gid.as_bytes());
+            data.extend_from_slice(&first_available.to_le_bytes());
+            put_messages(&mut data, messages);
+        }
+        ReliableResponse::Ack => data.push(1),
+        ReliableResponse::Replay { topic, messages } => {
+            data.push(2);
+            put_bytes(&mut data, topic.as_bytes());
+            put_messages(&mut data, messages);
+        }
+        ReliableResponse::Acked {
+            gid,
+            sequence_number,
+        } => {
+            data.push(3);
+            data.extend_from_slice(gid.as_bytes());
+            data.extend_from_slice(&sequence_number.to_le_bytes());
+        }
+        ReliableResponse::Unreliable { gid } => {
+            data.push(4);
+            data.extend_from_slice(gid.as_bytes());
+        }
+    }
+    data
+}
+
+fn decode_response(data: &Bytes) -> io::Result<ReliableResponse> {
+    match data.first() {
+        Some(0) => {
+            let mut offset = 25;
+            Ok(ReliableResponse::Retransmit {
+                gid: get_gid(data, 1)?,
+                first_available: get_u64(data, 17)?,
+                messages: get_messages(data, &mut offset)?,
+            })
+        }
+        Some(1) => Ok(ReliableResponse::Ack),
+        Some(2) => {
+            let mut offset = 1;
+            Ok(ReliableResponse::Replay {
+                topic: get_string(data, &mut offset)?,
+                messages: get_messages(data, &mut offset)?,
+            })
+        }
+        Some(3) => Ok(ReliableResponse::Acked {
+            gid: get_gid(data, 1)?,
+            sequence_number: get_u64(data, 17)?,
+        }),
+        Some(4) => Ok(ReliableResponse::Unreliable {
+            gid: get_gid(data, 1)?,
+        }),
+        _ => Err(invalid_data("unknown reliability response")),
+    }
+}
+
+#[derive(Clone)]
+pub(crate) struct ReliableCodec();
+
+#[async_trait]
+impl request_response::Codec for ReliableCodec {
+    type Protocol = ReliableProtocol;
+    type Request = ReliableRequest;
+    type Response = ReliableResponse;
+
+    async fn read_request<T>(&mut self, _: &ReliableProtocol, io: &mut T) -> io::Result<ReliableRequest>
+    where
+        T: AsyncRead + Unpin + Send,
+    {
+        let data = Bytes::from(read_length_prefixed(io, MAX_MESSAGE_SIZE).await?);
+        decode_request(&data)
+    }
+
+    async fn read_response<T>(&mut self, _: &ReliableProtocol, io: &mut T) -> io::Result<ReliableResponse>
+    where
+        T: AsyncRead + Unpin + Send,
+    {
+        let data = Bytes::from(read_length_prefixed(io, MAX_MESSAGE_SIZE).await?);
+        decode_response(&data)
+    }
+
+    async fn write_request<T>(
+        &mut self,
+        _: &ReliableProtocol,
+        io: &mut T,
+        request: ReliableRequest,
+    ) -> io::Result<()>
+    where
+        T: AsyncWrite + Unpin + Send,
+    {
+        write_length_prefixed(io, encode_request(&request)).await?;
+        io.close().await
+    }
+
+    async fn write_response<T>(
+        &mut self,
+        _: &ReliableProtocol,
+        io: &mut T,
+        response: ReliableResponse,
+    ) -> io::Result<()>
+    where
+        T: AsyncWrite + Unpin + Send,
+    {
+        write_length_prefixed(io, encode_response(&response)).await?;
+        io.close().await
+    }
+}
+
+/// Messages kept by a reliable or transient local publisher for retransmission and replay, and
+/// the acknowledgements received.
+struct PublisherHistory {
+    topic: String,
+    depth: usize,
+    reliable: bool,
+    transient_local: bool,
+    // Shared with the outgoing queue and the retransmissions, keeping them copies nothing
+    messages: VecDeque<(u64, Bytes)>,
+    last_sequence_number: u64,
+    last_published: Instant,
+    last_heartbeat: Option<Instant>,
+    // Reliable publishers only: highest sequence number acknowledged by each peer subscribed to
+    // the topic, starting from the last one sent when it subscribed. Peers that answer a
+    // heartbeat without reliable subscriptions are removed.
+    acks: HashMap<PeerId, u64>,
+}
+
+impl PublisherHistory {
+    fn all_acked(&self) -> bool {
+        self.acks
+            .values()
+            .all(|sequence_number| *sequence_number >= self.last_sequence_number)
+    }
+}
+
+/// Histories of the reliable and transient local publishers of a node, shared between the
+/// publishers and the event loop.
+pub(crate) struct PublisherHistories {
+    histories: Mutex<HashMap<Uuid, PublisherHistory>>,
+    acked: Condvar,
+}
+
+impl PublisherHistories {
+    pub(crate) fn new() -> Self {
+        Self {
+            histories: Mutex::new(HashMap::new()),
+            acked: Condvar::new(),
+        }
+    }
+
+    /// `peers` are the peers already subscribed to `topic`, see `add_peer`.
+    pub(crate) fn register<'a>(
+        &self,
+        gid: Uuid,
+        topic: String,
+        depth: usize,
+        reliable: bool,
+        transient_local: bool,
+        peers: impl Iterator<Item = &'a PeerId>,
+    ) {
+        let acks = if reliable {
+            peers.map(|peer| (*peer, 0)).collect()
+        } else {
+            HashMap::new()
+        };
+        self.histories.lock().unwrap().insert(
+            gid,
+            PublisherHistory {
+                topic: topic,
+                depth: depth.max(1),
+                reliable: reliable,
+                transient_local: transient_local,
+                messages: VecDeque::new(),
+                last_sequence_number: 0,
+                last_published: Instant::now(),
+                last_heartbeat: None,
+                acks: acks,
+            },
+        );
+    }
+
+    pub(crate) fn unregister(&self, gid: &Uuid) {
+        self.histories.lock().unwrap().remove(gid);
+        self.acked.notify_all();
+    }
+
+    pub(crate) fn push(&self, gid: &Uuid, sequence_number: u64, message: Bytes) {
+        let mut histories = self.histories.lock().unwrap();
+        if let Some(history) = histories.get_mut(gid) {
+            if history.messages.len() == history.depth {
+                history.messages.pop_front();
+            }
+            history.messages.push_back((sequence_number, message));
+            history.last_sequence_number = sequence_number;
+            history.last_published = Instant::now();
+        }
+    }
+
+    /// Answers a NACK with the requested messages that are still in the history.
+    pub(crate) fn retransmit(&self, gid: Uuid, first: u64, last: u64) -> ReliableResponse {
+        let histories = self.histories.lock().unwrap();
+        let (first_available, messages) = match histories.get(&gid) {
+            Some(history) => {
+                let first_available = history
+                    .messages
+                    .front()
+                    .map(|(sequence_number, _)| *sequence_number)
+                    .unwrap_or(history.last_sequence_number + 1);
+                let messages = history
+                    .messages
+                    .iter()
+                    .filter(|(sequence_number, _)| *sequence_number >= first && *sequence_number <= last)
+                    .map(|(_, message)| message.clone())
+                    .collect();
+                (first_available, messages)
+            }
+            // The publisher is gone, so is everything it sent
+            None => (last.saturating_add(1), Vec::new()),
+        };
+        ReliableResponse::Retransmit {
+            gid: gid,
+            first_available: first_available,
+            messages: messages,
+        }
+    }
+
+    /// The messages to replay to late joiners of `topic`, oldest first for each publisher.
+    ///
+    /// Messages whose lifespan has elapsed are not replayed.
+    pub(crate) fn durable_messages(&self, topic: &str) -> Vec<Bytes> {
+        let now = SystemTime::now();
+        let histories = self.histories.lock().unwrap();
+        histories
+            .values()
+            .filter(|history| history.transient_local && history.topic == topic)
+            .flat_map(|history| history.messages.iter().map(|(_, message)| message))
+            .filter(|message| {
+                MessageHeader::decode(message).map_or(false, |header| !header.is_expired(now))
+            })
+            .cloned()
+            .collect()
+    }
+
+    pub(crate) fn acknowledge(&self, gid: &Uuid, peer: PeerId, sequence_number: u64) {
+        let mut histories = self.histories.lock().unwrap();
+        if let Some(history) = histories.get_mut(gid) {
+            let acked = history.acks.entry(peer).or_insert(0);
+            if sequence_number > *acked {
+                *acked = sequence_number;
+                self.acked.notify_all();
+            }
+        }
+    }
+
+    /// Starts waiting for the acknowledgements of `peer`, which subscribed to `topic`, for the
+    /// messages the reliable publishers of `topic` send from now on.
+    pub(crate) fn add_peer(&self, topic: &str, peer: PeerId) {
+        let mut histories = self.histories.lock().unwrap();
+        for history in histories.values_mut() {
+            if history.reliable && history.topic == topic {
+                history
+                    .acks
+                    .entry(peer)
+                    .or_insert(history.last_sequence_number);
+            }
+        }
+    }
+
+    /// Stops waiting for the acknowledgements of `peer` for the messages of publisher `gid`.
+    pub(crate) fn forget_peer(&self, gid: &Uuid, peer: &PeerId) {
+        if let Some(history) = self.histories.lock().unwrap().get_mut(gid) {
+            history.acks.remove(peer);
+        }
+        self.acked.notify_all();
+    }
+
+    /// The heartbeats to send at `now`, to each peer that hasn't acknowledged the last message
+    /// of a reliable publisher that has been quiet for a while.
+    ///
+    /// Messages published right after a lost one reveal the loss, heartbeats are only needed
+    /// once the publisher stops.
+    pub(crate) fn heartbeats(&self, now: Instant) -> Vec<(PeerId, ReliableRequest)> {
+        let mut heartbeats = Vec::new();
+        let mut histories = self.histories.lock().unwrap();
+        for (gid, history) in histories.iter_mut() {
+            if !history.reliable
+                || history.all_acked()
+                || now.duration_since(history.last_published) < HEARTBEAT_PERIOD
+                || history.last_heartbeat.map_or(false, |last_heartbeat| {
+                    now.duration_since(last_heartbeat) < HEARTBEAT_PERIOD
+                })
+            {
+                continue;
+            }
+            history.last_heartbeat = Some(now);
+            for (peer, acked) in history.acks.iter() {
+                if *acked < history.last_sequence_number {
+                    heartbeats.push((
+                        *peer,
+                        ReliableRequest::Heartbeat {
+                            gid: *gid,
+                            topic: history.topic.clone(),
+                            first: acked + 1,
+                            last: history.last_sequence_number,
+                        },
+                    ));
+                }
+            }
+        }
+        heartbeats
+    }
+
+    /// Stops waiting for the acknowledgements of `peer`, on the given topic or on all of them.
+    pub(crate) fn remove_peer(&self, topic: Option<&str>, peer: &PeerId) {
+        let mut histories = self.histories.lock().unwrap();
+        for history in histories.values_mut() {
+            if topic.map_or(true, |topic| topic == history.topic) {
+                history.acks.remove(peer);
+            }
+        }
+        self.acked.notify_all();
+    }
+
+    /// Waits until every peer subscribed to the topic has acknowledged all the messages of
+    /// publisher `gid`, or has told it has no reliable subscription.
+    ///
+    /// Returns false if `timeout` expires first, `None` waits forever.
+    pub(crate) fn wait_for_all_acked(&self, gid: &Uuid, timeout: Option<Duration>) -> bool {
+        let deadline = timeout.and_then(|timeout| Instant::now().checked_add(timeout));
+        let mut histories = self.histories.lock().unwrap();
+        loop {
+            match histories.get(gid) {
+                Some(history) if !history.all_acked() => {}
+                _ => return true,
+            }
+            histories = match deadline {
+                None => self.acked.wait(histories).unwrap(),
+                Some(deadline) => {
+                    let now = Instant::now();
+                    if now >= deadline {
+                        return false;
+                    }
+                    self.acked.wait_timeout(histories, deadline - now).unwrap().0
+                }
+            };
+        }
+    }
+}
+
+/// What a reliable subscriber node has received from one publisher.
+pub(crate) struct ReceiverState {
+    pub topic: String,
+    pub source: PeerId,
+    // Last sequence number delivered in order
+    delivered: u64,
+    acked: u64,
+    // Last sequence number the publisher said it sent, see `heartbeat`
+    announced: u64,
+    // Messages received after a gap, waiting for the missing ones
+    pending: BTreeMap<u64, Bytes>,
+    nack_sent: Option<Instant>,
+    nack_retries: u32,
+    last_activity: Instant,
+}
+
+impl ReceiverState {
+    /// Starts tracking a publisher from the first message received from it, older messages
+    /// are not requested.
+    pub(crate) fn new(topic: String, source: PeerId, first_sequence_number: u64) -> Self {
+        Self {
+            topic: topic,
+            source: source,
+            delivered: first_sequence_number.saturating_sub(1),
+            acked: 0,
+            announced: 0,
+            pending: BTreeMap::new(),
+            nack_sent: None,
+            nack_retries: 0,
+            last_activity: Instant::now(),
+        }
+    }
+
+    /// Returns the messages that can now be delivered, in order.
+    pub(crate) fn receive(&mut self, sequence_number: u64, message: Bytes) -> Vec<Bytes> {
+        self.last_activity = Instant::now();
+        if sequence_number <= self.delivered {
+            return Vec::new();
+        }
+        if sequence_number == self.delivered + 1 && self.pending.is_empty() {
+            self.delivered = sequence_number;
+            return vec![message];
+        }
+        self.pending.insert(sequence_number, message);
+        if self.pending.len() > MAX_PENDING_MESSAGES {
+            let first_pending = *self.pending.keys().next().unwrap();
+            return self.skip_to(first_pending);
+        }
+        self.flush()
+    }
+
+    /// Gives up on the messages before `sequence_number`, returns the messages that can now be
+    /// delivered.
+    pub(crate) fn skip_to(&mut self, sequence_number: u64) -> Vec<Bytes> {
+        if sequence_number > self.delivered + 1 {
+            self.delivered = sequence_number - 1;
+            self.pending = self.pending.split_off(&sequence_number);
+        }
+        self.flush()
+    }
+
+    fn flush(&mut self) -> Vec<Bytes> {
+        let mut messages = Vec::new();
+        while let Some(message) = self.pending.remove(&(self.delivered + 1)) {
+            self.delivered += 1;
+            messages.push(message);
+        }
+        if self.pending.is_empty() {
+            self.nack_sent = None;
+            self.nack_retries = 0;
+        }
+        messages
+    }
+
+    /// Records the last sequence number sent by the publisher, the messages up to it that
+    /// haven't been received are NACKed like any other gap.
+    ///
+    /// # Returns
+    ///
+    /// The last sequence number delivered in order, which acknowledges the messages up to it.
+    pub(crate) fn heartbeat(&mut self, last: u64) -> u64 {
+        self.last_activity = Instant::now();
+        self.announced = self.announced.max(last);
+        self.acked = self.delivered;
+        self.delivered
+    }
+
+    /// The first message after the gap that comes first, if any.
+    fn gap_end(&self) -> Option<u64> {
+        match self.pending.keys().next() {
+            Some(first_pending) => Some(*first_pending),
+            None if self.announced > self.delivered => Some(self.announced + 1),
+            None => None,
+        }
+    }
+
+    /// The range of missing messages to NACK, unless a NACK is already outstanding.
+    pub(crate) fn nack(&mut self, now: Instant) -> Option<(u64, u64)> {
+        let gap_end = self.gap_end()?;
+        if let Some(nack_sent) = self.nack_sent {
+            if now.duration_since(nack_sent) < NACK_TIMEOUT {
+                return None;
+            }
+        }
+        self.nack_sent = Some(now);
+        self.nack_retries += 1;
+        Some((self.delivered + 1, gap_end - 1))
+    }
+
+    pub(crate) fn retransmission_received(&mut self) {
+        self.nack_sent = None;
+    }
+
+    /// Called periodically, returns the messages delivered by giving up on a gap.
+    pub(crate) fn tick(&mut self, now: Instant) -> Vec<Bytes> {
+        let timed_out = self
+            .nack_sent
+            .map_or(false, |nack_sent| now.duration_since(nack_sent) >= NACK_TIMEOUT);
+        if timed_out && self.nack_retries >= MAX_NACK_RETRIES {
+            if let Some(gap_end) = self.gap_end() {
+                return self.skip_to(gap_end);
+            }
+        }
+        Vec::new()
+    }
+
+    /// The sequence number to acknowledge, if it advanced since the last ACK.
+    pub(crate) fn ack(&mut self) -> Option<u64> {
+        if self.delivered > self.acked {
+            self.acked = self.delivered;
+            Some(self.delivered)
+        } else {
+            None
+        }
+    }
+
+    pub(crate) fn is_expired(&self, now: Instant) -> bool {
+        self.gap_end().is_none() && now.duration_since(self.last_activity) >= RECEIVER_TIMEOUT
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn message(sequence_number: u64) -> Bytes {
+        Bytes::from(sequence_number.to_le_bytes().to_vec())
+    }
+
+    fn sequence_numbers(messages: &[Bytes]) -> Vec<u64> {
+        messages
+            .iter()
+            .map(|message| u64::from_le_bytes(message[..8].try_into().unwrap()))
+            .collect()
+    }
+
+    #[test]
+    fn receiver_delivers_in_order_and_nacks_gaps() {
+        let now = Instant::now();
+        let mut receiver = ReceiverState::new(String::from("/chatter"), PeerId::random(), 1);
+        assert_eq!(sequence_numbers(&receiver.receive(1, message(1))), [1]);
+        assert!(receiver.nack(now).is_none());
+
+        assert!(receiver.receive(4, message(4)).is_empty());
+        assert!(receiver.receive(3, message(3)).is_empty());
+        assert_eq!(receiver.nack(now), Some((2, 2)));
+        // One NACK outstanding at a time
+        assert_eq!(receiver.nack(now + NACK_TIMEOUT / 2), None);
+        assert_eq!(receiver.nack(now + NACK_TIMEOUT), Some((2, 2)));
+
+        assert_eq!(
+            sequence_numbers(&receiver.receive(2, message(2))),
+            [2, 3, 4]
+        );
+        assert!(receiver.receive(2, message(2)).is_empty());
+        assert!(receiver.nack(now + NACK_TIMEOUT * 2).is_none());
+        assert_eq!(receiver.ack(), Some(4));
+        assert_eq!(receiver.ack(), None);
+    }
+
+    #[test]
+    fn receiver_gives_up_on_unanswered_nacks() {
+        let mut now = Instant::now();
+        let mut receiver = ReceiverState::new(String::from("/chatter"), PeerId::random(), 1);
+        receiver.receive(1, message(1));
+        receiver.receive(4, message(4));
+        for _ in 0..MAX_NACK_RETRIES {
+            assert!(receiver.tick(now).is_empty());
+            assert_eq!(receiver.nack(now), Some((2, 3)));
+            now += NACK_TIMEOUT;
+        }
+        assert_eq!(sequence_numbers(&receiver.tick(now)), [4]);
+        assert!(receiver.nack(now).is_none());
+        assert_eq!(receiver.ack(), Some(4));
+
+        // A new gap gets the whole number of retries again
+        receiver.receive(6, message(6));
+        assert_eq!(receiver.nack(now), Some((5, 5)));
+        assert!(receiver.tick(now + NACK_TIMEOUT).is_empty());
+    }
+
+    #[test]
+    fn receiver_skips_gaps_it_cant_buffer() {
+        let mut receiver = ReceiverState::new(String::from("/chatter"), PeerId::random(), 1);
+        receiver.receive(1, message(1));
+        let first_pending = 3;
+        for sequence_number in first_pending..first_pending + MAX_PENDING_MESSAGES as u64 {
+            assert!(receiver
+                .receive(sequence_number, message(sequence_number))
+                .is_empty());
+        }
+        let last = first_pending + MAX_PENDING_MESSAGES as u64;
+        let delivered = receiver.receive(last, message(last));
+        assert_eq!(delivered.len(), MAX_PENDING_MESSAGES + 1);
+        assert_eq!(sequence_numbers(&delivered)[0], first_pending);
+        assert_eq!(receiver.ack(), Some(last));
+    }
+
+    #[test]
+    fn heartbeat_reveals_lost_last_messages() {
+        let now = Instant::now();
+        let mut receiver = ReceiverState::new(String::from("/chatter"), PeerId::random(), 1);
+        receiver.receive(1, message(1));
+        assert!(receiver.nack(now).is_none());
+
+        assert_eq!(receiver.heartbeat(3), 1);
+        assert_eq!(receiver.nack(now), Some((2, 3)));
+        assert!(!receiver.is_expired(now + RECEIVER_TIMEOUT));
+        assert_eq!(sequence_numbers(&receiver.receive(2, message(2))), [2]);
+        assert_eq!(sequence_numbers(&receiver.receive(3, message(3))), [3]);
+        assert!(receiver.nack(now + NACK_TIMEOUT).is_none());
+        assert_eq!(receiver.heartbeat(3), 3);
+        assert!(receiver.is_expired(Instant::now() + RECEIVER_TIMEOUT));
+    }
+
+    #[test]
+    fn register_waits_for_the_peers_already_subscribed() {
+        let histories = PublisherHistories::new();
+        let (gid, first, second) = (Uuid::new_v4(), PeerId::random(), PeerId::random());
+        let peers = [first, second];
+        histories.register(gid, String::from("/chatter"), 4, true, false, peers.iter());
+        let best_effort = Uuid::new_v4();
+        histories.register(
+            best_effort,
+            String::from("/chatter"),
+            4,
+            false,
+            true,
+            peers.iter(),
+        );
+        let no_wait = Some(Duration::ZERO);
+        assert!(histories.wait_for_all_acked(&gid, no_wait));
+
+        histories.push(&gid, 1, message(1));
+        histories.push(&best_effort, 1, message(1));
+        assert!(!histories.wait_for_all_acked(&gid, no_wait));
+        assert!(histories.wait_for_all_acked(&best_effort, no_wait));
+        histories.acknowledge(&gid, first, 1);
+        assert!(!histories.wait_for_all_acked(&gid, no_wait));
+        histories.acknowledge(&gid, second, 1);
+        assert!(histories.wait_for_all_acked(&gid, no_wait));
+
+        // Late joiners are waited for from the next message on
+        let late = PeerId::random();
+        histories.add_peer("/chatter", late);
+        assert!(histories.wait_for_all_acked(&gid, no_wait));
+        histories.push(&gid, 2, message(2));
+        histories.acknowledge(&gid, first, 2);
+        histories.acknowledge(&gid, second, 2);
+        assert!(!histories.wait_for_all_acked(&gid, no_wait));
+        histories.forget_peer(&gid, &late);
+        assert!(histories.wait_for_all_acked(&gid, no_wait));
+    }
+
+    #[test]
+    fn heartbeats_start_after_a_quiet_period() {
+        let histories = PublisherHistories::new();
+        let (gid, first, second) = (Uuid::new_v4(), PeerId::random(), PeerId::random());
+        histories.register(
+            gid,
+            String::from("/chatter"),
+            4,
+            true,
+            false,
+            [first, second].iter(),
+        );
+        let best_effort = Uuid::new_v4();
+        histories.register(
+            best_effort,
+            String::from("/chatter"),
+            4,
+            false,
+            true,
+            [first].iter(),
+        );
+        assert!(histories
+            .heartbeats(Instant::now() + HEARTBEAT_PERIOD)
+            .is_empty());
+
+        histories.push(&gid, 1, message(1));
+        histories.push(&gid, 2, message(2));
+        histories.push(&best_effort, 1, message(1));
+        histories.acknowledge(&gid, second, 2);
+        let published = Instant::now();
+        assert!(histories.heartbeats(published).is_empty());
+
+        let heartbeats = histories.heartbeats(published + HEARTBEAT_PERIOD);
+        assert_eq!(heartbeats.len(), 1);
+        match &heartbeats[0] {
+            (
+                peer,
+                ReliableRequest::Heartbeat {
+                    gid: heartbeat_gid,
+                    topic,
+                    first: 1,
+                    last: 2,
+                },
+            ) => {
+                assert_eq!(*peer, first);
+                assert_eq!(*heartbeat_gid, gid);
+                assert_eq!(topic, "/chatter");
+            }
+            heartbeat => panic!("unexpected heartbeat {:?}", heartbeat),
+        }
+        // Repeated every period until acknowledged
+        assert!(histories
+            .heartbeats(published + HEARTBEAT_PERIOD * 3 / 2)
+            .is_empty());
+        assert_eq!(
+            histories.heartbeats(published + HEARTBEAT_PERIOD * 2).len(),
+            1
+        );
+        histories.acknowledge(&gid, first, 2);
+        assert!(histories
+            .heartbeats(published + HEARTBEAT_PERIOD * 3)
+            .is_empty());
+    }
+
+    #[test]
+    fn requests_and_responses_round_trip() {
+        let gid = Uuid::new_v4();
+        let request = encode_request(&ReliableRequest::Heartbeat {
+            gid: gid,
+            topic: String::from("/chatter"),
+            first: 3,
+            last: 7,
+        });
+        match decode_request(&Bytes::from(request)).unwrap() {
+            ReliableRequest::Heartbeat {
+                gid: decoded_gid,
+                topic,
+                first: 3,
+                last: 7,
+            } => {
+                assert_eq!(decoded_gid, gid);
+                assert_eq!(topic, "/chatter");
+            }
+            request => panic!("unexpected request {:?}", request),
+        }
+        let response = encode_response(&ReliableResponse::Retransmit {
+            gid: gid,
+            first_available: 2,
+            messages: vec![message(2), message(3)],
+        });
+        match decode_response(&Bytes::from(response)).unwrap() {
+            ReliableResponse::Retransmit {
+                first_available: 2,
+                messages,
+                ..
+            } => assert_eq!(sequence_numbers(&messages), [2, 3]),
+            response => panic!("unexpected response {:?}", response),
+        }
+        let mut truncated = encode_request(&ReliableRequest::Nack {
+            gid: gid,
+            first: 1,
+            last: 2,
+        });
+        truncated.pop();
+        assert!(decode_request(&Bytes::from(truncated)).is_err());
+    }
+
+    /// The reliability work of one second of a 1 kHz reliable topic with 64 byte messages and
+    /// one subscriber, on top of what a best effort publication costs: the history, in order
+    /// delivery, the ACKs every tick and the heartbeat checks. It must stay under 10% of a core.
+    ///
+    /// Run with `cargo test --release -- --ignored --nocapture reliable_1khz`.
+    #[test]
+    #[ignore]
+    fn reliable_1khz_overhead() {
+        const RATE: u64 = 1000;
+        const MESSAGES_PER_TICK: u64 = 20;
+        let payload = [0u8; 64];
+        let gid = Uuid::new_v4();
+        let subscriber = PeerId::random();
+        let histories = PublisherHistories::new();
+        histories.register(
+            gid,
+            String::from("/cmd_vel"),
+            10,
+            true,
+            false,
+            [subscriber].iter(),
+        );
+        let mut receiver = ReceiverState::new(String::from("/cmd_vel"), PeerId::random(), 1);
+
+        let publish = |flags: u8, sequence_number: u64| {
+            let header = MessageHeader::new(flags, ENCODING_CDR, 0, sequence_number, gid, 0);
+            let mut buffer = Vec::with_capacity(HEADER_SIZE + payload.len());
+            header.encode(&mut buffer);
+            buffer.extend_from_slice(&payload);
+            Bytes::from(buffer)
+        };
+
+        let start = Instant::now();
+        for sequence_number in 1..=RATE {
+            let message = publish(0, sequence_number);
+            std::hint::black_box(MessageHeader::decode(&message));
+        }
+        let best_effort = start.elapsed();
+
+        let start = Instant::now();
+        for sequence_number in 1..=RATE {
+            let message = publish(FLAG_RELIABLE, sequence_number);
+            histories.push(&gid, sequence_number, message.clone());
+            let header = MessageHeader::decode(&message).unwrap();
+            std::hint::black_box(receiver.receive(header.sequence_number, message));
+            if sequence_number % MESSAGES_PER_TICK == 0 {
+                let now = Instant::now();
+                std::hint::black_box(receiver.tick(now));
+                std::hint::black_box(receiver.nack(now));
+                if let Some(acked) = receiver.ack() {
+                    let request = encode_request(&ReliableRequest::Ack {
+                        gid: gid,
+                        sequence_number: acked,
+                    });
+                    if let ReliableRequest::Ack {
+                        gid,
+                        sequence_number,
+                    } = decode_request(&Bytes::from(request)).unwrap()
+                    {
+                        histories.acknowledge(&gid, subscriber, sequence_number);
+                    }
+                }
+                std::hint::black_box(histories.heartbeats(now));
+            }
+        }
+        let reliable = start.elapsed();
+
+        let overhead = reliable.saturating_sub(best_effort);
+        println!(
+            "1 s at {} Hz: best effort {:?}, reliable {:?}, overhead {:.3}% of a core",
+            RATE,
+            best_effort,
+            reliable,
+            overhead.as_secs_f64() * 100.0
+        );
+        assert!(histories.wait_for_all_acked(&gid, Some(Duration::ZERO)));
+        assert!(overhead < Duration::from_millis(100));
+    }
+}
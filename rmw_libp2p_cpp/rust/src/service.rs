@@ -0,0 +1,1098 @@
+// Copyright 2024 Esteve Fernandez
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! ROS services on top of a request-response protocol.
+//!
+//! Servers advertise themselves by subscribing to the gossipsub topic `rq<service name>`, so that
+//! clients know which peers serve a service without any extra discovery traffic. Nothing is ever
+//! published on that topic: requests are sent directly to the serving peer, and the response
+//! comes back on the same substream. Connections between two peers are shared by every service,
+//! client, publisher and subscription, yamux multiplexes a short-lived substream per request over
+//! them.
+//!
+//! The servers known to each node are kept in a `ServerDirectory`, so that checking whether a
+//! service is available never touches the network. When several peers serve the same service,
+//! each request goes to one of them, chosen by the routing policy of its client: the nearest
+//! server by measured round-trip time, the server with the fewest outstanding requests, or a
+//! consistent hash of the client GID, which keeps every request of a client on the same server.
+//!
+//! Requests are matched with their responses by the GID of the client and a sequence number
+//! assigned by the client, starting at 1. Servers and clients of the same node talk to each other
+//! directly, without going through the network.
+//!
+//! Requests are pipelined: clients never wait for a response before sending the next request,
+//! and servers may answer them in any order. Each node keeps up to `MAX_IN_FLIGHT_REQUESTS`
+//! requests outstanding per server peer, the rest wait in the client node until responses come
+//! back, see `ServerWindows`. Servers accept up to `MAX_PENDING_REQUESTS` unanswered requests
+//! per service, so that a slow service can't take all the memory of its node, see
+//! `PendingResponses`.
+
+use crate::reliability::{get_bytes, get_gid, get_string, get_u64, put_bytes, MAX_MESSAGE_SIZE};
+use crate::{
+    CustomClientHandle, CustomNodeHandle, CustomServiceHandle, Libp2pCustomNode, ServiceCallback,
+};
+
+use std::collections::hash_map::DefaultHasher;
+use std::collections::{HashMap, HashSet, VecDeque};
+use std::ffi::{c_void, CStr, CString};
+use std::hash::{Hash, Hasher};
+use std::io;
+use std::io::Cursor;
+use std::os::raw::c_char;
+use std::sync::atomic::{AtomicI64, Ordering};
+use std::time::Duration;
+
+use async_trait::async_trait;
+use libp2p::core::upgrade::{read_length_prefixed, write_length_prefixed};
+use libp2p::core::ProtocolName;
+use libp2p::futures::{AsyncRead, AsyncWrite, AsyncWriteExt};
+use libp2p::{gossipsub, request_response, PeerId};
+
+use uuid::Uuid;
+
+/// Time a client waits for the response of a remote server, service callbacks may take a while
+pub(crate) const REQUEST_TIMEOUT: Duration = Duration::from_secs(60);
+
+/// Requests a node sends to a server peer before waiting for responses
+const MAX_IN_FLIGHT_REQUESTS: usize = 64;
+/// Unanswered requests of remote clients a service accepts, the next ones are refused
+const MAX_PENDING_REQUESTS: usize = 4096;
+
+/// Send each request to the server with the lowest round-trip time.
+pub const ROUTING_NEAREST: u8 = 0;
+/// Send each request to the server with the fewest requests outstanding from this node.
+pub const ROUTING_LEAST_LOADED: u8 = 1;
+/// Send all the requests of a client to the same server, chosen by hashing the client GID.
+pub const ROUTING_HASH: u8 = 2;
+
+/// Gossipsub topic the servers of a service subscribe to, to advertise themselves.
+pub(crate) fn service_topic(service_name: &str) -> gossipsub::IdentTopic {
+    gossipsub::IdentTopic::new(format!("rq{}", service_name))
+}
+
+/// Name of the service advertised by a gossipsub topic, if it is a service topic.
+pub(crate) fn service_name(topic: &str) -> Option<&str> {
+    topic.strip_prefix("rq")
+}
+
+/// Called with the name of a service and whether it has become available or unavailable.
+pub(crate) type AvailabilityCallback = unsafe extern "C" fn(&CustomNodeHandle, *const c_char, bool);
+
+#[derive(Default)]
+struct ServerEntry {
+    // Servers of this node
+    local: usize,
+    // Remote peers advertising the service
+    peers: HashSet<PeerId>,
+}
+
+impl ServerEntry {
+    fn is_available(&self) -> bool {
+        self.local > 0 || !self.peers.is_empty()
+    }
+}
+
+/// Servers known to a node for each service, keyed by the service name.
+///
+/// Fed by the local servers and by the subscriptions of the remote peers to the service topics,
+/// and cleaned up when a peer disconnects. Availability changes are reported to the callback,
+/// under the lock, so the RMW can wake up the waiters of the graph guard condition instead of
+/// polling.
+#[derive(Default)]
+pub(crate) struct ServerDirectory {
+    services: HashMap<String, ServerEntry>,
+    // Smoothed round-trip time of the connected peers, measured by ping
+    rtts: HashMap<PeerId, Duration>,
+    callback: Option<(CustomNodeHandle, AvailabilityCallback)>,
+}
+
+/// Rendezvous hashing weight of a server for a client, the server with the highest weight gets
+/// its requests. Only the clients of a server that goes away move to another one.
+fn rendezvous_weight(client_gid: &Uuid, peer: &PeerId) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    client_gid.hash(&mut hasher);
+    peer.hash(&mut hasher);
+    hasher.finish()
+}
+
+impl ServerDirectory {
+    pub(crate) fn set_callback(&mut self, callback: Option<(CustomNodeHandle, AvailabilityCallback)>) -> () {
+        self.callback = callback;
+    }
+
+    pub(crate) fn is_available(&self, service_name: &str) -> bool {
+        self.services
+            .get(service_name)
+            .map_or(false, |entry| entry.is_available())
+    }
+
+    /// Remote peer to send a request of a client to, following the routing policy of the client,
+    /// one of the `ROUTING_*` constants. Used when no server lives in this node.
+    ///
+    /// `load` returns the number of requests this node has outstanding with a peer. Peers whose
+    /// round-trip time hasn't been measured yet are considered the farthest.
+    pub(crate) fn remote_server<F: Fn(&PeerId) -> usize>(
+        &self,
+        service_name: &str,
+        routing: u8,
+        client_gid: &Uuid,
+        load: F,
+    ) -> Option<PeerId> {
+        let peers = &self.services.get(service_name)?.peers;
+        let rtt = |peer: &PeerId| self.rtts.get(peer).cloned().unwrap_or(Duration::MAX);
+        match routing {
+            ROUTING_LEAST_LOADED => peers.iter().min_by_key(|peer| (load(peer), rtt(peer))),
+            ROUTING_HASH => peers
+                .iter()
+                .max_by_key(|peer| rendezvous_weight(client_gid, peer)),
+            _ => peers.iter().min_by_key(|peer| (rtt(peer), load(peer))),
+        }
+        .cloned()
+    }
+
+    /// Records a round-trip time sample of a peer, smoothed like TCP does.
+    pub(crate) fn record_rtt(&mut self, peer: PeerId, sample: Duration) -> () {
+        self.rtts
+            .entry(peer)
+            .and_modify(|rtt| *rtt = (*rtt * 7 + sample) / 8)
+            .or_insert(sample);
+    }
+
+    pub(crate) fn add_local(&mut self, service_name: &str) -> () {
+        self.update(service_name, |entry| entry.local += 1);
+    }
+
+    pub(crate) fn remove_local(&mut self, service_name: &str) -> () {
+        self.update(service_name, |entry| entry.local = entry.local.saturating_sub(1));
+    }
+
+    pub(crate) fn add_peer(&mut self, service_name: &str, peer: PeerId) -> () {
+        self.update(service_name, |entry| {
+            entry.peers.insert(peer);
+        });
+    }
+
+    pub(crate) fn remove_peer(&mut self, service_name: &str, peer: &PeerId) -> () {
+        self.update(service_name, |entry| {
+            entry.peers.remove(peer);
+        });
+    }
+
+    pub(crate) fn peer_disconnected(&mut self, peer: &PeerId) -> () {
+        self.rtts.remove(peer);
+        let service_names: Vec<String> = self
+            .services
+            .iter()
+            .filter(|(_, entry)| entry.peers.contains(peer))
+            .map(|(service_name, _)| service_name.clone())
+            .collect();
+        for service_name in service_names {
+            self.remove_peer(&service_name, peer);
+        }
+    }
+
+    fn update<F: FnOnce(&mut ServerEntry)>(&mut self, service_name: &str, f: F) -> () {
+        let entry = self.services.entry(service_name.to_string()).or_default();
+        let was_available = entry.is_available();
+        f(entry);
+        let available = entry.is_available();
+        if !available {
+            self.services.remove(service_name);
+        }
+        if available != was_available {
+            if let Some((obj, callback)) = self.callback.as_ref() {
+                let service_name = CString::new(service_name).unwrap();
+                unsafe {
+                    callback(obj, service_name.as_ptr(), available);
+                }
+            }
+        }
+    }
+}
+
+#[derive(Debug, Clone)]
+pub(crate) struct ServiceProtocol();
+
+impl ProtocolName for ServiceProtocol {
+    fn protocol_name(&self) -> &[u8] {
+        b"/rmw_libp2p/service/1.0.0"
+    }
+}
+
+#[derive(Debug)]
+pub(crate) struct ServiceRequest {
+    pub service_name: String,
+    pub client_gid: Uuid,
+    pub sequence_number: i64,
+    pub payload: Vec<u8>,
+}
+
+#[derive(Debug)]
+pub(crate) struct ServiceResponse {
+    pub client_gid: Uuid,
+    pub sequence_number: i64,
+    pub payload: Vec<u8>,
+}
+
+fn encode_request(request: &ServiceRequest) -> Vec<u8> {
+    let mut data = Vec::with_capacity(40 + request.service_name.len() + request.payload.len());
+    data.extend_from_slice(request.client_gid.as_bytes());
+    data.extend_from_slice(&request.sequence_number.to_le_bytes());
+    put_bytes(&mut data, request.service_name.as_bytes());
+    put_bytes(&mut data, &request.payload);
+    data
+}
+
+fn decode_request(data: &[u8]) -> io::Result<ServiceRequest> {
+    let mut offset = 24;
+    Ok(ServiceRequest {
+        client_gid: get_gid(data, 0)?,
+        sequence_number: get_u64(data, 16)? as i64,
+        service_name: get_string(data, &mut offset)?,
+        payload: get_bytes(data, &mut offset)?,
+    })
+}
+
+fn encode_response(response: &ServiceResponse) -> Vec<u8> {
+    let mut data = Vec::with_capacity(32 + response.payload.len());
+    data.extend_from_slice(response.client_gid.as_bytes());
+    data.extend_from_slice(&response.sequence_number.to_le_bytes());
+    put_bytes(&mut data, &response.payload);
+    data
+}
+
+fn decode_response(data: &[u8]) -> io::Result<ServiceResponse> {
+    let mut offset = 24;
+    Ok(ServiceResponse {
+        client_gid: get_gid(data, 0)?,
+        sequence_number: get_u64(data, 16)? as i64,
+        payload: get_bytes(data, &mut offset)?,
+    })
+}
+
+#[derive(Clone)]
+pub(crate) struct ServiceCodec();
+
+#[async_trait]
+impl request_response::Codec for ServiceCodec {
+    type Protocol = ServiceProtocol;
+    type Request = ServiceRequest;
+    type Response = ServiceResponse;
+
+    async fn read_request<T>(&mut self, _: &ServiceProtocol, io: &mut T) -> io::Result<ServiceRequest>
+    where
+        T: AsyncRead + Unpin + Send,
+    {
+        let data = read_length_prefixed(io, MAX_MESSAGE_SIZE).await?;
+        decode_request(&data)
+    }
+
+    async fn read_response<T>(&mut self, _: &ServiceProtocol, io: &mut T) -> io::Result<ServiceResponse>
+    where
+        T: AsyncRead + Unpin + Send,
+    {
+        let data = read_length_prefixed(io, MAX_MESSAGE_SIZE).await?;
+        decode_response(&data)
+    }
+
+    async fn write_request<T>(
+        &mut self,
+        _: &ServiceProtocol,
+        io: &mut T,
+        request: ServiceRequest,
+    ) -> io::Result<()>
+    where
+        T: AsyncWrite + Unpin + Send,
+    {
+        write_length_prefixed(io, encode_request(&request)).await?;
+        io.close().await
+    }
+
+    async fn write_response<T>(
+        &mut self,
+        _: &ServiceProtocol,
+        io: &mut T,
+        response: ServiceResponse,
+    ) -> io::Result<()>
+    where
+        T: AsyncWrite + Unpin + Send,
+    {
+        write_length_prefixed(io, encode_response(&response)).await?;
+        io.close().await
+    }
+}
+
+#[derive(Default)]
+struct ServerWindow {
+    in_flight: usize,
+    waiting: VecDeque<ServiceRequest>,
+}
+
+/// Requests sent to each server peer and not answered yet.
+///
+/// Only `MAX_IN_FLIGHT_REQUESTS` requests are outstanding at a time per server peer, the next
+/// ones are queued until a response or a failure frees a slot. This keeps the pipeline full
+/// without flooding a server with more substreams than it can serve.
+#[derive(Default)]
+pub(crate) struct ServerWindows {
+    peers: HashMap<PeerId, ServerWindow>,
+}
+
+impl ServerWindows {
+    /// Returns the request back if it can be sent to `peer` right away, queues it otherwise.
+    pub(crate) fn admit(&mut self, peer: PeerId, request: ServiceRequest) -> Option<ServiceRequest> {
+        let window = self.peers.entry(peer).or_default();
+        if window.in_flight < MAX_IN_FLIGHT_REQUESTS {
+            window.in_flight += 1;
+            Some(request)
+        } else {
+            window.waiting.push_back(request);
+            None
+        }
+    }
+
+    /// A request sent to `peer` was answered or failed, returns the next one to send, if any.
+    pub(crate) fn complete(&mut self, peer: &PeerId) -> Option<ServiceRequest> {
+        let window = self.peers.get_mut(peer)?;
+        match window.waiting.pop_front() {
+            Some(request) => Some(request),
+            None => {
+                window.in_flight = window.in_flight.saturating_sub(1);
+                if window.in_flight == 0 {
+                    self.peers.remove(peer);
+                }
+                None
+            }
+        }
+    }
+
+    /// Requests sent to `peer` and not answered yet, plus the ones waiting to be sent.
+    pub(crate) fn load(&self, peer: &PeerId) -> usize {
+        self.peers
+            .get(peer)
+            .map_or(0, |window| window.in_flight + window.waiting.len())
+    }
+
+    /// Forgets a disconnected peer, the requests waiting for it are dropped.
+    ///
+    /// Their clients are not told, the same as for requests sent while no server is available:
+    /// the ROS client never gets a response and its caller has to time out. The failures of the
+    /// requests that were in flight find no window afterwards, `complete` ignores them.
+    pub(crate) fn remove_peer(&mut self, peer: &PeerId) -> () {
+        self.peers.remove(peer);
+    }
+}
+
+/// Requests of remote clients waiting for a local server to respond, keyed by the client GID
+/// and the sequence number.
+#[derive(Default)]
+pub(crate) struct PendingResponses {
+    channels: HashMap<(Uuid, i64), (String, request_response::ResponseChannel<ServiceResponse>)>,
+    // Number of entries of `channels` for each service
+    counts: HashMap<String, usize>,
+}
+
+impl PendingResponses {
+    /// Keeps the channel of a request to a service, unless the service has too many unanswered
+    /// requests already. Returns false in that case, dropping the channel fails the request.
+    pub(crate) fn insert(
+        &mut self,
+        request: &ServiceRequest,
+        channel: request_response::ResponseChannel<ServiceResponse>,
+    ) -> bool {
+        let count = self.counts.entry(request.service_name.clone()).or_insert(0);
+        if *count >= MAX_PENDING_REQUESTS {
+            return false;
+        }
+        *count += 1;
+        let key = (request.client_gid, request.sequence_number);
+        if let Some((service_name, _)) = self
+            .channels
+            .insert(key, (request.service_name.clone(), channel))
+        {
+            // A retransmitted request replaces the previous one
+            self.release(&service_name);
+        }
+        true
+    }
+
+    pub(crate) fn remove(
+        &mut self,
+        client_gid: &Uuid,
+        sequence_number: i64,
+    ) -> Option<request_response::ResponseChannel<ServiceResponse>> {
+        let (service_name, channel) = self.channels.remove(&(*client_gid, sequence_number))?;
+        self.release(&service_name);
+        Some(channel)
+    }
+
+    /// Drops the requests whose client gave up or disconnected, they can't be answered anymore.
+    pub(crate) fn retain_open(&mut self) -> () {
+        let counts = &mut self.counts;
+        self.channels.retain(|_, (service_name, channel)| {
+            let open = channel.is_open();
+            if !open {
+                if let Some(count) = counts.get_mut(service_name.as_str()) {
+                    *count -= 1;
+                }
+            }
+            open
+        });
+        self.counts.retain(|_, count| *count > 0);
+    }
+
+    fn release(&mut self, service_name: &str) -> () {
+        if let Some(count) = self.counts.get_mut(service_name) {
+            *count -= 1;
+            if *count == 0 {
+                self.counts.remove(service_name);
+            }
+        }
+    }
+}
+
+/// Represents the server of a ROS service.
+pub struct Libp2pCustomService {
+    gid: Uuid,
+    node: *mut Libp2pCustomNode,
+    service_name: String,
+    obj_ptr: *const c_void,
+}
+
+impl Drop for Libp2pCustomService {
+    /// Unregisters the service from the node.
+    ///
+    /// Once this returns, the callback will not be called anymore for this service.
+    fn drop(&mut self) {
+        let libp2p2_custom_node = unsafe {
+            assert!(!self.node.is_null());
+            &mut *self.node
+        };
+        libp2p2_custom_node.remove_service(&self.service_name, self.obj_ptr);
+    }
+}
+
+/// Represents the client of a ROS service.
+pub struct Libp2pCustomClient {
+    gid: Uuid,
+    node: *mut Libp2pCustomNode,
+    service_name: String,
+    // Server selection policy, one of the `ROUTING_*` constants
+    routing: u8,
+    // Sequence number of the last request sent, the first one is 1
+    sequence_number: AtomicI64,
+}
+
+impl Drop for Libp2pCustomClient {
+    /// Unregisters the client from the node.
+    ///
+    /// Once this returns, the callback will not be called anymore for this client.
+    fn drop(&mut self) {
+        let libp2p2_custom_node = unsafe {
+            assert!(!self.node.is_null());
+            &mut *self.node
+        };
+        libp2p2_custom_node.remove_client(&self.gid);
+    }
+}
+
+fn buffer_to_vec(ptr_buffer: *const Cursor<Vec<u8>>) -> Vec<u8> {
+    let buffer = unsafe {
+        assert!(!ptr_buffer.is_null());
+        &*ptr_buffer
+    };
+    buffer.get_ref().to_vec()
+}
+
+/// Creates a new `Libp2pCustomService`.
+///
+/// The service starts receiving the requests sent by clients to `service_name`, both from this
+/// node and from remote peers.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_node` - A raw pointer to a `Libp2pCustomNode`.
+/// * `service_name_ptr` - A raw pointer to a C string representing the service name.
+/// * `obj` - A `CustomServiceHandle` passed to the callback.
+/// * `callback` - A callback function called with the GID of the client, the sequence number
+///   and the payload of every request. The payload is owned by the receiver, which must release
+///   it with `rs_libp2p_message_free`.
+///
+/// # Returns
+///
+/// A raw pointer to a `Libp2pCustomService`.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_node` or `service_name_ptr` is null, or if the latter does
+/// not point to a valid null-terminated string.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_service_new(
+    ptr_node: *mut Libp2pCustomNode,
+    service_name_ptr: *const c_char,
+    obj: CustomServiceHandle,
+    callback: ServiceCallback<CustomServiceHandle>,
+) -> *mut Libp2pCustomService {
+    let libp2p2_custom_node = unsafe {
+        assert!(!ptr_node.is_null());
+        &mut *ptr_node
+    };
+    let service_name = unsafe {
+        assert!(!service_name_ptr.is_null());
+        CStr::from_ptr(service_name_ptr)
+    }
+    .to_str()
+    .unwrap()
+    .to_string();
+
+    let obj_ptr = obj.ptr;
+    libp2p2_custom_node.register_service(&service_name, obj, callback);
+    Box::into_raw(Box::new(Libp2pCustomService {
+        gid: Uuid::new_v4(),
+        node: ptr_node,
+        service_name: service_name,
+        obj_ptr: obj_ptr,
+    }))
+}
+
+/// Frees a `Libp2pCustomService` from memory.
+///
+/// Requests that have not been answered yet are dropped, their clients never get a response.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr_service` - A raw pointer to a `Libp2pCustomService`.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_service_free(ptr_service: *mut Libp2pCustomService) {
+    if ptr_service.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(ptr_service) };
+}
+
+/// Gets the GID of a `Libp2pCustomService`.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_service` - A raw pointer to a `Libp2pCustomService`.
+/// * `buf` - A raw pointer to a buffer where the GID bytes will be copied.
+///
+/// # Returns
+///
+/// The number of bytes copied into the buffer.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_service` is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_service_get_gid(
+    ptr_service: *mut Libp2pCustomService,
+    buf: *mut std::os::raw::c_uchar,
+) -> usize {
+    let libp2p2_custom_service = unsafe {
+        assert!(!ptr_service.is_null());
+        &*ptr_service
+    };
+    let gid_bytes = libp2p2_custom_service.gid.as_bytes();
+    let count = gid_bytes.len();
+    unsafe {
+        std::ptr::copy_nonoverlapping(gid_bytes.as_ptr(), buf as *mut u8, count);
+    }
+    count
+}
+
+/// Sends the response to a request received by a `Libp2pCustomService`.
+///
+/// The response is routed back to the peer the request came from, or handed directly to the
+/// client if it lives in the same node. Responses to clients that are gone are dropped.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_service` - A raw pointer to a `Libp2pCustomService`.
+/// * `client_gid_ptr` - A raw pointer to the 16 bytes of the GID of the client, as passed to the
+///   service callback.
+/// * `sequence_number` - The sequence number of the request, as passed to the service callback.
+/// * `ptr_buffer` - A raw pointer to the buffer containing the serialized response.
+///
+/// # Returns
+///
+/// 0 if the response was queued.
+///
+/// # Panics
+///
+/// This function will panic if any of the pointers is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_service_send_response(
+    ptr_service: *mut Libp2pCustomService,
+    client_gid_ptr: *const u8,
+    sequence_number: i64,
+    ptr_buffer: *const Cursor<Vec<u8>>,
+) -> usize {
+    let libp2p2_custom_service = unsafe {
+        assert!(!ptr_service.is_null());
+        &*ptr_service
+    };
+    let client_gid = unsafe {
+        assert!(!client_gid_ptr.is_null());
+        Uuid::from_slice(std::slice::from_raw_parts(client_gid_ptr, 16)).unwrap()
+    };
+    let libp2p2_custom_node = unsafe {
+        assert!(!libp2p2_custom_service.node.is_null());
+        &mut *libp2p2_custom_service.node
+    };
+    libp2p2_custom_node.send_response(ServiceResponse {
+        client_gid: client_gid,
+        sequence_number: sequence_number,
+        payload: buffer_to_vec(ptr_buffer),
+    });
+    0
+}
+
+/// Creates a new `Libp2pCustomClient`.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_node` - A raw pointer to a `Libp2pCustomNode`.
+/// * `service_name_ptr` - A raw pointer to a C string representing the service name.
+/// * `obj` - A `CustomClientHandle` passed to the callback.
+/// * `callback` - A callback function called with the GID of the client, the sequence number of
+///   the request and the payload of every response. The payload is owned by the receiver, which
+///   must release it with `rs_libp2p_message_free`.
+/// * `routing` - How a server is chosen when several peers serve the service: 0 for the nearest,
+///   1 for the least loaded and 2 for a hash of the client GID, see the `ROUTING_*` constants.
+///
+/// # Returns
+///
+/// A raw pointer to a `Libp2pCustomClient`.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_node` or `service_name_ptr` is null, or if the latter does
+/// not point to a valid null-terminated string.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_client_new(
+    ptr_node: *mut Libp2pCustomNode,
+    service_name_ptr: *const c_char,
+    obj: CustomClientHandle,
+    callback: ServiceCallback<CustomClientHandle>,
+    routing: u8,
+) -> *mut Libp2pCustomClient {
+    let libp2p2_custom_node = unsafe {
+        assert!(!ptr_node.is_null());
+        &mut *ptr_node
+    };
+    let service_name = unsafe {
+        assert!(!service_name_ptr.is_null());
+        CStr::from_ptr(service_name_ptr)
+    }
+    .to_str()
+    .unwrap()
+    .to_string();
+
+    let gid = Uuid::new_v4();
+    libp2p2_custom_node.register_client(gid, obj, callback);
+    Box::into_raw(Box::new(Libp2pCustomClient {
+        gid: gid,
+        node: ptr_node,
+        service_name: service_name,
+        routing: routing,
+        sequence_number: AtomicI64::new(0),
+    }))
+}
+
+/// Frees a `Libp2pCustomClient` from memory.
+///
+/// Responses to the pending requests of the client are dropped.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr_client` - A raw pointer to a `Libp2pCustomClient`.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_client_free(ptr_client: *mut Libp2pCustomClient) {
+    if ptr_client.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(ptr_client) };
+}
+
+/// Gets the GID of a `Libp2pCustomClient`.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_client` - A raw pointer to a `Libp2pCustomClient`.
+/// * `buf` - A raw pointer to a buffer where the GID bytes will be copied.
+///
+/// # Returns
+///
+/// The number of bytes copied into the buffer.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_client` is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_client_get_gid(
+    ptr_client: *mut Libp2pCustomClient,
+    buf: *mut std::os::raw::c_uchar,
+) -> usize {
+    let libp2p2_custom_client = unsafe {
+        assert!(!ptr_client.is_null());
+        &*ptr_client
+    };
+    let gid_bytes = libp2p2_custom_client.gid.as_bytes();
+    let count = gid_bytes.len();
+    unsafe {
+        std::ptr::copy_nonoverlapping(gid_bytes.as_ptr(), buf as *mut u8, count);
+    }
+    count
+}
+
+/// Sends a request to the server of the service of a `Libp2pCustomClient`.
+///
+/// The request is handed directly to a server of the same node if there is one, or sent to a
+/// remote peer serving the service otherwise. Requests sent while no server is available are
+/// dropped, see `rs_libp2p_custom_client_server_available`. So are the requests sent to a peer
+/// that disconnects before answering them, whether they were in flight or still queued in the
+/// node: the client gets neither a response nor an error, callers have to time out.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers and calls unsafe functions.
+///
+/// # Arguments
+///
+/// * `ptr_client` - A raw pointer to a `Libp2pCustomClient`.
+/// * `ptr_buffer` - A raw pointer to the buffer containing the serialized request.
+///
+/// # Returns
+///
+/// The sequence number of the request, which its response will carry.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_client` or `ptr_buffer` is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_client_send_request(
+    ptr_client: *mut Libp2pCustomClient,
+    ptr_buffer: *const Cursor<Vec<u8>>,
+) -> i64 {
+    let libp2p2_custom_client = unsafe {
+        assert!(!ptr_client.is_null());
+        &*ptr_client
+    };
+    let libp2p2_custom_node = unsafe {
+        assert!(!libp2p2_custom_client.node.is_null());
+        &mut *libp2p2_custom_client.node
+    };
+    let sequence_number = libp2p2_custom_client
+        .sequence_number
+        .fetch_add(1, Ordering::Relaxed)
+        + 1;
+    libp2p2_custom_node.send_request(
+        ServiceRequest {
+            service_name: libp2p2_custom_client.service_name.clone(),
+            client_gid: libp2p2_custom_client.gid,
+            sequence_number: sequence_number,
+            payload: buffer_to_vec(ptr_buffer),
+        },
+        libp2p2_custom_client.routing,
+    );
+    sequence_number
+}
+
+/// Checks whether a server of the service of a `Libp2pCustomClient` is available, either in the
+/// same node or in a connected peer.
+///
+/// This is a lookup in the servers known to the node, it never touches the network.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr_client` - A raw pointer to a `Libp2pCustomClient`.
+///
+/// # Panics
+///
+/// This function will panic if `ptr_client` is null.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_custom_client_server_available(
+    ptr_client: *mut Libp2pCustomClient,
+) -> bool {
+    let libp2p2_custom_client = unsafe {
+        assert!(!ptr_client.is_null());
+        &*ptr_client
+    };
+    let libp2p2_custom_node = unsafe {
+        assert!(!libp2p2_custom_client.node.is_null());
+        &*libp2p2_custom_client.node
+    };
+    libp2p2_custom_node.server_available(&libp2p2_custom_client.service_name)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::time::Instant;
+
+    use libp2p::futures::io::Cursor as AsyncCursor;
+    use libp2p::futures::StreamExt;
+    use libp2p::request_response::Codec;
+    use libp2p::swarm::SwarmEvent;
+    use libp2p::{identity, Multiaddr, Swarm};
+
+    fn request(sequence_number: i64) -> ServiceRequest {
+        ServiceRequest {
+            service_name: String::from("/add_two_ints"),
+            client_gid: Uuid::new_v4(),
+            sequence_number: sequence_number,
+            payload: vec![7u8; 24],
+        }
+    }
+
+    #[test]
+    fn requests_and_responses_round_trip() {
+        let runtime = tokio::runtime::Builder::new_current_thread()
+            .build()
+            .unwrap();
+        runtime.block_on(async {
+            let mut codec = ServiceCodec();
+            let mut io = AsyncCursor::new(Vec::new());
+            codec
+                .write_request(&ServiceProtocol(), &mut io, request(-3))
+                .await
+                .unwrap();
+            io.set_position(0);
+            let received = codec
+                .read_request(&ServiceProtocol(), &mut io)
+                .await
+                .unwrap();
+            assert_eq!(received.service_name, "/add_two_ints");
+            assert_eq!(received.sequence_number, -3);
+            assert_eq!(received.payload, [7u8; 24]);
+
+            let mut io = AsyncCursor::new(Vec::new());
+            codec
+                .write_response(
+                    &ServiceProtocol(),
+                    &mut io,
+                    ServiceResponse {
+                        client_gid: received.client_gid,
+                        sequence_number: received.sequence_number,
+                        payload: Vec::new(),
+                    },
+                )
+                .await
+                .unwrap();
+            io.set_position(0);
+            let response = codec
+                .read_response(&ServiceProtocol(), &mut io)
+                .await
+                .unwrap();
+            assert_eq!(response.client_gid, received.client_gid);
+            assert_eq!(response.sequence_number, -3);
+            assert!(response.payload.is_empty());
+        });
+    }
+
+    #[test]
+    fn truncated_requests_and_responses_are_rejected() {
+        let request_data = encode_request(&request(1));
+        let response_data = encode_response(&ServiceResponse {
+            client_gid: Uuid::new_v4(),
+            sequence_number: 1,
+            payload: vec![7u8; 24],
+        });
+        assert!(decode_request(&request_data).is_ok());
+        assert!(decode_response(&response_data).is_ok());
+        for length in 0..request_data.len() {
+            assert!(decode_request(&request_data[..length]).is_err());
+        }
+        for length in 0..response_data.len() {
+            assert!(decode_response(&response_data[..length]).is_err());
+        }
+    }
+
+    #[test]
+    fn server_windows_queue_requests_beyond_the_window() {
+        let mut windows = ServerWindows::default();
+        let peer = PeerId::random();
+        for sequence_number in 1..=MAX_IN_FLIGHT_REQUESTS as i64 {
+            assert!(windows.admit(peer, request(sequence_number)).is_some());
+        }
+        let queued = MAX_IN_FLIGHT_REQUESTS as i64 + 1;
+        assert!(windows.admit(peer, request(queued)).is_none());
+        assert!(windows.admit(peer, request(queued + 1)).is_none());
+        assert_eq!(windows.load(&peer), MAX_IN_FLIGHT_REQUESTS + 2);
+
+        // Other peers have windows of their own
+        let other = PeerId::random();
+        assert!(windows.admit(other, request(1)).is_some());
+        assert_eq!(windows.load(&other), 1);
+
+        // Each completion hands over its slot to the oldest queued request
+        assert_eq!(windows.complete(&peer).unwrap().sequence_number, queued);
+        assert_eq!(windows.complete(&peer).unwrap().sequence_number, queued + 1);
+        assert_eq!(windows.load(&peer), MAX_IN_FLIGHT_REQUESTS);
+        assert!(windows.complete(&peer).is_none());
+        assert_eq!(windows.load(&peer), MAX_IN_FLIGHT_REQUESTS - 1);
+    }
+
+    #[test]
+    fn server_windows_forget_idle_and_removed_peers() {
+        let mut windows = ServerWindows::default();
+        let peer = PeerId::random();
+        assert!(windows.admit(peer, request(1)).is_some());
+        assert!(windows.complete(&peer).is_none());
+        assert_eq!(windows.load(&peer), 0);
+        assert!(windows.peers.is_empty());
+        assert!(windows.complete(&peer).is_none());
+
+        for sequence_number in 1..=MAX_IN_FLIGHT_REQUESTS as i64 + 2 {
+            windows.admit(peer, request(sequence_number));
+        }
+        windows.remove_peer(&peer);
+        assert_eq!(windows.load(&peer), 0);
+        // Neither the failures of the requests in flight nor the queued requests come back
+        assert!(windows.complete(&peer).is_none());
+        assert!(windows.admit(peer, request(1)).is_some());
+        assert_eq!(windows.load(&peer), 1);
+    }
+
+    fn swarm() -> Swarm<request_response::Behaviour<ServiceCodec>> {
+        let keypair = identity::Keypair::generate_ed25519();
+        let peer_id = PeerId::from(keypair.public());
+        let transport = libp2p::tokio_development_transport(keypair).unwrap();
+        let behaviour = request_response::Behaviour::new(
+            ServiceCodec(),
+            std::iter::once((ServiceProtocol(), request_response::ProtocolSupport::Full)),
+            request_response::Config::default(),
+        );
+        Swarm::with_tokio_executor(transport, behaviour, peer_id)
+    }
+
+    /// Round trips of small sequential requests between two peers over TCP on the loopback
+    /// interface, with the transport, security and multiplexing of the nodes. The server answers
+    /// right away, so this is what the network path adds to a service call.
+    ///
+    /// Run with `cargo test --release -- --ignored --nocapture service_round_trip`.
+    #[test]
+    #[ignore]
+    fn service_round_trip_latency() {
+        const CALLS: i64 = 1000;
+
+        let runtime = tokio::runtime::Runtime::new().unwrap();
+        runtime.block_on(async {
+            let mut server = swarm();
+            let server_id = *server.local_peer_id();
+            server
+                .listen_on("/ip4/127.0.0.1/tcp/0".parse().unwrap())
+                .unwrap();
+            let address: Multiaddr = loop {
+                if let SwarmEvent::NewListenAddr { address, .. } = server.select_next_some().await {
+                    break address;
+                }
+            };
+            tokio::spawn(async move {
+                loop {
+                    if let SwarmEvent::Behaviour(request_response::Event::Message {
+                        message:
+                            request_response::Message::Request {
+                                request, channel, ..
+                            },
+                        ..
+                    }) = server.select_next_some().await
+                    {
+                        let response = ServiceResponse {
+                            client_gid: request.client_gid,
+                            sequence_number: request.sequence_number,
+                            payload: request.payload,
+                        };
+                        let _ = server.behaviour_mut().send_response(channel, response);
+                    }
+                }
+            });
+
+            let mut client = swarm();
+            client.behaviour_mut().add_address(&server_id, address);
+            let mut round_trips = Vec::new();
+            // The first call also dials the server
+            for sequence_number in 0..=CALLS {
+                let start = Instant::now();
+                client
+                    .behaviour_mut()
+                    .send_request(&server_id, request(sequence_number));
+                loop {
+                    match client.select_next_some().await {
+                        SwarmEvent::Behaviour(request_response::Event::Message {
+                            message: request_response::Message::Response { response, .. },
+                            ..
+                        }) => {
+                            assert_eq!(response.sequence_number, sequence_number);
+                            break;
+                        }
+                        SwarmEvent::Behaviour(request_response::Event::OutboundFailure {
+                            error,
+                            ..
+                        }) => panic!("request failed: {:?}", error),
+                        _ => {}
+                    }
+                }
+                if sequence_number > 0 {
+                    round_trips.push(start.elapsed());
+                }
+            }
+            round_trips.sort();
+            let median = round_trips[round_trips.len() / 2];
+            let p99 = round_trips[round_trips.len() * 99 / 100];
+            println!(
+                "{} calls: median {:?}, p99 {:?}, max {:?}",
+                CALLS,
+                median,
+                p99,
+                round_trips.last().unwrap()
+            );
+            assert!(median < Duration::from_millis(1));
+        });
+    }
+}
@@ -12,10 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use crate::messages;
 use crate::CustomSubscriptionHandle;
 use crate::Libp2pCustomNode;
 
-use std::ffi::CStr;
+use std::ffi::{c_void, CStr};
 use std::io::Cursor;
 use std::os::raw::c_char;
 use std::sync::Arc;
@@ -34,6 +35,7 @@ use libp2p::gossipsub;
 /// * `gid` - A unique identifier for this subscription.
 /// * `node` - A raw pointer to the `Libp2pCustomNode` associated with this subscription. This is needed to access the outgoing queue.
 /// * `topic` - The topic of the subscription.
+/// * `obj_ptr` - The pointer stored in the `CustomSubscriptionHandle`, used to unregister the callback.
 /// * `incoming_queue` - A thread-safe, unlimited queue for incoming messages. Each message is a tuple of the topic and the message data.
 ///
 /// # Safety
@@ -43,6 +45,7 @@ pub struct Libp2pCustomSubscription {
     gid: Uuid,
     node: *mut Libp2pCustomNode, // We need to store the Node here to have access to the outgoing queue
     topic: gossipsub::IdentTopic,
+    obj_ptr: *const c_void,
     incoming_queue: Arc<deadqueue::unlimited::Queue<(gossipsub::IdentTopic, Vec<u8>)>>,
 }
 
@@ -61,6 +64,8 @@ impl Libp2pCustomSubscription {
     /// * `topic_str` - The topic string for the subscription.
     /// * `obj` - The custom subscription handle object.
     /// * `callback` - The callback function to be called when a message is received.
+    /// * `reliable` - Whether the messages of reliable publishers are delivered in order, with retransmissions.
+    /// * `transient_local` - Whether the history of transient local publishers is replayed to it.
     ///
     /// # Safety
     ///
@@ -80,34 +85,53 @@ impl Libp2pCustomSubscription {
     /// let topic_str = "my_topic";
     /// let obj = /* create the custom subscription handle */;
     ///
-    /// let subscription = Libp2pCustomSubscription::new(ptr_node, topic_str, obj, callback_fn);
+    /// let subscription = Libp2pCustomSubscription::new(ptr_node, topic_str, obj, callback_fn, false, false);
     /// ```
     fn new(
         ptr_node: *mut Libp2pCustomNode,
         topic_str: &str,
         obj: CustomSubscriptionHandle,
         callback: unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize),
+        reliable: bool,
+        transient_local: bool,
     ) -> Self {
         let libp2p2_custom_node = unsafe {
             assert!(!ptr_node.is_null());
             &mut *ptr_node
         };
 
+        let obj_ptr = obj.ptr;
         libp2p2_custom_node.notify_new_subscriber(
             gossipsub::IdentTopic::new(topic_str),
             obj,
             callback,
+            reliable,
+            transient_local,
         );
 
         Self {
             gid: Uuid::new_v4(),
             node: ptr_node,
             topic: gossipsub::IdentTopic::new(topic_str),
+            obj_ptr: obj_ptr,
             incoming_queue: Arc::new(deadqueue::unlimited::Queue::new()),
         }
     }
 }
 
+impl Drop for Libp2pCustomSubscription {
+    /// Unregisters the subscription callback from the node.
+    ///
+    /// Once this returns, the callback will not be called anymore for this subscription.
+    fn drop(&mut self) {
+        let libp2p2_custom_node = unsafe {
+            assert!(!self.node.is_null());
+            &mut *self.node
+        };
+        libp2p2_custom_node.remove_subscriber(self.topic.clone(), self.obj_ptr);
+    }
+}
+
 /// Creates a new `Libp2pCustomSubscription`.
 ///
 /// This function takes a raw pointer to a `Libp2pCustomNode`, a raw pointer to a C string representing the topic, a `CustomSubscriptionHandle`, and a callback function.
@@ -123,6 +147,8 @@ impl Libp2pCustomSubscription {
 /// * `topic_str_ptr` - A raw pointer to a C string representing the topic.
 /// * `obj` - A `CustomSubscriptionHandle` associated with the new subscription.
 /// * `callback` - A callback function to be called when a new message is published to the topic.
+/// * `reliable` - Whether the messages of reliable publishers are delivered in order, with retransmissions.
+/// * `transient_local` - Whether the history of transient local publishers is replayed to it.
 ///
 /// # Returns
 ///
@@ -137,14 +163,22 @@ pub extern "C" fn rs_libp2p_custom_subscription_new(
     topic_str_ptr: *const c_char,
     obj: CustomSubscriptionHandle,
     callback: unsafe extern "C" fn(&CustomSubscriptionHandle, *mut u8, len: usize),
+    reliable: bool,
+    transient_local: bool,
 ) -> *mut Libp2pCustomSubscription {
     let topic_str = unsafe {
         assert!(!topic_str_ptr.is_null());
         CStr::from_ptr(topic_str_ptr)
     };
 
-    let libp2p2_custom_subscription =
-        Libp2pCustomSubscription::new(ptr_node, topic_str.to_str().unwrap(), obj, callback);
+    let libp2p2_custom_subscription = Libp2pCustomSubscription::new(
+        ptr_node,
+        topic_str.to_str().unwrap(),
+        obj,
+        callback,
+        reliable,
+        transient_local,
+    );
     Box::into_raw(Box::new(libp2p2_custom_subscription))
 }
 
@@ -211,3 +245,41 @@ pub extern "C" fn rs_libp2p_custom_subscription_get_gid(
     }
     count
 }
+
+/// Allocates a zeroed message that can be released with `rs_libp2p_message_free`.
+///
+/// Receivers that rebuild a message from the one delivered to them, like delta encoded ones, hand
+/// the result out in place of the original, so both need to be released the same way.
+///
+/// # Arguments
+///
+/// * `len` - The length of the message.
+///
+/// # Returns
+///
+/// A raw pointer to the `len` bytes of the message.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_message_new(len: usize) -> *mut u8 {
+    messages::allocate(len)
+}
+
+/// Frees a message delivered to a subscription callback.
+///
+/// Every message handed to a subscription callback is lent to the receiver, which must release it with this function once it is done with it.
+/// The same bytes may be lent to several receivers at once, so they must not be written to.
+///
+/// # Safety
+///
+/// This function is unsafe because it uses raw pointers.
+///
+/// # Arguments
+///
+/// * `ptr` - A raw pointer to the message, as passed to the subscription callback.
+/// * `len` - The length of the message, as passed to the subscription callback.
+#[no_mangle]
+pub extern "C" fn rs_libp2p_message_free(ptr: *mut u8, len: usize) {
+    if ptr.is_null() {
+        return;
+    }
+    messages::release(ptr, len);
+}
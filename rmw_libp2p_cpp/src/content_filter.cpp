@@ -0,0 +1,1088 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rcutils/logging_macros.h"
+
+#include "rosidl_typesupport_introspection_cpp/field_types.hpp"
+#include "rosidl_typesupport_introspection_cpp/message_introspection.hpp"
+
+#include "rosidl_typesupport_introspection_c/message_introspection.h"
+
+#include "impl/cdr_buffer.hpp"
+#include "impl/compact.hpp"
+#include "impl/content_filter.hpp"
+#include "impl/xcdr2.hpp"
+
+#include "type_support_common.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+// Numeric value of a field or a literal. Booleans are the integers 0 and 1.
+struct ContentFilter::Value
+{
+  enum class Kind { SIGNED, UNSIGNED, FLOATING };
+
+  Kind kind = Kind::SIGNED;
+  int64_t i = 0;
+  uint64_t u = 0;
+  double d = 0.0;
+};
+
+struct ContentFilter::Node
+{
+  enum class Kind { AND, OR, NOT, COMPARE };
+  enum class Op { EQ, NE, LT, LE, GT, GE };
+
+  Kind kind;
+  std::unique_ptr<Node> left;
+  std::unique_ptr<Node> right;
+  // COMPARE only: the field in the given slot is compared with value
+  size_t slot = 0;
+  Op op = Op::EQ;
+  Value value;
+};
+
+// Reads the fields used by a filter from a serialized message
+class ContentFilter::Reader
+{
+public:
+  virtual ~Reader() = default;
+
+  // Makes the field at the dotted path available in slot, returns false if it can't be filtered
+  virtual bool
+  add(const std::string & path, size_t slot, std::string & error) = 0;
+
+  virtual bool
+  read(cdr::ReadCDRBuffer & deser, std::vector<Value> & values) const = 0;
+
+  virtual bool
+  read(xcdr2::Reader & deser, std::vector<Value> & values) const = 0;
+
+  virtual bool
+  read(compact::Reader & deser, std::vector<Value> & values) const = 0;
+};
+
+namespace
+{
+
+using Value = ContentFilter::Value;
+using Node = ContentFilter::Node;
+
+// Expressions of remote subscriptions come from discovery, parsing and evaluating them recurses
+// once per nesting level and once per AND / OR, both bounded here to keep the stack small
+constexpr size_t kMaxExpressionLength = 4096;
+constexpr size_t kMaxNestingDepth = 64;
+
+Value
+make_signed(int64_t i)
+{
+  Value value;
+  value.kind = Value::Kind::SIGNED;
+  value.i = i;
+  return value;
+}
+
+Value
+make_unsigned(uint64_t u)
+{
+  Value value;
+  value.kind = Value::Kind::UNSIGNED;
+  value.u = u;
+  return value;
+}
+
+Value
+make_floating(double d)
+{
+  Value value;
+  value.kind = Value::Kind::FLOATING;
+  value.d = d;
+  return value;
+}
+
+double
+as_double(const Value & value)
+{
+  switch (value.kind) {
+    case Value::Kind::SIGNED:
+      return static_cast<double>(value.i);
+    case Value::Kind::UNSIGNED:
+      return static_cast<double>(value.u);
+    default:
+      return value.d;
+  }
+}
+
+template<typename T>
+int
+three_way(const T & a, const T & b)
+{
+  return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// Integers are compared exactly, anything involving a floating point value as doubles
+int
+compare(const Value & a, const Value & b)
+{
+  if (a.kind == Value::Kind::FLOATING || b.kind == Value::Kind::FLOATING) {
+    return three_way(as_double(a), as_double(b));
+  }
+  if (a.kind == Value::Kind::SIGNED && b.kind == Value::Kind::SIGNED) {
+    return three_way(a.i, b.i);
+  }
+  if (a.kind == Value::Kind::UNSIGNED && b.kind == Value::Kind::UNSIGNED) {
+    return three_way(a.u, b.u);
+  }
+  if (a.kind == Value::Kind::SIGNED) {
+    return a.i < 0 ? -1 : three_way(static_cast<uint64_t>(a.i), b.u);
+  }
+  return b.i < 0 ? 1 : three_way(a.u, static_cast<uint64_t>(b.i));
+}
+
+bool
+holds(Node::Op op, int order)
+{
+  switch (op) {
+    case Node::Op::EQ:
+      return order == 0;
+    case Node::Op::NE:
+      return order != 0;
+    case Node::Op::LT:
+      return order < 0;
+    case Node::Op::LE:
+      return order <= 0;
+    case Node::Op::GT:
+      return order > 0;
+    default:
+      return order >= 0;
+  }
+}
+
+// Operator with its operands swapped, for comparisons written as literal op field
+Node::Op
+flip(Node::Op op)
+{
+  switch (op) {
+    case Node::Op::LT:
+      return Node::Op::GT;
+    case Node::Op::LE:
+      return Node::Op::GE;
+    case Node::Op::GT:
+      return Node::Op::LT;
+    case Node::Op::GE:
+      return Node::Op::LE;
+    default:
+      return op;
+  }
+}
+
+bool
+evaluate_node(const Node & node, const std::vector<Value> & values)
+{
+  switch (node.kind) {
+    case Node::Kind::AND:
+      return evaluate_node(*node.left, values) && evaluate_node(*node.right, values);
+    case Node::Kind::OR:
+      return evaluate_node(*node.left, values) || evaluate_node(*node.right, values);
+    case Node::Kind::NOT:
+      return !evaluate_node(*node.left, values);
+    default:
+      return holds(node.op, compare(values[node.slot], node.value));
+  }
+}
+
+std::string
+to_upper(std::string text)
+{
+  std::transform(
+    text.begin(), text.end(), text.begin(),
+    [](unsigned char c) {return static_cast<char>(std::toupper(c));});
+  return text;
+}
+
+bool
+parse_literal(const std::string & text, Value & value)
+{
+  const std::string upper = to_upper(text);
+  if (upper == "TRUE" || upper == "FALSE") {
+    value = make_signed(upper == "TRUE" ? 1 : 0);
+    return true;
+  }
+  if (text.empty() || text[0] == '\'') {
+    return false;
+  }
+  const char * begin = text.c_str();
+  char * end = nullptr;
+  errno = 0;
+  const bool is_integer = upper.find_first_of(".EN") == std::string::npos ||
+    upper.compare(0, 2, "0X") == 0 || upper.compare(0, 3, "-0X") == 0;
+  if (!is_integer) {
+    value = make_floating(std::strtod(begin, &end));
+  } else if (text[0] == '-') {
+    value = make_signed(std::strtoll(begin, &end, 0));
+  } else {
+    const uint64_t u = std::strtoull(begin, &end, 0);
+    value = u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) ?
+      make_unsigned(u) : make_signed(static_cast<int64_t>(u));
+  }
+  return errno == 0 && end != begin && *end == '\0';
+}
+
+struct Token
+{
+  enum class Kind { END, IDENTIFIER, LITERAL, PARAMETER, OPERATOR, OPEN, CLOSE };
+
+  Kind kind;
+  std::string text;
+};
+
+bool
+tokenize(const std::string & expression, std::vector<Token> & tokens, std::string & error)
+{
+  size_t i = 0;
+  while (i < expression.size()) {
+    const unsigned char c = expression[i];
+    const size_t begin = i;
+    if (std::isspace(c)) {
+      ++i;
+      continue;
+    }
+    if (std::isalpha(c) || c == '_') {
+      while (i < expression.size() &&
+        (std::isalnum(static_cast<unsigned char>(expression[i])) ||
+        expression[i] == '_' || expression[i] == '.'))
+      {
+        ++i;
+      }
+      tokens.push_back({Token::Kind::IDENTIFIER, expression.substr(begin, i - begin)});
+    } else if (std::isdigit(c) || c == '.' || c == '-' || c == '+') {
+      ++i;
+      while (i < expression.size()) {
+        const unsigned char n = expression[i];
+        const bool exponent_sign = (n == '+' || n == '-') &&
+          (expression[i - 1] == 'e' || expression[i - 1] == 'E');
+        if (!std::isalnum(n) && n != '.' && !exponent_sign) {
+          break;
+        }
+        ++i;
+      }
+      tokens.push_back({Token::Kind::LITERAL, expression.substr(begin, i - begin)});
+    } else if (c == '%') {
+      ++i;
+      while (i < expression.size() && std::isdigit(static_cast<unsigned char>(expression[i]))) {
+        ++i;
+      }
+      if (i == begin + 1) {
+        error = "expected a parameter index after '%'";
+        return false;
+      }
+      tokens.push_back({Token::Kind::PARAMETER, expression.substr(begin + 1, i - begin - 1)});
+    } else if (c == '\'' || c == '"') {
+      error = "string literals are not supported";
+      return false;
+    } else if (c == '(' || c == ')') {
+      ++i;
+      tokens.push_back({c == '(' ? Token::Kind::OPEN : Token::Kind::CLOSE, std::string(1, c)});
+    } else if (c == '=' || c == '<' || c == '>' || c == '!') {
+      ++i;
+      if (i < expression.size() && (expression[i] == '=' || (c == '<' && expression[i] == '>'))) {
+        ++i;
+      }
+      const std::string op = expression.substr(begin, i - begin);
+      if (op == "!") {
+        error = "unknown operator '!'";
+        return false;
+      }
+      tokens.push_back({Token::Kind::OPERATOR, op});
+    } else {
+      error = std::string("unexpected character '") + expression[i] + "'";
+      return false;
+    }
+  }
+  tokens.push_back({Token::Kind::END, ""});
+  return true;
+}
+
+class Parser
+{
+public:
+  Parser(
+    const std::vector<Token> & tokens, const std::vector<std::string> & parameters,
+    ContentFilter::Reader & reader)
+  : tokens_(tokens), parameters_(parameters), reader_(reader), position_(0), depth_(0)
+  {
+  }
+
+  std::unique_ptr<Node>
+  parse(std::string & error)
+  {
+    std::unique_ptr<Node> root = parse_or();
+    if (root && peek().kind != Token::Kind::END) {
+      error_ = "unexpected '" + peek().text + "'";
+      root.reset();
+    }
+    if (!root) {
+      error = error_;
+    }
+    return root;
+  }
+
+  size_t
+  slot_count() const
+  {
+    return slots_.size();
+  }
+
+private:
+  struct Operand
+  {
+    bool is_field;
+    size_t slot;
+    Value value;
+  };
+
+  const Token &
+  peek() const
+  {
+    return tokens_[position_];
+  }
+
+  bool
+  accept_keyword(const char * keyword)
+  {
+    if (peek().kind == Token::Kind::IDENTIFIER && to_upper(peek().text) == keyword) {
+      ++position_;
+      return true;
+    }
+    return false;
+  }
+
+  std::unique_ptr<Node>
+  nesting_error()
+  {
+    error_ = "expression nested deeper than " + std::to_string(kMaxNestingDepth) + " levels";
+    return nullptr;
+  }
+
+  std::unique_ptr<Node>
+  combine(Node::Kind kind, std::unique_ptr<Node> left, std::unique_ptr<Node> right)
+  {
+    std::unique_ptr<Node> node(new Node());
+    node->kind = kind;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+  }
+
+  std::unique_ptr<Node>
+  parse_or()
+  {
+    std::unique_ptr<Node> left = parse_and();
+    while (left && accept_keyword("OR")) {
+      std::unique_ptr<Node> right = parse_and();
+      if (!right) {
+        return nullptr;
+      }
+      left = combine(Node::Kind::OR, std::move(left), std::move(right));
+    }
+    return left;
+  }
+
+  std::unique_ptr<Node>
+  parse_and()
+  {
+    std::unique_ptr<Node> left = parse_not();
+    while (left && accept_keyword("AND")) {
+      std::unique_ptr<Node> right = parse_not();
+      if (!right) {
+        return nullptr;
+      }
+      left = combine(Node::Kind::AND, std::move(left), std::move(right));
+    }
+    return left;
+  }
+
+  // One more NOT or '(' around the tokens parsed while it is alive
+  class NestingGuard
+  {
+  public:
+    explicit NestingGuard(size_t & depth)
+    : depth_(depth)
+    {
+      ++depth_;
+    }
+
+    ~NestingGuard()
+    {
+      --depth_;
+    }
+
+    bool
+    too_deep() const
+    {
+      return depth_ > kMaxNestingDepth;
+    }
+
+  private:
+    size_t & depth_;
+  };
+
+  std::unique_ptr<Node>
+  parse_not()
+  {
+    if (accept_keyword("NOT")) {
+      NestingGuard guard(depth_);
+      if (guard.too_deep()) {
+        return nesting_error();
+      }
+      std::unique_ptr<Node> operand = parse_not();
+      if (!operand) {
+        return nullptr;
+      }
+      return combine(Node::Kind::NOT, std::move(operand), nullptr);
+    }
+    if (peek().kind == Token::Kind::OPEN) {
+      ++position_;
+      NestingGuard guard(depth_);
+      if (guard.too_deep()) {
+        return nesting_error();
+      }
+      std::unique_ptr<Node> inner = parse_or();
+      if (!inner) {
+        return nullptr;
+      }
+      if (peek().kind != Token::Kind::CLOSE) {
+        error_ = "expected ')'";
+        return nullptr;
+      }
+      ++position_;
+      return inner;
+    }
+    return parse_comparison();
+  }
+
+  std::unique_ptr<Node>
+  parse_comparison()
+  {
+    Operand left;
+    if (!parse_operand(left)) {
+      return nullptr;
+    }
+    if (peek().kind != Token::Kind::OPERATOR) {
+      error_ = "expected a comparison operator";
+      return nullptr;
+    }
+    const std::string & text = peek().text;
+    Node::Op op;
+    if (text == "=" || text == "==") {
+      op = Node::Op::EQ;
+    } else if (text == "<>" || text == "!=") {
+      op = Node::Op::NE;
+    } else if (text == "<") {
+      op = Node::Op::LT;
+    } else if (text == "<=") {
+      op = Node::Op::LE;
+    } else if (text == ">") {
+      op = Node::Op::GT;
+    } else {
+      op = Node::Op::GE;
+    }
+    ++position_;
+    Operand right;
+    if (!parse_operand(right)) {
+      return nullptr;
+    }
+    if (left.is_field == right.is_field) {
+      error_ = "each comparison must involve exactly one field";
+      return nullptr;
+    }
+    std::unique_ptr<Node> node(new Node());
+    node->kind = Node::Kind::COMPARE;
+    if (left.is_field) {
+      node->slot = left.slot;
+      node->op = op;
+      node->value = right.value;
+    } else {
+      node->slot = right.slot;
+      node->op = flip(op);
+      node->value = left.value;
+    }
+    return node;
+  }
+
+  bool
+  parse_operand(Operand & operand)
+  {
+    const Token & token = peek();
+    operand.is_field = false;
+    if (token.kind == Token::Kind::LITERAL) {
+      if (!parse_literal(token.text, operand.value)) {
+        error_ = "invalid number '" + token.text + "'";
+        return false;
+      }
+    } else if (token.kind == Token::Kind::PARAMETER) {
+      const size_t index = std::strtoul(token.text.c_str(), nullptr, 10);
+      if (index >= parameters_.size()) {
+        error_ = "missing expression parameter %" + token.text;
+        return false;
+      }
+      if (!parse_literal(parameters_[index], operand.value)) {
+        error_ = "expression parameter %" + token.text + " is not a number or boolean";
+        return false;
+      }
+    } else if (token.kind == Token::Kind::IDENTIFIER) {
+      const std::string upper = to_upper(token.text);
+      if (upper == "TRUE" || upper == "FALSE") {
+        parse_literal(upper, operand.value);
+      } else if (upper == "AND" || upper == "OR" || upper == "NOT") {
+        error_ = "unexpected '" + token.text + "'";
+        return false;
+      } else {
+        operand.is_field = true;
+        if (!resolve(token.text, operand.slot)) {
+          return false;
+        }
+      }
+    } else {
+      error_ = token.kind == Token::Kind::END ?
+        "unexpected end of expression" : "unexpected '" + token.text + "'";
+      return false;
+    }
+    ++position_;
+    return true;
+  }
+
+  // The same field used several times is only read once
+  bool
+  resolve(const std::string & path, size_t & slot)
+  {
+    auto it = slots_.find(path);
+    if (it != slots_.end()) {
+      slot = it->second;
+      return true;
+    }
+    slot = slots_.size();
+    if (!reader_.add(path, slot, error_)) {
+      return false;
+    }
+    slots_.emplace(path, slot);
+    return true;
+  }
+
+  const std::vector<Token> & tokens_;
+  const std::vector<std::string> & parameters_;
+  ContentFilter::Reader & reader_;
+  size_t position_;
+  // Current number of NOT and '(' around the token being parsed, see kMaxNestingDepth
+  size_t depth_;
+  std::map<std::string, size_t> slots_;
+  std::string error_;
+};
+
+// Walks a message the same way TypeSupport::serializeROSmessage writes it. In the classic
+// encoding that is the member count first, then every member in order; strings and arrays of
+// primitives are not written yet, so they take no space. XCDR2 has no member counts, strings
+// and arrays are skipped by their length and arrays of messages by their DHEADER. The compact
+// encoding has no member counts either and its varints are read one by one. Neither strings nor
+// arrays can be filtered on.
+template<typename MembersType>
+class MessageReader : public ContentFilter::Reader
+{
+public:
+  explicit MessageReader(const MembersType * members)
+  : members_(members)
+  {
+  }
+
+  bool
+  add(const std::string & path, size_t slot, std::string & error) override
+  {
+    const size_t dot = path.find('.');
+    const std::string name = path.substr(0, dot);
+    uint32_t index = 0;
+    while (index < members_->member_count_ && name != members_->members_[index].name_) {
+      ++index;
+    }
+    if (index == members_->member_count_) {
+      error = "unknown field '" + name + "'";
+      return false;
+    }
+    const auto member = members_->members_ + index;
+    if (member->is_array_) {
+      error = "field '" + name + "' is an array";
+      return false;
+    }
+    auto field = std::lower_bound(
+      fields_.begin(), fields_.end(), index,
+      [](const Field & field, uint32_t index) {return field.index < index;});
+    if (dot != std::string::npos) {
+      if (member->type_id_ != ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE) {
+        error = "field '" + name + "' is not a message";
+        return false;
+      }
+      if (field == fields_.end() || field->index != index) {
+        Field nested;
+        nested.index = index;
+        nested.slot = 0;
+        nested.nested.reset(
+          new MessageReader(static_cast<const MembersType *>(member->members_->data)));
+        field = fields_.insert(field, std::move(nested));
+      }
+      return field->nested->add(path.substr(dot + 1), slot, error);
+    }
+    if (!is_filterable(member->type_id_)) {
+      error = "field '" + name + "' is not a boolean or a number";
+      return false;
+    }
+    Field leaf;
+    leaf.index = index;
+    leaf.slot = slot;
+    fields_.insert(field, std::move(leaf));
+    return true;
+  }
+
+  bool
+  read(cdr::ReadCDRBuffer & deser, std::vector<Value> & values) const override
+  {
+    return read_fields(deser, values);
+  }
+
+  bool
+  read(xcdr2::Reader & deser, std::vector<Value> & values) const override
+  {
+    return read_fields(deser, values);
+  }
+
+  bool
+  read(compact::Reader & deser, std::vector<Value> & values) const override
+  {
+    return read_fields(deser, values);
+  }
+
+private:
+  struct Field
+  {
+    uint32_t index;
+    size_t slot;
+    std::unique_ptr<MessageReader> nested;
+  };
+
+  template<typename Deser>
+  bool
+  read_fields(Deser & deser, std::vector<Value> & values) const
+  {
+    if (!read_member_count(deser, members_)) {
+      return false;
+    }
+    auto field = fields_.begin();
+    // Members after the last one the filter uses are never read
+    for (uint32_t index = 0; field != fields_.end(); ++index) {
+      const auto member = members_->members_ + index;
+      if (field->index != index) {
+        skip_member(deser, member);
+        continue;
+      }
+      if (field->nested) {
+        if (!field->nested->read(deser, values)) {
+          return false;
+        }
+      } else {
+        values[field->slot] = read_value(deser, member->type_id_);
+      }
+      ++field;
+    }
+    return true;
+  }
+
+  static bool
+  read_member_count(cdr::ReadCDRBuffer & deser, const MembersType * members)
+  {
+    uint32_t member_count = 0;
+    deser >> member_count;
+    return member_count == members->member_count_;
+  }
+
+  static bool
+  read_member_count(xcdr2::Reader &, const MembersType *)
+  {
+    return true;
+  }
+
+  static bool
+  read_member_count(compact::Reader &, const MembersType *)
+  {
+    return true;
+  }
+
+  static bool
+  is_filterable(uint8_t type_id)
+  {
+    switch (type_id) {
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  template<typename T, typename Deser>
+  static T
+  read_primitive(Deser & deser)
+  {
+    T value = T();
+    deser >> value;
+    return value;
+  }
+
+  template<typename Deser>
+  static Value
+  read_value(Deser & deser, uint8_t type_id)
+  {
+    switch (type_id) {
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+        return make_signed(read_primitive<bool>(deser) ? 1 : 0);
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+        return make_unsigned(read_primitive<uint8_t>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+        return make_signed(static_cast<int8_t>(read_primitive<char>(deser)));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+        return make_floating(read_primitive<float>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+        return make_floating(read_primitive<double>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+        return make_signed(read_primitive<int16_t>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+        return make_unsigned(read_primitive<uint16_t>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+        return make_signed(read_primitive<int32_t>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+        return make_unsigned(read_primitive<uint32_t>(deser));
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+        return make_signed(read_primitive<int64_t>(deser));
+      default:
+        return make_unsigned(read_primitive<uint64_t>(deser));
+    }
+  }
+
+  template<typename MemberType>
+  static void
+  skip_member(cdr::ReadCDRBuffer & deser, const MemberType * member)
+  {
+    switch (member->type_id_) {
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE:
+        {
+          auto sub_members = static_cast<const MembersType *>(member->members_->data);
+          size_t count = 1;
+          if (member->is_array_) {
+            count = member->array_size_;
+            if (!member->array_size_ || member->is_upper_bound_) {
+              count = read_primitive<uint32_t>(deser);
+            }
+          }
+          for (size_t i = 0; i < count; ++i) {
+            skip_message(deser, sub_members);
+          }
+        }
+        break;
+      default:
+        if (!member->is_array_) {
+          read_value(deser, member->type_id_);
+        }
+        break;
+    }
+  }
+
+  template<typename MemberType>
+  static void
+  skip_member(xcdr2::Reader & deser, const MemberType * member)
+  {
+    const bool is_sequence = !member->array_size_ || member->is_upper_bound_;
+    switch (member->type_id_) {
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE:
+        if (member->is_array_) {
+          deser.seek(deser.read_dheader());
+        } else {
+          skip_message(deser, static_cast<const MembersType *>(member->members_->data));
+        }
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+        if (member->is_array_) {
+          deser.seek(deser.read_dheader());
+        } else {
+          deser.skip(1, read_primitive<uint32_t>(deser));
+        }
+        break;
+      default:
+        if (!member->is_array_) {
+          deser.skip(primitive_size(member->type_id_), 1);
+        } else {
+          const size_t count =
+            is_sequence ? read_primitive<uint32_t>(deser) : member->array_size_;
+          deser.skip(primitive_size(member->type_id_), count);
+        }
+        break;
+    }
+  }
+
+  // Compact integers are varints, so primitives are read rather than skipped by their size
+  template<typename MemberType>
+  static void
+  skip_member(compact::Reader & deser, const MemberType * member)
+  {
+    size_t count = 1;
+    if (member->is_array_) {
+      count = member->array_size_;
+      if (!member->array_size_ || member->is_upper_bound_) {
+        count = read_primitive<uint32_t>(deser);
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      switch (member->type_id_) {
+        case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE:
+          skip_message(deser, static_cast<const MembersType *>(member->members_->data));
+          break;
+        case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+          deser.skip(read_primitive<uint64_t>(deser));
+          break;
+        case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+          {
+            std::u16string ignored;
+            deser.read_u16string(ignored);
+          }
+          break;
+        case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WCHAR:
+          read_primitive<uint16_t>(deser);
+          break;
+        default:
+          read_value(deser, member->type_id_);
+          break;
+      }
+    }
+  }
+
+  static size_t
+  primitive_size(uint8_t type_id)
+  {
+    switch (type_id) {
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WCHAR:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+        return 2;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+        return 4;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+        return 8;
+      default:
+        return 1;
+    }
+  }
+
+  template<typename Deser>
+  static void
+  skip_message(Deser & deser, const MembersType * members)
+  {
+    read_member_count(deser, members);
+    for (uint32_t index = 0; index < members->member_count_; ++index) {
+      skip_member(deser, members->members_ + index);
+    }
+  }
+
+  const MembersType * members_;
+  // Members used by the filter, ordered by index
+  std::vector<Field> fields_;
+};
+
+}  // namespace
+
+ContentFilter::~ContentFilter() = default;
+
+std::unique_ptr<ContentFilter>
+ContentFilter::compile(
+  const void * untyped_members, const char * typesupport_identifier,
+  const std::string & expression, const std::vector<std::string> & parameters,
+  std::string & error)
+{
+  std::unique_ptr<ContentFilter> filter(new ContentFilter());
+  filter->expression_ = expression;
+  filter->parameters_ = parameters;
+  if (using_introspection_c_typesupport(typesupport_identifier)) {
+    filter->reader_.reset(
+      new MessageReader<rosidl_typesupport_introspection_c__MessageMembers>(
+        static_cast<const rosidl_typesupport_introspection_c__MessageMembers *>(
+          untyped_members)));
+  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
+    filter->reader_.reset(
+      new MessageReader<rosidl_typesupport_introspection_cpp::MessageMembers>(
+        static_cast<const rosidl_typesupport_introspection_cpp::MessageMembers *>(
+          untyped_members)));
+  } else {
+    error = "unknown typesupport identifier";
+    return nullptr;
+  }
+
+  if (expression.size() > kMaxExpressionLength) {
+    error = "expression longer than " + std::to_string(kMaxExpressionLength) + " characters";
+    return nullptr;
+  }
+  std::vector<Token> tokens;
+  if (!tokenize(expression, tokens, error)) {
+    return nullptr;
+  }
+  Parser parser(tokens, parameters, *filter->reader_);
+  filter->root_ = parser.parse(error);
+  if (!filter->root_) {
+    return nullptr;
+  }
+  filter->slot_count_ = parser.slot_count();
+  return filter;
+}
+
+bool
+ContentFilter::evaluate(const uint8_t * data, size_t length, PayloadEncoding encoding) const
+{
+  std::vector<Value> values(slot_count_);
+  switch (encoding) {
+    case PayloadEncoding::CDR:
+      {
+        cdr::ReadCDRBuffer deser(data, length);
+        if (!reader_->read(deser, values)) {
+          return true;
+        }
+      }
+      break;
+    case PayloadEncoding::XCDR2:
+      try {
+        xcdr2::Reader deser(data, length);
+        if (!reader_->read(deser, values)) {
+          return true;
+        }
+      } catch (const std::runtime_error &) {
+        return true;
+      }
+      break;
+    case PayloadEncoding::COMPACT:
+      try {
+        compact::Reader deser(data, length);
+        if (!reader_->read(deser, values)) {
+          return true;
+        }
+      } catch (const std::runtime_error &) {
+        return true;
+      }
+      break;
+    default:
+      return true;
+  }
+  return evaluate_node(*root_, values);
+}
+
+MatchedFilters::MatchedFilters(
+  const void * untyped_members, const char * typesupport_identifier)
+: untyped_members_(untyped_members), typesupport_identifier_(typesupport_identifier),
+  unfiltered_(0)
+{
+}
+
+void
+MatchedFilters::update(
+  const Gid & gid, const std::string & expression,
+  const std::vector<std::string> & parameters, bool added)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!added) {
+    auto it = filters_.find(gid);
+    if (it != filters_.end()) {
+      filters_.erase(it);
+    } else if (unfiltered_ > 0) {
+      --unfiltered_;
+    }
+    return;
+  }
+  if (expression.empty()) {
+    ++unfiltered_;
+    return;
+  }
+  std::string error;
+  std::unique_ptr<ContentFilter> filter = ContentFilter::compile(
+    untyped_members_, typesupport_identifier_, expression, parameters, error);
+  if (!filter) {
+    // The subscription still filters on its own side
+    RCUTILS_LOG_WARN_NAMED(
+      "rmw_libp2p_cpp", "ignoring content filter \"%s\" of a matched subscription: %s",
+      expression.c_str(), error.c_str());
+    ++unfiltered_;
+    return;
+  }
+  filters_[gid] = std::move(filter);
+}
+
+bool
+MatchedFilters::filtering() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return unfiltered_ == 0 && !filters_.empty();
+}
+
+bool
+MatchedFilters::accepts(const uint8_t * data, size_t length, PayloadEncoding encoding) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (unfiltered_ > 0 || filters_.empty()) {
+    return true;
+  }
+  for (const auto & filter : filters_) {
+    if (filter.second->evaluate(data, length, encoding)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace rmw_libp2p_cpp
@@ -0,0 +1,209 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <vector>
+
+#include "rcutils/logging_macros.h"
+
+#include "impl/delta_encoding.hpp"
+#include "impl/message_header.hpp"
+#include "impl/rmw_libp2p_rs.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+namespace
+{
+
+// Runs of fewer equal bytes are cheaper to send in the middle of the differing ones than as
+// their own pair of lengths
+constexpr size_t kMinEqualRun = 4;
+
+// Best effort publishers send keyframes this many times more often than reliable ones
+constexpr uint32_t kBestEffortKeyframeDivisor = 4;
+
+void
+put_varint(std::vector<uint8_t> & buffer, uint64_t value)
+{
+  while (value >= 0x80) {
+    buffer.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<uint8_t>(value));
+}
+
+bool
+get_varint(const uint8_t * & data, const uint8_t * end, uint64_t & value)
+{
+  value = 0;
+  for (unsigned shift = 0; shift < 64 && data != end; shift += 7) {
+    const uint8_t byte = *data++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+DeltaEncoder::DeltaEncoder(uint32_t keyframe_interval, bool reliable, size_t history_depth)
+: keyframe_interval_(keyframe_interval), since_keyframe_(0), keyframe_id_(0)
+{
+  if (!reliable) {
+    keyframe_interval_ /= kBestEffortKeyframeDivisor;
+  }
+  if (history_depth > 0 && history_depth < keyframe_interval_) {
+    keyframe_interval_ = static_cast<uint32_t>(history_depth);
+  }
+  if (keyframe_interval_ == 0) {
+    keyframe_interval_ = 1;
+  }
+}
+
+const uint8_t *
+DeltaEncoder::encode(
+  const uint8_t * payload, size_t length, size_t & encoded_length, uint8_t & flags,
+  uint8_t & keyframe)
+{
+  if (!keyframe_.empty() && since_keyframe_ < keyframe_interval_) {
+    delta_.clear();
+    put_varint(delta_, length);
+    const size_t common = length < keyframe_.size() ? length : keyframe_.size();
+    auto differs = [&](size_t i) {
+        return i >= common || payload[i] != keyframe_[i];
+      };
+    // Deltas as large as most of the payload are worth a new keyframe instead
+    const size_t limit = length - length / 4;
+    size_t i = 0;
+    while (i < length && delta_.size() < limit) {
+      const size_t equal_begin = i;
+      while (i < length && !differs(i)) {
+        ++i;
+      }
+      const size_t differ_begin = i;
+      size_t differ_end = i;
+      size_t equal_run = 0;
+      for (; i < length && equal_run < kMinEqualRun; ++i) {
+        if (differs(i)) {
+          differ_end = i + 1;
+          equal_run = 0;
+        } else {
+          ++equal_run;
+        }
+      }
+      i = differ_end;
+      put_varint(delta_, differ_begin - equal_begin);
+      put_varint(delta_, differ_end - differ_begin);
+      for (size_t j = differ_begin; j < differ_end; ++j) {
+        delta_.push_back(payload[j] ^ (j < common ? keyframe_[j] : 0));
+      }
+    }
+    if (i >= length && delta_.size() < limit) {
+      ++since_keyframe_;
+      encoded_length = delta_.size();
+      flags = kMessageFlagDelta;
+      keyframe = keyframe_id_;
+      return delta_.data();
+    }
+  }
+  keyframe_.assign(payload, payload + length);
+  since_keyframe_ = 1;
+  ++keyframe_id_;
+  encoded_length = length;
+  flags = kMessageFlagKeyframe;
+  keyframe = keyframe_id_;
+  return payload;
+}
+
+bool
+DeltaDecoder::decode(uint8_t * & message, uintptr_t & length)
+{
+  MessageHeader header;
+  if (!parse_message_header(message, length, header) ||
+    !(header.flags & (kMessageFlagKeyframe | kMessageFlagDelta)))
+  {
+    return true;
+  }
+  Gid gid;
+  memcpy(gid.data(), header.gid, gid.size());
+  const uint8_t * data = message + kMessageHeaderSize;
+  const uint8_t * end = message + length;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (header.flags & kMessageFlagKeyframe) {
+    Keyframe & keyframe = keyframes_[gid];
+    keyframe.id = header.keyframe;
+    keyframe.payload.assign(data, end);
+    return true;
+  }
+
+  auto keyframe = keyframes_.find(gid);
+  uint64_t payload_length = 0;
+  // Bytes past the end of the keyframe are all in the delta, a longer length is corrupted
+  if (keyframe == keyframes_.end() || keyframe->second.id != header.keyframe ||
+    !get_varint(data, end, payload_length) ||
+    payload_length > keyframe->second.payload.size() + static_cast<uint64_t>(end - data))
+  {
+    RCUTILS_LOG_DEBUG_NAMED(
+      "rmw_libp2p_cpp", "dropping delta encoded message without its keyframe");
+    rs_libp2p_message_free(message, length);
+    return false;
+  }
+  const std::vector<uint8_t> & base = keyframe->second.payload;
+  uint8_t * rebuilt = rs_libp2p_message_new(kMessageHeaderSize + payload_length);
+  memcpy(rebuilt, message, kMessageHeaderSize);
+  // Subscriptions see an ordinary message from here on
+  rebuilt[1] &= ~kMessageFlagDelta;
+  uint8_t * payload = rebuilt + kMessageHeaderSize;
+  const size_t common = payload_length < base.size() ? payload_length : base.size();
+  memcpy(payload, base.data(), common);
+
+  size_t position = 0;
+  bool valid = true;
+  while (valid && data != end) {
+    uint64_t equal = 0;
+    uint64_t differ = 0;
+    valid = get_varint(data, end, equal) && get_varint(data, end, differ) &&
+      equal <= payload_length - position &&
+      differ <= payload_length - position - equal &&
+      differ <= static_cast<uint64_t>(end - data);
+    if (valid) {
+      position += equal;
+      for (uint64_t i = 0; i < differ; ++i, ++position) {
+        payload[position] ^= *data++;
+      }
+    }
+  }
+  rs_libp2p_message_free(message, length);
+  if (!valid) {
+    RCUTILS_LOG_DEBUG_NAMED("rmw_libp2p_cpp", "dropping malformed delta encoded message");
+    rs_libp2p_message_free(rebuilt, kMessageHeaderSize + payload_length);
+    return false;
+  }
+  message = rebuilt;
+  length = kMessageHeaderSize + payload_length;
+  return true;
+}
+
+void
+DeltaDecoder::remove_publisher(const Gid & gid)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  keyframes_.erase(gid);
+}
+
+}  // namespace rmw_libp2p_cpp
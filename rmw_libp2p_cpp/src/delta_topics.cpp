@@ -0,0 +1,63 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "impl/delta_topics.hpp"
+#include "impl/name_patterns.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+namespace
+{
+
+bool
+parse_interval(const std::string & value, uint32_t & interval)
+{
+  if (value.empty() || value[0] < '0' || value[0] > '9') {
+    return false;
+  }
+  char * end = nullptr;
+  errno = 0;
+  const unsigned long parsed = strtoul(value.c_str(), &end, 10);  // NOLINT(runtime/int)
+  if (errno != 0 || *end != '\0' || parsed == 0 || parsed > UINT32_MAX) {
+    return false;
+  }
+  interval = static_cast<uint32_t>(parsed);
+  return true;
+}
+
+}  // namespace
+
+DeltaTopics::DeltaTopics()
+: patterns_(parse_name_patterns("RMW_LIBP2P_DELTA_TOPICS", parse_interval))
+{
+}
+
+uint32_t
+DeltaTopics::get(const std::string & topic_name) const
+{
+  for (const auto & pattern : patterns_) {
+    if (name_matches(pattern.first, topic_name)) {
+      return pattern.second;
+    }
+  }
+  return 0;
+}
+
+}  // namespace rmw_libp2p_cpp
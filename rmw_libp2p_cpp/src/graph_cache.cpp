@@ -0,0 +1,1470 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rcutils/env.h"
+#include "rcutils/logging_macros.h"
+
+#include "impl/content_filter.hpp"
+#include "impl/custom_subscription_info.hpp"
+#include "impl/event_listener.hpp"
+#include "impl/graph_cache.hpp"
+#include "impl/guard_condition.hpp"
+#include "impl/listener.hpp"
+#include "impl/qos.hpp"
+#include "impl/rmw_libp2p_rs.hpp"
+#include "impl/topic_priorities.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+namespace
+{
+
+// Discovery messages are a fixed header followed by a kind specific body:
+//
+//   u8 version, u8 kind, u8[16] origin, u64 sequence number
+//
+//   HEARTBEAT:        u32 count, u8[16] gids of the manual publishers asserting their liveliness
+//   DELTA:            u32 record count, records
+//   SNAPSHOT:         u32 chunk index, u32 chunk count, u32 record count, records
+//   SNAPSHOT_REQUEST: u8[16] target origin
+//   LEAVE:            (empty)
+//
+// A record is u8 op, u8 entity kind, u8[16] gid and, for additions, the rest of the entity
+// (including the u64 type hash, then the content filter expression and its u32 count of
+// parameters).
+// Integers are little endian, strings are a u32 length followed by the characters.
+//
+// gossipsub drops messages larger than its max_transmit_size (64 KiB by default), so records
+// are split across messages of at most kMaxDiscoveryMessageSize bytes: consecutive deltas, each
+// with its own sequence number, or the chunks of a snapshot, which share its sequence number.
+constexpr uint8_t kDiscoveryVersion = 5;
+constexpr size_t kMaxDiscoveryMessageSize = 32 * 1024;
+
+enum class MessageKind : uint8_t
+{
+  HEARTBEAT = 0,
+  DELTA = 1,
+  SNAPSHOT = 2,
+  SNAPSHOT_REQUEST = 3,
+  LEAVE = 4,
+};
+
+constexpr std::chrono::milliseconds kDefaultHeartbeatPeriod{1000};
+constexpr std::chrono::milliseconds kDefaultSnapshotPeriod{10000};
+constexpr std::chrono::milliseconds kDefaultNotificationInterval{100};
+// Number of missed heartbeats after which an origin is considered gone
+constexpr int kLeaseHeartbeats = 5;
+
+std::chrono::milliseconds
+get_env_milliseconds(const char * name, std::chrono::milliseconds default_value)
+{
+  const char * value = nullptr;
+  if (rcutils_get_env(name, &value) != nullptr || value == nullptr || value[0] == '\0') {
+    return default_value;
+  }
+  char * end = nullptr;
+  unsigned long long milliseconds = strtoull(value, &end, 10);  // NOLINT(runtime/int)
+  if (*end != '\0' || milliseconds == 0) {
+    RCUTILS_LOG_WARN_NAMED(
+      "rmw_libp2p_cpp",
+      "ignoring invalid value '%s' for %s", value, name);
+    return default_value;
+  }
+  return std::chrono::milliseconds(milliseconds);
+}
+
+// Zero if the liveliness of the endpoint never expires
+std::chrono::nanoseconds
+liveliness_lease(const rmw_qos_profile_t & qos)
+{
+  return std::chrono::nanoseconds(qos_duration_ns(qos.liveliness_lease_duration));
+}
+
+bool
+is_automatic_leased_publisher(const GraphEntity & entity)
+{
+  return entity.kind == EntityKind::PUBLISHER &&
+         entity.qos.liveliness != RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC &&
+         liveliness_lease(entity.qos).count() > 0;
+}
+
+bool
+same_time(const rmw_time_t & a, const rmw_time_t & b)
+{
+  return a.sec == b.sec && a.nsec == b.nsec;
+}
+
+// Endpoints that do not advertise their type hash are given the benefit of the doubt
+bool
+compatible_types(uint64_t a, uint64_t b)
+{
+  return a == 0 || b == 0 || a == b;
+}
+
+bool
+same_entity(const GraphEntity & a, const GraphEntity & b)
+{
+  return a.kind == b.kind && a.node_gid == b.node_gid && a.name == b.name &&
+         a.namespace_ == b.namespace_ && a.enclave == b.enclave && a.type_name == b.type_name &&
+         a.type_hash == b.type_hash &&
+         a.qos.history == b.qos.history && a.qos.depth == b.qos.depth &&
+         a.qos.reliability == b.qos.reliability && a.qos.durability == b.qos.durability &&
+         same_time(a.qos.deadline, b.qos.deadline) && same_time(a.qos.lifespan, b.qos.lifespan) &&
+         a.qos.liveliness == b.qos.liveliness &&
+         same_time(a.qos.liveliness_lease_duration, b.qos.liveliness_lease_duration) &&
+         a.qos.avoid_ros_namespace_conventions == b.qos.avoid_ros_namespace_conventions &&
+         a.filter_expression == b.filter_expression &&
+         a.filter_parameters == b.filter_parameters;
+}
+
+class MessageWriter
+{
+public:
+  MessageWriter(MessageKind kind, const Gid & origin, uint64_t sequence_number)
+  {
+    put_u8(kDiscoveryVersion);
+    put_u8(static_cast<uint8_t>(kind));
+    put_gid(origin);
+    put_u64(sequence_number);
+  }
+
+  void put_u8(uint8_t value)
+  {
+    buffer_.push_back(value);
+  }
+
+  void put_u32(uint32_t value)
+  {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      buffer_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void put_u64(uint64_t value)
+  {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      buffer_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void put_gid(const Gid & gid)
+  {
+    buffer_.insert(buffer_.end(), gid.begin(), gid.end());
+  }
+
+  void put_string(const std::string & value)
+  {
+    put_u32(static_cast<uint32_t>(value.size()));
+    buffer_.insert(buffer_.end(), value.begin(), value.end());
+  }
+
+  void put_time(const rmw_time_t & value)
+  {
+    put_u64(value.sec);
+    put_u64(value.nsec);
+  }
+
+  void put_qos(const rmw_qos_profile_t & qos)
+  {
+    put_u8(static_cast<uint8_t>(qos.history));
+    put_u32(static_cast<uint32_t>(qos.depth));
+    put_u8(static_cast<uint8_t>(qos.reliability));
+    put_u8(static_cast<uint8_t>(qos.durability));
+    put_time(qos.deadline);
+    put_time(qos.lifespan);
+    put_u8(static_cast<uint8_t>(qos.liveliness));
+    put_time(qos.liveliness_lease_duration);
+    put_u8(qos.avoid_ros_namespace_conventions ? 1 : 0);
+  }
+
+  void put_entity(uint8_t op, const GraphEntity & entity)
+  {
+    put_u8(op);
+    put_u8(static_cast<uint8_t>(entity.kind));
+    put_gid(entity.gid);
+    if (op != 0) {
+      return;
+    }
+    put_gid(entity.node_gid);
+    put_string(entity.name);
+    put_string(entity.namespace_);
+    put_string(entity.enclave);
+    put_string(entity.type_name);
+    put_u64(entity.type_hash);
+    put_qos(entity.qos);
+    put_string(entity.filter_expression);
+    put_u32(static_cast<uint32_t>(entity.filter_parameters.size()));
+    for (const std::string & parameter : entity.filter_parameters) {
+      put_string(parameter);
+    }
+  }
+
+  // Overwrites the u32 written at offset
+  void patch_u32(size_t offset, uint32_t value)
+  {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      buffer_[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+  }
+
+  std::vector<uint8_t> & buffer()
+  {
+    return buffer_;
+  }
+
+private:
+  std::vector<uint8_t> buffer_;
+};
+
+// Writes the records, pairs of an op and an entity, into as many messages as needed to keep
+// each of them under kMaxDiscoveryMessageSize. A record larger than that still gets a message of
+// its own. new_message returns a writer with everything that comes before the record count.
+template<typename NewMessage>
+std::vector<MessageWriter>
+write_records(
+  const std::vector<std::pair<uint8_t, const GraphEntity *>> & records, NewMessage new_message)
+{
+  std::vector<MessageWriter> messages;
+  size_t count_offset = 0;
+  uint32_t count = 0;
+  auto start_message = [&]() {
+      messages.push_back(new_message());
+      count_offset = messages.back().buffer().size();
+      messages.back().put_u32(0);
+      count = 0;
+    };
+  start_message();
+  for (const auto & record : records) {
+    const size_t size = messages.back().buffer().size();
+    messages.back().put_entity(record.first, *record.second);
+    if (messages.back().buffer().size() > kMaxDiscoveryMessageSize && count > 0) {
+      messages.back().buffer().resize(size);
+      messages.back().patch_u32(count_offset, count);
+      start_message();
+      messages.back().put_entity(record.first, *record.second);
+    }
+    ++count;
+  }
+  messages.back().patch_u32(count_offset, count);
+  return messages;
+}
+
+class MessageReader
+{
+public:
+  MessageReader(const uint8_t * data, size_t length)
+  : data_(data), length_(length), offset_(0)
+  {
+  }
+
+  bool get_u8(uint8_t & value)
+  {
+    if (length_ - offset_ < sizeof(value)) {
+      return false;
+    }
+    value = data_[offset_++];
+    return true;
+  }
+
+  bool get_u32(uint32_t & value)
+  {
+    if (length_ - offset_ < sizeof(value)) {
+      return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      value |= static_cast<uint32_t>(data_[offset_++]) << (8 * i);
+    }
+    return true;
+  }
+
+  bool get_u64(uint64_t & value)
+  {
+    if (length_ - offset_ < sizeof(value)) {
+      return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      value |= static_cast<uint64_t>(data_[offset_++]) << (8 * i);
+    }
+    return true;
+  }
+
+  bool get_gid(Gid & gid)
+  {
+    if (length_ - offset_ < gid.size()) {
+      return false;
+    }
+    std::copy(data_ + offset_, data_ + offset_ + gid.size(), gid.begin());
+    offset_ += gid.size();
+    return true;
+  }
+
+  bool get_string(std::string & value)
+  {
+    uint32_t size = 0;
+    if (!get_u32(size) || length_ - offset_ < size) {
+      return false;
+    }
+    value.assign(reinterpret_cast<const char *>(data_ + offset_), size);
+    offset_ += size;
+    return true;
+  }
+
+  bool get_time(rmw_time_t & value)
+  {
+    uint64_t sec = 0;
+    uint64_t nsec = 0;
+    if (!get_u64(sec) || !get_u64(nsec)) {
+      return false;
+    }
+    value.sec = sec;
+    value.nsec = nsec;
+    return true;
+  }
+
+  bool get_qos(rmw_qos_profile_t & qos)
+  {
+    uint8_t history = 0;
+    uint32_t depth = 0;
+    uint8_t reliability = 0;
+    uint8_t durability = 0;
+    uint8_t liveliness = 0;
+    uint8_t avoid_ros_namespace_conventions = 0;
+    if (!get_u8(history) || !get_u32(depth) || !get_u8(reliability) || !get_u8(durability) ||
+      !get_time(qos.deadline) || !get_time(qos.lifespan) || !get_u8(liveliness) ||
+      !get_time(qos.liveliness_lease_duration) || !get_u8(avoid_ros_namespace_conventions))
+    {
+      return false;
+    }
+    qos.history = static_cast<rmw_qos_history_policy_t>(history);
+    qos.depth = depth;
+    qos.reliability = static_cast<rmw_qos_reliability_policy_t>(reliability);
+    qos.durability = static_cast<rmw_qos_durability_policy_t>(durability);
+    qos.liveliness = static_cast<rmw_qos_liveliness_policy_t>(liveliness);
+    qos.avoid_ros_namespace_conventions = avoid_ros_namespace_conventions != 0;
+    return true;
+  }
+
+  bool get_entity(uint8_t & op, GraphEntity & entity)
+  {
+    uint8_t kind = 0;
+    if (!get_u8(op) || op > 1 || !get_u8(kind) ||
+      kind > static_cast<uint8_t>(EntityKind::CLIENT) || !get_gid(entity.gid))
+    {
+      return false;
+    }
+    entity.kind = static_cast<EntityKind>(kind);
+    if (op != 0) {
+      return true;
+    }
+    uint32_t parameter_count = 0;
+    if (!get_gid(entity.node_gid) || !get_string(entity.name) ||
+      !get_string(entity.namespace_) || !get_string(entity.enclave) ||
+      !get_string(entity.type_name) || !get_u64(entity.type_hash) || !get_qos(entity.qos) ||
+      !get_string(entity.filter_expression) || !get_u32(parameter_count) ||
+      // every parameter takes at least its length
+      parameter_count > length_ - offset_)
+    {
+      return false;
+    }
+    entity.filter_parameters.resize(parameter_count);
+    for (std::string & parameter : entity.filter_parameters) {
+      if (!get_string(parameter)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  const uint8_t * data_;
+  size_t length_;
+  size_t offset_;
+};
+
+}  // namespace
+
+GraphCache::GraphCache(size_t domain_id)
+: domain_id_(domain_id),
+  heartbeat_period_(
+    get_env_milliseconds("RMW_LIBP2P_GRAPH_HEARTBEAT_PERIOD_MS", kDefaultHeartbeatPeriod)),
+  snapshot_period_(
+    get_env_milliseconds("RMW_LIBP2P_GRAPH_SNAPSHOT_PERIOD_MS", kDefaultSnapshotPeriod)),
+  lease_duration_(heartbeat_period_ * kLeaseHeartbeats),
+  notification_interval_(
+    get_env_milliseconds(
+      "RMW_LIBP2P_GRAPH_NOTIFICATION_INTERVAL_MS", kDefaultNotificationInterval)),
+  node_handle_(nullptr),
+  publisher_handle_(nullptr),
+  subscription_handle_(nullptr),
+  running_(false),
+  snapshot_requested_(false),
+  sequence_number_(0),
+  pending_changes_(false),
+  random_engine_(std::random_device{}()),
+  liveliness_asserted_(false)
+{
+  origin_ = generate_gid();
+  OriginState & self = origins_[origin_];
+  self.synchronized = true;
+  self.sequence_number = 0;
+}
+
+GraphCache::~GraphCache()
+{
+  shutdown();
+}
+
+bool
+GraphCache::start()
+{
+  const std::string topic_name = "rmw_libp2p/graph/" + std::to_string(domain_id_);
+
+  node_handle_ = rs_libp2p_custom_node_new();
+  if (!node_handle_) {
+    return false;
+  }
+  // Discovery traffic is small, and liveliness heartbeats must not wait behind data
+  publisher_handle_ = rs_libp2p_custom_publisher_new(
+    node_handle_, topic_name.c_str(), false, false, 0, 0,
+    static_cast<uint8_t>(TopicPriority::CONTROL));
+  if (!publisher_handle_) {
+    return false;
+  }
+  subscription_handle_ = rs_libp2p_custom_subscription_new(
+    node_handle_, topic_name.c_str(), this, GraphCache::on_discovery_message, false, false);
+  if (!subscription_handle_) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  running_ = true;
+  worker_ = std::thread(&GraphCache::run, this);
+  return true;
+}
+
+void
+GraphCache::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  condition_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+
+  if (publisher_handle_) {
+    // Best effort, remote caches will expire our entities after the lease otherwise
+    MessageWriter writer(MessageKind::LEAVE, origin_, sequence_number_);
+    publish(writer.buffer());
+  }
+
+  // The subscription must go first, it guarantees no discovery callback is running afterwards
+  if (subscription_handle_) {
+    rs_libp2p_custom_subscription_free(subscription_handle_);
+    subscription_handle_ = nullptr;
+  }
+  if (publisher_handle_) {
+    rs_libp2p_custom_publisher_free(publisher_handle_);
+    publisher_handle_ = nullptr;
+  }
+  if (node_handle_) {
+    rs_libp2p_custom_node_free(node_handle_);
+    node_handle_ = nullptr;
+  }
+}
+
+Gid
+GraphCache::generate_gid()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Gid gid;
+  for (size_t i = 0; i < gid.size(); i += sizeof(uint64_t)) {
+    uint64_t value = random_engine_();
+    memcpy(gid.data() + i, &value, sizeof(value));
+  }
+  return gid;
+}
+
+void
+GraphCache::add_node(
+  const Gid & gid, const std::string & name, const std::string & namespace_,
+  const std::string & enclave)
+{
+  GraphEntity entity{};
+  entity.kind = EntityKind::NODE;
+  entity.gid = gid;
+  entity.name = name;
+  entity.namespace_ = namespace_;
+  entity.enclave = enclave;
+  add_local_entity(std::move(entity));
+}
+
+void
+GraphCache::add_publisher(
+  const Gid & gid, const Gid & node_gid, const std::string & topic_name,
+  const std::string & type_name, uint64_t type_hash, const rmw_qos_profile_t & qos)
+{
+  GraphEntity entity{};
+  entity.kind = EntityKind::PUBLISHER;
+  entity.gid = gid;
+  entity.node_gid = node_gid;
+  entity.name = topic_name;
+  entity.type_name = type_name;
+  entity.type_hash = type_hash;
+  entity.qos = qos;
+  add_local_entity(std::move(entity));
+}
+
+void
+GraphCache::add_subscription(
+  const Gid & gid, const Gid & node_gid, const std::string & topic_name,
+  const std::string & type_name, uint64_t type_hash, const rmw_qos_profile_t & qos,
+  const std::string & filter_expression, const std::vector<std::string> & filter_parameters)
+{
+  GraphEntity entity{};
+  entity.kind = EntityKind::SUBSCRIPTION;
+  entity.gid = gid;
+  entity.node_gid = node_gid;
+  entity.name = topic_name;
+  entity.type_name = type_name;
+  entity.type_hash = type_hash;
+  entity.qos = qos;
+  entity.filter_expression = filter_expression;
+  entity.filter_parameters = filter_parameters;
+  add_local_entity(std::move(entity));
+}
+
+void
+GraphCache::set_content_filter(
+  const Gid & gid, const std::string & filter_expression,
+  const std::vector<std::string> & filter_parameters)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const GraphEntity * current = find_entity(gid);
+  if (!current || current->origin != origin_ || current->kind != EntityKind::SUBSCRIPTION) {
+    return;
+  }
+  // Re-announcing the entity replaces it everywhere, matches included
+  GraphEntity entity = *current;
+  entity.filter_expression = filter_expression;
+  entity.filter_parameters = filter_parameters;
+  pending_records_.push_back(Record{RecordOp::ADD, entity});
+  apply_add(origin_, std::move(entity));
+  condition_.notify_all();
+}
+
+void
+GraphCache::add_service(
+  const Gid & gid, const Gid & node_gid, const std::string & service_name,
+  const std::string & type_name)
+{
+  GraphEntity entity{};
+  entity.kind = EntityKind::SERVICE;
+  entity.gid = gid;
+  entity.node_gid = node_gid;
+  entity.name = service_name;
+  entity.type_name = type_name;
+  add_local_entity(std::move(entity));
+}
+
+void
+GraphCache::add_client(
+  const Gid & gid, const Gid & node_gid, const std::string & service_name,
+  const std::string & type_name)
+{
+  GraphEntity entity{};
+  entity.kind = EntityKind::CLIENT;
+  entity.gid = gid;
+  entity.node_gid = node_gid;
+  entity.name = service_name;
+  entity.type_name = type_name;
+  add_local_entity(std::move(entity));
+}
+
+void
+GraphCache::add_local_entity(GraphEntity && entity)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_records_.push_back(Record{RecordOp::ADD, entity});
+  apply_add(origin_, std::move(entity));
+  condition_.notify_all();
+}
+
+void
+GraphCache::remove_entity(const Gid & gid)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const GraphEntity * entity = find_entity(gid);
+  if (!entity || entity->origin != origin_) {
+    return;
+  }
+  Record record{RecordOp::REMOVE, GraphEntity{}};
+  record.entity.kind = entity->kind;
+  record.entity.gid = gid;
+  pending_records_.push_back(std::move(record));
+  apply_remove(origin_, gid);
+  liveliness_publishers_.erase(gid);
+  condition_.notify_all();
+}
+
+void
+GraphCache::add_liveliness_publisher(const Gid & gid, EventListener * event_listener)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const GraphEntity * entity = find_entity(gid);
+  if (!entity || entity->kind != EntityKind::PUBLISHER ||
+    liveliness_lease(entity->qos).count() == 0)
+  {
+    return;
+  }
+  liveliness_publishers_[gid] = LivelinessPublisher{
+    event_listener,
+    entity->qos.liveliness == RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC,
+    liveliness_lease(entity->qos),
+    std::chrono::steady_clock::now()};
+  // The worker needs to take the new lease into account
+  liveliness_asserted_ = true;
+  condition_.notify_all();
+}
+
+void
+GraphCache::assert_liveliness(const Gid & gid)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = liveliness_publishers_.find(gid);
+  if (it == liveliness_publishers_.end() || !it->second.manual) {
+    return;
+  }
+  liveliness_asserted_ = true;
+  condition_.notify_all();
+}
+
+void
+GraphCache::apply_add(const Gid & origin, GraphEntity && entity)
+{
+  auto it = entities_.find(entity.gid);
+  if (it != entities_.end()) {
+    if (it->second.origin != origin) {
+      // GIDs are unique, this can only be a stale announcement from a previous owner
+      return;
+    }
+    if (same_entity(it->second, entity)) {
+      // Typically a snapshot repeating what we already know, nothing to notify
+      return;
+    }
+    unindex_entity(it->second);
+    entities_.erase(it);
+    origins_[origin].automatic_publishers.erase(entity.gid);
+  }
+  entity.origin = origin;
+  origins_[origin].entities.insert(entity.gid);
+  if (is_automatic_leased_publisher(entity)) {
+    origins_[origin].automatic_publishers.insert(entity.gid);
+  }
+  index_entity(entity);
+  mark_changed();
+  entities_.emplace(entity.gid, std::move(entity));
+}
+
+void
+GraphCache::apply_remove(const Gid & origin, const Gid & gid)
+{
+  auto it = entities_.find(gid);
+  if (it == entities_.end() || it->second.origin != origin) {
+    return;
+  }
+  mark_changed();
+  unindex_entity(it->second);
+  entities_.erase(it);
+  origins_[origin].entities.erase(gid);
+  origins_[origin].automatic_publishers.erase(gid);
+}
+
+void
+GraphCache::index_entity(const GraphEntity & entity)
+{
+  switch (entity.kind) {
+    case EntityKind::NODE:
+      nodes_by_name_.emplace(std::make_pair(entity.name, entity.namespace_), entity.gid);
+      return;
+    case EntityKind::PUBLISHER:
+    case EntityKind::SUBSCRIPTION:
+    case EntityKind::SERVICE:
+    case EntityKind::CLIENT:
+      break;
+  }
+
+  bool is_topic = entity.kind == EntityKind::PUBLISHER || entity.kind == EntityKind::SUBSCRIPTION;
+  NameEntry & entry = is_topic ? topics_[entity.name] : services_[entity.name];
+  if (entity.kind == EntityKind::PUBLISHER || entity.kind == EntityKind::SERVICE) {
+    entry.writers.insert(entity.gid);
+  } else {
+    entry.readers.insert(entity.gid);
+  }
+  entry.types[entity.type_name]++;
+  node_endpoints_[entity.node_gid].insert(entity.gid);
+
+  if (is_topic) {
+    update_matches(entity, true);
+  }
+}
+
+void
+GraphCache::unindex_entity(const GraphEntity & entity)
+{
+  switch (entity.kind) {
+    case EntityKind::NODE:
+      {
+        auto range = nodes_by_name_.equal_range(std::make_pair(entity.name, entity.namespace_));
+        for (auto it = range.first; it != range.second; ++it) {
+          if (it->second == entity.gid) {
+            nodes_by_name_.erase(it);
+            break;
+          }
+        }
+        return;
+      }
+    case EntityKind::PUBLISHER:
+    case EntityKind::SUBSCRIPTION:
+    case EntityKind::SERVICE:
+    case EntityKind::CLIENT:
+      break;
+  }
+
+  bool is_topic = entity.kind == EntityKind::PUBLISHER || entity.kind == EntityKind::SUBSCRIPTION;
+  auto & names = is_topic ? topics_ : services_;
+  auto name_it = names.find(entity.name);
+  if (name_it != names.end()) {
+    NameEntry & entry = name_it->second;
+    entry.writers.erase(entity.gid);
+    entry.readers.erase(entity.gid);
+    auto type_it = entry.types.find(entity.type_name);
+    if (type_it != entry.types.end() && --type_it->second == 0) {
+      entry.types.erase(type_it);
+    }
+    if (entry.writers.empty() && entry.readers.empty()) {
+      names.erase(name_it);
+    }
+  }
+
+  auto node_it = node_endpoints_.find(entity.node_gid);
+  if (node_it != node_endpoints_.end()) {
+    node_it->second.erase(entity.gid);
+    if (node_it->second.empty()) {
+      node_endpoints_.erase(node_it);
+    }
+  }
+
+  if (is_topic) {
+    update_matches(entity, false);
+  }
+}
+
+void
+GraphCache::update_matches(const GraphEntity & entity, bool added)
+{
+  auto range = match_listeners_.equal_range(entity.name);
+  for (auto it = range.first; it != range.second; ++it) {
+    const MatchListener & listener = it->second;
+    if (listener.kind == entity.kind) {
+      continue;
+    }
+    if (!added && listener.delta_decoder) {
+      listener.delta_decoder->remove_publisher(entity.gid);
+    }
+    if (compatible_types(listener.type_hash, entity.type_hash)) {
+      if (listener.matched_count) {
+        if (added) {
+          listener.matched_count->fetch_add(1);
+        } else {
+          listener.matched_count->fetch_sub(1);
+        }
+      }
+      if (entity.kind == EntityKind::PUBLISHER) {
+        listener.event_listener->update_liveliness(
+          entity.gid, liveliness_lease(entity.qos), added);
+      } else if (listener.matched_filters) {
+        listener.matched_filters->update(
+          entity.gid, entity.filter_expression, entity.filter_parameters, added);
+      }
+    } else {
+      listener.event_listener->update_incompatible_type(added);
+    }
+  }
+}
+
+void
+GraphCache::notify_publisher_alive(const GraphEntity & publisher)
+{
+  auto range = match_listeners_.equal_range(publisher.name);
+  for (auto it = range.first; it != range.second; ++it) {
+    const MatchListener & listener = it->second;
+    if (listener.kind == EntityKind::SUBSCRIPTION &&
+      compatible_types(listener.type_hash, publisher.type_hash))
+    {
+      listener.event_listener->notify_publisher_alive(publisher.gid);
+    }
+  }
+}
+
+void
+GraphCache::refresh_liveliness(const Gid & origin, const std::vector<Gid> & asserted)
+{
+  auto origin_it = origins_.find(origin);
+  if (origin_it == origins_.end()) {
+    return;
+  }
+  for (const Gid & gid : origin_it->second.automatic_publishers) {
+    const GraphEntity * entity = find_entity(gid);
+    if (entity) {
+      notify_publisher_alive(*entity);
+    }
+  }
+  for (const Gid & gid : asserted) {
+    const GraphEntity * entity = find_entity(gid);
+    if (entity && entity->origin == origin && entity->kind == EntityKind::PUBLISHER) {
+      notify_publisher_alive(*entity);
+    }
+  }
+}
+
+std::chrono::steady_clock::time_point
+GraphCache::next_liveliness_heartbeat() const
+{
+  auto next = std::chrono::steady_clock::time_point::max();
+  for (const auto & publisher : liveliness_publishers_) {
+    const LivelinessPublisher & liveliness = publisher.second;
+    // Publications reach the subscriptions as well, no heartbeat needed after them
+    auto proven = std::max(liveliness.last_proof, liveliness.event_listener->last_activity());
+    if (liveliness.manual && liveliness.event_listener->last_assertion() <= proven) {
+      // Nothing to prove, the publisher is going to lose its liveliness
+      continue;
+    }
+    // Leave half of the lease for the heartbeat to get through
+    next = std::min(next, proven + liveliness.lease / 2);
+  }
+  return next;
+}
+
+std::vector<Gid>
+GraphCache::prove_liveliness(std::chrono::steady_clock::time_point now, bool heartbeat)
+{
+  std::vector<Gid> asserted;
+  for (auto & publisher : liveliness_publishers_) {
+    LivelinessPublisher & liveliness = publisher.second;
+    if (liveliness.manual) {
+      auto proven = std::max(liveliness.last_proof, liveliness.event_listener->last_activity());
+      if (!heartbeat || liveliness.event_listener->last_assertion() <= proven) {
+        continue;
+      }
+      asserted.push_back(publisher.first);
+    }
+    liveliness.last_proof = now;
+    // Local subscriptions do not receive our own announcements
+    const GraphEntity * entity = find_entity(publisher.first);
+    if (entity) {
+      notify_publisher_alive(*entity);
+    }
+  }
+  return asserted;
+}
+
+void
+GraphCache::forget_origin(const Gid & origin)
+{
+  auto origin_it = origins_.find(origin);
+  if (origin_it == origins_.end()) {
+    return;
+  }
+  for (const Gid & gid : origin_it->second.entities) {
+    auto it = entities_.find(gid);
+    if (it != entities_.end()) {
+      mark_changed();
+      unindex_entity(it->second);
+      entities_.erase(it);
+    }
+  }
+  origins_.erase(origin_it);
+}
+
+void
+GraphCache::mark_changed()
+{
+  if (!pending_changes_) {
+    condition_.notify_all();
+  }
+  pending_changes_ = true;
+}
+
+void
+GraphCache::add_graph_listener(GuardCondition * guard_condition)
+{
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  graph_listeners_.insert(guard_condition);
+}
+
+void
+GraphCache::remove_graph_listener(GuardCondition * guard_condition)
+{
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  graph_listeners_.erase(guard_condition);
+}
+
+void
+GraphCache::add_match_listener(
+  const std::string & topic_name, EntityKind kind, uint64_t type_hash,
+  std::atomic_size_t * matched_count, EventListener * event_listener,
+  MatchedFilters * matched_filters, DeltaDecoder * delta_decoder)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  match_listeners_.emplace(
+    topic_name,
+    MatchListener{kind, type_hash, matched_count, event_listener, matched_filters, delta_decoder});
+
+  size_t count = 0;
+  auto it = topics_.find(topic_name);
+  if (it != topics_.end()) {
+    const std::set<Gid> & others =
+      kind == EntityKind::PUBLISHER ? it->second.readers : it->second.writers;
+    for (const Gid & gid : others) {
+      const GraphEntity * entity = find_entity(gid);
+      if (!entity) {
+        continue;
+      }
+      if (compatible_types(type_hash, entity->type_hash)) {
+        count++;
+        if (kind == EntityKind::SUBSCRIPTION) {
+          event_listener->update_liveliness(gid, liveliness_lease(entity->qos), true);
+        } else if (matched_filters) {
+          matched_filters->update(
+            gid, entity->filter_expression, entity->filter_parameters, true);
+        }
+      } else {
+        event_listener->update_incompatible_type(true);
+      }
+    }
+  }
+  if (matched_count) {
+    matched_count->store(count);
+  }
+}
+
+void
+GraphCache::remove_match_listener(
+  const std::string & topic_name, EventListener * event_listener)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto range = match_listeners_.equal_range(topic_name);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.event_listener == event_listener) {
+      match_listeners_.erase(it);
+      return;
+    }
+  }
+}
+
+void
+GraphCache::notify_graph_listeners()
+{
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  for (GuardCondition * guard_condition : graph_listeners_) {
+    guard_condition->trigger();
+  }
+}
+
+void
+GraphCache::on_discovery_message(
+  const CustomSubscriptionHandle * subscription_handle, uint8_t * message,
+  uintptr_t length)
+{
+  // The discovery subscription is registered with the graph cache itself as its handle
+  auto graph_cache =
+    static_cast<GraphCache *>(static_cast<void *>(subscription_handle->custom_subscription_info));
+  graph_cache->handle_message(message, length);
+  rs_libp2p_message_free(message, length);
+}
+
+void
+GraphCache::on_server_availability(
+  const CustomNodeHandle * node_handle, const char * service_name, bool available)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp", "%s(%s, %d)", __FUNCTION__, service_name, available);
+  GraphCache * graph_cache = node_handle->graph_cache;
+  std::lock_guard<std::mutex> lock(graph_cache->mutex_);
+  graph_cache->mark_changed();
+}
+
+void
+GraphCache::handle_message(const uint8_t * data, size_t length)
+{
+  MessageReader reader(data, length);
+  uint8_t version = 0;
+  uint8_t raw_kind = 0;
+  Gid origin;
+  uint64_t sequence_number = 0;
+  if (!reader.get_u8(version) || version != kDiscoveryVersion || !reader.get_u8(raw_kind) ||
+    !reader.get_gid(origin) || !reader.get_u64(sequence_number))
+  {
+    RCUTILS_LOG_DEBUG_NAMED("rmw_libp2p_cpp", "dropping malformed discovery message");
+    return;
+  }
+  const MessageKind kind = static_cast<MessageKind>(raw_kind);
+
+  // Decode everything before touching the cache, so a malformed message is dropped as a whole
+  std::vector<Record> records;
+  std::vector<Gid> asserted;
+  Gid target;
+  uint32_t chunk_index = 0;
+  uint32_t chunk_count = 1;
+  if (kind == MessageKind::HEARTBEAT) {
+    uint32_t count = 0;
+    if (!reader.get_u32(count)) {
+      return;
+    }
+    asserted.reserve(std::min<size_t>(count, length));
+    for (uint32_t i = 0; i < count; ++i) {
+      Gid gid;
+      if (!reader.get_gid(gid)) {
+        return;
+      }
+      asserted.push_back(gid);
+    }
+  } else if (kind == MessageKind::DELTA || kind == MessageKind::SNAPSHOT) {
+    if (kind == MessageKind::SNAPSHOT &&
+      (!reader.get_u32(chunk_index) || !reader.get_u32(chunk_count) ||
+      chunk_index >= chunk_count))
+    {
+      return;
+    }
+    uint32_t count = 0;
+    if (!reader.get_u32(count)) {
+      return;
+    }
+    records.reserve(std::min<size_t>(count, length));
+    for (uint32_t i = 0; i < count; ++i) {
+      uint8_t op = 0;
+      GraphEntity entity{};
+      if (!reader.get_entity(op, entity)) {
+        RCUTILS_LOG_DEBUG_NAMED("rmw_libp2p_cpp", "dropping malformed discovery record");
+        return;
+      }
+      records.push_back(Record{static_cast<RecordOp>(op), std::move(entity)});
+    }
+  } else if (kind == MessageKind::SNAPSHOT_REQUEST) {
+    if (!reader.get_gid(target)) {
+      return;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (origin == origin_) {
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+
+  switch (kind) {
+    case MessageKind::SNAPSHOT_REQUEST:
+      if (target == origin_) {
+        snapshot_requested_ = true;
+        condition_.notify_all();
+      }
+      return;
+    case MessageKind::LEAVE:
+      forget_origin(origin);
+      return;
+    case MessageKind::HEARTBEAT:
+    case MessageKind::DELTA:
+    case MessageKind::SNAPSHOT:
+      break;
+    default:
+      return;
+  }
+
+  auto origin_it = origins_.find(origin);
+  if (origin_it == origins_.end()) {
+    OriginState state{};
+    state.synchronized = false;
+    state.sequence_number = 0;
+    origin_it = origins_.emplace(origin, std::move(state)).first;
+  }
+  OriginState & state = origin_it->second;
+  state.last_seen = now;
+
+  if (kind == MessageKind::HEARTBEAT) {
+    refresh_liveliness(origin, asserted);
+    if (!state.synchronized || sequence_number > state.sequence_number) {
+      request_snapshot(origin, now);
+    }
+    return;
+  }
+
+  if (kind == MessageKind::DELTA) {
+    if (state.synchronized && sequence_number <= state.sequence_number) {
+      // Duplicate or reordered delta, already covered
+      return;
+    }
+    if (!state.synchronized || sequence_number != state.sequence_number + 1) {
+      // Missed something, the records are still applied since they are idempotent
+      request_snapshot(origin, now);
+    }
+    for (Record & record : records) {
+      if (record.op == RecordOp::ADD) {
+        apply_add(origin, std::move(record.entity));
+      } else {
+        apply_remove(origin, record.entity.gid);
+      }
+    }
+    state.sequence_number = sequence_number;
+    refresh_liveliness(origin, asserted);
+    return;
+  }
+
+  // SNAPSHOT: replace everything known about this origin once all the chunks arrived, the
+  // additions are applied right away since they are idempotent. Deltas are applied even before
+  // the first snapshot completes, a snapshot older than them would undo them.
+  if (sequence_number < state.sequence_number) {
+    return;
+  }
+  if (state.snapshot_chunks.empty() || sequence_number != state.snapshot_sequence_number ||
+    chunk_count != state.snapshot_chunk_count)
+  {
+    state.snapshot_sequence_number = sequence_number;
+    state.snapshot_chunk_count = chunk_count;
+    state.snapshot_chunks.clear();
+    state.snapshot_entities.clear();
+  }
+  if (!state.snapshot_chunks.insert(chunk_index).second) {
+    return;
+  }
+  for (Record & record : records) {
+    state.snapshot_entities.insert(record.entity.gid);
+    if (record.op == RecordOp::ADD) {
+      apply_add(origin, std::move(record.entity));
+    }
+  }
+  if (state.snapshot_chunks.size() == chunk_count) {
+    std::vector<Gid> stale;
+    for (const Gid & gid : state.entities) {
+      if (state.snapshot_entities.find(gid) == state.snapshot_entities.end()) {
+        stale.push_back(gid);
+      }
+    }
+    for (const Gid & gid : stale) {
+      apply_remove(origin, gid);
+    }
+    state.synchronized = true;
+    state.sequence_number = std::max(state.sequence_number, sequence_number);
+    state.snapshot_chunks.clear();
+    state.snapshot_entities.clear();
+  }
+  refresh_liveliness(origin, asserted);
+}
+
+void
+GraphCache::request_snapshot(const Gid & origin, std::chrono::steady_clock::time_point now)
+{
+  OriginState & state = origins_[origin];
+  // Give the origin a chance to answer before asking again
+  if (state.last_snapshot_request != std::chrono::steady_clock::time_point() &&
+    now - state.last_snapshot_request < heartbeat_period_ * 2)
+  {
+    return;
+  }
+  state.last_snapshot_request = now;
+  pending_snapshot_requests_.push_back(origin);
+  condition_.notify_all();
+}
+
+std::vector<std::vector<uint8_t>>
+GraphCache::encode_snapshot() const
+{
+  const OriginState & self = origins_.at(origin_);
+  std::vector<std::pair<uint8_t, const GraphEntity *>> records;
+  records.reserve(self.entities.size());
+  // Nodes first, so that receivers can resolve the owner of the endpoints that follow
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const Gid & gid : self.entities) {
+      const GraphEntity & entity = entities_.at(gid);
+      if ((entity.kind == EntityKind::NODE) == (pass == 0)) {
+        records.emplace_back(static_cast<uint8_t>(RecordOp::ADD), &entity);
+      }
+    }
+  }
+
+  uint32_t chunk_index = 0;
+  size_t chunk_count_offset = 0;
+  std::vector<MessageWriter> chunks = write_records(
+    records, [this, &chunk_index, &chunk_count_offset]() {
+      MessageWriter writer(MessageKind::SNAPSHOT, origin_, sequence_number_);
+      writer.put_u32(chunk_index++);
+      chunk_count_offset = writer.buffer().size();
+      writer.put_u32(0);
+      return writer;
+    });
+  std::vector<std::vector<uint8_t>> messages;
+  for (MessageWriter & chunk : chunks) {
+    chunk.patch_u32(chunk_count_offset, static_cast<uint32_t>(chunks.size()));
+    messages.push_back(std::move(chunk.buffer()));
+  }
+  return messages;
+}
+
+void
+GraphCache::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  auto next_heartbeat = now;
+  // Announce ourselves right away
+  auto next_snapshot = now;
+
+  while (running_) {
+    auto deadline = std::min(std::min(next_heartbeat, next_snapshot), next_liveliness_heartbeat());
+    if (pending_changes_) {
+      deadline = std::min(deadline, last_notification_ + notification_interval_);
+    }
+    condition_.wait_until(
+      lock, deadline, [this]() {
+        return !running_ || !pending_records_.empty() || snapshot_requested_ ||
+        !pending_snapshot_requests_.empty() || liveliness_asserted_ ||
+        (pending_changes_ &&
+        std::chrono::steady_clock::now() >= last_notification_ + notification_interval_);
+      });
+    if (!running_) {
+      break;
+    }
+    now = std::chrono::steady_clock::now();
+    liveliness_asserted_ = false;
+    const bool liveliness_due = now >= next_liveliness_heartbeat();
+
+    std::vector<std::vector<uint8_t>> outgoing;
+    if (!pending_records_.empty()) {
+      std::vector<std::pair<uint8_t, const GraphEntity *>> records;
+      records.reserve(pending_records_.size());
+      for (const Record & record : pending_records_) {
+        records.emplace_back(static_cast<uint8_t>(record.op), &record.entity);
+      }
+      std::vector<MessageWriter> deltas = write_records(
+        records, [this]() {
+          return MessageWriter(MessageKind::DELTA, origin_, ++sequence_number_);
+        });
+      for (MessageWriter & delta : deltas) {
+        outgoing.push_back(std::move(delta.buffer()));
+      }
+      pending_records_.clear();
+      origins_[origin_].sequence_number = sequence_number_;
+      next_heartbeat = now + heartbeat_period_;
+    }
+    if (snapshot_requested_ || now >= next_snapshot) {
+      for (std::vector<uint8_t> & chunk : encode_snapshot()) {
+        outgoing.push_back(std::move(chunk));
+      }
+      snapshot_requested_ = false;
+      next_snapshot = now + snapshot_period_;
+      next_heartbeat = now + heartbeat_period_;
+    }
+    // Manual assertions need a heartbeat to be listed, automatic liveliness is proven by any
+    // announcement
+    if (now >= next_heartbeat || liveliness_due) {
+      std::vector<Gid> asserted = prove_liveliness(now, true);
+      MessageWriter writer(MessageKind::HEARTBEAT, origin_, sequence_number_);
+      writer.put_u32(static_cast<uint32_t>(asserted.size()));
+      for (const Gid & gid : asserted) {
+        writer.put_gid(gid);
+      }
+      outgoing.push_back(std::move(writer.buffer()));
+      next_heartbeat = now + heartbeat_period_;
+    } else if (!outgoing.empty()) {
+      prove_liveliness(now, false);
+    }
+    for (const Gid & target : pending_snapshot_requests_) {
+      MessageWriter writer(MessageKind::SNAPSHOT_REQUEST, origin_, sequence_number_);
+      writer.put_gid(target);
+      outgoing.push_back(std::move(writer.buffer()));
+    }
+    pending_snapshot_requests_.clear();
+
+    std::vector<Gid> expired;
+    for (const auto & origin : origins_) {
+      if (origin.first != origin_ && now - origin.second.last_seen > lease_duration_) {
+        expired.push_back(origin.first);
+      }
+    }
+    for (const Gid & origin : expired) {
+      forget_origin(origin);
+    }
+
+    // Coalesce graph changes, the first change after a quiet period is notified right away
+    bool changed = false;
+    if (pending_changes_ && now >= last_notification_ + notification_interval_) {
+      changed = true;
+      pending_changes_ = false;
+      last_notification_ = now;
+    }
+
+    lock.unlock();
+    for (const auto & message : outgoing) {
+      publish(message);
+    }
+    if (changed) {
+      notify_graph_listeners();
+    }
+    lock.lock();
+  }
+}
+
+void
+GraphCache::publish(const std::vector<uint8_t> & message)
+{
+  rs_libp2p_custom_publisher_publish_raw(publisher_handle_, message.data(), message.size());
+}
+
+const GraphEntity *
+GraphCache::find_entity(const Gid & gid) const
+{
+  auto it = entities_.find(gid);
+  return it == entities_.end() ? nullptr : &it->second;
+}
+
+size_t
+GraphCache::count_publishers(const std::string & topic_name) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = topics_.find(topic_name);
+  return it == topics_.end() ? 0u : it->second.writers.size();
+}
+
+size_t
+GraphCache::count_subscribers(const std::string & topic_name) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = topics_.find(topic_name);
+  return it == topics_.end() ? 0u : it->second.readers.size();
+}
+
+void
+GraphCache::get_node_names(
+  std::vector<std::string> & names,
+  std::vector<std::string> & namespaces,
+  std::vector<std::string> & enclaves) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  names.reserve(nodes_by_name_.size());
+  namespaces.reserve(nodes_by_name_.size());
+  enclaves.reserve(nodes_by_name_.size());
+  for (const auto & node : nodes_by_name_) {
+    names.push_back(node.first.first);
+    namespaces.push_back(node.first.second);
+    const GraphEntity * entity = find_entity(node.second);
+    enclaves.push_back(entity ? entity->enclave : std::string());
+  }
+}
+
+void
+GraphCache::get_topic_names_and_types(NamesAndTypes & topic_names_and_types) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto & topic : topics_) {
+    auto & types = topic_names_and_types[topic.first];
+    for (const auto & type : topic.second.types) {
+      types.insert(type.first);
+    }
+  }
+}
+
+void
+GraphCache::get_service_names_and_types(NamesAndTypes & service_names_and_types) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto & service : services_) {
+    auto & types = service_names_and_types[service.first];
+    for (const auto & type : service.second.types) {
+      types.insert(type.first);
+    }
+  }
+}
+
+bool
+GraphCache::get_names_and_types_by_node(
+  const std::string & node_name,
+  const std::string & node_namespace,
+  EntityKind kind,
+  NamesAndTypes & names_and_types) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto range = nodes_by_name_.equal_range(std::make_pair(node_name, node_namespace));
+  if (range.first == range.second) {
+    return false;
+  }
+  for (auto node_it = range.first; node_it != range.second; ++node_it) {
+    auto endpoints_it = node_endpoints_.find(node_it->second);
+    if (endpoints_it == node_endpoints_.end()) {
+      continue;
+    }
+    for (const Gid & gid : endpoints_it->second) {
+      const GraphEntity * entity = find_entity(gid);
+      if (entity && entity->kind == kind) {
+        names_and_types[entity->name].insert(entity->type_name);
+      }
+    }
+  }
+  return true;
+}
+
+void
+GraphCache::get_endpoints_info_by_topic(
+  const std::string & topic_name,
+  EntityKind kind,
+  std::vector<GraphEndpointInfo> & endpoints_info) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = topics_.find(topic_name);
+  if (it == topics_.end()) {
+    return;
+  }
+  const std::set<Gid> & gids =
+    kind == EntityKind::PUBLISHER ? it->second.writers : it->second.readers;
+  endpoints_info.reserve(gids.size());
+  for (const Gid & gid : gids) {
+    const GraphEntity * entity = find_entity(gid);
+    if (!entity) {
+      continue;
+    }
+    GraphEndpointInfo info;
+    const GraphEntity * node = find_entity(entity->node_gid);
+    if (node) {
+      info.node_name = node->name;
+      info.node_namespace = node->namespace_;
+    }
+    info.type_name = entity->type_name;
+    info.gid = entity->gid;
+    info.qos = entity->qos;
+    endpoints_info.push_back(std::move(info));
+  }
+}
+
+}  // namespace rmw_libp2p_cpp
@@ -43,6 +43,20 @@ public:
 
   const rs_libp2p_cdr_buffer * data() const noexcept {return buffer_;}
 
+  // Discards the bytes written so far, the allocation is kept and resized toward capacity
+  void reset(size_t capacity)
+  {
+    rs_libp2p_cdr_buffer_write_reset(buffer_, capacity);
+  }
+
+  // Bytes written so far, valid until the next write
+  const uint8_t * bytes(size_t * length) const
+  {
+    const uint8_t * data = nullptr;
+    rs_libp2p_cdr_buffer_get_data(buffer_, &data, length);
+    return data;
+  }
+
   inline WriteCDRBuffer & operator<<(const uint64_t n)
   {
     rs_libp2p_cdr_buffer_write_uint64(buffer_, n);
@@ -85,6 +99,11 @@ public:
     return *this;
   }
 
+  inline WriteCDRBuffer & operator<<(const bool n)
+  {
+    rs_libp2p_cdr_buffer_write_bool(buffer_, n);
+    return *this;
+  }
   inline WriteCDRBuffer & operator<<(const char n)
   {
     rs_libp2p_cdr_buffer_write_char(buffer_, n);
@@ -191,10 +210,11 @@ public:
     char * data;
     size_t size;
     rs_libp2p_cdr_buffer_read_string(buffer_, &data, &size);
+    // assign() and clear() keep the capacity of strings taken into repeatedly
     if (!size) {
-      s = std::string();
+      s.clear();
     } else {
-      s = std::string(data, size);
+      s.assign(data, size);
       rs_libp2p_cdr_buffer_free_string(data);
     }
     return *this;
@@ -0,0 +1,362 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__COMPACT_HPP_
+#define IMPL__COMPACT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "impl/scatter_gather.hpp"
+
+namespace rmw_libp2p_cpp
+{
+namespace compact
+{
+
+// Encoding for links where every byte counts: members follow each other without any alignment
+// padding or member counts, integers wider than a byte are LEB128 varints (zigzag encoded when
+// signed, so small negative values stay short), floating point values keep their 4 or 8 little
+// endian bytes, and strings and sequences are preceded by their length as a varint. Strings
+// have no terminator.
+//
+// There is no encapsulation header, the encoding is identified by the message header.
+
+// The longest varint, a 64 bit value in groups of 7 bits
+constexpr size_t kMaxVarintSize = 10;
+
+inline uint64_t
+zigzag(int64_t n)
+{
+  return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+inline int64_t
+unzigzag(uint64_t n)
+{
+  return static_cast<int64_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+class Writer
+{
+public:
+  // Discards the bytes written so far, the allocation is kept and resized toward capacity
+  void reset(size_t capacity)
+  {
+    buffer_.clear();
+    references_.clear();
+    if (buffer_.capacity() < capacity) {
+      buffer_.reserve(capacity);
+    } else if (buffer_.capacity() / 2 > capacity) {
+      std::vector<uint8_t> smaller;
+      smaller.reserve(capacity);
+      buffer_.swap(smaller);
+    }
+  }
+
+  // Arrays of bytes or floating point values of at least threshold bytes written from now on
+  // are referenced instead of copied, the payload is then only available through gather()
+  void reference_arrays(size_t threshold) {references_.set_threshold(threshold);}
+
+  // The whole payload as long as no array was referenced
+  const uint8_t * data() const noexcept {return buffer_.data();}
+  // Size of the payload, including the referenced arrays
+  size_t size() const noexcept {return buffer_.size() + references_.size();}
+  // Bytes held by the buffer itself
+  size_t buffered() const noexcept {return buffer_.size();}
+
+  const std::vector<Fragment> & gather()
+  {
+    return references_.gather(buffer_.data(), buffer_.size());
+  }
+
+  inline Writer & operator<<(const bool b)
+  {
+    buffer_.push_back(b ? 1 : 0);
+    return *this;
+  }
+  inline Writer & operator<<(const char c)
+  {
+    buffer_.push_back(static_cast<uint8_t>(c));
+    return *this;
+  }
+  inline Writer & operator<<(const int8_t n)
+  {
+    buffer_.push_back(static_cast<uint8_t>(n));
+    return *this;
+  }
+  inline Writer & operator<<(const uint8_t n)
+  {
+    buffer_.push_back(n);
+    return *this;
+  }
+  inline Writer & operator<<(const int16_t n) {return put_varint(zigzag(n));}
+  inline Writer & operator<<(const uint16_t n) {return put_varint(n);}
+  inline Writer & operator<<(const char16_t n) {return put_varint(n);}
+  inline Writer & operator<<(const int32_t n) {return put_varint(zigzag(n));}
+  inline Writer & operator<<(const uint32_t n) {return put_varint(n);}
+  inline Writer & operator<<(const int64_t n) {return put_varint(zigzag(n));}
+  inline Writer & operator<<(const uint64_t n) {return put_varint(n);}
+  inline Writer & operator<<(const float f)
+  {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return put_fixed(bits, 4);
+  }
+  inline Writer & operator<<(const double d)
+  {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return put_fixed(bits, 8);
+  }
+
+  template<typename T>
+  void write_array(const T * values, size_t count)
+  {
+    // Booleans are written one by one, an uninitialized one may hold any value
+    if (sizeof(T) == 1 && !std::is_same<T, bool>::value) {
+      const uint8_t * bytes = reinterpret_cast<const uint8_t *>(values);
+      if (references_.should_reference(count)) {
+        references_.add(buffer_.size(), bytes, count);
+      } else {
+        buffer_.insert(buffer_.end(), bytes, bytes + count);
+      }
+      return;
+    }
+    // Integers are varints, only floating point values keep their little endian bytes
+    if (std::is_floating_point<T>::value && references_.should_reference(count * sizeof(T)) &&
+      host_is_little_endian())
+    {
+      references_.add(buffer_.size(), values, count * sizeof(T));
+      return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      *this << values[i];
+    }
+  }
+
+  void write_string(const char * data, size_t length)
+  {
+    put_varint(length);
+    buffer_.insert(buffer_.end(), data, data + length);
+  }
+
+  // Number of UTF-16 code units, then each of them as a varint
+  void write_u16string(const uint16_t * data, size_t length)
+  {
+    put_varint(length);
+    for (size_t i = 0; i < length; ++i) {
+      put_varint(data[i]);
+    }
+  }
+
+private:
+  Writer & put_varint(uint64_t value)
+  {
+    while (value >= 0x80) {
+      buffer_.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    buffer_.push_back(static_cast<uint8_t>(value));
+    return *this;
+  }
+
+  Writer & put_fixed(uint64_t value, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      buffer_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    return *this;
+  }
+
+  std::vector<uint8_t> buffer_;
+  ReferencedArrays references_;
+};
+
+// Reading past the end, a varint that doesn't fit its type or an unterminated one throw
+// std::runtime_error, like malformed classic payloads do
+class Reader
+{
+public:
+  Reader(const uint8_t * data, size_t length)
+  : data_(data), length_(length), position_(0)
+  {
+  }
+
+  inline Reader & operator>>(bool & b)
+  {
+    require(1);
+    b = data_[position_++] != 0;
+    return *this;
+  }
+  inline Reader & operator>>(char & c)
+  {
+    require(1);
+    c = static_cast<char>(data_[position_++]);
+    return *this;
+  }
+  inline Reader & operator>>(int8_t & n)
+  {
+    require(1);
+    n = static_cast<int8_t>(data_[position_++]);
+    return *this;
+  }
+  inline Reader & operator>>(uint8_t & n)
+  {
+    require(1);
+    n = data_[position_++];
+    return *this;
+  }
+  inline Reader & operator>>(int16_t & n) {return get_signed(n);}
+  inline Reader & operator>>(uint16_t & n) {return get_unsigned(n);}
+  inline Reader & operator>>(char16_t & n) {return get_unsigned(n);}
+  inline Reader & operator>>(int32_t & n) {return get_signed(n);}
+  inline Reader & operator>>(uint32_t & n) {return get_unsigned(n);}
+  inline Reader & operator>>(int64_t & n) {return get_signed(n);}
+  inline Reader & operator>>(uint64_t & n) {return get_unsigned(n);}
+  inline Reader & operator>>(float & f)
+  {
+    const uint32_t bits = static_cast<uint32_t>(get_fixed(4));
+    memcpy(&f, &bits, sizeof(f));
+    return *this;
+  }
+  inline Reader & operator>>(double & d)
+  {
+    const uint64_t bits = get_fixed(8);
+    memcpy(&d, &bits, sizeof(d));
+    return *this;
+  }
+
+  template<typename T>
+  void read_array(T * values, size_t count)
+  {
+    if (sizeof(T) == 1 && !std::is_same<T, bool>::value) {
+      require(count);
+      memcpy(values, data_ + position_, count);
+      position_ += count;
+      return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      *this >> values[i];
+    }
+  }
+
+  // Returns the characters of a string, not null terminated, they point into the payload
+  const char * read_string(size_t & length)
+  {
+    uint64_t size = 0;
+    *this >> size;
+    require(size);
+    const char * data = reinterpret_cast<const char *>(data_ + position_);
+    position_ += size;
+    length = size;
+    return data;
+  }
+
+  void read_u16string(std::u16string & s)
+  {
+    uint64_t size = 0;
+    *this >> size;
+    // Every code unit takes at least a byte
+    require(size);
+    s.resize(size);
+    for (size_t i = 0; i < s.size(); ++i) {
+      *this >> s[i];
+    }
+  }
+
+  // Skips size bytes
+  void skip(size_t size)
+  {
+    require(size);
+    position_ += size;
+  }
+
+  size_t position() const noexcept {return position_;}
+  size_t remaining() const noexcept {return length_ - position_;}
+
+private:
+  void require(uint64_t size) const
+  {
+    if (size > length_ - position_) {
+      throw std::runtime_error("not enough data to deserialize");
+    }
+  }
+
+  template<typename T>
+  Reader & get_unsigned(T & n)
+  {
+    const uint64_t value = get_varint();
+    if (value > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+      throw std::runtime_error("varint out of range");
+    }
+    n = static_cast<T>(value);
+    return *this;
+  }
+
+  template<typename T>
+  Reader & get_signed(T & n)
+  {
+    const int64_t value = unzigzag(get_varint());
+    if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max()) {
+      throw std::runtime_error("varint out of range");
+    }
+    n = static_cast<T>(value);
+    return *this;
+  }
+
+  uint64_t get_varint()
+  {
+    uint64_t value = 0;
+    for (size_t i = 0; i < kMaxVarintSize; ++i) {
+      require(1);
+      const uint8_t byte = data_[position_++];
+      // The last group only holds the top bit of a 64 bit value
+      if (i == kMaxVarintSize - 1 && byte > 1) {
+        throw std::runtime_error("varint out of range");
+      }
+      value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    throw std::runtime_error("varint too long");
+  }
+
+  uint64_t get_fixed(size_t size)
+  {
+    require(size);
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      value |= static_cast<uint64_t>(data_[position_ + i]) << (8 * i);
+    }
+    position_ += size;
+    return value;
+  }
+
+  const uint8_t * data_;
+  size_t length_;
+  size_t position_;
+};
+
+}  // namespace compact
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__COMPACT_HPP_
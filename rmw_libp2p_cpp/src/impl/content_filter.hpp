@@ -0,0 +1,124 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__CONTENT_FILTER_HPP_
+#define IMPL__CONTENT_FILTER_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "impl/graph_cache.hpp"
+#include "impl/message_header.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+// Content filter of a subscription, written in a subset of the DDS filter expression grammar:
+//
+//   condition := condition OR condition | condition AND condition | NOT condition
+//              | '(' condition ')' | operand op operand
+//   op        := '=' | '<>' | '!=' | '<' | '<=' | '>' | '>='
+//   operand   := field | number | TRUE | FALSE | %N
+//
+// where field is a dotted path to a boolean or numeric member (e.g. status.robot_id) and %N is
+// replaced by the N-th expression parameter. Every comparison involves exactly one field.
+//
+// Filters are compiled against the introspection members of the type and evaluated on
+// serialized messages: only the members up to the last one the expression uses are read, and
+// no ROS message is ever built.
+class ContentFilter
+{
+public:
+  // Returns nullptr and describes the problem in error if the expression is invalid for the type
+  static std::unique_ptr<ContentFilter>
+  compile(
+    const void * untyped_members, const char * typesupport_identifier,
+    const std::string & expression, const std::vector<std::string> & parameters,
+    std::string & error);
+
+  ~ContentFilter();
+
+  // Whether a serialized message, without its message header, passes the filter. Messages that
+  // cannot be read pass, deserialization reports them.
+  bool
+  evaluate(
+    const uint8_t * data, size_t length,
+    PayloadEncoding encoding = PayloadEncoding::CDR) const;
+
+  const std::string &
+  expression() const
+  {
+    return expression_;
+  }
+
+  const std::vector<std::string> &
+  parameters() const
+  {
+    return parameters_;
+  }
+
+  struct Value;
+  struct Node;
+  class Reader;
+
+private:
+  ContentFilter() = default;
+
+  std::string expression_;
+  std::vector<std::string> parameters_;
+  std::unique_ptr<Node> root_;
+  // Reads the members used by the expression, one slot each
+  std::unique_ptr<Reader> reader_;
+  size_t slot_count_;
+};
+
+// Content filters of the subscriptions matched with a publisher, kept up to date by the graph
+// cache. Lets the publisher drop the messages that no subscription wants before sending them.
+class MatchedFilters
+{
+public:
+  MatchedFilters(const void * untyped_members, const char * typesupport_identifier);
+
+  void
+  update(
+    const Gid & gid, const std::string & expression,
+    const std::vector<std::string> & parameters, bool added);
+
+  // True if accepts could currently reject a message
+  bool
+  filtering() const;
+
+  // False only if every known subscription filters and none of them passes the message
+  bool
+  accepts(
+    const uint8_t * data, size_t length,
+    PayloadEncoding encoding = PayloadEncoding::CDR) const;
+
+private:
+  const void * untyped_members_;
+  const char * typesupport_identifier_;
+
+  mutable std::mutex mutex_;
+  // Subscriptions without a filter, or with one this publisher can't evaluate
+  size_t unfiltered_;
+  std::unordered_map<Gid, std::unique_ptr<ContentFilter>, GidHash> filters_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__CONTENT_FILTER_HPP_
@@ -23,6 +23,7 @@
 #include "rmw/rmw.h"
 #include "impl/custom_publisher_info.hpp"
 #include "impl/custom_subscription_info.hpp"
+#include "impl/graph_cache.hpp"
 #include "impl/rmw_libp2p_rs.hpp"
 
 namespace rmw_libp2p_cpp
@@ -32,6 +33,7 @@ typedef struct CustomNodeInfo
 {
   rs_libp2p_custom_node_t * node_handle_;
   rmw_guard_condition_t * graph_guard_condition_;
+  Gid gid_;
   std::mutex publishers_mutex_;
   std::map<std::string, std::set<CustomPublisherInfo *>> publishers_;
   std::mutex subscriptions_mutex_;
@@ -16,12 +16,19 @@
 #define IMPL__CUSTOM_PUBLISHER_INFO_HPP_
 
 #include <atomic>
-#include <set>
 #include <string>
 
 #include "rmw/rmw.h"
 
+#include "impl/cdr_buffer.hpp"
+#include "impl/compact.hpp"
+#include "impl/delta_encoding.hpp"
+#include "impl/content_filter.hpp"
+#include "impl/event_listener.hpp"
+#include "impl/message_header.hpp"
 #include "impl/rmw_libp2p_rs.hpp"
+#include "impl/serialization_buffer_pool.hpp"
+#include "impl/xcdr2.hpp"
 
 namespace rmw_libp2p_cpp
 {
@@ -32,9 +39,19 @@ typedef struct CustomPublisherInfo
   const char * typesupport_identifier_;
   rmw_qos_profile_t qos_;
   std::string discovery_name_;
-  std::set<std::string> subscriptions_;
+  // Subscriptions of compatible types on the topic, kept up to date by the graph cache
   std::atomic_size_t subscriptions_matched_count_;
   rs_libp2p_custom_publisher_t * publisher_handle_;
+  EventListener * event_listener_;
+  // Content filters of the matched subscriptions, kept up to date by the graph cache
+  MatchedFilters * matched_filters_;
+  // Encoding of the messages published with rmw_publish, see TopicEncodings
+  PayloadEncoding encoding_;
+  SerializationBufferPool<cdr::WriteCDRBuffer> serialization_buffers_;
+  SerializationBufferPool<xcdr2::Writer> xcdr2_buffers_;
+  SerializationBufferPool<compact::Writer> compact_buffers_;
+  // Only for the topics in RMW_LIBP2P_DELTA_TOPICS, see DeltaTopics
+  DeltaEncoder * delta_encoder_;
 } CustomPublisherInfo;
 }  // namespace rmw_libp2p_cpp
 #endif  // IMPL__CUSTOM_PUBLISHER_INFO_HPP_
@@ -16,12 +16,16 @@
 #define IMPL__CUSTOM_SUBSCRIPTION_INFO_HPP_
 
 #include <atomic>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <string>
 
 #include "rmw/rmw.h"
 
+#include "impl/content_filter.hpp"
+#include "impl/event_listener.hpp"
 #include "impl/rmw_libp2p_rs.hpp"
 
 namespace rmw_libp2p_cpp
@@ -32,9 +36,18 @@ typedef struct CustomSubscriptionInfo
 {
   const rmw_node_t * node_;
   rmw_libp2p_cpp::Listener * listener_;
+  rmw_libp2p_cpp::EventListener * event_listener_;
   void * type_support_;
   const char * typesupport_identifier_;
+  // Introspection members of the type, content filters are compiled against them
+  const void * untyped_members_;
   rmw_qos_profile_t qos_;
+  // Null if the subscription takes every message. rmw_take works on a copy, so the filter can be
+  // replaced while a message is being evaluated.
+  std::mutex content_filter_mutex_;
+  std::shared_ptr<const rmw_libp2p_cpp::ContentFilter> content_filter_;
+  // Publishers of the topic with a compatible type, kept up to date by the graph cache
+  std::atomic_size_t publishers_matched_count_;
   rs_libp2p_custom_subscription_t * subscription_handle_;
 } CustomSubscriptionInfo;
 }  // namespace rmw_libp2p_cpp
@@ -0,0 +1,110 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__DELTA_ENCODING_HPP_
+#define IMPL__DELTA_ENCODING_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "impl/graph_cache.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+// Delta encoding of the serialized messages of slowly changing topics, e.g. /joint_states or
+// /tf. Every keyframe_interval messages the publisher sends a keyframe, the full payload, and
+// in between the XOR of the payload with the last keyframe, run-length encoded: the delta is
+// the length of the payload as a varint followed by pairs of varints, the number of bytes equal
+// to the keyframe and the number of differing ones, each pair followed by the XOR of the
+// differing bytes. Bytes past the end of the keyframe are XORed with 0.
+//
+// Keyframes and deltas are flagged in the message header, which also carries the keyframe id a
+// delta refers to. A subscription that missed the keyframe drops the deltas against it until
+// the next keyframe; reliable publishers repair losses anyway, so best effort ones send their
+// keyframes more often. Publisher histories keep the full messages rather than the deltas, so
+// retransmissions and the history replayed to late joiners never depend on a keyframe.
+// Transient local publishers also send a keyframe at least every history_depth messages, so that
+// the replayed history holds the one the next deltas are against.
+class DeltaEncoder
+{
+public:
+  // history_depth is 0 for volatile publishers
+  DeltaEncoder(uint32_t keyframe_interval, bool reliable, size_t history_depth);
+
+  // Encodes payload and hands the bytes to publish to
+  // publish(const uint8_t * data, size_t length, uint8_t flags, uint8_t keyframe): payload
+  // itself for a keyframe, the delta otherwise. flags is kMessageFlagKeyframe or
+  // kMessageFlagDelta and keyframe the id of the keyframe. Concurrent publishers are serialized
+  // so that deltas never overtake their keyframe.
+  template<typename Publish>
+  void
+  encode(const uint8_t * payload, size_t length, Publish && publish)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t encoded_length = 0;
+    uint8_t flags = 0;
+    uint8_t keyframe = 0;
+    const uint8_t * encoded = encode(payload, length, encoded_length, flags, keyframe);
+    publish(encoded, encoded_length, flags, keyframe);
+  }
+
+private:
+  // The result is valid until the next call
+  const uint8_t *
+  encode(
+    const uint8_t * payload, size_t length, size_t & encoded_length, uint8_t & flags,
+    uint8_t & keyframe);
+
+  uint32_t keyframe_interval_;
+  // Messages published since the last keyframe
+  uint32_t since_keyframe_;
+  uint8_t keyframe_id_;
+  std::vector<uint8_t> keyframe_;
+  std::vector<uint8_t> delta_;
+  std::mutex mutex_;
+};
+
+// Keeps the last keyframe of every delta encoded publisher a subscription hears from
+class DeltaDecoder
+{
+public:
+  // Reconstructs a delta encoded message in place, message and length are replaced by the full
+  // message, header included, and the original one is released. Keyframes are recorded and left
+  // alone, as are messages that aren't delta encoded. Returns false, having released the
+  // message, if its keyframe is unknown or it is malformed.
+  bool
+  decode(uint8_t * & message, uintptr_t & length);
+
+  // Forgets the last keyframe of a publisher that went away
+  void
+  remove_publisher(const Gid & gid);
+
+private:
+  struct Keyframe
+  {
+    uint8_t id;
+    std::vector<uint8_t> payload;
+  };
+
+  std::mutex mutex_;
+  std::map<Gid, Keyframe> keyframes_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__DELTA_ENCODING_HPP_
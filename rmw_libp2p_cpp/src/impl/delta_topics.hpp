@@ -0,0 +1,51 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__DELTA_TOPICS_HPP_
+#define IMPL__DELTA_TOPICS_HPP_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rmw_libp2p_cpp
+{
+
+// Topics whose messages are delta encoded (see impl/delta_encoding.hpp), configured through the
+// RMW_LIBP2P_DELTA_TOPICS environment variable as a comma separated list of pattern=interval
+// entries, e.g.
+//
+//   RMW_LIBP2P_DELTA_TOPICS="/joint_states=50,/tf=50"
+//
+// where interval is the number of messages between two keyframes of a reliable publisher and
+// '*' in a pattern matches any sequence of characters. The first matching entry wins, topics
+// that match none are not delta encoded. Subscriptions reconstruct delta encoded messages
+// whatever their configuration, only publishers look at this.
+class DeltaTopics
+{
+public:
+  DeltaTopics();
+
+  // Keyframe interval of the topic, 0 if its messages aren't delta encoded
+  uint32_t
+  get(const std::string & topic_name) const;
+
+private:
+  std::vector<std::pair<std::string, uint32_t>> patterns_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__DELTA_TOPICS_HPP_
@@ -0,0 +1,494 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__EVENT_LISTENER_HPP_
+#define IMPL__EVENT_LISTENER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "rmw/event.h"
+#include "rmw/event_callback_type.h"
+
+#include "impl/graph_cache.hpp"
+#include "impl/timer_wheel.hpp"
+
+// The incompatible type event only exists in newer versions of rmw
+#if defined(__has_include)
+#if __has_include("rmw/events_statuses/incompatible_type.h")
+#include "rmw/events_statuses/incompatible_type.h"
+#define RMW_LIBP2P_CPP_HAS_INCOMPATIBLE_TYPE_EVENT
+#endif
+#endif
+
+namespace rmw_libp2p_cpp
+{
+
+// Status changes of a publisher or subscription, reported through rmw events
+class EventListener
+{
+public:
+  explicit EventListener(TimerWheel * timer_wheel)
+  : timer_wheel_(timer_wheel), stopped_(false), condition_mutex_(nullptr),
+    condition_variable_(nullptr), incompatible_type_current_count_(0), deadline_timer_(0),
+    last_activity_(TimerWheel::Clock::now().time_since_epoch().count()), liveliness_timer_(0),
+    last_assertion_(last_activity_.load()), leased_publishers_count_(0), alive_count_(0),
+    not_alive_count_(0), alive_count_change_(0), not_alive_count_change_(0)
+  {
+  }
+
+  // Called by the graph cache when an endpoint of the opposite kind with a different type is
+  // discovered on the topic, or when it goes away.
+  void
+  update_incompatible_type(bool discovered)
+  {
+    if (!discovered) {
+      incompatible_type_current_count_--;
+      return;
+    }
+    incompatible_type_current_count_++;
+    report(incompatible_type_);
+  }
+
+  // Whether endpoints with an incompatible type are currently present on the topic
+  bool
+  has_incompatible_types() const
+  {
+    return incompatible_type_current_count_ > 0;
+  }
+
+  // Report a missed deadline for every period that elapses without notify_activity() being
+  // called, i.e. without publishing for publishers or receiving for subscriptions.
+  void
+  start_deadline(std::chrono::nanoseconds period)
+  {
+    notify_activity();
+    // Activity only touches last_activity_, the timer checks it when it expires instead of
+    // being rearmed on every message
+    deadline_timer_ = timer_wheel_->add(
+      TimerWheel::Clock::now() + period,
+      [this, period](TimerWheel::Clock::time_point now) {
+        auto last_activity = TimerWheel::Clock::time_point(
+          TimerWheel::Clock::duration(last_activity_.load(std::memory_order_relaxed)));
+        if (now - last_activity < period) {
+          return last_activity + period;
+        }
+        report(deadline_missed_);
+        return now + period;
+      });
+  }
+
+  // Report lost liveliness whenever a publisher goes for a whole lease without publishing or
+  // asserting its liveliness. Only meaningful for manual by topic liveliness, automatic
+  // liveliness is asserted by the context for as long as it runs.
+  void
+  start_liveliness_lost(std::chrono::nanoseconds lease)
+  {
+    assert_liveliness();
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    liveliness_timer_ = timer_wheel_->add(
+      TimerWheel::Clock::now() + lease,
+      [this, lease, lost = false](TimerWheel::Clock::time_point now) mutable {
+        auto last_assertion = this->last_assertion();
+        if (now - last_assertion < lease) {
+          lost = false;
+          return last_assertion + lease;
+        }
+        if (!lost) {
+          lost = true;
+          report(liveliness_lost_);
+        }
+        return now + lease;
+      });
+  }
+
+  // Must be called before the listener is destroyed
+  void
+  stop_timers()
+  {
+    TimerWheel::TimerId liveliness_timer = 0;
+    {
+      std::lock_guard<std::mutex> lock(internal_mutex_);
+      stopped_ = true;
+      liveliness_timer = liveliness_timer_;
+      liveliness_timer_ = 0;
+    }
+    // Not under internal_mutex_, removing waits for running callbacks, which take it
+    if (deadline_timer_) {
+      timer_wheel_->remove(deadline_timer_);
+      deadline_timer_ = 0;
+    }
+    if (liveliness_timer) {
+      timer_wheel_->remove(liveliness_timer);
+    }
+  }
+
+  void
+  notify_activity()
+  {
+    last_activity_.store(
+      TimerWheel::Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+  }
+
+  // Time of the last publication or reception
+  TimerWheel::Clock::time_point
+  last_activity() const
+  {
+    return TimerWheel::Clock::time_point(
+      TimerWheel::Clock::duration(last_activity_.load(std::memory_order_relaxed)));
+  }
+
+  // Called by rmw_publisher_assert_liveliness(), publishing asserts liveliness as well
+  void
+  assert_liveliness()
+  {
+    last_assertion_.store(
+      TimerWheel::Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+  }
+
+  // Time the publisher last proved its liveliness, by publishing or by asserting it
+  TimerWheel::Clock::time_point
+  last_assertion() const
+  {
+    return TimerWheel::Clock::time_point(
+      TimerWheel::Clock::duration(
+        std::max(
+          last_activity_.load(std::memory_order_relaxed),
+          last_assertion_.load(std::memory_order_relaxed))));
+  }
+
+  // Called by the graph cache when a publisher is matched with this subscription or goes away.
+  // A zero lease means that the publisher never loses its liveliness while it exists.
+  void
+  update_liveliness(const Gid & publisher, std::chrono::nanoseconds lease, bool matched)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    auto it = publishers_liveliness_.find(publisher);
+    if (matched) {
+      if (it != publishers_liveliness_.end()) {
+        return;
+      }
+      auto now = TimerWheel::Clock::now();
+      publishers_liveliness_.emplace(publisher, PublisherLiveliness{lease, now, true});
+      alive_count_++;
+      alive_count_change_++;
+      if (lease.count() > 0) {
+        leased_publishers_count_++;
+        arm_liveliness_timer(now + lease);
+      }
+    } else {
+      if (it == publishers_liveliness_.end()) {
+        return;
+      }
+      if (it->second.alive) {
+        alive_count_--;
+        alive_count_change_--;
+      } else {
+        not_alive_count_--;
+        not_alive_count_change_--;
+      }
+      if (it->second.lease.count() > 0) {
+        leased_publishers_count_--;
+      }
+      publishers_liveliness_.erase(it);
+    }
+    report_locked(liveliness_changed_);
+  }
+
+  // Whether any matched publisher can lose its liveliness, i.e. whether received messages need
+  // to be passed to notify_publisher_alive()
+  bool
+  tracks_liveliness() const
+  {
+    return leased_publishers_count_.load(std::memory_order_relaxed) > 0;
+  }
+
+  // Called when a message or a liveliness heartbeat is received from a matched publisher
+  void
+  notify_publisher_alive(const Gid & publisher)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    auto it = publishers_liveliness_.find(publisher);
+    if (it == publishers_liveliness_.end() || it->second.lease.count() == 0) {
+      return;
+    }
+    PublisherLiveliness & liveliness = it->second;
+    liveliness.last_seen = TimerWheel::Clock::now();
+    if (liveliness.alive) {
+      return;
+    }
+    liveliness.alive = true;
+    alive_count_++;
+    alive_count_change_++;
+    not_alive_count_--;
+    not_alive_count_change_--;
+    report_locked(liveliness_changed_);
+    arm_liveliness_timer(liveliness.last_seen + liveliness.lease);
+  }
+
+  void
+  attach_condition(std::mutex * condition_mutex, std::condition_variable * condition_variable)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    condition_mutex_ = condition_mutex;
+    condition_variable_ = condition_variable;
+  }
+
+  void
+  detach_condition()
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    condition_mutex_ = nullptr;
+    condition_variable_ = nullptr;
+  }
+
+  bool
+  has_event(rmw_event_type_t event_type)
+  {
+    Status * status = get_status(event_type);
+    return status && status->total_count_change > 0;
+  }
+
+  // Fill event_info with the status for event_type and reset its changes.
+  // Returns false if the event type is not supported.
+  bool
+  take_event(rmw_event_type_t event_type, void * event_info)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    switch (event_type) {
+#ifdef RMW_LIBP2P_CPP_HAS_INCOMPATIBLE_TYPE_EVENT
+      case RMW_EVENT_SUBSCRIPTION_INCOMPATIBLE_TYPE:
+      case RMW_EVENT_PUBLISHER_INCOMPATIBLE_TYPE:
+        {
+          auto status = static_cast<rmw_incompatible_type_status_t *>(event_info);
+          status->total_count = incompatible_type_.total_count;
+          status->total_count_change = incompatible_type_.total_count_change.exchange(0);
+          return true;
+        }
+#endif
+      case RMW_EVENT_OFFERED_DEADLINE_MISSED:
+        {
+          auto status = static_cast<rmw_offered_deadline_missed_status_t *>(event_info);
+          status->total_count = deadline_missed_.total_count;
+          status->total_count_change = deadline_missed_.total_count_change.exchange(0);
+          return true;
+        }
+      case RMW_EVENT_REQUESTED_DEADLINE_MISSED:
+        {
+          auto status = static_cast<rmw_requested_deadline_missed_status_t *>(event_info);
+          status->total_count = deadline_missed_.total_count;
+          status->total_count_change = deadline_missed_.total_count_change.exchange(0);
+          return true;
+        }
+      case RMW_EVENT_LIVELINESS_LOST:
+        {
+          auto status = static_cast<rmw_liveliness_lost_status_t *>(event_info);
+          status->total_count = liveliness_lost_.total_count;
+          status->total_count_change = liveliness_lost_.total_count_change.exchange(0);
+          return true;
+        }
+      case RMW_EVENT_LIVELINESS_CHANGED:
+        {
+          auto status = static_cast<rmw_liveliness_changed_status_t *>(event_info);
+          status->alive_count = alive_count_;
+          status->not_alive_count = not_alive_count_;
+          status->alive_count_change = alive_count_change_;
+          status->not_alive_count_change = not_alive_count_change_;
+          alive_count_change_ = 0;
+          not_alive_count_change_ = 0;
+          liveliness_changed_.total_count_change = 0;
+          return true;
+        }
+      default:
+        (void)event_info;
+        return false;
+    }
+  }
+
+  void
+  set_callback(rmw_event_type_t event_type, rmw_event_callback_t callback, const void * user_data)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    Status * status = get_status(event_type);
+    if (!status) {
+      return;
+    }
+    status->callback = callback;
+    status->user_data = user_data;
+    // Report the changes that happened before the callback was set
+    if (callback && status->total_count_change > 0) {
+      callback(user_data, status->total_count_change);
+    }
+  }
+
+private:
+  typedef struct Status
+  {
+    Status()
+    : total_count(0), total_count_change(0), callback(nullptr), user_data(nullptr)
+    {
+    }
+
+    int32_t total_count;
+    std::atomic<int32_t> total_count_change;
+    rmw_event_callback_t callback;
+    const void * user_data;
+  } Status;
+
+  typedef struct PublisherLiveliness
+  {
+    // 0 if the publisher never loses its liveliness
+    std::chrono::nanoseconds lease;
+    TimerWheel::Clock::time_point last_seen;
+    bool alive;
+  } PublisherLiveliness;
+
+  Status *
+  get_status(rmw_event_type_t event_type)
+  {
+    switch (event_type) {
+#ifdef RMW_LIBP2P_CPP_HAS_INCOMPATIBLE_TYPE_EVENT
+      case RMW_EVENT_SUBSCRIPTION_INCOMPATIBLE_TYPE:
+      case RMW_EVENT_PUBLISHER_INCOMPATIBLE_TYPE:
+        return &incompatible_type_;
+#endif
+      case RMW_EVENT_OFFERED_DEADLINE_MISSED:
+      case RMW_EVENT_REQUESTED_DEADLINE_MISSED:
+        return &deadline_missed_;
+      case RMW_EVENT_LIVELINESS_LOST:
+        return &liveliness_lost_;
+      case RMW_EVENT_LIVELINESS_CHANGED:
+        return &liveliness_changed_;
+      default:
+        return nullptr;
+    }
+  }
+
+  void
+  report(Status & status)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    report_locked(status);
+  }
+
+  // Must be called with internal_mutex_ held
+  void
+  report_locked(Status & status)
+  {
+    if (condition_mutex_) {
+      std::unique_lock<std::mutex> clock(*condition_mutex_);
+      // the change needs to be mutually exclusive with rmw_wait()
+      // which checks has_event() and decides if wait() needs to be called
+      status.total_count++;
+      status.total_count_change++;
+      clock.unlock();
+      condition_variable_->notify_one();
+    } else {
+      status.total_count++;
+      status.total_count_change++;
+    }
+
+    if (status.callback) {
+      status.callback(status.user_data, 1);
+    }
+  }
+
+  // Make sure that the liveliness of the matched publishers is checked by expiration at the
+  // latest. Must be called with internal_mutex_ held.
+  void
+  arm_liveliness_timer(TimerWheel::Clock::time_point expiration)
+  {
+    if (liveliness_timer_ || stopped_) {
+      return;
+    }
+    liveliness_timer_ = timer_wheel_->add(
+      expiration, [this](TimerWheel::Clock::time_point now) {
+        return check_liveliness(now);
+      });
+  }
+
+  // Timer callback, flag the publishers whose lease expired and return when to check again
+  TimerWheel::Clock::time_point
+  check_liveliness(TimerWheel::Clock::time_point now)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    auto next = TimerWheel::Clock::time_point::max();
+    bool changed = false;
+    for (auto & publisher : publishers_liveliness_) {
+      PublisherLiveliness & liveliness = publisher.second;
+      if (!liveliness.alive || liveliness.lease.count() == 0) {
+        continue;
+      }
+      auto expiration = liveliness.last_seen + liveliness.lease;
+      if (now < expiration) {
+        next = std::min(next, expiration);
+        continue;
+      }
+      liveliness.alive = false;
+      alive_count_--;
+      alive_count_change_--;
+      not_alive_count_++;
+      not_alive_count_change_++;
+      changed = true;
+    }
+    if (changed) {
+      report_locked(liveliness_changed_);
+    }
+    if (next == TimerWheel::Clock::time_point::max()) {
+      // Rearmed by notify_publisher_alive() once a publisher comes back
+      liveliness_timer_ = 0;
+    }
+    return next;
+  }
+
+  TimerWheel * timer_wheel_;
+  // Set by stop_timers(), no new timers are added afterwards
+  bool stopped_;
+
+  std::mutex internal_mutex_;
+  std::mutex * condition_mutex_;
+  std::condition_variable * condition_variable_;
+
+  std::atomic_size_t incompatible_type_current_count_;
+  Status incompatible_type_;
+
+  TimerWheel::TimerId deadline_timer_;
+  // steady_clock ticks of the last publication or reception
+  std::atomic<TimerWheel::Clock::rep> last_activity_;
+  Status deadline_missed_;
+
+  // Liveliness lost timer of publishers, liveliness check timer of subscriptions
+  TimerWheel::TimerId liveliness_timer_;
+  // steady_clock ticks of the last explicit liveliness assertion of a publisher
+  std::atomic<TimerWheel::Clock::rep> last_assertion_;
+  Status liveliness_lost_;
+
+  // Liveliness of the publishers matched with a subscription
+  std::unordered_map<Gid, PublisherLiveliness, GidHash> publishers_liveliness_;
+  std::atomic_size_t leased_publishers_count_;
+  int32_t alive_count_;
+  int32_t not_alive_count_;
+  int32_t alive_count_change_;
+  int32_t not_alive_count_change_;
+  Status liveliness_changed_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__EVENT_LISTENER_HPP_
@@ -0,0 +1,431 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__GRAPH_CACHE_HPP_
+#define IMPL__GRAPH_CACHE_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "impl/rmw_libp2p_rs.hpp"
+
+class GuardCondition;
+
+namespace rmw_libp2p_cpp
+{
+
+struct CustomSubscriptionHandle;
+
+class DeltaDecoder;
+
+class EventListener;
+
+class GraphCache;
+
+class MatchedFilters;
+
+// Registered with each libp2p node to hear about the availability of service servers
+struct CustomNodeHandle
+{
+  GraphCache * graph_cache;
+};
+
+// Globally unique identifier of a graph entity (node, endpoint) or of a graph cache.
+// Publishers and subscriptions reuse the UUID generated by the Rust side.
+using Gid = std::array<uint8_t, 16>;
+
+struct GidHash
+{
+  size_t operator()(const Gid & gid) const
+  {
+    // GIDs are random, so any slice of them is a good enough hash
+    size_t hash;
+    memcpy(&hash, gid.data(), sizeof(hash));
+    return hash;
+  }
+};
+
+enum class EntityKind : uint8_t
+{
+  NODE = 0,
+  PUBLISHER = 1,
+  SUBSCRIPTION = 2,
+  SERVICE = 3,
+  CLIENT = 4,
+};
+
+typedef struct GraphEntity
+{
+  EntityKind kind;
+  Gid gid;
+  // Gid of the graph cache (i.e. the context) that announced this entity
+  Gid origin;
+  // Gid of the node the endpoint belongs to, unused for nodes
+  Gid node_gid;
+  // Node name for nodes, topic or service name for endpoints
+  std::string name;
+  // Node namespace and enclave, unused for endpoints
+  std::string namespace_;
+  std::string enclave;
+  // ROS type name (e.g. std_msgs/msg/String), unused for nodes
+  std::string type_name;
+  // Structural hash of the type of topic endpoints, 0 if unknown
+  uint64_t type_hash;
+  rmw_qos_profile_t qos;
+  // Content filter of subscriptions, empty if they take every message
+  std::string filter_expression;
+  std::vector<std::string> filter_parameters;
+} GraphEntity;
+
+typedef struct GraphEndpointInfo
+{
+  std::string node_name;
+  std::string node_namespace;
+  std::string type_name;
+  Gid gid;
+  rmw_qos_profile_t qos;
+} GraphEndpointInfo;
+
+using NamesAndTypes = std::map<std::string, std::set<std::string>>;
+
+// Cache of the ROS graph, one per context.
+//
+// Every context announces its own entities on a dedicated discovery topic. Changes are sent as
+// incremental deltas (add / remove records), batched by a worker thread and tagged with a
+// per-origin sequence number. Each origin also sends a periodic heartbeat carrying its current
+// sequence number and, less often, a compacted snapshot of all its entities, in as many chunks
+// as needed to fit in gossipsub messages. A receiver that detects a gap in the sequence numbers,
+// or that hears from an unknown origin, asks that origin for a snapshot. Origins that stay
+// silent for longer than the lease are dropped.
+//
+// All the graph queries are answered from local indexes, without touching the network.
+//
+// Changes that actually modify the graph are coalesced and notified to the registered guard
+// conditions by the worker thread, at most once per minimum interval.
+//
+// The announcements of an origin also prove the liveliness of its automatic publishers, and its
+// heartbeats list the manual by topic publishers that asserted their liveliness. Heartbeats are
+// sent early when a publisher lease would otherwise expire, unless the publisher recently
+// published, since its messages already prove its liveliness to the subscriptions.
+class GraphCache
+{
+public:
+  explicit GraphCache(size_t domain_id);
+
+  ~GraphCache();
+
+  // Create the discovery endpoints and start the worker thread.
+  bool
+  start();
+
+  // Announce that this context is leaving, stop the worker thread and release the discovery
+  // endpoints. Safe to call more than once.
+  void
+  shutdown();
+
+  Gid
+  generate_gid();
+
+  void
+  add_node(
+    const Gid & gid, const std::string & name, const std::string & namespace_,
+    const std::string & enclave);
+
+  void
+  add_publisher(
+    const Gid & gid, const Gid & node_gid, const std::string & topic_name,
+    const std::string & type_name, uint64_t type_hash, const rmw_qos_profile_t & qos);
+
+  void
+  add_subscription(
+    const Gid & gid, const Gid & node_gid, const std::string & topic_name,
+    const std::string & type_name, uint64_t type_hash, const rmw_qos_profile_t & qos,
+    const std::string & filter_expression = std::string(),
+    const std::vector<std::string> & filter_parameters = std::vector<std::string>());
+
+  // Announce the new content filter of the local subscription gid, an empty expression removes it
+  void
+  set_content_filter(
+    const Gid & gid, const std::string & filter_expression,
+    const std::vector<std::string> & filter_parameters);
+
+  void
+  add_service(
+    const Gid & gid, const Gid & node_gid, const std::string & service_name,
+    const std::string & type_name);
+
+  void
+  add_client(
+    const Gid & gid, const Gid & node_gid, const std::string & service_name,
+    const std::string & type_name);
+
+  void
+  remove_entity(const Gid & gid);
+
+  // Prove the liveliness of the local publisher gid, which must have been added with a finite
+  // lease, on its behalf. Its publications and assertions are read from event_listener.
+  // Unregistered by remove_entity().
+  void
+  add_liveliness_publisher(const Gid & gid, EventListener * event_listener);
+
+  // Called by rmw_publisher_assert_liveliness(), only needed for manual by topic liveliness
+  void
+  assert_liveliness(const Gid & gid);
+
+  // Trigger guard_condition on graph changes.
+  void
+  add_graph_listener(GuardCondition * guard_condition);
+
+  void
+  remove_graph_listener(GuardCondition * guard_condition);
+
+  // Track the endpoints of the opposite kind on topic_name for a local publisher or subscription
+  // of the given kind. Endpoints whose type hash matches (or is unknown) are counted in
+  // matched_count, unless it is null. event_listener is told about the others as they come and go.
+  // For publishers, matched_filters, unless it is null, follows the content filters of the
+  // matched subscriptions. For subscriptions, delta_decoder, unless it is null, forgets the
+  // keyframes of the publishers that go away.
+  void
+  add_match_listener(
+    const std::string & topic_name, EntityKind kind, uint64_t type_hash,
+    std::atomic_size_t * matched_count, EventListener * event_listener,
+    MatchedFilters * matched_filters = nullptr, DeltaDecoder * delta_decoder = nullptr);
+
+  void
+  remove_match_listener(const std::string & topic_name, EventListener * event_listener);
+
+  size_t
+  count_publishers(const std::string & topic_name) const;
+
+  size_t
+  count_subscribers(const std::string & topic_name) const;
+
+  void
+  get_node_names(
+    std::vector<std::string> & names,
+    std::vector<std::string> & namespaces,
+    std::vector<std::string> & enclaves) const;
+
+  void
+  get_topic_names_and_types(NamesAndTypes & topic_names_and_types) const;
+
+  void
+  get_service_names_and_types(NamesAndTypes & service_names_and_types) const;
+
+  // Returns false if there is no node with the given name and namespace.
+  bool
+  get_names_and_types_by_node(
+    const std::string & node_name,
+    const std::string & node_namespace,
+    EntityKind kind,
+    NamesAndTypes & names_and_types) const;
+
+  void
+  get_endpoints_info_by_topic(
+    const std::string & topic_name,
+    EntityKind kind,
+    std::vector<GraphEndpointInfo> & endpoints_info) const;
+
+  static void
+  on_discovery_message(
+    const CustomSubscriptionHandle * subscription_handle, uint8_t * message,
+    uintptr_t length);
+
+  // A server of service_name became available or unavailable to a libp2p node, wake up the
+  // graph listeners so that rmw_service_server_is_available is checked again
+  static void
+  on_server_availability(
+    const CustomNodeHandle * node_handle, const char * service_name, bool available);
+
+private:
+  enum class RecordOp : uint8_t
+  {
+    ADD = 0,
+    REMOVE = 1,
+  };
+
+  typedef struct Record
+  {
+    RecordOp op;
+    GraphEntity entity;
+  } Record;
+
+  typedef struct OriginState
+  {
+    // Whether a snapshot has been received, i.e. sequence_number can be trusted
+    bool synchronized;
+    uint64_t sequence_number;
+    std::chrono::steady_clock::time_point last_seen;
+    std::chrono::steady_clock::time_point last_snapshot_request;
+    // Snapshot being collected, it is only complete once all its chunks arrived
+    uint64_t snapshot_sequence_number;
+    uint32_t snapshot_chunk_count;
+    std::set<uint32_t> snapshot_chunks;
+    std::set<Gid> snapshot_entities;
+    std::set<Gid> entities;
+    // Automatic publishers with a finite lease, kept alive by any announcement of the origin
+    std::set<Gid> automatic_publishers;
+  } OriginState;
+
+  typedef struct NameEntry
+  {
+    // Publishers or servers
+    std::set<Gid> writers;
+    // Subscriptions or clients
+    std::set<Gid> readers;
+    // Number of endpoints using each type
+    std::map<std::string, size_t> types;
+  } NameEntry;
+
+  void
+  add_local_entity(GraphEntity && entity);
+
+  void
+  apply_add(const Gid & origin, GraphEntity && entity);
+
+  void
+  apply_remove(const Gid & origin, const Gid & gid);
+
+  void
+  index_entity(const GraphEntity & entity);
+
+  void
+  unindex_entity(const GraphEntity & entity);
+
+  void
+  update_matches(const GraphEntity & entity, bool added);
+
+  // Tell the local subscriptions matched with publisher that it is alive
+  void
+  notify_publisher_alive(const GraphEntity & publisher);
+
+  // An announcement was received from origin, listing the given manual publishers
+  void
+  refresh_liveliness(const Gid & origin, const std::vector<Gid> & asserted);
+
+  // When the next heartbeat is needed to keep the local publishers alive
+  std::chrono::steady_clock::time_point
+  next_liveliness_heartbeat() const;
+
+  // Update the local publishers after an announcement, returns the manual publishers that
+  // asserted their liveliness, to be listed in a heartbeat if heartbeat is true
+  std::vector<Gid>
+  prove_liveliness(std::chrono::steady_clock::time_point now, bool heartbeat);
+
+  void
+  forget_origin(const Gid & origin);
+
+  void
+  mark_changed();
+
+  void
+  notify_graph_listeners();
+
+  void
+  handle_message(const uint8_t * data, size_t length);
+
+  void
+  request_snapshot(const Gid & origin, std::chrono::steady_clock::time_point now);
+
+  // The chunks of the snapshot, see kMaxDiscoveryMessageSize
+  std::vector<std::vector<uint8_t>>
+  encode_snapshot() const;
+
+  void
+  run();
+
+  void
+  publish(const std::vector<uint8_t> & message);
+
+  const GraphEntity *
+  find_entity(const Gid & gid) const;
+
+  const size_t domain_id_;
+  Gid origin_;
+  const std::chrono::milliseconds heartbeat_period_;
+  const std::chrono::milliseconds snapshot_period_;
+  const std::chrono::milliseconds lease_duration_;
+  const std::chrono::milliseconds notification_interval_;
+
+  rs_libp2p_custom_node_t * node_handle_;
+  rs_libp2p_custom_publisher_t * publisher_handle_;
+  rs_libp2p_custom_subscription_t * subscription_handle_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread worker_;
+  bool running_;
+  bool snapshot_requested_;
+  uint64_t sequence_number_;
+  std::vector<Record> pending_records_;
+  std::vector<Gid> pending_snapshot_requests_;
+  bool pending_changes_;
+  std::chrono::steady_clock::time_point last_notification_;
+  std::mt19937_64 random_engine_;
+
+  std::unordered_map<Gid, GraphEntity, GidHash> entities_;
+  std::unordered_map<Gid, OriginState, GidHash> origins_;
+  std::map<std::string, NameEntry> topics_;
+  std::map<std::string, NameEntry> services_;
+  std::multimap<std::pair<std::string, std::string>, Gid> nodes_by_name_;
+  std::unordered_map<Gid, std::set<Gid>, GidHash> node_endpoints_;
+
+  typedef struct MatchListener
+  {
+    // Kind of the local endpoint
+    EntityKind kind;
+    uint64_t type_hash;
+    std::atomic_size_t * matched_count;
+    EventListener * event_listener;
+    MatchedFilters * matched_filters;
+    DeltaDecoder * delta_decoder;
+  } MatchListener;
+
+  std::multimap<std::string, MatchListener> match_listeners_;
+
+  typedef struct LivelinessPublisher
+  {
+    EventListener * event_listener;
+    bool manual;
+    std::chrono::nanoseconds lease;
+    // Last time the publisher liveliness was proven to the other origins
+    std::chrono::steady_clock::time_point last_proof;
+  } LivelinessPublisher;
+
+  std::unordered_map<Gid, LivelinessPublisher, GidHash> liveliness_publishers_;
+  // Set when a manual publisher asserts its liveliness, wakes up the worker
+  bool liveliness_asserted_;
+
+  // Separate from mutex_, listeners are triggered without holding it
+  std::mutex listeners_mutex_;
+  std::set<GuardCondition *> graph_listeners_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__GRAPH_CACHE_HPP_
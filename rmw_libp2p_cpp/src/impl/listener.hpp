@@ -16,7 +16,9 @@
 #define IMPL__LISTENER_HPP_
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -25,6 +27,10 @@
 
 #include "rcutils/logging_macros.h"
 
+#include "impl/delta_encoding.hpp"
+#include "impl/message_header.hpp"
+#include "impl/rmw_libp2p_rs.hpp"
+
 namespace rmw_libp2p_cpp
 {
 
@@ -45,6 +51,16 @@ public:
   {
   }
 
+  ~Listener()
+  {
+    // Messages are owned by the listener until taken
+    while (!message_queue_.empty()) {
+      Data & data = message_queue_.front();
+      rs_libp2p_message_free(data.first, data.second);
+      message_queue_.pop();
+    }
+  }
+
   static void
   on_publication(
     const CustomSubscriptionHandle * subscription_handle, uint8_t * message,
@@ -54,6 +70,23 @@ public:
       static_cast<CustomSubscriptionInfo *>(subscription_handle->custom_subscription_info);
 
     Listener * listener = subscription_impl->listener_;
+
+    EventListener * event_listener = subscription_impl->event_listener_;
+    event_listener->notify_activity();
+    // Messages prove the liveliness of their publisher, no need to look at them otherwise
+    if (event_listener->tracks_liveliness()) {
+      MessageHeader header;
+      if (parse_message_header(message, length, header)) {
+        Gid gid;
+        memcpy(gid.data(), header.gid, gid.size());
+        event_listener->notify_publisher_alive(gid);
+      }
+    }
+
+    // Delta encoded messages are queued reconstructed, the ones that can't be are dropped
+    if (!listener->delta_decoder_.decode(message, length)) {
+      return;
+    }
     Data data = std::make_pair(message, length);
 
     std::lock_guard<std::mutex> lock(listener->internal_mutex_);
@@ -92,23 +125,41 @@ public:
     return message_queue_.size() > 0;
   }
 
+  // Messages whose lifespan has elapsed are dropped without being handed out
   bool
   take_next_data(uint8_t ** message, uintptr_t & length)
   {
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
     std::lock_guard<std::mutex> lock(internal_mutex_);
-    if (message_queue_.empty()) {
-      return false;
+    while (!message_queue_.empty()) {
+      Data data = message_queue_.front();
+      message_queue_.pop();
+      MessageHeader header;
+      if (parse_message_header(data.first, data.second, header) &&
+        is_message_expired(header, now_ns))
+      {
+        rs_libp2p_message_free(data.first, data.second);
+        continue;
+      }
+      *message = data.first;
+      length = data.second;
+      return true;
     }
-    Data & data = message_queue_.front();
-    *message = std::move(data.first);
-    length = std::move(data.second);
-    message_queue_.pop();
-    return true;
+    return false;
+  }
+
+  // Told by the graph cache about the publishers that go away
+  DeltaDecoder *
+  delta_decoder()
+  {
+    return &delta_decoder_;
   }
 
 private:
   std::mutex internal_mutex_;
   std::queue<Data> message_queue_;
+  DeltaDecoder delta_decoder_;
   std::mutex * condition_mutex_;
   std::condition_variable * condition_variable_;
 };
@@ -0,0 +1,106 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__MESSAGE_HEADER_HPP_
+#define IMPL__MESSAGE_HEADER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace rmw_libp2p_cpp
+{
+
+// Header prepended by publishers to every message, see MessageHeader in rust/src/reliability.rs.
+// The serialized message follows it.
+constexpr size_t kMessageHeaderSize = 48;
+constexpr uint8_t kMessageHeaderVersion = 4;
+constexpr uint8_t kMessageFlagReliable = 1;
+// Delta encoded topics, see impl/delta_encoding.hpp
+constexpr uint8_t kMessageFlagKeyframe = 4;
+constexpr uint8_t kMessageFlagDelta = 8;
+
+// Encoding of the serialized message. It travels in the header, so subscriptions decode the
+// messages of every publisher whatever the encoding configured for the topic on their side.
+enum class PayloadEncoding : uint8_t
+{
+  // The classic encoding of the cdr crate, also the one of rmw_serialize
+  CDR = 0,
+  // XCDR2 (PLAIN_CDR2), see impl/xcdr2.hpp
+  XCDR2 = 1,
+  // Varints without padding for low bandwidth links, see impl/compact.hpp
+  COMPACT = 2,
+};
+
+typedef struct MessageHeader
+{
+  uint8_t flags;
+  uint8_t encoding;
+  // Keyframe of a keyframe or delta message
+  uint8_t keyframe;
+  uint32_t nsecs;
+  uint64_t secs;
+  uint64_t sequence_number;
+  uint8_t gid[16];
+  // 0 if the message never expires
+  uint64_t lifespan_ns;
+} MessageHeader;
+
+namespace detail
+{
+
+inline uint64_t
+get_le(const uint8_t * data, size_t size)
+{
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(data[i]) << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace detail
+
+// Returns false if the message is too short or was sent by an unknown version.
+inline bool
+parse_message_header(const uint8_t * data, size_t length, MessageHeader & header)
+{
+  if (length < kMessageHeaderSize || data[0] != kMessageHeaderVersion) {
+    return false;
+  }
+  header.flags = data[1];
+  header.encoding = data[2];
+  header.keyframe = data[3];
+  header.nsecs = static_cast<uint32_t>(detail::get_le(data + 4, 4));
+  header.secs = detail::get_le(data + 8, 8);
+  header.sequence_number = detail::get_le(data + 16, 8);
+  memcpy(header.gid, data + 24, sizeof(header.gid));
+  header.lifespan_ns = detail::get_le(data + 40, 8);
+  return true;
+}
+
+// Whether the lifespan of the message has elapsed at now_ns, in nanoseconds since the epoch.
+inline bool
+is_message_expired(const MessageHeader & header, int64_t now_ns)
+{
+  if (header.lifespan_ns == 0) {
+    return false;
+  }
+  uint64_t source_ns = header.secs * 1000000000ULL + header.nsecs;
+  return now_ns >= 0 && static_cast<uint64_t>(now_ns) > source_ns + header.lifespan_ns;
+}
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__MESSAGE_HEADER_HPP_
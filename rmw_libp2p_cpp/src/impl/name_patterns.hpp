@@ -0,0 +1,71 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__NAME_PATTERNS_HPP_
+#define IMPL__NAME_PATTERNS_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rcutils/env.h"
+#include "rcutils/logging_macros.h"
+
+namespace rmw_libp2p_cpp
+{
+
+// Glob match where '*' matches any sequence of characters, including '/'
+bool
+name_matches(const std::string & pattern, const std::string & name);
+
+// Reads the comma separated list of pattern=value entries of the environment variable env_name.
+// Entries whose value is rejected by parse_value are skipped with a warning.
+template<typename T>
+std::vector<std::pair<std::string, T>>
+parse_name_patterns(const char * env_name, bool (* parse_value)(const std::string &, T &))
+{
+  std::vector<std::pair<std::string, T>> patterns;
+  const char * value = nullptr;
+  if (rcutils_get_env(env_name, &value) != nullptr || value == nullptr) {
+    return patterns;
+  }
+  const std::string config(value);
+  size_t begin = 0;
+  while (begin < config.size()) {
+    size_t end = config.find(',', begin);
+    if (end == std::string::npos) {
+      end = config.size();
+    }
+    const std::string entry = config.substr(begin, end - begin);
+    begin = end + 1;
+    if (entry.empty()) {
+      continue;
+    }
+    size_t separator = entry.rfind('=');
+    T parsed;
+    if (separator == std::string::npos || separator == 0 ||
+      !parse_value(entry.substr(separator + 1), parsed))
+    {
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_libp2p_cpp", "ignoring invalid entry '%s' in %s", entry.c_str(), env_name);
+      continue;
+    }
+    patterns.emplace_back(entry.substr(0, separator), parsed);
+  }
+  return patterns;
+}
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__NAME_PATTERNS_HPP_
@@ -0,0 +1,56 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__QOS_HPP_
+#define IMPL__QOS_HPP_
+
+#include <cstdint>
+
+#include "rmw/qos_profiles.h"
+#include "rmw/time.h"
+#include "rmw/types.h"
+
+namespace rmw_libp2p_cpp
+{
+
+// Duration of a QoS policy (deadline, lifespan...) in nanoseconds, 0 if unspecified or infinite
+inline uint64_t
+qos_duration_ns(const rmw_time_t & duration)
+{
+  const rmw_time_t infinite = RMW_DURATION_INFINITE;
+  if (rmw_time_equal(duration, infinite)) {
+    return 0;
+  }
+  return rmw_time_total_nsec(duration);
+}
+
+// QoS of services and clients, which only support reliable, volatile and keep last: requests
+// and responses travel over a reliable stream and are never replayed
+inline rmw_qos_profile_t
+service_qos(const rmw_qos_profile_t & qos_policies)
+{
+  rmw_qos_profile_t qos = qos_policies;
+  qos.history = RMW_QOS_POLICY_HISTORY_KEEP_LAST;
+  if (qos.depth == RMW_QOS_POLICY_DEPTH_SYSTEM_DEFAULT) {
+    qos.depth = rmw_qos_profile_services_default.depth;
+  }
+  qos.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+  qos.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
+  qos.liveliness = RMW_QOS_POLICY_LIVELINESS_AUTOMATIC;
+  return qos;
+}
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__QOS_HPP_
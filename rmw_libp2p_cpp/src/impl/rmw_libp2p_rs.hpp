@@ -22,9 +22,28 @@ extern "C"
 
 namespace rmw_libp2p_cpp
 {
+struct CustomNodeHandle;
+
 struct CustomSubscriptionHandle;
 
 struct CustomSubscriptionInfo;
+
+struct ServiceListenerHandle;
+
+class DeltaTopics;
+
+struct Fragment;
+
+class GraphCache;
+
+class ServiceRoutingPolicies;
+
+class TimerWheel;
+
+class TopicEncodings;
+class TopicPriorities;
+
+class TypeSupportRegistry;
 }
 
 typedef struct rs_libp2p_custom_node rs_libp2p_custom_node_t;
@@ -33,6 +52,10 @@ typedef struct rs_libp2p_custom_publisher rs_libp2p_custom_publisher_t;
 
 typedef struct rs_libp2p_custom_subscription rs_libp2p_custom_subscription_t;
 
+typedef struct rs_libp2p_custom_service rs_libp2p_custom_service_t;
+
+typedef struct rs_libp2p_custom_client rs_libp2p_custom_client_t;
+
 typedef struct rs_libp2p_cdr_buffer rs_libp2p_cdr_buffer_t;
 
 extern rs_libp2p_custom_node_t *
@@ -41,8 +64,16 @@ rs_libp2p_custom_node_new();
 extern void
 rs_libp2p_custom_node_free(rs_libp2p_custom_node_t *);
 
+extern void
+rs_libp2p_custom_node_set_availability_callback(
+  rs_libp2p_custom_node_t *, const void *,
+  void (*)(const rmw_libp2p_cpp::CustomNodeHandle *, const char *, bool)
+);
+
 extern rs_libp2p_custom_publisher_t *
-rs_libp2p_custom_publisher_new(rs_libp2p_custom_node_t *, const char *);
+rs_libp2p_custom_publisher_new(
+  rs_libp2p_custom_node_t *, const char *, bool, bool, size_t, uint64_t, uint8_t
+);
 
 extern void
 rs_libp2p_custom_publisher_free(rs_libp2p_custom_publisher_t *);
@@ -52,8 +83,9 @@ rs_libp2p_custom_publisher_get_gid(rs_libp2p_custom_publisher_t *, uint8_t *);
 
 extern rs_libp2p_custom_subscription_t *
 rs_libp2p_custom_subscription_new(
-  rs_libp2p_custom_node_t *, const char *, const rmw_libp2p_cpp::CustomSubscriptionInfo *,
-  void (*)(const rmw_libp2p_cpp::CustomSubscriptionHandle *, uint8_t *, const uintptr_t)
+  rs_libp2p_custom_node_t *, const char *, const void *,
+  void (*)(const rmw_libp2p_cpp::CustomSubscriptionHandle *, uint8_t *, const uintptr_t),
+  bool, bool
 );
 
 extern void
@@ -62,24 +94,117 @@ rs_libp2p_custom_subscription_free(rs_libp2p_custom_subscription_t *);
 extern size_t
 rs_libp2p_custom_subscription_get_gid(rs_libp2p_custom_subscription_t *, uint8_t *);
 
+extern uint8_t *
+rs_libp2p_message_new(uintptr_t);
+
+extern void
+rs_libp2p_message_free(uint8_t *, uintptr_t);
+
+extern rs_libp2p_custom_service_t *
+rs_libp2p_custom_service_new(
+  rs_libp2p_custom_node_t *, const char *, const void *,
+  void (*)(
+    const rmw_libp2p_cpp::ServiceListenerHandle *, const uint8_t *, int64_t, uint8_t *,
+    const uintptr_t)
+);
+
+extern void
+rs_libp2p_custom_service_free(rs_libp2p_custom_service_t *);
+
+extern size_t
+rs_libp2p_custom_service_get_gid(rs_libp2p_custom_service_t *, uint8_t *);
+
+extern size_t
+rs_libp2p_custom_service_send_response(
+  rs_libp2p_custom_service_t *, const uint8_t *, int64_t,
+  const rs_libp2p_cdr_buffer *);
+
+extern rs_libp2p_custom_client_t *
+rs_libp2p_custom_client_new(
+  rs_libp2p_custom_node_t *, const char *, const void *,
+  void (*)(
+    const rmw_libp2p_cpp::ServiceListenerHandle *, const uint8_t *, int64_t, uint8_t *,
+    const uintptr_t),
+  uint8_t
+);
+
+extern void
+rs_libp2p_custom_client_free(rs_libp2p_custom_client_t *);
+
+extern size_t
+rs_libp2p_custom_client_get_gid(rs_libp2p_custom_client_t *, uint8_t *);
+
+extern int64_t
+rs_libp2p_custom_client_send_request(
+  rs_libp2p_custom_client_t *,
+  const rs_libp2p_cdr_buffer *);
+
+extern bool
+rs_libp2p_custom_client_server_available(rs_libp2p_custom_client_t *);
+
 extern rs_libp2p_cdr_buffer_t *
 rs_libp2p_cdr_buffer_write_new();
 
+extern void
+rs_libp2p_cdr_buffer_write_reset(rs_libp2p_cdr_buffer_t *, size_t);
+
 extern rs_libp2p_cdr_buffer_t *
 rs_libp2p_cdr_buffer_read_new(const uint8_t *, size_t);
 
 extern void
 rs_libp2p_cdr_buffer_free(rs_libp2p_cdr_buffer_t *);
 
+extern void
+rs_libp2p_cdr_buffer_get_data(const rs_libp2p_cdr_buffer_t *, const uint8_t **, size_t *);
+
 extern uint32_t rs_libp2p_custom_publisher_publish(
   rs_libp2p_custom_publisher_t *,
   const rs_libp2p_cdr_buffer *);
 
+extern size_t rs_libp2p_custom_publisher_publish_serialized(
+  rs_libp2p_custom_publisher_t *,
+  const uint8_t *,
+  size_t,
+  uint8_t,
+  uint8_t,
+  uint8_t);
+
+extern size_t rs_libp2p_custom_publisher_publish_delta(
+  rs_libp2p_custom_publisher_t *,
+  const uint8_t *,
+  size_t,
+  const uint8_t *,
+  size_t,
+  uint8_t,
+  uint8_t);
+
+extern size_t rs_libp2p_custom_publisher_publish_fragments(
+  rs_libp2p_custom_publisher_t *,
+  const rmw_libp2p_cpp::Fragment *,
+  size_t,
+  uint8_t);
+
+extern size_t rs_libp2p_custom_publisher_publish_raw(
+  rs_libp2p_custom_publisher_t *,
+  const uint8_t *,
+  size_t);
+
+extern bool rs_libp2p_custom_publisher_wait_for_all_acked(
+  rs_libp2p_custom_publisher_t *,
+  uint64_t);
+
 struct rmw_context_impl_s
 {
   void * rs_event_loop_thread;
   bool is_shutdown;
   void * rs_local_key;
+  rmw_libp2p_cpp::GraphCache * graph_cache;
+  rmw_libp2p_cpp::TypeSupportRegistry * type_support_registry;
+  rmw_libp2p_cpp::TimerWheel * timer_wheel;
+  rmw_libp2p_cpp::TopicPriorities * topic_priorities;
+  rmw_libp2p_cpp::TopicEncodings * topic_encodings;
+  rmw_libp2p_cpp::DeltaTopics * delta_topics;
+  rmw_libp2p_cpp::ServiceRoutingPolicies * service_routing;
 };
 
 void * rs_rmw_init();
@@ -156,6 +281,9 @@ rs_libp2p_cdr_buffer_write_int32(rs_libp2p_cdr_buffer_t *, int32_t);
 extern void
 rs_libp2p_cdr_buffer_write_int64(rs_libp2p_cdr_buffer_t *, int64_t);
 
+extern void
+rs_libp2p_cdr_buffer_write_bool(rs_libp2p_cdr_buffer_t *, bool);
+
 extern void
 rs_libp2p_cdr_buffer_write_char(rs_libp2p_cdr_buffer_t *, char);
 
@@ -0,0 +1,127 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__SCATTER_GATHER_HPP_
+#define IMPL__SCATTER_GATHER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rmw_libp2p_cpp
+{
+
+// A piece of a serialized message, the layout matches Fragment in publisher.rs
+struct Fragment
+{
+  const uint8_t * data;
+  size_t size;
+};
+
+// Arrays smaller than this are cheaper to copy into the serialization buffer than to hand over
+// as a fragment of their own
+constexpr size_t kMinReferencedArray = 16 * 1024;
+
+// Arrays of numbers can only be referenced when their bytes in memory are the ones on the wire
+inline bool
+host_is_little_endian()
+{
+  const uint16_t probe = 1;
+  uint8_t first;
+  memcpy(&first, &probe, 1);
+  return first == 1;
+}
+
+// Large arrays a writer borrows from the ROS message instead of copying them into its buffer.
+// The serialized message is the buffer of the writer with each referenced array inserted at the
+// offset the writer had reached when it was written, so the references are only valid until the
+// message is modified or freed.
+class ReferencedArrays
+{
+public:
+  ReferencedArrays()
+  : threshold_(0), size_(0)
+  {
+  }
+
+  // Arrays of at least threshold bytes are referenced from now on, 0 disables it
+  void set_threshold(size_t threshold) {threshold_ = threshold;}
+
+  bool should_reference(size_t size) const noexcept {return threshold_ != 0 && size >= threshold_;}
+
+  void add(size_t offset, const void * data, size_t size)
+  {
+    references_.push_back({offset, static_cast<const uint8_t *>(data), size});
+    size_ += size;
+  }
+
+  // Total size of the referenced arrays
+  size_t size() const noexcept {return size_;}
+
+  // Size of the arrays referenced at or after offset
+  size_t size_since(size_t offset) const noexcept
+  {
+    size_t size = 0;
+    for (auto it = references_.rbegin(); it != references_.rend() && it->offset >= offset; ++it) {
+      size += it->size;
+    }
+    return size;
+  }
+
+  // Forgets the references and stops referencing arrays
+  void clear()
+  {
+    references_.clear();
+    fragments_.clear();
+    threshold_ = 0;
+    size_ = 0;
+  }
+
+  // Splits the message into slices of the buffer and the referenced arrays, in order
+  const std::vector<Fragment> & gather(const uint8_t * buffer, size_t buffer_size)
+  {
+    fragments_.clear();
+    size_t offset = 0;
+    for (const Reference & reference : references_) {
+      if (reference.offset > offset) {
+        fragments_.push_back({buffer + offset, reference.offset - offset});
+        offset = reference.offset;
+      }
+      fragments_.push_back({reference.data, reference.size});
+    }
+    if (buffer_size > offset) {
+      fragments_.push_back({buffer + offset, buffer_size - offset});
+    }
+    return fragments_;
+  }
+
+private:
+  struct Reference
+  {
+    size_t offset;
+    const uint8_t * data;
+    size_t size;
+  };
+
+  size_t threshold_;
+  size_t size_;
+  std::vector<Reference> references_;
+  // Kept across messages like the buffer of the writer, so that gathering does not allocate
+  std::vector<Fragment> fragments_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__SCATTER_GATHER_HPP_
@@ -0,0 +1,93 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPL__SERIALIZATION_BUFFER_POOL_HPP_
+#define IMPL__SERIALIZATION_BUFFER_POOL_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace rmw_libp2p_cpp
+{
+
+// Serialization buffers of a publisher, recycled across calls to rmw_publish so that publishing
+// at a steady rate does not allocate. The swarm copies the payload into its own message before
+// rs_libp2p_custom_publisher_publish returns, so a buffer can be released right after that.
+//
+// Buffer is the writer of one of the encodings (cdr::WriteCDRBuffer, xcdr2::Writer or
+// compact::Writer), anything with a reset(capacity) that empties it and resizes its allocation.
+template<typename Buffer>
+class SerializationBufferPool
+{
+public:
+  SerializationBufferPool()
+  : average_size_(0)
+  {
+  }
+
+  std::unique_ptr<Buffer>
+  acquire()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        std::unique_ptr<Buffer> buffer = std::move(free_.back());
+        free_.pop_back();
+        return buffer;
+      }
+    }
+    return std::unique_ptr<Buffer>(new Buffer());
+  }
+
+  // message_size is the number of bytes the buffer was filled with
+  void
+  release(std::unique_ptr<Buffer> buffer, size_t message_size)
+  {
+    size_t capacity;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Exponentially weighted moving average of the recent message sizes, alpha = 1/8
+      if (average_size_ == 0) {
+        average_size_ = message_size;
+      } else {
+        average_size_ = average_size_ - average_size_ / 8 + message_size / 8;
+      }
+      capacity = average_size_ + average_size_ / 4;
+      if (free_.size() >= kMaxFreeBuffers) {
+        return;
+      }
+    }
+    // Size the buffer for the next message outside the lock, it may allocate
+    buffer->reset(capacity);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < kMaxFreeBuffers) {
+      free_.push_back(std::move(buffer));
+    }
+  }
+
+private:
+  // More than this many buffers are only needed by bursts of concurrent rmw_publish calls
+  static constexpr size_t kMaxFreeBuffers = 4;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> free_;
+  size_t average_size_;
+};
+
+}  // namespace rmw_libp2p_cpp
+#endif  // IMPL__SERIALIZATION_BUFFER_POOL_HPP_
@@ -0,0 +1,134 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__SERVICE_LISTENER_HPP_
+#define IMPL__SERVICE_LISTENER_HPP_
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+#include "impl/graph_cache.hpp"
+#include "impl/rmw_libp2p_rs.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+class ServiceListener;
+
+struct ServiceListenerHandle
+{
+  ServiceListener * listener;
+};
+
+// Requests received by a service, or responses received by a client, waiting to be taken
+class ServiceListener
+{
+public:
+  struct Data
+  {
+    // GID of the client that sent the request
+    Gid client_gid;
+    int64_t sequence_number;
+    uint8_t * message;
+    uintptr_t length;
+  };
+
+  ServiceListener()
+  : condition_mutex_(nullptr), condition_variable_(nullptr)
+  {
+  }
+
+  ~ServiceListener()
+  {
+    // Messages are owned by the listener until taken
+    while (!message_queue_.empty()) {
+      Data & data = message_queue_.front();
+      rs_libp2p_message_free(data.message, data.length);
+      message_queue_.pop();
+    }
+  }
+
+  static void
+  on_message(
+    const ServiceListenerHandle * handle, const uint8_t * client_gid, int64_t sequence_number,
+    uint8_t * message, uintptr_t length)
+  {
+    ServiceListener * listener = handle->listener;
+    Data data;
+    memcpy(data.client_gid.data(), client_gid, data.client_gid.size());
+    data.sequence_number = sequence_number;
+    data.message = message;
+    data.length = length;
+
+    std::lock_guard<std::mutex> lock(listener->internal_mutex_);
+
+    if (listener->condition_mutex_) {
+      std::unique_lock<std::mutex> clock(*listener->condition_mutex_);
+      // the change to message_queue_ needs to be mutually exclusive with rmw_wait()
+      // which checks has_data() and decides if wait() needs to be called
+      listener->message_queue_.push(std::move(data));
+      clock.unlock();
+      listener->condition_variable_->notify_one();
+    } else {
+      listener->message_queue_.push(std::move(data));
+    }
+  }
+
+  void
+  attach_condition(std::mutex * condition_mutex, std::condition_variable * condition_variable)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    condition_mutex_ = condition_mutex;
+    condition_variable_ = condition_variable;
+  }
+
+  void
+  detach_condition()
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    condition_mutex_ = nullptr;
+    condition_variable_ = nullptr;
+  }
+
+  bool
+  has_data()
+  {
+    return message_queue_.size() > 0;
+  }
+
+  // The message must be released with rs_libp2p_message_free once deserialized
+  bool
+  take_next_data(Data & data)
+  {
+    std::lock_guard<std::mutex> lock(internal_mutex_);
+    if (message_queue_.empty()) {
+      return false;
+    }
+    data = message_queue_.front();
+    message_queue_.pop();
+    return true;
+  }
+
+private:
+  std::mutex internal_mutex_;
+  std::queue<Data> message_queue_;
+  std::mutex * condition_mutex_;
+  std::condition_variable * condition_variable_;
+};
+
+}  // namespace rmw_libp2p_cpp
+#endif  // IMPL__SERVICE_LISTENER_HPP_
@@ -0,0 +1,59 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__SERVICE_ROUTING_HPP_
+#define IMPL__SERVICE_ROUTING_HPP_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rmw_libp2p_cpp
+{
+
+// How a client picks a server when several peers serve its service, see rust/src/service.rs.
+// Servers in the same node as the client are always preferred.
+enum class ServiceRouting : uint8_t
+{
+  // Lowest measured round-trip time
+  NEAREST = 0,
+  // Fewest requests outstanding from the node of the client
+  LEAST_LOADED = 1,
+  // Consistent hash of the client GID, every request of a client goes to the same server
+  HASH = 2,
+};
+
+// Routing policy of the clients of a context, configured through the RMW_LIBP2P_SERVICE_ROUTING
+// environment variable as a comma separated list of pattern=policy entries, e.g.
+//
+//   RMW_LIBP2P_SERVICE_ROUTING="/plan_path=least_loaded,/map/*=hash"
+//
+// where policy is one of nearest, least_loaded or hash and '*' in a pattern matches any sequence
+// of characters. The first matching entry wins, services that match none use nearest.
+class ServiceRoutingPolicies
+{
+public:
+  ServiceRoutingPolicies();
+
+  ServiceRouting
+  get(const std::string & service_name) const;
+
+private:
+  std::vector<std::pair<std::string, ServiceRouting>> patterns_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__SERVICE_ROUTING_HPP_
@@ -0,0 +1,110 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__TIMER_WHEEL_HPP_
+#define IMPL__TIMER_WHEEL_HPP_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rmw_libp2p_cpp
+{
+
+// Hierarchical timer wheel shared by all the endpoints of a context, used to enforce QoS
+// deadlines without one timer (or thread) per endpoint.
+//
+// Time is divided in ticks of a fixed resolution. The first level has one slot per tick, each
+// following level has one slot per full turn of the previous one, and timers cascade down a
+// level when their slot comes up. Adding, removing and expiring a timer are O(1), and a single
+// worker thread runs the callbacks. The thread sleeps while no timer is armed.
+class TimerWheel
+{
+public:
+  using Clock = std::chrono::steady_clock;
+  using TimerId = uint64_t;
+  // Called from the worker thread when the timer expires, without any lock held. Returns the
+  // next expiration of the timer, or Clock::time_point::max() to stop it.
+  using Callback = std::function<Clock::time_point(Clock::time_point now)>;
+
+  explicit TimerWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(1));
+
+  ~TimerWheel();
+
+  TimerId
+  add(Clock::time_point expiration, Callback callback);
+
+  // Once this returns, the callback of the timer is not running and won't be called anymore,
+  // unless it is called from the callback itself.
+  void
+  remove(TimerId id);
+
+private:
+  static constexpr size_t kLevels = 4;
+  static constexpr size_t kSlotBits = 6;
+  static constexpr size_t kSlots = 1u << kSlotBits;
+  static constexpr uint64_t kSlotMask = kSlots - 1;
+
+  typedef struct Timer
+  {
+    uint64_t expiration_tick;
+    Callback callback;
+    size_t level;
+    size_t slot;
+  } Timer;
+
+  // First tick at or after time_point
+  uint64_t
+  to_tick(Clock::time_point time_point) const;
+
+  // Ticks fully elapsed at time_point
+  uint64_t
+  elapsed_ticks(Clock::time_point time_point) const;
+
+  Clock::time_point
+  to_time_point(uint64_t tick) const;
+
+  void
+  insert(TimerId id, Timer & timer);
+
+  void
+  cascade(size_t level);
+
+  void
+  run();
+
+  const Clock::duration resolution_;
+  const Clock::time_point start_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread worker_;
+  bool running_;
+  uint64_t current_tick_;
+  TimerId next_id_;
+  // Timer whose callback is running, 0 if none
+  TimerId running_timer_;
+  std::unordered_map<TimerId, Timer> timers_;
+  std::array<std::array<std::unordered_set<TimerId>, kSlots>, kLevels> wheel_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__TIMER_WHEEL_HPP_
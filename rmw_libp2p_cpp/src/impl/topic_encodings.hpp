@@ -0,0 +1,51 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPL__TOPIC_ENCODINGS_HPP_
+#define IMPL__TOPIC_ENCODINGS_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "impl/message_header.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+// Encoding of the messages published on the topics of a context, configured through the
+// RMW_LIBP2P_TOPIC_ENCODINGS environment variable as a comma separated list of pattern=encoding
+// entries, e.g.
+//
+//   RMW_LIBP2P_TOPIC_ENCODINGS="/dds_bridge/*=xcdr2,/radio/*=compact"
+//
+// where encoding is one of cdr, xcdr2 or compact and '*' in a pattern matches any sequence of
+// characters. The first matching entry wins, topics that match none are published in cdr.
+// Subscriptions decode any encoding, only publishers look at this.
+class TopicEncodings
+{
+public:
+  TopicEncodings();
+
+  PayloadEncoding
+  get(const std::string & topic_name) const;
+
+private:
+  std::vector<std::pair<std::string, PayloadEncoding>> patterns_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__TOPIC_ENCODINGS_HPP_
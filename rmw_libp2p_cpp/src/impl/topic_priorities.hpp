@@ -0,0 +1,56 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPL__TOPIC_PRIORITIES_HPP_
+#define IMPL__TOPIC_PRIORITIES_HPP_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rmw_libp2p_cpp
+{
+
+// Outgoing lanes of a node, see rust/src/outgoing.rs. Messages of lower values preempt the
+// messages of higher ones.
+enum class TopicPriority : uint8_t
+{
+  CONTROL = 0,
+  DEFAULT = 1,
+  BULK = 2,
+};
+
+// Priority of the topics of a context, configured through the RMW_LIBP2P_TOPIC_PRIORITIES
+// environment variable as a comma separated list of pattern=priority entries, e.g.
+//
+//   RMW_LIBP2P_TOPIC_PRIORITIES="/cmd_vel=control,/e_stop=control,/camera/*=bulk"
+//
+// where priority is one of control, default or bulk and '*' in a pattern matches any sequence of
+// characters. The first matching entry wins, topics that match none get the default priority.
+class TopicPriorities
+{
+public:
+  TopicPriorities();
+
+  TopicPriority
+  get(const std::string & topic_name) const;
+
+private:
+  std::vector<std::pair<std::string, TopicPriority>> patterns_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__TOPIC_PRIORITIES_HPP_
@@ -21,7 +21,10 @@
 #include <rosidl_runtime_c/u16string_functions.h>
 
 #include <cassert>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include "rcutils/logging_macros.h"
 
@@ -39,6 +42,8 @@
 
 #include "impl/cdr_buffer.hpp"
 #include "impl/rmw_libp2p_rs.hpp"
+#include "impl/compact.hpp"
+#include "impl/xcdr2.hpp"
 
 namespace rmw_libp2p_cpp
 {
@@ -169,13 +174,31 @@ struct U16StringHelper<rosidl_typesupport_introspection_cpp::MessageMembers>
   }
 };
 
+// The introspection members of the type are compiled once, when the type support is created,
+// into a flat list of operations: one per primitive member, with the members of nested
+// messages inlined at their offset. Serializing a message is then a single loop over the list
+// instead of a walk of the introspection tree. The same list serves every encoding.
 template<typename MembersType>
 class TypeSupport
 {
 public:
   bool serializeROSmessage(const void * ros_message, cdr::WriteCDRBuffer & ser);
 
-  bool deserializeROSmessage(cdr::ReadCDRBuffer & deser, void * ros_message);
+  // XCDR2 (PLAIN_CDR2) encoding, see impl/xcdr2.hpp
+  bool serializeROSmessage(const void * ros_message, xcdr2::Writer & ser);
+
+  // Compact encoding for low bandwidth links, see impl/compact.hpp
+  bool serializeROSmessage(const void * ros_message, compact::Writer & ser);
+
+  // check_schema can be disabled when the sender is known to use the same type (same type hash)
+  bool deserializeROSmessage(
+    cdr::ReadCDRBuffer & deser, void * ros_message, bool check_schema = true);
+
+  // XCDR2 payloads have no member counts, only their DHEADERs are checked
+  bool deserializeROSmessage(xcdr2::Reader & deser, void * ros_message);
+
+  // Compact payloads have no member counts either, nothing in them can be checked
+  bool deserializeROSmessage(compact::Reader & deser, void * ros_message);
 
 protected:
   explicit TypeSupport(const MembersType * members);
@@ -183,12 +206,73 @@ protected:
   const MembersType * members_;
 
 private:
-  bool serializeROSmessage(
-    cdr::WriteCDRBuffer & ser, const MembersType * members, const void * ros_message);
+  using MemberType = typename std::remove_cv<
+    typename std::remove_pointer<decltype(MembersType::members_)>::type>::type;
 
-  bool deserializeROSmessage(
-    cdr::ReadCDRBuffer & deser, const MembersType * members, void * ros_message,
-    bool call_new);
+  struct Operation;
+  using Plan = std::vector<Operation>;
+
+  struct Operation
+  {
+    enum class Kind : uint8_t
+    {
+      // Member count of a message, written in front of its members
+      MEMBER_COUNT,
+      BOOLEAN,
+      UINT8,
+      CHAR,
+      FLOAT,
+      DOUBLE,
+      INT16,
+      UINT16,
+      INT32,
+      UINT32,
+      INT64,
+      UINT64,
+      // Strings and arrays of primitives, handled by (de)serialize_field
+      MEMBER,
+      // Arrays and sequences of messages, each element is serialized with elements
+      MESSAGES,
+    };
+
+    Kind kind;
+    // Offset of the field from the start of the message the plan is for
+    uint32_t offset;
+    uint32_t member_count;
+    const MemberType * member;
+    std::unique_ptr<Plan> elements;
+  };
+
+  static typename Operation::Kind
+  primitive_kind(uint8_t type_id);
+
+  static void
+  compile(const MembersType * members, uint32_t offset, Plan & plan);
+
+  static void
+  serialize_member(cdr::WriteCDRBuffer & ser, const MemberType * member, void * field);
+
+  // XCDR2 and compact, which share their handling of strings and arrays
+  template<typename Writer>
+  static void
+  serialize_member(Writer & ser, const MemberType * member, void * field);
+
+  static void
+  deserialize_member(cdr::ReadCDRBuffer & deser, const MemberType * member, void * field);
+
+  template<typename Reader>
+  static void
+  deserialize_member(Reader & deser, const MemberType * member, void * field);
+
+  template<typename Buffer>
+  static void
+  serialize(Buffer & ser, const Plan & plan, const void * ros_message);
+
+  template<typename Buffer>
+  static void
+  deserialize(Buffer & deser, const Plan & plan, void * ros_message, bool check_schema);
+
+  Plan plan_;
 };
 
 }  // namespace rmw_libp2p_cpp
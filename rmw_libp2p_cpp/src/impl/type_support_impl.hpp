@@ -17,10 +17,13 @@
 
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "impl/cdr_buffer.hpp"
 #include "impl/macros.hpp"
+#include "impl/compact.hpp"
+#include "impl/xcdr2.hpp"
 
 #include "rosidl_runtime_c/primitives_sequence_functions.h"
 
@@ -101,6 +104,10 @@ TypeSupport<MembersType>::TypeSupport(const MembersType * members)
 {
   assert(members);
   this->members_ = members;
+  // Messages without members are not serialized at all
+  if (members->member_count_ != 0) {
+    compile(members, 0, plan_);
+  }
 }
 
 template<typename T>
@@ -210,10 +217,10 @@ void serialize_field<std::u16string>(
   }
 }
 
-inline
+template<typename Buffer>
 size_t get_submessage_sequence_serialize(
   const rosidl_typesupport_introspection_cpp::MessageMember * member,
-  cdr::WriteCDRBuffer & ser,
+  Buffer & ser,
   void * & field,
   void * & subros_message)
 {
@@ -232,10 +239,10 @@ size_t get_submessage_sequence_serialize(
   }
 }
 
-inline
+template<typename Buffer>
 size_t get_submessage_sequence_serialize(
   const rosidl_typesupport_introspection_c__MessageMember * member,
-  cdr::WriteCDRBuffer & ser,
+  Buffer & ser,
   void * & field,
   void * & subros_message)
 {
@@ -254,90 +261,471 @@ size_t get_submessage_sequence_serialize(
   }
 }
 
+// Classic payloads start every message with its member count, XCDR2 and compact ones don't
+inline
+void serialize_member_count(cdr::WriteCDRBuffer & ser, uint32_t member_count)
+{
+  ser << member_count;
+}
+
+inline
+void serialize_member_count(xcdr2::Writer &, uint32_t)
+{
+}
+
+inline
+void serialize_member_count(compact::Writer &, uint32_t)
+{
+}
+
+inline
+void deserialize_member_count(cdr::ReadCDRBuffer & deser, uint32_t expected, bool check_schema)
+{
+  uint32_t member_count = 0;
+  deser >> member_count;
+  if (check_schema && member_count != expected) {
+    throw std::runtime_error("failed to deserialize value");
+  }
+}
+
+inline
+void deserialize_member_count(xcdr2::Reader &, uint32_t, bool)
+{
+}
+
+inline
+void deserialize_member_count(compact::Reader &, uint32_t, bool)
+{
+}
+
+// XCDR2 precedes arrays and sequences of non-primitive elements with their size in bytes, the
+// DHEADER. Classic and compact payloads have nothing around them.
+inline
+size_t begin_elements(cdr::WriteCDRBuffer &)
+{
+  return 0;
+}
+
+inline
+void end_elements(cdr::WriteCDRBuffer &, size_t)
+{
+}
+
+inline
+size_t begin_elements(compact::Writer &)
+{
+  return 0;
+}
+
+inline
+void end_elements(compact::Writer &, size_t)
+{
+}
+
+inline
+size_t begin_elements(compact::Reader &)
+{
+  return 0;
+}
+
+inline
+void end_elements(compact::Reader &, size_t)
+{
+}
+
+inline
+size_t begin_elements(xcdr2::Writer & ser)
+{
+  return ser.begin_dheader();
+}
+
+inline
+void end_elements(xcdr2::Writer & ser, size_t position)
+{
+  ser.end_dheader(position);
+}
+
+inline
+size_t begin_elements(cdr::ReadCDRBuffer &)
+{
+  return 0;
+}
+
+inline
+void end_elements(cdr::ReadCDRBuffer &, size_t)
+{
+}
+
+inline
+size_t begin_elements(xcdr2::Reader & deser)
+{
+  return deser.read_dheader();
+}
+
+// Elements that don't fill their DHEADER exactly were written for another type
+inline
+void end_elements(xcdr2::Reader & deser, size_t end)
+{
+  if (deser.position() != end) {
+    throw std::runtime_error("failed to deserialize value");
+  }
+}
+
+// Every XCDR2 or compact element takes at least a byte, so a longer sequence can't fit in the
+// payload and must not be allocated
+inline
+void check_sequence_length(cdr::ReadCDRBuffer &, size_t)
+{
+}
+
+template<typename Reader>
+void check_sequence_length(Reader & deser, size_t length)
+{
+  if (length > deser.remaining()) {
+    throw std::runtime_error("not enough data to deserialize");
+  }
+}
+
+// Kind of the operation serializing a single member of the given type, MEMBER if it isn't a
+// primitive
 template<typename MembersType>
-bool TypeSupport<MembersType>::serializeROSmessage(
-  cdr::WriteCDRBuffer & ser, const MembersType * members, const void * ros_message)
+typename TypeSupport<MembersType>::Operation::Kind
+TypeSupport<MembersType>::primitive_kind(uint8_t type_id)
 {
-  assert(ros_message);
-  assert(members);
+  switch (type_id) {
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+      return Operation::Kind::BOOLEAN;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+      return Operation::Kind::UINT8;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+      return Operation::Kind::CHAR;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      return Operation::Kind::FLOAT;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      return Operation::Kind::DOUBLE;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      return Operation::Kind::INT16;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+      return Operation::Kind::UINT16;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      return Operation::Kind::INT32;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+      return Operation::Kind::UINT32;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      return Operation::Kind::INT64;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+      return Operation::Kind::UINT64;
+    default:
+      return Operation::Kind::MEMBER;
+  }
+}
 
-  ser << members->member_count_;
+template<typename MembersType>
+void TypeSupport<MembersType>::compile(
+  const MembersType * members, uint32_t offset, Plan & plan)
+{
+  Operation member_count{};
+  member_count.kind = Operation::Kind::MEMBER_COUNT;
+  member_count.member_count = members->member_count_;
+  plan.push_back(std::move(member_count));
 
   for (uint32_t i = 0; i < members->member_count_; ++i) {
     const auto member = members->members_ + i;
-    void * field = const_cast<char *>(static_cast<const char *>(ros_message)) + member->offset_;
+    Operation operation{};
+    operation.offset = offset + member->offset_;
+    operation.member = member;
+    if (member->type_id_ == ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE) {
+      auto sub_members = static_cast<const MembersType *>(member->members_->data);
+      if (!member->is_array_) {
+        // Single messages are inlined, at their offset in the enclosing message
+        compile(sub_members, operation.offset, plan);
+        continue;
+      }
+      operation.kind = Operation::Kind::MESSAGES;
+      operation.elements.reset(new Plan());
+      compile(sub_members, 0, *operation.elements);
+    } else if (member->is_array_) {
+      operation.kind = Operation::Kind::MEMBER;
+    } else {
+      operation.kind = primitive_kind(member->type_id_);
+    }
+    plan.push_back(std::move(operation));
+  }
+}
+
+template<typename MembersType>
+void TypeSupport<MembersType>::serialize_member(
+  cdr::WriteCDRBuffer & ser, const MemberType * member, void * field)
+{
+  switch (member->type_id_) {
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+      serialize_field<bool>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+      serialize_field<uint8_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+      serialize_field<char>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      serialize_field<float>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      serialize_field<double>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      serialize_field<int16_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+      serialize_field<uint16_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      serialize_field<int32_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+      serialize_field<uint32_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      serialize_field<int64_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+      serialize_field<uint64_t>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      // serialize_field<std::string>(member, field, ser);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+      // serialize_field<std::u16string>(member, field, ser);
+      break;
+    default:
+      throw std::runtime_error("unknown type");
+  }
+}
+
+inline
+void check_string_length(size_t length, size_t upper_bound)
+{
+  if (upper_bound && length > upper_bound) {
+    throw std::runtime_error("string overcomes the maximum length");
+  }
+}
+
+// XCDR2 and compact strings are written straight from the storage of the message
+template<typename Writer>
+void serialize_string(Writer & ser, const std::string & str, size_t upper_bound)
+{
+  check_string_length(str.size(), upper_bound);
+  ser.write_string(str.data(), str.size());
+}
+
+template<typename Writer>
+void serialize_string(Writer & ser, const rosidl_runtime_c__String & str, size_t upper_bound)
+{
+  check_string_length(str.size, upper_bound);
+  ser.write_string(str.data ? str.data : "", str.size);
+}
+
+template<typename Writer>
+void serialize_string(Writer & ser, const std::u16string & str, size_t upper_bound)
+{
+  check_string_length(str.size(), upper_bound);
+  ser.write_u16string(reinterpret_cast<const uint16_t *>(str.data()), str.size());
+}
+
+template<typename Writer>
+void serialize_string(
+  Writer & ser, const rosidl_runtime_c__U16String & str, size_t upper_bound)
+{
+  check_string_length(str.size, upper_bound);
+  ser.write_u16string(str.data, str.size);
+}
+
+// Sequences start with their number of elements, arrays have a fixed one
+template<typename Writer, typename MemberType>
+size_t serialize_array_size(Writer & ser, const MemberType * member, const void * field)
+{
+  const size_t size = member->size_function(field);
+  if (member->is_upper_bound_ && size > member->array_size_) {
+    throw std::runtime_error("sequence overcomes the maximum length");
+  }
+  if (!member->array_size_ || member->is_upper_bound_) {
+    ser << static_cast<uint32_t>(size);
+  }
+  return size;
+}
+
+template<typename T, typename Writer, typename MemberType>
+void serialize_primitive_array(Writer & ser, const MemberType * member, const void * field)
+{
+  const size_t size = serialize_array_size(ser, member, field);
+  if (size == 0) {
+    return;
+  }
+  // Only std::vector<bool> has no get functions, its elements are fetched one by one
+  if (member->get_const_function) {
+    ser.write_array(static_cast<const T *>(member->get_const_function(field, 0)), size);
+  } else {
+    for (size_t i = 0; i < size; ++i) {
+      T value = T();
+      member->fetch_function(field, i, &value);
+      ser << value;
+    }
+  }
+}
+
+template<typename T, typename Writer, typename MemberType>
+void serialize_string_array(Writer & ser, const MemberType * member, const void * field)
+{
+  const size_t elements = begin_elements(ser);
+  const size_t size = serialize_array_size(ser, member, field);
+  for (size_t i = 0; i < size; ++i) {
+    serialize_string(
+      ser, *static_cast<const T *>(member->get_const_function(field, i)),
+      member->string_upper_bound_);
+  }
+  end_elements(ser, elements);
+}
+
+template<typename MembersType>
+template<typename Writer>
+void TypeSupport<MembersType>::serialize_member(
+  Writer & ser, const MemberType * member, void * field)
+{
+  using String = typename StringHelper<MembersType>::type;
+  using U16String = typename U16StringHelper<MembersType>::type;
+  if (!member->is_array_) {
+    // Every other single member is a primitive with its own operation
     switch (member->type_id_) {
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
-        if (!member->is_array_) {
-          // don't cast to bool here because if the bool is
-          // uninitialized the random value can't be deserialized
-          ser << (*static_cast<uint8_t *>(field) ? true : false);
-        } else {
-          serialize_field<bool>(member, field, ser);
-        }
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+        serialize_string(ser, *static_cast<const String *>(field), member->string_upper_bound_);
+        return;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+        serialize_string(
+          ser, *static_cast<const U16String *>(field), member->string_upper_bound_);
+        return;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WCHAR:
+        ser << *static_cast<const uint16_t *>(field);
+        return;
+      default:
+        throw std::runtime_error("unknown type");
+    }
+  }
+  switch (member->type_id_) {
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+      serialize_primitive_array<bool>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+      serialize_primitive_array<uint8_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+      serialize_primitive_array<char>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WCHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+      serialize_primitive_array<uint16_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      serialize_primitive_array<float>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      serialize_primitive_array<double>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      serialize_primitive_array<int16_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      serialize_primitive_array<int32_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+      serialize_primitive_array<uint32_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      serialize_primitive_array<int64_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+      serialize_primitive_array<uint64_t>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      serialize_string_array<String>(ser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+      serialize_string_array<U16String>(ser, member, field);
+      break;
+    default:
+      throw std::runtime_error("unknown type");
+  }
+}
+
+template<typename MembersType>
+template<typename Buffer>
+void TypeSupport<MembersType>::serialize(
+  Buffer & ser, const Plan & plan, const void * ros_message)
+{
+  for (const Operation & operation : plan) {
+    void * field = const_cast<char *>(static_cast<const char *>(ros_message)) + operation.offset;
+    switch (operation.kind) {
+      case Operation::Kind::MEMBER_COUNT:
+        serialize_member_count(ser, operation.member_count);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
-        serialize_field<uint8_t>(member, field, ser);
+      case Operation::Kind::BOOLEAN:
+        // don't cast to bool here because if the bool is
+        // uninitialized the random value can't be deserialized
+        ser << (*static_cast<uint8_t *>(field) ? true : false);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
-        serialize_field<char>(member, field, ser);
+      case Operation::Kind::UINT8:
+        ser << *static_cast<uint8_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
-        serialize_field<float>(member, field, ser);
+      case Operation::Kind::CHAR:
+        ser << *static_cast<char *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
-        serialize_field<double>(member, field, ser);
+      case Operation::Kind::FLOAT:
+        ser << *static_cast<float *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
-        serialize_field<int16_t>(member, field, ser);
+      case Operation::Kind::DOUBLE:
+        ser << *static_cast<double *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
-        serialize_field<uint16_t>(member, field, ser);
+      case Operation::Kind::INT16:
+        ser << *static_cast<int16_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
-        serialize_field<int32_t>(member, field, ser);
+      case Operation::Kind::UINT16:
+        ser << *static_cast<uint16_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
-        serialize_field<uint32_t>(member, field, ser);
+      case Operation::Kind::INT32:
+        ser << *static_cast<int32_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
-        serialize_field<int64_t>(member, field, ser);
+      case Operation::Kind::UINT32:
+        ser << *static_cast<uint32_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
-        serialize_field<uint64_t>(member, field, ser);
+      case Operation::Kind::INT64:
+        ser << *static_cast<int64_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
-        // serialize_field<std::string>(member, field, ser);
+      case Operation::Kind::UINT64:
+        ser << *static_cast<uint64_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
-        // serialize_field<std::u16string>(member, field, ser);
+      case Operation::Kind::MEMBER:
+        serialize_member(ser, operation.member, field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE:
+      case Operation::Kind::MESSAGES:
         {
-          auto sub_members = static_cast<const MembersType *>(member->members_->data);
-          if (!member->is_array_) {
-            serializeROSmessage(ser, sub_members, field);
-          } else {
-            void * subros_message = nullptr;
-            size_t array_size = 0;
-
-            array_size = get_submessage_sequence_serialize(
-              member, ser, field, subros_message);
-
-            for (size_t index = 0; index < array_size; ++index) {
-              serializeROSmessage(ser, sub_members, member->get_function(subros_message, index));
-            }
+          void * subros_message = nullptr;
+          size_t elements = begin_elements(ser);
+          size_t array_size = get_submessage_sequence_serialize(
+            operation.member, ser, field, subros_message);
+          for (size_t index = 0; index < array_size; ++index) {
+            serialize(
+              ser, *operation.elements, operation.member->get_function(subros_message, index));
           }
+          end_elements(ser, elements);
         }
         break;
-      default:
-        throw std::runtime_error("unknown type");
     }
   }
-
-  return true;
 }
 
 template<typename T>
@@ -352,8 +740,9 @@ void deserialize_field(
   } else if (member->array_size_ && !member->is_upper_bound_) {
     // deser.deserializeSequence(static_cast<T *>(field), member->array_size_);
   } else {
+    // The message is already constructed, clearing keeps the capacity for the next take
     auto & vector = *reinterpret_cast<std::vector<T> *>(field);
-    new(&vector) std::vector<T>;
+    vector.clear();
     // deser >> vector;
   }
 }
@@ -373,8 +762,14 @@ void deserialize_field(
     auto & data = *reinterpret_cast<typename GenericCSequence<T>::type *>(field);
     size_t dsize = 0;
     // deser.deserializeSequenceSize(&dsize);
-    if (!GenericCSequence<T>::init(&data, dsize)) {
-      throw std::runtime_error("unable to initialize GenericCSequence");
+    // Only reallocate when the storage of the previous take is too small
+    if (dsize > data.capacity) {
+      GenericCSequence<T>::fini(&data);
+      if (!GenericCSequence<T>::init(&data, dsize)) {
+        throw std::runtime_error("unable to initialize GenericCSequence");
+      }
+    } else {
+      data.size = dsize;
     }
     // deser.deserializeSequence(reinterpret_cast<T *>(data.data), dsize);
   }
@@ -472,13 +867,36 @@ void deserialize_field<std::u16string>(
   }
 }
 
+// Sequences of messages are resized in place: std::vector keeps its capacity when it shrinks and
+// the elements that remain are overwritten, so taking repeatedly into the same message only
+// allocates when a sequence grows past its largest size so far.
+inline
+void resize_sequence(
+  const rosidl_typesupport_introspection_cpp::MessageMember * member, void * field, size_t size)
+{
+  member->resize_function(field, size);
+}
+
+// The resize function of C sequences finalizes every element and allocates new ones. Elements
+// are initialized up to the capacity of the sequence, so shrinking only needs to update its size.
 inline
+void resize_sequence(
+  const rosidl_typesupport_introspection_c__MessageMember * member, void * field, size_t size)
+{
+  auto sequence = static_cast<rosidl_runtime_c__void__Sequence *>(field);
+  if (size > sequence->capacity) {
+    member->resize_function(field, size);
+  } else {
+    sequence->size = size;
+  }
+}
+
+template<typename Buffer>
 size_t get_submessage_sequence_deserialize(
   const rosidl_typesupport_introspection_cpp::MessageMember * member,
-  cdr::ReadCDRBuffer & deser,
+  Buffer & deser,
   void * & field,
-  void * & subros_message,
-  bool & call_new)
+  void * & subros_message)
 {
   if (member->array_size_ && !member->is_upper_bound_) {
     subros_message = field;
@@ -487,22 +905,19 @@ size_t get_submessage_sequence_deserialize(
     // Deserialize length
     uint32_t array_size = 0;
     deser >> array_size;
-    auto vector = reinterpret_cast<std::vector<unsigned char> *>(field);
-    new(vector) std::vector<unsigned char>;
-    member->resize_function(field, array_size);
+    check_sequence_length(deser, array_size);
+    resize_sequence(member, field, array_size);
     subros_message = field;
-    call_new = true;
     return array_size;
   }
 }
 
-inline
+template<typename Buffer>
 size_t get_submessage_sequence_deserialize(
   const rosidl_typesupport_introspection_c__MessageMember * member,
-  cdr::ReadCDRBuffer & deser,
+  Buffer & deser,
   void * & field,
-  void * & subros_message,
-  bool & call_new)
+  void * & subros_message)
 {
   if (member->array_size_ && !member->is_upper_bound_) {
     subros_message = &field;
@@ -511,128 +926,338 @@ size_t get_submessage_sequence_deserialize(
     // Deserialize length
     uint32_t array_size = 0;
     deser >> array_size;
-    member->resize_function(field, array_size);
+    check_sequence_length(deser, array_size);
+    resize_sequence(member, field, array_size);
     subros_message = field;
-    call_new = true;
     return array_size;
   }
 }
 
 template<typename MembersType>
-bool TypeSupport<MembersType>::deserializeROSmessage(
-  cdr::ReadCDRBuffer & deser, const MembersType * members, void * ros_message, bool call_new)
+void TypeSupport<MembersType>::deserialize_member(
+  cdr::ReadCDRBuffer & deser, const MemberType * member, void * field)
 {
-  assert(members);
-  assert(ros_message);
+  switch (member->type_id_) {
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+      deserialize_field<bool>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+      deserialize_field<uint8_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+      deserialize_field<char>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      deserialize_field<float>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      deserialize_field<double>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      deserialize_field<int16_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+      deserialize_field<uint16_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      deserialize_field<int32_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+      deserialize_field<uint32_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      deserialize_field<int64_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+      deserialize_field<uint64_t>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      deserialize_field<std::string>(member, field, deser, false);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+      // deserialize_field<std::u16string>(member, field, deser, false);
+      break;
+    default:
+      throw std::runtime_error("unknown type");
+  }
+}
 
-  uint32_t member_count = 0;
-  deser >> member_count;
+template<typename Reader>
+void deserialize_string(Reader & deser, std::string & str)
+{
+  size_t length = 0;
+  const char * data = deser.read_string(length);
+  str.assign(data, length);
+}
 
-  if (member_count != members->member_count_) {
-    throw std::runtime_error("failed to deserialize value");
+template<typename Reader>
+void deserialize_string(Reader & deser, rosidl_runtime_c__String & str)
+{
+  size_t length = 0;
+  const char * data = deser.read_string(length);
+  if (!rosidl_runtime_c__String__assignn(&str, data, length)) {
+    throw std::runtime_error("unable to assign rosidl_runtime_c__String");
   }
+}
 
-  for (uint32_t i = 0; i < members->member_count_; ++i) {
-    const auto * member = members->members_ + i;
-    void * field = static_cast<char *>(ros_message) + member->offset_;
+template<typename Reader>
+void deserialize_string(Reader & deser, std::u16string & str)
+{
+  deser.read_u16string(str);
+}
+
+template<typename Reader>
+void deserialize_string(Reader & deser, rosidl_runtime_c__U16String & str)
+{
+  std::u16string u16str;
+  deser.read_u16string(u16str);
+  if (!rosidl_runtime_c__U16String__assignn(
+      &str, reinterpret_cast<const uint16_t *>(u16str.data()), u16str.size()))
+  {
+    throw std::runtime_error("unable to assign rosidl_runtime_c__U16String");
+  }
+}
+
+template<typename Reader, typename MemberType>
+size_t deserialize_array_size(Reader & deser, const MemberType * member, void * field)
+{
+  if (member->array_size_ && !member->is_upper_bound_) {
+    return member->array_size_;
+  }
+  uint32_t size = 0;
+  deser >> size;
+  if (member->is_upper_bound_ && size > member->array_size_) {
+    throw std::runtime_error("sequence overcomes the maximum length");
+  }
+  check_sequence_length(deser, size);
+  resize_sequence(member, field, size);
+  return size;
+}
+
+template<typename T, typename Reader, typename MemberType>
+void deserialize_primitive_array(Reader & deser, const MemberType * member, void * field)
+{
+  const size_t size = deserialize_array_size(deser, member, field);
+  if (size == 0) {
+    return;
+  }
+  if (member->get_function) {
+    deser.read_array(static_cast<T *>(member->get_function(field, 0)), size);
+  } else {
+    for (size_t i = 0; i < size; ++i) {
+      T value = T();
+      deser >> value;
+      member->assign_function(field, i, &value);
+    }
+  }
+}
+
+template<typename T, typename Reader, typename MemberType>
+void deserialize_string_array(Reader & deser, const MemberType * member, void * field)
+{
+  const size_t end = begin_elements(deser);
+  const size_t size = deserialize_array_size(deser, member, field);
+  for (size_t i = 0; i < size; ++i) {
+    deserialize_string(deser, *static_cast<T *>(member->get_function(field, i)));
+  }
+  end_elements(deser, end);
+}
+
+template<typename MembersType>
+template<typename Reader>
+void TypeSupport<MembersType>::deserialize_member(
+  Reader & deser, const MemberType * member, void * field)
+{
+  using String = typename StringHelper<MembersType>::type;
+  using U16String = typename U16StringHelper<MembersType>::type;
+  if (!member->is_array_) {
     switch (member->type_id_) {
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
-        deserialize_field<bool>(member, field, deser, call_new);
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+        deserialize_string(deser, *static_cast<String *>(field));
+        return;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+        deserialize_string(deser, *static_cast<U16String *>(field));
+        return;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WCHAR:
+        deser >> *static_cast<uint16_t *>(field);
+        return;
+      default:
+        throw std::runtime_error("unknown type");
+    }
+  }
+  switch (member->type_id_) {
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+      deserialize_primitive_array<bool>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+      deserialize_primitive_array<uint8_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+      deserialize_primitive_array<char>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WCHAR:
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+      deserialize_primitive_array<uint16_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+      deserialize_primitive_array<float>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+      deserialize_primitive_array<double>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+      deserialize_primitive_array<int16_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+      deserialize_primitive_array<int32_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+      deserialize_primitive_array<uint32_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+      deserialize_primitive_array<int64_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+      deserialize_primitive_array<uint64_t>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      deserialize_string_array<String>(deser, member, field);
+      break;
+    case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+      deserialize_string_array<U16String>(deser, member, field);
+      break;
+    default:
+      throw std::runtime_error("unknown type");
+  }
+}
+
+template<typename MembersType>
+template<typename Buffer>
+void TypeSupport<MembersType>::deserialize(
+  Buffer & deser, const Plan & plan, void * ros_message, bool check_schema)
+{
+  for (const Operation & operation : plan) {
+    void * field = static_cast<char *>(ros_message) + operation.offset;
+    switch (operation.kind) {
+      case Operation::Kind::MEMBER_COUNT:
+        deserialize_member_count(deser, operation.member_count, check_schema);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
-        deserialize_field<uint8_t>(member, field, deser, call_new);
+      case Operation::Kind::BOOLEAN:
+        deser >> *static_cast<bool *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
-        deserialize_field<char>(member, field, deser, call_new);
+      case Operation::Kind::UINT8:
+        deser >> *static_cast<uint8_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
-        deserialize_field<float>(member, field, deser, call_new);
+      case Operation::Kind::CHAR:
+        deser >> *static_cast<char *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
-        deserialize_field<double>(member, field, deser, call_new);
+      case Operation::Kind::FLOAT:
+        deser >> *static_cast<float *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
-        deserialize_field<int16_t>(member, field, deser, call_new);
+      case Operation::Kind::DOUBLE:
+        deser >> *static_cast<double *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
-        deserialize_field<uint16_t>(member, field, deser, call_new);
+      case Operation::Kind::INT16:
+        deser >> *static_cast<int16_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
-        deserialize_field<int32_t>(member, field, deser, call_new);
+      case Operation::Kind::UINT16:
+        deser >> *static_cast<uint16_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
-        deserialize_field<uint32_t>(member, field, deser, call_new);
+      case Operation::Kind::INT32:
+        deser >> *static_cast<int32_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
-        deserialize_field<int64_t>(member, field, deser, call_new);
+      case Operation::Kind::UINT32:
+        deser >> *static_cast<uint32_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
-        deserialize_field<uint64_t>(member, field, deser, call_new);
+      case Operation::Kind::INT64:
+        deser >> *static_cast<int64_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
-        deserialize_field<std::string>(member, field, deser, call_new);
+      case Operation::Kind::UINT64:
+        deser >> *static_cast<uint64_t *>(field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
-        // deserialize_field<std::u16string>(member, field, deser, call_new);
+      case Operation::Kind::MEMBER:
+        deserialize_member(deser, operation.member, field);
         break;
-      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE:
+      case Operation::Kind::MESSAGES:
         {
-          auto sub_members = (const MembersType *)member->members_->data;
-          if (!member->is_array_) {
-            deserializeROSmessage(deser, sub_members, field, call_new);
-          } else {
-            void * subros_message = nullptr;
-            size_t array_size = 0;
-            bool recall_new = call_new;
-
-            array_size = get_submessage_sequence_deserialize(
-              member, deser, field, subros_message, recall_new);
-
-            for (size_t index = 0; index < array_size; ++index) {
-              deserializeROSmessage(
-                deser, sub_members, member->get_function(subros_message, index), recall_new);
-            }
+          void * subros_message = nullptr;
+          size_t elements = begin_elements(deser);
+          size_t array_size = get_submessage_sequence_deserialize(
+            operation.member, deser, field, subros_message);
+          for (size_t index = 0; index < array_size; ++index) {
+            deserialize(
+              deser, *operation.elements, operation.member->get_function(subros_message, index),
+              check_schema);
           }
+          end_elements(deser, elements);
         }
         break;
-      default:
-        throw std::runtime_error("unknown type");
     }
   }
+}
 
+template<typename MembersType>
+bool TypeSupport<MembersType>::serializeROSmessage(
+  const void * ros_message, cdr::WriteCDRBuffer & ser)
+{
+  assert(ros_message);
+
+  serialize(ser, plan_, ros_message);
   return true;
 }
 
 template<typename MembersType>
 bool TypeSupport<MembersType>::serializeROSmessage(
-  const void * ros_message, cdr::WriteCDRBuffer & ser)
+  const void * ros_message, xcdr2::Writer & ser)
 {
   assert(ros_message);
 
-  if (members_->member_count_ != 0) {
-    TypeSupport::serializeROSmessage(ser, members_, ros_message);
-  }
+  serialize(ser, plan_, ros_message);
+  ser.finish();
+  return true;
+}
+
+template<typename MembersType>
+bool TypeSupport<MembersType>::serializeROSmessage(
+  const void * ros_message, compact::Writer & ser)
+{
+  assert(ros_message);
+
+  serialize(ser, plan_, ros_message);
   return true;
 }
 
 template<typename MembersType>
 bool TypeSupport<MembersType>::deserializeROSmessage(
-  cdr::ReadCDRBuffer & deser, void * ros_message)
+  cdr::ReadCDRBuffer & deser, void * ros_message, bool check_schema)
 {
   assert(ros_message);
-  if (members_->member_count_ != 0) {
-    // Skip the first uint64_t and uint32_t, they correspond to the timestamp
-    uint64_t secs = 0;
-    deser >> secs;
 
-    uint32_t usecs = 0;
-    deser >> usecs;
+  deserialize(deser, plan_, ros_message, check_schema);
+  return true;
+}
 
-    TypeSupport::deserializeROSmessage(deser, members_, ros_message, false);
-  }
+template<typename MembersType>
+bool TypeSupport<MembersType>::deserializeROSmessage(
+  xcdr2::Reader & deser, void * ros_message)
+{
+  assert(ros_message);
+
+  deserialize(deser, plan_, ros_message, false);
+  return true;
+}
+
+template<typename MembersType>
+bool TypeSupport<MembersType>::deserializeROSmessage(
+  compact::Reader & deser, void * ros_message)
+{
+  assert(ros_message);
 
+  deserialize(deser, plan_, ros_message, false);
   return true;
 }
 
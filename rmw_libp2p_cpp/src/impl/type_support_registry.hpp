@@ -0,0 +1,73 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPL__TYPE_SUPPORT_REGISTRY_HPP_
+#define IMPL__TYPE_SUPPORT_REGISTRY_HPP_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace rmw_libp2p_cpp
+{
+
+typedef struct RegisteredType
+{
+  // MessageTypeSupport_c or MessageTypeSupport_cpp, depending on typesupport_identifier
+  void * type_support;
+  const char * typesupport_identifier;
+  // ROS type name (e.g. std_msgs/msg/String)
+  std::string type_name;
+  // Structural hash of the type (see _create_type_hash)
+  uint64_t type_hash;
+  size_t references;
+} RegisteredType;
+
+// Message type supports shared by all the endpoints of a context.
+//
+// Types are keyed by their introspection members, which are static and unique per type and
+// typesupport, so no name needs to be formatted to look them up. The type support is created by
+// the first endpoint of a type and deleted when the last one releases it.
+class TypeSupportRegistry
+{
+public:
+  TypeSupportRegistry() = default;
+
+  TypeSupportRegistry(const TypeSupportRegistry &) = delete;
+
+  TypeSupportRegistry &
+  operator=(const TypeSupportRegistry &) = delete;
+
+  ~TypeSupportRegistry();
+
+  // Returns nullptr and sets the rmw error if the type support cannot be created.
+  // Every successful call must be balanced with a call to release().
+  const RegisteredType *
+  acquire(const void * untyped_members, const char * typesupport_identifier);
+
+  void
+  release(void * untyped_typesupport);
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<const void *, RegisteredType> types_;
+  // Reverse index, endpoints only keep the type support around
+  std::unordered_map<void *, const void *> members_;
+};
+
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__TYPE_SUPPORT_REGISTRY_HPP_
@@ -0,0 +1,389 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPL__XCDR2_HPP_
+#define IMPL__XCDR2_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "impl/scatter_gather.hpp"
+
+namespace rmw_libp2p_cpp
+{
+namespace xcdr2
+{
+
+// PLAIN_CDR2 encoding of final types (DDS-XTypes 1.3, 7.4.3): primitives are aligned to their
+// size but never to more than 4 bytes, there are no member counts and only sequences and arrays
+// of non-primitive elements are preceded by a DHEADER with their size in bytes.
+//
+// Payloads start with the 4 byte encapsulation header, the alignment is relative to its end.
+constexpr uint8_t kPlainCdr2Be = 0x06;
+constexpr uint8_t kPlainCdr2Le = 0x07;
+constexpr size_t kEncapsulationSize = 4;
+constexpr size_t kMaxAlignment = 4;
+
+// Writes little endian payloads, byte by byte so that the host byte order doesn't matter. Large
+// arrays are only referenced in place on little endian hosts.
+class Writer
+{
+public:
+  Writer()
+  {
+    begin();
+  }
+
+  // Discards the bytes written so far, the allocation is kept and resized toward capacity
+  void reset(size_t capacity)
+  {
+    buffer_.clear();
+    references_.clear();
+    if (buffer_.capacity() < capacity) {
+      buffer_.reserve(capacity);
+    } else if (buffer_.capacity() / 2 > capacity) {
+      std::vector<uint8_t> smaller;
+      smaller.reserve(capacity);
+      buffer_.swap(smaller);
+    }
+    begin();
+  }
+
+  // Pads the payload to a multiple of 4 bytes, the padding is recorded in the options of the
+  // encapsulation header. No more bytes can be written afterwards.
+  void finish()
+  {
+    const size_t padding = (kMaxAlignment - size() % kMaxAlignment) % kMaxAlignment;
+    buffer_.resize(buffer_.size() + padding, 0);
+    buffer_[3] = static_cast<uint8_t>(padding);
+  }
+
+  // Arrays of numbers of at least threshold bytes written from now on are referenced instead
+  // of copied, the payload is then only available through gather()
+  void reference_arrays(size_t threshold) {references_.set_threshold(threshold);}
+
+  // The whole payload as long as no array was referenced
+  const uint8_t * data() const noexcept {return buffer_.data();}
+  // Size of the payload, including the referenced arrays
+  size_t size() const noexcept {return buffer_.size() + references_.size();}
+  // Bytes held by the buffer itself
+  size_t buffered() const noexcept {return buffer_.size();}
+
+  const std::vector<Fragment> & gather()
+  {
+    return references_.gather(buffer_.data(), buffer_.size());
+  }
+
+  inline Writer & operator<<(const bool b)
+  {
+    buffer_.push_back(b ? 1 : 0);
+    return *this;
+  }
+  inline Writer & operator<<(const char c)
+  {
+    buffer_.push_back(static_cast<uint8_t>(c));
+    return *this;
+  }
+  inline Writer & operator<<(const int8_t n) {return put(static_cast<uint8_t>(n), 1);}
+  inline Writer & operator<<(const uint8_t n) {return put(n, 1);}
+  inline Writer & operator<<(const int16_t n) {return put(static_cast<uint16_t>(n), 2);}
+  inline Writer & operator<<(const uint16_t n) {return put(n, 2);}
+  inline Writer & operator<<(const char16_t n) {return put(n, 2);}
+  inline Writer & operator<<(const int32_t n) {return put(static_cast<uint32_t>(n), 4);}
+  inline Writer & operator<<(const uint32_t n) {return put(n, 4);}
+  inline Writer & operator<<(const int64_t n) {return put(static_cast<uint64_t>(n), 8);}
+  inline Writer & operator<<(const uint64_t n) {return put(n, 8);}
+  inline Writer & operator<<(const float f)
+  {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return put(bits, 4);
+  }
+  inline Writer & operator<<(const double d)
+  {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return put(bits, 8);
+  }
+
+  template<typename T>
+  void write_array(const T * values, size_t count)
+  {
+    // Booleans are written one by one, an uninitialized one may hold any value
+    if (sizeof(T) == 1 && !std::is_same<T, bool>::value) {
+      const uint8_t * bytes = reinterpret_cast<const uint8_t *>(values);
+      if (references_.should_reference(count)) {
+        references_.add(buffer_.size(), bytes, count);
+      } else {
+        buffer_.insert(buffer_.end(), bytes, bytes + count);
+      }
+      return;
+    }
+    // Little endian numbers are laid out in memory as they are on the wire once the first one is
+    // aligned, none of them is wider than the alignment of the ones after it
+    if (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+      references_.should_reference(count * sizeof(T)) && host_is_little_endian())
+    {
+      align(sizeof(T) < kMaxAlignment ? sizeof(T) : kMaxAlignment);
+      references_.add(buffer_.size(), values, count * sizeof(T));
+      return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      *this << values[i];
+    }
+  }
+
+  // Length including the terminating null character, then the characters and the terminator
+  void write_string(const char * data, size_t length)
+  {
+    *this << static_cast<uint32_t>(length + 1);
+    buffer_.insert(buffer_.end(), data, data + length);
+    buffer_.push_back(0);
+  }
+
+  // Length in bytes, then the UTF-16 code units without terminator
+  void write_u16string(const uint16_t * data, size_t length)
+  {
+    *this << static_cast<uint32_t>(length * 2);
+    for (size_t i = 0; i < length; ++i) {
+      put(data[i], 2);
+    }
+  }
+
+  // Reserves the DHEADER of a sequence or array of non-primitive elements, end_dheader fills it
+  // with the size of everything written in between
+  size_t begin_dheader()
+  {
+    *this << static_cast<uint32_t>(0);
+    return buffer_.size();
+  }
+
+  void end_dheader(size_t position)
+  {
+    const uint64_t size = buffer_.size() - position + references_.size_since(position);
+    for (size_t i = 0; i < 4; ++i) {
+      buffer_[position - 4 + i] = static_cast<uint8_t>(size >> (8 * i));
+    }
+  }
+
+private:
+  void begin()
+  {
+    buffer_.push_back(0);
+    buffer_.push_back(kPlainCdr2Le);
+    buffer_.push_back(0);
+    buffer_.push_back(0);
+  }
+
+  // Alignment is relative to the start of the payload, referenced arrays included
+  void align(size_t alignment)
+  {
+    while (size() % alignment != 0) {
+      buffer_.push_back(0);
+    }
+  }
+
+  Writer & put(uint64_t value, size_t size)
+  {
+    align(size < kMaxAlignment ? size : kMaxAlignment);
+    for (size_t i = 0; i < size; ++i) {
+      buffer_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    return *this;
+  }
+
+  std::vector<uint8_t> buffer_;
+  ReferencedArrays references_;
+};
+
+// Reads payloads of either byte order. Reading past the end throws std::runtime_error, like
+// malformed classic payloads do.
+class Reader
+{
+public:
+  Reader(const uint8_t * data, size_t length)
+  : data_(data), length_(length), position_(kEncapsulationSize)
+  {
+    if (length < kEncapsulationSize || data[0] != 0 ||
+      (data[1] != kPlainCdr2Be && data[1] != kPlainCdr2Le))
+    {
+      throw std::runtime_error("not a PLAIN_CDR2 payload");
+    }
+    big_endian_ = data[1] == kPlainCdr2Be;
+    // The last two bits of the options are the padding at the end of the payload
+    const size_t padding = data[3] & 0x3;
+    if (length_ - kEncapsulationSize < padding) {
+      throw std::runtime_error("not a PLAIN_CDR2 payload");
+    }
+    length_ -= padding;
+  }
+
+  inline Reader & operator>>(bool & b)
+  {
+    b = get(1, 1) != 0;
+    return *this;
+  }
+  inline Reader & operator>>(char & c)
+  {
+    c = static_cast<char>(get(1, 1));
+    return *this;
+  }
+  inline Reader & operator>>(int8_t & n) {return get_as(n);}
+  inline Reader & operator>>(uint8_t & n) {return get_as(n);}
+  inline Reader & operator>>(int16_t & n) {return get_as(n);}
+  inline Reader & operator>>(uint16_t & n) {return get_as(n);}
+  inline Reader & operator>>(char16_t & n) {return get_as(n);}
+  inline Reader & operator>>(int32_t & n) {return get_as(n);}
+  inline Reader & operator>>(uint32_t & n) {return get_as(n);}
+  inline Reader & operator>>(int64_t & n) {return get_as(n);}
+  inline Reader & operator>>(uint64_t & n) {return get_as(n);}
+  inline Reader & operator>>(float & f)
+  {
+    const uint32_t bits = static_cast<uint32_t>(get(4, 4));
+    memcpy(&f, &bits, sizeof(f));
+    return *this;
+  }
+  inline Reader & operator>>(double & d)
+  {
+    const uint64_t bits = get(8, 4);
+    memcpy(&d, &bits, sizeof(d));
+    return *this;
+  }
+
+  template<typename T>
+  void read_array(T * values, size_t count)
+  {
+    if (sizeof(T) == 1 && !std::is_same<T, bool>::value) {
+      require(count);
+      memcpy(values, data_ + position_, count);
+      position_ += count;
+      return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      *this >> values[i];
+    }
+  }
+
+  // Returns the characters of a string, not null terminated, they point into the payload
+  const char * read_string(size_t & length)
+  {
+    uint32_t size = 0;
+    *this >> size;
+    if (size == 0) {
+      throw std::runtime_error("string without terminator");
+    }
+    require(size);
+    const char * data = reinterpret_cast<const char *>(data_ + position_);
+    position_ += size;
+    length = size - 1;
+    return data;
+  }
+
+  void read_u16string(std::u16string & s)
+  {
+    uint32_t size = 0;
+    *this >> size;
+    require(size);
+    s.resize(size / 2);
+    for (size_t i = 0; i < s.size(); ++i) {
+      *this >> s[i];
+    }
+    position_ += size % 2;
+  }
+
+  // Returns the position at which the elements announced by a DHEADER end
+  size_t read_dheader()
+  {
+    uint32_t size = 0;
+    *this >> size;
+    require(size);
+    return position_ + size;
+  }
+
+  // Skips count elements of element_size bytes each
+  void skip(size_t element_size, size_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    align(element_size < kMaxAlignment ? element_size : kMaxAlignment);
+    if (element_size != 0 && count > (length_ - position_) / element_size) {
+      throw std::runtime_error("not enough data to deserialize");
+    }
+    position_ += element_size * count;
+  }
+
+  // Moves to the given position, from read_dheader
+  void seek(size_t position)
+  {
+    if (position < position_ || position > length_) {
+      throw std::runtime_error("failed to deserialize value");
+    }
+    position_ = position;
+  }
+
+  size_t position() const noexcept {return position_;}
+  size_t remaining() const noexcept {return length_ - position_;}
+
+private:
+  template<typename T>
+  Reader & get_as(T & n)
+  {
+    n = static_cast<T>(get(sizeof(T), sizeof(T) < kMaxAlignment ? sizeof(T) : kMaxAlignment));
+    return *this;
+  }
+
+  void require(size_t size) const
+  {
+    if (size > length_ - position_) {
+      throw std::runtime_error("not enough data to deserialize");
+    }
+  }
+
+  void align(size_t alignment)
+  {
+    const size_t padding = (alignment - position_ % alignment) % alignment;
+    require(padding);
+    position_ += padding;
+  }
+
+  uint64_t get(size_t size, size_t alignment)
+  {
+    align(alignment);
+    require(size);
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      const size_t shift = big_endian_ ? size - 1 - i : i;
+      value |= static_cast<uint64_t>(data_[position_ + i]) << (8 * shift);
+    }
+    position_ += size;
+    return value;
+  }
+
+  const uint8_t * data_;
+  size_t length_;
+  size_t position_;
+  bool big_endian_;
+};
+
+}  // namespace xcdr2
+}  // namespace rmw_libp2p_cpp
+
+#endif  // IMPL__XCDR2_HPP_
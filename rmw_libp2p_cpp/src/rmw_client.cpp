@@ -0,0 +1,372 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <stdexcept>
+
+#include "rmw/allocators.h"
+#include "rmw/error_handling.h"
+#include "rmw/rmw.h"
+
+#include "rcutils/logging_macros.h"
+
+#include "rosidl_typesupport_introspection_cpp/identifier.hpp"
+
+#include "rosidl_typesupport_introspection_c/identifier.h"
+
+#include "impl/cdr_buffer.hpp"
+#include "impl/identifier.hpp"
+#include "impl/custom_client_info.hpp"
+#include "impl/custom_node_info.hpp"
+#include "impl/qos.hpp"
+#include "impl/service_listener.hpp"
+#include "impl/service_routing.hpp"
+
+#include "ros_message_serialization.hpp"
+#include "type_support_common.hpp"
+
+extern "C"
+{
+rmw_client_t *
+rmw_create_client(
+  const rmw_node_t * node,
+  const rosidl_service_type_support_t * type_supports,
+  const char * service_name,
+  const rmw_qos_profile_t * qos_policies)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s(node=%p,type_supports=%p,service_name=%s,qos_policies=%p)",
+    __FUNCTION__, (void *)node, (void *)type_supports, service_name, (void *)qos_policies);
+
+  if (!node) {
+    RMW_SET_ERROR_MSG("node handle is null");
+    return nullptr;
+  }
+
+  if (node->implementation_identifier != libp2p_identifier) {
+    RMW_SET_ERROR_MSG("node handle not from this implementation");
+    return nullptr;
+  }
+
+  if (!service_name || strlen(service_name) == 0) {
+    RMW_SET_ERROR_MSG("service topic is null or empty string");
+    return nullptr;
+  }
+
+  if (!qos_policies) {
+    RMW_SET_ERROR_MSG("qos_profile is null");
+    return nullptr;
+  }
+
+  auto node_data = static_cast<rmw_libp2p_cpp::CustomNodeInfo *>(node->data);
+  if (!node_data) {
+    RMW_SET_ERROR_MSG("node data is null");
+    return nullptr;
+  }
+
+  if (!node_data->node_handle_) {
+    RMW_SET_ERROR_MSG("node handle is null");
+    return nullptr;
+  }
+
+  const rosidl_service_type_support_t * type_support = get_service_typesupport_handle(
+    type_supports, rosidl_typesupport_introspection_c__identifier);
+  if (!type_support) {
+    type_support = get_service_typesupport_handle(
+      type_supports, rosidl_typesupport_introspection_cpp::typesupport_identifier);
+    if (!type_support) {
+      RMW_SET_ERROR_MSG("type support not from this implementation");
+      return nullptr;
+    }
+  }
+
+  rmw_libp2p_cpp::CustomClientInfo * info = nullptr;
+  rmw_client_t * rmw_client = nullptr;
+
+  info = new rmw_libp2p_cpp::CustomClientInfo();
+  info->node_ = node;
+  info->typesupport_identifier_ = type_support->typesupport_identifier;
+  info->qos_ = rmw_libp2p_cpp::service_qos(*qos_policies);
+
+  info->request_type_support_ = _create_request_type_support(
+    type_support->data, info->typesupport_identifier_);
+  info->response_type_support_ = _create_response_type_support(
+    type_support->data, info->typesupport_identifier_);
+  if (!info->request_type_support_ || !info->response_type_support_) {
+    goto fail;
+  }
+
+  info->listener_ = new rmw_libp2p_cpp::ServiceListener;
+  info->client_handle_ = rs_libp2p_custom_client_new(
+    node_data->node_handle_, service_name,
+    info->listener_, rmw_libp2p_cpp::ServiceListener::on_message,
+    static_cast<uint8_t>(node->context->impl->service_routing->get(service_name)));
+  if (!info->client_handle_) {
+    RMW_SET_ERROR_MSG("failed to create libp2p client");
+    goto fail;
+  }
+
+  rmw_client = rmw_client_allocate();
+  if (!rmw_client) {
+    RMW_SET_ERROR_MSG("failed to allocate memory for client");
+    goto fail;
+  }
+
+  rmw_client->implementation_identifier = libp2p_identifier;
+  rmw_client->data = info;
+  rmw_client->service_name = reinterpret_cast<const char *>(
+    rmw_allocate(strlen(service_name) + 1));
+  if (!rmw_client->service_name) {
+    RMW_SET_ERROR_MSG("failed to allocate memory for client name");
+    goto fail;
+  }
+  memcpy(
+    const_cast<char *>(rmw_client->service_name), service_name,
+    strlen(service_name) + 1);
+
+  {
+    rmw_libp2p_cpp::Gid gid;
+    rs_libp2p_custom_client_get_gid(info->client_handle_, gid.data());
+    node->context->impl->graph_cache->add_client(
+      gid, node_data->gid_, service_name,
+      _create_ros_service_type_name(type_support->data, info->typesupport_identifier_));
+  }
+
+  return rmw_client;
+
+fail:
+  if (info->client_handle_) {
+    rs_libp2p_custom_client_free(info->client_handle_);
+  }
+  delete info->listener_;
+  if (info->request_type_support_) {
+    _delete_typesupport(info->request_type_support_, info->typesupport_identifier_);
+  }
+  if (info->response_type_support_) {
+    _delete_typesupport(info->response_type_support_, info->typesupport_identifier_);
+  }
+  delete info;
+
+  if (rmw_client) {
+    if (rmw_client->service_name) {
+      rmw_free(const_cast<char *>(rmw_client->service_name));
+    }
+    rmw_client_free(rmw_client);
+  }
+
+  return nullptr;
+}
+
+rmw_ret_t
+rmw_destroy_client(
+  rmw_node_t * node,
+  rmw_client_t * client)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    node,
+    node->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(client->data);
+  if (info) {
+    if (info->client_handle_) {
+      rmw_libp2p_cpp::Gid gid;
+      rs_libp2p_custom_client_get_gid(info->client_handle_, gid.data());
+      node->context->impl->graph_cache->remove_entity(gid);
+      // No more responses are delivered to the listener once this returns
+      rs_libp2p_custom_client_free(info->client_handle_);
+    }
+    delete info->listener_;
+    _delete_typesupport(info->request_type_support_, info->typesupport_identifier_);
+    _delete_typesupport(info->response_type_support_, info->typesupport_identifier_);
+    delete info;
+  }
+  if (client->service_name) {
+    rmw_free(const_cast<char *>(client->service_name));
+  }
+  rmw_client_free(client);
+
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_send_request(
+  const rmw_client_t * client,
+  const void * ros_request,
+  int64_t * sequence_id)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s(client=%p,ros_request=%p,sequence_id=%p)", __FUNCTION__,
+    (void *)client, ros_request, (void *)sequence_id);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_request, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(sequence_id, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(client->data);
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(info, "custom client info is null", return RMW_RET_ERROR);
+
+  rmw_libp2p_cpp::cdr::WriteCDRBuffer ser;
+  if (!_serialize_ros_message(
+      ros_request, ser, info->request_type_support_,
+      info->typesupport_identifier_))
+  {
+    RMW_SET_ERROR_MSG("cannot serialize data");
+    return RMW_RET_ERROR;
+  }
+
+  *sequence_id = rs_libp2p_custom_client_send_request(info->client_handle_, ser.data());
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_take_response(
+  const rmw_client_t * client,
+  rmw_service_info_t * request_header,
+  void * ros_response,
+  bool * taken)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s(client=%p,request_header=%p,ros_response=%p,taken=%p)", __FUNCTION__,
+    (void *)client, (void *)request_header, ros_response, (void *)taken);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(request_header, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_response, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+
+  *taken = false;
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(client->data);
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(info, "custom client info is null", return RMW_RET_ERROR);
+
+  rmw_libp2p_cpp::ServiceListener::Data data;
+  if (info->listener_->take_next_data(data)) {
+    try {
+      rmw_libp2p_cpp::cdr::ReadCDRBuffer buffer(data.message, data.length);
+      _deserialize_ros_message(
+        buffer, ros_response, info->response_type_support_, info->typesupport_identifier_);
+      *taken = true;
+    } catch (const std::runtime_error & e) {
+      // Most likely sent by a service with an incompatible type, drop it
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_libp2p_cpp",
+        "dropping response that cannot be deserialized: %s", e.what());
+    }
+    rs_libp2p_message_free(data.message, data.length);
+
+    if (*taken) {
+      request_header->source_timestamp = 0;
+      request_header->received_timestamp = 0;
+      // Sequence number of the request this response answers
+      rmw_request_id_t & request_id = request_header->request_id;
+      memset(request_id.writer_guid, 0, sizeof(request_id.writer_guid));
+      memcpy(request_id.writer_guid, data.client_gid.data(), data.client_gid.size());
+      request_id.sequence_number = data.sequence_number;
+    }
+  }
+
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_service_server_is_available(
+  const rmw_node_t * node,
+  const rmw_client_t * client,
+  bool * is_available)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    node,
+    node->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(is_available, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(client->data);
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(info, "custom client info is null", return RMW_RET_ERROR);
+
+  *is_available = rs_libp2p_custom_client_server_available(info->client_handle_);
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_client_request_publisher_get_actual_qos(
+  const rmw_client_t * client,
+  rmw_qos_profile_t * qos)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(qos, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(client->data);
+  *qos = info->qos_;
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_client_response_subscription_get_actual_qos(
+  const rmw_client_t * client,
+  rmw_qos_profile_t * qos)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(qos, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(client->data);
+  *qos = info->qos_;
+  return RMW_RET_OK;
+}
+}  // extern "C"
@@ -0,0 +1,172 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rcutils/logging_macros.h"
+
+#include "rmw/error_handling.h"
+#include "rmw/event.h"
+#include "rmw/impl/cpp/macros.hpp"
+#include "rmw/rmw.h"
+
+#include "impl/custom_publisher_info.hpp"
+#include "impl/custom_subscription_info.hpp"
+#include "impl/event_listener.hpp"
+#include "impl/identifier.hpp"
+
+namespace
+{
+
+bool
+is_publisher_event_supported(rmw_event_type_t event_type)
+{
+  switch (event_type) {
+    case RMW_EVENT_OFFERED_DEADLINE_MISSED:
+    case RMW_EVENT_LIVELINESS_LOST:
+      return true;
+#ifdef RMW_LIBP2P_CPP_HAS_INCOMPATIBLE_TYPE_EVENT
+    case RMW_EVENT_PUBLISHER_INCOMPATIBLE_TYPE:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+bool
+is_subscription_event_supported(rmw_event_type_t event_type)
+{
+  switch (event_type) {
+    case RMW_EVENT_REQUESTED_DEADLINE_MISSED:
+    case RMW_EVENT_LIVELINESS_CHANGED:
+      return true;
+#ifdef RMW_LIBP2P_CPP_HAS_INCOMPATIBLE_TYPE_EVENT
+    case RMW_EVENT_SUBSCRIPTION_INCOMPATIBLE_TYPE:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+extern "C"
+{
+rmw_ret_t
+rmw_publisher_event_init(
+  rmw_event_t * event,
+  const rmw_publisher_t * publisher,
+  rmw_event_type_t event_type)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(event, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  if (!is_publisher_event_supported(event_type)) {
+    RMW_SET_ERROR_MSG("provided event_type is not supported by rmw_libp2p_cpp");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
+  event->implementation_identifier = libp2p_identifier;
+  event->data = info->event_listener_;
+  event->event_type = event_type;
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_subscription_event_init(
+  rmw_event_t * event,
+  const rmw_subscription_t * subscription,
+  rmw_event_type_t event_type)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(event, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  if (!is_subscription_event_supported(event_type)) {
+    RMW_SET_ERROR_MSG("provided event_type is not supported by rmw_libp2p_cpp");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomSubscriptionInfo *>(subscription->data);
+  event->implementation_identifier = libp2p_identifier;
+  event->data = info->event_listener_;
+  event->event_type = event_type;
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_take_event(
+  const rmw_event_t * event_handle,
+  void * event_info,
+  bool * taken)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(event_handle, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(event_info, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    event_handle,
+    event_handle->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto event_listener = static_cast<rmw_libp2p_cpp::EventListener *>(event_handle->data);
+  *taken = event_listener->take_event(event_handle->event_type, event_info);
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_event_set_callback(
+  rmw_event_t * event,
+  rmw_event_callback_t callback,
+  const void * user_data)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(event, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    event,
+    event->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto event_listener = static_cast<rmw_libp2p_cpp::EventListener *>(event->data);
+  event_listener->set_callback(event->event_type, callback, user_data);
+  return RMW_RET_OK;
+}
+}  // extern "C"
@@ -0,0 +1,535 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "rcutils/allocator.h"
+#include "rcutils/logging_macros.h"
+#include "rcutils/strdup.h"
+#include "rcutils/types/string_array.h"
+
+#include "rmw/error_handling.h"
+#include "rmw/get_node_info_and_types.h"
+#include "rmw/get_service_names_and_types.h"
+#include "rmw/get_topic_endpoint_info.h"
+#include "rmw/get_topic_names_and_types.h"
+#include "rmw/names_and_types.h"
+#include "rmw/rmw.h"
+#include "rmw/topic_endpoint_info_array.h"
+
+#include "rmw/impl/cpp/macros.hpp"
+
+#include "impl/identifier.hpp"
+#include "impl/graph_cache.hpp"
+#include "impl/rmw_libp2p_rs.hpp"
+
+namespace
+{
+
+rmw_libp2p_cpp::GraphCache *
+get_graph_cache(const rmw_node_t * node)
+{
+  if (!node->context || !node->context->impl || !node->context->impl->graph_cache) {
+    RMW_SET_ERROR_MSG("node context has no graph cache");
+    return nullptr;
+  }
+  return node->context->impl->graph_cache;
+}
+
+rmw_ret_t
+check_node(const rmw_node_t * node)
+{
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    node,
+    node->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+copy_names_and_types(
+  const rmw_libp2p_cpp::NamesAndTypes & names_and_types,
+  rcutils_allocator_t * allocator,
+  rmw_names_and_types_t * result)
+{
+  if (names_and_types.empty()) {
+    return RMW_RET_OK;
+  }
+
+  rmw_ret_t ret = rmw_names_and_types_init(result, names_and_types.size(), allocator);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+
+  size_t index = 0;
+  for (const auto & name_and_types : names_and_types) {
+    result->names.data[index] = rcutils_strdup(name_and_types.first.c_str(), *allocator);
+    if (!result->names.data[index]) {
+      goto fail;
+    }
+    if (rcutils_string_array_init(
+        &result->types[index], name_and_types.second.size(), allocator) != RCUTILS_RET_OK)
+    {
+      goto fail;
+    }
+    size_t type_index = 0;
+    for (const std::string & type_name : name_and_types.second) {
+      result->types[index].data[type_index] = rcutils_strdup(type_name.c_str(), *allocator);
+      if (!result->types[index].data[type_index]) {
+        goto fail;
+      }
+      ++type_index;
+    }
+    ++index;
+  }
+  return RMW_RET_OK;
+
+fail:
+  RMW_SET_ERROR_MSG("failed to allocate memory for names and types");
+  if (rmw_names_and_types_fini(result) != RMW_RET_OK) {
+    RCUTILS_LOG_ERROR_NAMED(
+      "rmw_libp2p_cpp",
+      "failed to cleanup names and types during error handling");
+  }
+  return RMW_RET_BAD_ALLOC;
+}
+
+rmw_ret_t
+copy_string_array(
+  const std::vector<std::string> & strings,
+  rcutils_allocator_t * allocator,
+  rcutils_string_array_t * result)
+{
+  if (rcutils_string_array_init(result, strings.size(), allocator) != RCUTILS_RET_OK) {
+    RMW_SET_ERROR_MSG("failed to allocate memory for string array");
+    return RMW_RET_BAD_ALLOC;
+  }
+  for (size_t i = 0; i < strings.size(); ++i) {
+    result->data[i] = rcutils_strdup(strings[i].c_str(), *allocator);
+    if (!result->data[i]) {
+      RMW_SET_ERROR_MSG("failed to allocate memory for string array");
+      if (rcutils_string_array_fini(result) != RCUTILS_RET_OK) {
+        RCUTILS_LOG_ERROR_NAMED(
+          "rmw_libp2p_cpp",
+          "failed to cleanup string array during error handling");
+      }
+      return RMW_RET_BAD_ALLOC;
+    }
+  }
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+get_names_and_types_by_node(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * node_name,
+  const char * node_namespace,
+  rmw_libp2p_cpp::EntityKind kind,
+  rmw_names_and_types_t * names_and_types)
+{
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RCUTILS_CHECK_ALLOCATOR_WITH_MSG(
+    allocator, "allocator argument is invalid", return RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(node_name, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(node_namespace, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(names_and_types, RMW_RET_INVALID_ARGUMENT);
+  ret = rmw_names_and_types_check_zero(names_and_types);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+
+  rmw_libp2p_cpp::NamesAndTypes result;
+  if (!graph_cache->get_names_and_types_by_node(node_name, node_namespace, kind, result)) {
+    RMW_SET_ERROR_MSG("node name non-existent");
+    return RMW_RET_NODE_NAME_NON_EXISTENT;
+  }
+  return copy_names_and_types(result, allocator, names_and_types);
+}
+
+rmw_ret_t
+get_endpoints_info_by_topic(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * topic_name,
+  rmw_libp2p_cpp::EntityKind kind,
+  rmw_topic_endpoint_info_array_t * endpoints_info)
+{
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RCUTILS_CHECK_ALLOCATOR_WITH_MSG(
+    allocator, "allocator argument is invalid", return RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(topic_name, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(endpoints_info, RMW_RET_INVALID_ARGUMENT);
+  ret = rmw_topic_endpoint_info_array_check_zero(endpoints_info);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+
+  std::vector<rmw_libp2p_cpp::GraphEndpointInfo> result;
+  graph_cache->get_endpoints_info_by_topic(topic_name, kind, result);
+  if (result.empty()) {
+    return RMW_RET_OK;
+  }
+
+  ret = rmw_topic_endpoint_info_array_init_with_size(endpoints_info, result.size(), allocator);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+
+  const rmw_endpoint_type_t endpoint_type =
+    kind == rmw_libp2p_cpp::EntityKind::PUBLISHER ? RMW_ENDPOINT_PUBLISHER :
+    RMW_ENDPOINT_SUBSCRIPTION;
+  for (size_t i = 0; i < result.size(); ++i) {
+    rmw_topic_endpoint_info_t & info = endpoints_info->info_array[i];
+    uint8_t gid[RMW_GID_STORAGE_SIZE] = {};
+    memcpy(gid, result[i].gid.data(), result[i].gid.size());
+    if (
+      rmw_topic_endpoint_info_set_node_name(
+        &info, result[i].node_name.c_str(), allocator) != RMW_RET_OK ||
+      rmw_topic_endpoint_info_set_node_namespace(
+        &info, result[i].node_namespace.c_str(), allocator) != RMW_RET_OK ||
+      rmw_topic_endpoint_info_set_topic_type(
+        &info, result[i].type_name.c_str(), allocator) != RMW_RET_OK ||
+      rmw_topic_endpoint_info_set_endpoint_type(&info, endpoint_type) != RMW_RET_OK ||
+      rmw_topic_endpoint_info_set_gid(&info, gid, RMW_GID_STORAGE_SIZE) != RMW_RET_OK ||
+      rmw_topic_endpoint_info_set_qos_profile(&info, &result[i].qos) != RMW_RET_OK)
+    {
+      if (rmw_topic_endpoint_info_array_fini(endpoints_info, allocator) != RMW_RET_OK) {
+        RCUTILS_LOG_ERROR_NAMED(
+          "rmw_libp2p_cpp",
+          "failed to cleanup endpoint info array during error handling");
+      }
+      return RMW_RET_BAD_ALLOC;
+    }
+  }
+  return RMW_RET_OK;
+}
+
+}  // namespace
+
+extern "C"
+{
+rmw_ret_t
+rmw_count_publishers(
+  const rmw_node_t * node,
+  const char * topic_name,
+  size_t * count)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RMW_CHECK_ARGUMENT_FOR_NULL(topic_name, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(count, RMW_RET_INVALID_ARGUMENT);
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+  *count = graph_cache->count_publishers(topic_name);
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_count_subscribers(
+  const rmw_node_t * node,
+  const char * topic_name,
+  size_t * count)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RMW_CHECK_ARGUMENT_FOR_NULL(topic_name, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(count, RMW_RET_INVALID_ARGUMENT);
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+  *count = graph_cache->count_subscribers(topic_name);
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_get_node_names_with_enclaves(
+  const rmw_node_t * node,
+  rcutils_string_array_t * node_names,
+  rcutils_string_array_t * node_namespaces,
+  rcutils_string_array_t * enclaves)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RMW_CHECK_ARGUMENT_FOR_NULL(node_names, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(node_namespaces, RMW_RET_INVALID_ARGUMENT);
+  if (rmw_check_zero_rmw_string_array(node_names) != RMW_RET_OK ||
+    rmw_check_zero_rmw_string_array(node_namespaces) != RMW_RET_OK ||
+    (enclaves && rmw_check_zero_rmw_string_array(enclaves) != RMW_RET_OK))
+  {
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+
+  std::vector<std::string> names;
+  std::vector<std::string> namespaces;
+  std::vector<std::string> enclave_names;
+  graph_cache->get_node_names(names, namespaces, enclave_names);
+
+  rcutils_allocator_t allocator = rcutils_get_default_allocator();
+  ret = copy_string_array(names, &allocator, node_names);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  ret = copy_string_array(namespaces, &allocator, node_namespaces);
+  if (ret != RMW_RET_OK) {
+    rcutils_string_array_fini(node_names);
+    return ret;
+  }
+  if (enclaves) {
+    ret = copy_string_array(enclave_names, &allocator, enclaves);
+    if (ret != RMW_RET_OK) {
+      rcutils_string_array_fini(node_names);
+      rcutils_string_array_fini(node_namespaces);
+      return ret;
+    }
+  }
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_get_node_names(
+  const rmw_node_t * node,
+  rcutils_string_array_t * node_names,
+  rcutils_string_array_t * node_namespaces)
+{
+  return rmw_get_node_names_with_enclaves(node, node_names, node_namespaces, nullptr);
+}
+
+rmw_ret_t
+rmw_get_topic_names_and_types(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  bool no_demangle,
+  rmw_names_and_types_t * topic_names_and_types)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  // Topic names are not mangled by this implementation
+  (void)no_demangle;
+
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RCUTILS_CHECK_ALLOCATOR_WITH_MSG(
+    allocator, "allocator argument is invalid", return RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(topic_names_and_types, RMW_RET_INVALID_ARGUMENT);
+  ret = rmw_names_and_types_check_zero(topic_names_and_types);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+
+  rmw_libp2p_cpp::NamesAndTypes result;
+  graph_cache->get_topic_names_and_types(result);
+  return copy_names_and_types(result, allocator, topic_names_and_types);
+}
+
+rmw_ret_t
+rmw_get_service_names_and_types(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  rmw_names_and_types_t * service_names_and_types)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  rmw_ret_t ret = check_node(node);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+  RCUTILS_CHECK_ALLOCATOR_WITH_MSG(
+    allocator, "allocator argument is invalid", return RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(service_names_and_types, RMW_RET_INVALID_ARGUMENT);
+  ret = rmw_names_and_types_check_zero(service_names_and_types);
+  if (ret != RMW_RET_OK) {
+    return ret;
+  }
+
+  rmw_libp2p_cpp::GraphCache * graph_cache = get_graph_cache(node);
+  if (!graph_cache) {
+    return RMW_RET_ERROR;
+  }
+
+  rmw_libp2p_cpp::NamesAndTypes result;
+  graph_cache->get_service_names_and_types(result);
+  return copy_names_and_types(result, allocator, service_names_and_types);
+}
+
+rmw_ret_t
+rmw_get_publisher_names_and_types_by_node(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * node_name,
+  const char * node_namespace,
+  bool no_demangle,
+  rmw_names_and_types_t * topic_names_and_types)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  (void)no_demangle;
+
+  return get_names_and_types_by_node(
+    node, allocator, node_name, node_namespace,
+    rmw_libp2p_cpp::EntityKind::PUBLISHER, topic_names_and_types);
+}
+
+rmw_ret_t
+rmw_get_subscriber_names_and_types_by_node(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * node_name,
+  const char * node_namespace,
+  bool no_demangle,
+  rmw_names_and_types_t * topic_names_and_types)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  (void)no_demangle;
+
+  return get_names_and_types_by_node(
+    node, allocator, node_name, node_namespace,
+    rmw_libp2p_cpp::EntityKind::SUBSCRIPTION, topic_names_and_types);
+}
+
+rmw_ret_t
+rmw_get_service_names_and_types_by_node(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * node_name,
+  const char * node_namespace,
+  rmw_names_and_types_t * service_names_and_types)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  return get_names_and_types_by_node(
+    node, allocator, node_name, node_namespace,
+    rmw_libp2p_cpp::EntityKind::SERVICE, service_names_and_types);
+}
+
+rmw_ret_t
+rmw_get_client_names_and_types_by_node(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * node_name,
+  const char * node_namespace,
+  rmw_names_and_types_t * service_names_and_types)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  return get_names_and_types_by_node(
+    node, allocator, node_name, node_namespace,
+    rmw_libp2p_cpp::EntityKind::CLIENT, service_names_and_types);
+}
+
+rmw_ret_t
+rmw_get_publishers_info_by_topic(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * topic_name,
+  bool no_mangle,
+  rmw_topic_endpoint_info_array_t * publishers_info)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  (void)no_mangle;
+
+  return get_endpoints_info_by_topic(
+    node, allocator, topic_name,
+    rmw_libp2p_cpp::EntityKind::PUBLISHER, publishers_info);
+}
+
+rmw_ret_t
+rmw_get_subscriptions_info_by_topic(
+  const rmw_node_t * node,
+  rcutils_allocator_t * allocator,
+  const char * topic_name,
+  bool no_mangle,
+  rmw_topic_endpoint_info_array_t * subscriptions_info)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  (void)no_mangle;
+
+  return get_endpoints_info_by_topic(
+    node, allocator, topic_name,
+    rmw_libp2p_cpp::EntityKind::SUBSCRIPTION, subscriptions_info);
+}
+}  // extern "C"
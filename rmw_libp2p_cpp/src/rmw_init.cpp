@@ -21,9 +21,16 @@
 
 #include "rcpputils/scope_exit.hpp"
 
+#include "impl/delta_topics.hpp"
+#include "impl/graph_cache.hpp"
 #include "impl/identifier.hpp"
 
 #include "impl/rmw_libp2p_rs.hpp"
+#include "impl/service_routing.hpp"
+#include "impl/timer_wheel.hpp"
+#include "impl/topic_encodings.hpp"
+#include "impl/topic_priorities.hpp"
+#include "impl/type_support_registry.hpp"
 
 extern "C"
 {
@@ -172,7 +179,16 @@ rmw_init(
   }
 
   auto cleanup_impl = rcpputils::make_scope_exit(
-    [context]() {delete context->impl;});
+    [context]() {
+      delete context->impl->graph_cache;
+      delete context->impl->type_support_registry;
+      delete context->impl->timer_wheel;
+      delete context->impl->topic_priorities;
+      delete context->impl->topic_encodings;
+      delete context->impl->delta_topics;
+      delete context->impl->service_routing;
+      delete context->impl;
+    });
 
   // context->impl->rs_event_loop_thread = rs_rmw_init();
   context->options = rmw_get_zero_initialized_init_options();
@@ -186,6 +202,54 @@ rmw_init(
     return ret;
   }
 
+  context->impl->graph_cache =
+    new (std::nothrow) rmw_libp2p_cpp::GraphCache(context->actual_domain_id);
+  if (nullptr == context->impl->graph_cache) {
+    RMW_SET_ERROR_MSG("failed to allocate graph cache");
+    return RMW_RET_BAD_ALLOC;
+  }
+  if (!context->impl->graph_cache->start()) {
+    RMW_SET_ERROR_MSG("failed to start graph discovery");
+    return RMW_RET_ERROR;
+  }
+
+  context->impl->type_support_registry =
+    new (std::nothrow) rmw_libp2p_cpp::TypeSupportRegistry();
+  if (nullptr == context->impl->type_support_registry) {
+    RMW_SET_ERROR_MSG("failed to allocate type support registry");
+    return RMW_RET_BAD_ALLOC;
+  }
+
+  context->impl->timer_wheel = new (std::nothrow) rmw_libp2p_cpp::TimerWheel();
+  if (nullptr == context->impl->timer_wheel) {
+    RMW_SET_ERROR_MSG("failed to allocate timer wheel");
+    return RMW_RET_BAD_ALLOC;
+  }
+
+  context->impl->topic_priorities = new (std::nothrow) rmw_libp2p_cpp::TopicPriorities();
+  if (nullptr == context->impl->topic_priorities) {
+    RMW_SET_ERROR_MSG("failed to allocate topic priorities");
+    return RMW_RET_BAD_ALLOC;
+  }
+
+  context->impl->topic_encodings = new (std::nothrow) rmw_libp2p_cpp::TopicEncodings();
+  if (nullptr == context->impl->topic_encodings) {
+    RMW_SET_ERROR_MSG("failed to allocate topic encodings");
+    return RMW_RET_BAD_ALLOC;
+  }
+
+  context->impl->delta_topics = new (std::nothrow) rmw_libp2p_cpp::DeltaTopics();
+  if (nullptr == context->impl->delta_topics) {
+    RMW_SET_ERROR_MSG("failed to allocate delta topics");
+    return RMW_RET_BAD_ALLOC;
+  }
+
+  context->impl->service_routing = new (std::nothrow) rmw_libp2p_cpp::ServiceRoutingPolicies();
+  if (nullptr == context->impl->service_routing) {
+    RMW_SET_ERROR_MSG("failed to allocate service routing policies");
+    return RMW_RET_BAD_ALLOC;
+  }
+
   cleanup_impl.cancel();
   restore_context.cancel();
   return RMW_RET_OK;
@@ -212,6 +276,10 @@ rmw_shutdown(
     return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
   // TODO(esteve): stop event loop thread here
   // context->impl->event_loop_thread
+  if (context->impl->graph_cache) {
+    context->impl->graph_cache->shutdown();
+  }
+  context->impl->is_shutdown = true;
   return RMW_RET_OK;
 }
 
@@ -239,6 +307,13 @@ rmw_context_fini(
     return RMW_RET_INVALID_ARGUMENT;
   }
   rmw_ret_t ret = rmw_init_options_fini(&context->options);
+  delete context->impl->graph_cache;
+  delete context->impl->type_support_registry;
+  delete context->impl->timer_wheel;
+  delete context->impl->topic_priorities;
+  delete context->impl->topic_encodings;
+  delete context->impl->delta_topics;
+  delete context->impl->service_routing;
   delete context->impl;
   *context = rmw_get_zero_initialized_context();
   return ret;
@@ -44,51 +44,6 @@
 
 extern "C"
 {
-rmw_ret_t
-rmw_subscription_count_matched_publishers(
-  const rmw_subscription_t * subscription,
-  size_t * publisher_count)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)subscription;
-  (void)publisher_count;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_publisher_event_init(
-  rmw_event_t * event,
-  const rmw_publisher_t * publisher,
-  rmw_event_type_t event_type)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)event;
-  (void)publisher;
-  (void)event_type;
-
-  return RMW_RET_UNSUPPORTED;
-}
-
-rmw_ret_t
-rmw_subscription_event_init(
-  rmw_event_t * event,
-  const rmw_subscription_t * subscription,
-  rmw_event_type_t event_type)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  return RMW_RET_UNSUPPORTED;
-}
-
 rmw_ret_t
 rmw_take_loaned_message_with_info(
   const rmw_subscription_t * subscription,
@@ -110,144 +65,6 @@ rmw_take_loaned_message_with_info(
   return RMW_RET_ERROR;
 }
 
-rmw_client_t *
-rmw_create_client(
-  const rmw_node_t * node,
-  const rosidl_service_type_support_t * type_support,
-  const char * service_name,
-  const rmw_qos_profile_t * qos_policies)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)type_support;
-  (void)service_name;
-  (void)qos_policies;
-
-  return nullptr;
-}
-
-rmw_ret_t
-rmw_service_server_is_available(
-  const rmw_node_t * node,
-  const rmw_client_t * client,
-  bool * is_available)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)client;
-  (void)is_available;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_send_response(
-  const rmw_service_t * service,
-  rmw_request_id_t * request_header,
-  void * ros_response)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)service;
-  (void)request_header;
-  (void)ros_response;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_take_request(
-  const rmw_service_t * service,
-  rmw_service_info_t * request_header,
-  void * ros_request,
-  bool * taken)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)service;
-  (void)request_header;
-  (void)ros_request;
-  (void)taken;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_destroy_service(
-  rmw_node_t * node,
-  rmw_service_t * service)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)service;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_take_response(
-  const rmw_client_t * client,
-  rmw_service_info_t * request_header,
-  void * ros_response,
-  bool * taken)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)client;
-  (void)request_header;
-  (void)ros_response;
-  (void)taken;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_send_request(
-  const rmw_client_t * client,
-  const void * ros_request,
-  int64_t * sequence_id)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)client;
-  (void)ros_request;
-  (void)sequence_id;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_destroy_client(
-  rmw_node_t * node,
-  rmw_client_t * client)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)client;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_return_loaned_message_from_subscription(
   const rmw_subscription_t * subscription,
@@ -280,36 +97,6 @@ rmw_borrow_loaned_message(
   return RMW_RET_ERROR;
 }
 
-rmw_ret_t
-rmw_client_request_publisher_get_actual_qos(
-  const rmw_client_t * client,
-  rmw_qos_profile_t * qos)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)client;
-  (void)qos;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_client_response_subscription_get_actual_qos(
-  const rmw_client_t * client,
-  rmw_qos_profile_t * qos)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)client;
-  (void)qos;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_client_set_on_new_response_callback(
   rmw_client_t * client,
@@ -386,38 +173,6 @@ rmw_return_loaned_message_from_publisher(
   return RMW_RET_ERROR;
 }
 
-rmw_ret_t
-rmw_publisher_count_matched_subscriptions(
-  const rmw_publisher_t * publisher,
-  size_t * subscription_count)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)publisher;
-  (void)subscription_count;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_publish_serialized_message(
-  const rmw_publisher_t * publisher,
-  const rmw_serialized_message_t * serialized_message,
-  rmw_publisher_allocation_t * allocation)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)publisher;
-  (void)serialized_message;
-  (void)allocation;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_get_serialized_message_size(
   const rosidl_message_type_support_t * type_support,
@@ -435,67 +190,6 @@ rmw_get_serialized_message_size(
   return RMW_RET_ERROR;
 }
 
-rmw_ret_t
-rmw_publisher_assert_liveliness(const rmw_publisher_t * publisher)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)publisher;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_publisher_wait_for_all_acked(
-  const rmw_publisher_t * publisher,
-  rmw_time_t wait_timeout)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)publisher;
-  (void)wait_timeout;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_serialize(
-  const void * ros_message,
-  const rosidl_message_type_support_t * type_support,
-  rmw_serialized_message_t * serialized_message)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)ros_message;
-  (void)type_support;
-  (void)serialized_message;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_deserialize(
-  const rmw_serialized_message_t * serialized_message,
-  const rosidl_message_type_support_t * type_support,
-  void * ros_message)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)serialized_message;
-  (void)type_support;
-  (void)ros_message;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_init_subscription_allocation(
   const rosidl_message_type_support_t * type_support,
@@ -526,76 +220,6 @@ rmw_fini_subscription_allocation(
   return RMW_RET_ERROR;
 }
 
-rmw_ret_t
-rmw_count_publishers(
-  const rmw_node_t * node,
-  const char * topic_name,
-  size_t * count)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)topic_name;
-  (void)count;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_count_subscribers(
-  const rmw_node_t * node,
-  const char * topic_name,
-  size_t * count)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)topic_name;
-  (void)count;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_node_names_with_enclaves(
-  const rmw_node_t * node,
-  rcutils_string_array_t * node_names,
-  rcutils_string_array_t * node_namespaces,
-  rcutils_string_array_t * enclaves)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)node_names;
-  (void)node_namespaces;
-  (void)enclaves;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_node_names(
-  const rmw_node_t * node,
-  rcutils_string_array_t * node_names,
-  rcutils_string_array_t * node_namespaces)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)node_names;
-  (void)node_namespaces;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_set_log_severity(rmw_log_severity_t severity)
 {
@@ -642,23 +266,6 @@ rmw_service_set_on_new_request_callback(
   return RMW_RET_ERROR;
 }
 
-rmw_ret_t
-rmw_event_set_callback(
-  rmw_event_t * event,
-  rmw_event_callback_t callback,
-  const void * user_data)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)event;
-  (void)callback;
-  (void)user_data;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_take_loaned_message(
   const rmw_subscription_t * subscription,
@@ -741,38 +348,6 @@ rmw_take_sequence(
   return RMW_RET_ERROR;
 }
 
-rmw_ret_t
-rmw_subscription_get_content_filter(
-  const rmw_subscription_t * subscription,
-  rcutils_allocator_t * allocator,
-  rmw_subscription_content_filter_options_t * options)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)subscription;
-  (void)allocator;
-  (void)options;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_subscription_set_content_filter(
-  rmw_subscription_t * subscription,
-  const rmw_subscription_content_filter_options_t * options)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)subscription;
-  (void)options;
-
-  return RMW_RET_ERROR;
-}
-
 bool
 rmw_feature_supported(rmw_feature_t feature)
 {
@@ -785,189 +360,6 @@ rmw_feature_supported(rmw_feature_t feature)
   return false;
 }
 
-rmw_ret_t
-rmw_take_event(
-  const rmw_event_t * event_handle,
-  void * event_info,
-  bool * taken)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)event_handle;
-  (void)event_info;
-  (void)taken;
-
-  return RMW_RET_OK;
-}
-
-rmw_ret_t
-rmw_get_client_names_and_types_by_node(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  const char * node_name,
-  const char * node_namespace,
-  rmw_names_and_types_t * service_names_and_types)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)node_name;
-  (void)node_namespace;
-  (void)service_names_and_types;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_service_names_and_types_by_node(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  const char * node_name,
-  const char * node_namespace,
-  rmw_names_and_types_t * service_names_and_types)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)node_name;
-  (void)node_namespace;
-  (void)service_names_and_types;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_publisher_names_and_types_by_node(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  const char * node_name,
-  const char * node_namespace,
-  bool no_demangle,
-  rmw_names_and_types_t * topic_names_and_types)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)node_name;
-  (void)node_namespace;
-  (void)no_demangle;
-  (void)topic_names_and_types;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_subscriber_names_and_types_by_node(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  const char * node_name,
-  const char * node_namespace,
-  bool no_demangle,
-  rmw_names_and_types_t * topic_names_and_types)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)node_name;
-  (void)node_namespace;
-  (void)no_demangle;
-  (void)topic_names_and_types;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_publishers_info_by_topic(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  const char * topic_name,
-  bool no_mangle,
-  rmw_topic_endpoint_info_array_t * publishers_info)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)topic_name;
-  (void)no_mangle;
-  (void)publishers_info;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_service_names_and_types(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  rmw_names_and_types_t * service_names_and_types)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)service_names_and_types;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_subscriptions_info_by_topic(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  const char * topic_name,
-  bool no_mangle,
-  rmw_topic_endpoint_info_array_t * subscriptions_info)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)topic_name;
-  (void)no_mangle;
-  (void)subscriptions_info;
-
-  return RMW_RET_ERROR;
-}
-
-rmw_ret_t
-rmw_get_topic_names_and_types(
-  const rmw_node_t * node,
-  rcutils_allocator_t * allocator,
-  bool no_demangle,
-  rmw_names_and_types_t * topic_names_and_types)
-{
-  RCUTILS_LOG_DEBUG_NAMED(
-    "rmw_libp2p_cpp",
-    "%s()", __FUNCTION__);
-
-  (void)node;
-  (void)allocator;
-  (void)no_demangle;
-  (void)topic_names_and_types;
-
-  return RMW_RET_ERROR;
-}
-
 rmw_ret_t
 rmw_publisher_get_network_flow_endpoints(
   const rmw_publisher_t * publisher,
@@ -28,6 +28,7 @@
 
 #include "impl/identifier.hpp"
 #include "impl/custom_node_info.hpp"
+#include "impl/guard_condition.hpp"
 #include "impl/rmw_libp2p_rs.hpp"
 
 extern "C"
@@ -107,10 +108,21 @@ rmw_create_node(
     RMW_SET_ERROR_MSG("failed to allocate libp2p node");
     goto fail;
   }
+  // The handle is a pointer to the graph cache, see CustomNodeHandle
+  rs_libp2p_custom_node_set_availability_callback(
+    node_impl->node_handle_, context->impl->graph_cache,
+    rmw_libp2p_cpp::GraphCache::on_server_availability);
 
   // Assign ROS context
   node_handle->context = context;
 
+  node_impl->gid_ = context->impl->graph_cache->generate_gid();
+  context->impl->graph_cache->add_graph_listener(
+    static_cast<GuardCondition *>(node_impl->graph_guard_condition_->data));
+  context->impl->graph_cache->add_node(
+    node_impl->gid_, name, namespace_,
+    context->options.enclave ? context->options.enclave : "");
+
   return node_handle;
 
 fail:
@@ -144,6 +156,13 @@ rmw_destroy_node(
 
   auto impl = static_cast<rmw_libp2p_cpp::CustomNodeInfo *>(node->data);
   if (impl) {
+    if (node->context && node->context->impl->graph_cache) {
+      node->context->impl->graph_cache->remove_entity(impl->gid_);
+      if (impl->graph_guard_condition_) {
+        node->context->impl->graph_cache->remove_graph_listener(
+          static_cast<GuardCondition *>(impl->graph_guard_condition_->data));
+      }
+    }
     if (impl->node_handle_) {
       rs_libp2p_custom_node_free(impl->node_handle_);
     }
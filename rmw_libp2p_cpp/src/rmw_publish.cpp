@@ -15,6 +15,10 @@
 #include <cassert>
 
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include "rcutils/logging_macros.h"
 
@@ -22,10 +26,97 @@
 #include "rmw/rmw.h"
 
 #include "impl/cdr_buffer.hpp"
+#include "impl/compact.hpp"
 #include "impl/custom_publisher_info.hpp"
 #include "impl/identifier.hpp"
+#include "impl/message_header.hpp"
+#include "impl/scatter_gather.hpp"
+#include "impl/xcdr2.hpp"
 #include "ros_message_serialization.hpp"
 
+namespace
+{
+
+// Hands a serialized message to the swarm, delta encoded if the topic is
+void
+publish_payload(
+  rmw_libp2p_cpp::CustomPublisherInfo * info, const uint8_t * data, size_t length,
+  rmw_libp2p_cpp::PayloadEncoding encoding)
+{
+  if (!info->delta_encoder_) {
+    rs_libp2p_custom_publisher_publish_serialized(
+      info->publisher_handle_, data, length, static_cast<uint8_t>(encoding), 0, 0);
+    return;
+  }
+  info->delta_encoder_->encode(
+    data, length,
+    [info, data, length, encoding](const uint8_t * encoded, size_t encoded_length,
+    uint8_t flags, uint8_t keyframe) {
+      // The history keeps the full message of a delta, for late joiners
+      if (flags & rmw_libp2p_cpp::kMessageFlagDelta) {
+        rs_libp2p_custom_publisher_publish_delta(
+          info->publisher_handle_, encoded, encoded_length, data, length,
+          static_cast<uint8_t>(encoding), keyframe);
+      } else {
+        rs_libp2p_custom_publisher_publish_serialized(
+          info->publisher_handle_, encoded, encoded_length, static_cast<uint8_t>(encoding), flags,
+          keyframe);
+      }
+    });
+}
+
+// The XCDR2 and compact encodings are written by the type support itself, the swarm gets the
+// bytes along with the encoding.
+//
+// Large arrays (e.g. the data of an image) are not copied into the serialization buffer, the
+// swarm gathers them straight from the ROS message into the message it sends. Content filters
+// and delta encoding need the payload in one piece, it is only split when neither applies.
+template<typename Writer>
+rmw_ret_t
+publish_encoded(
+  rmw_libp2p_cpp::CustomPublisherInfo * info,
+  rmw_libp2p_cpp::SerializationBufferPool<Writer> & buffers,
+  rmw_libp2p_cpp::PayloadEncoding encoding,
+  const void * ros_message)
+{
+  rmw_ret_t returnedValue = RMW_RET_ERROR;
+  std::unique_ptr<Writer> ser = buffers.acquire();
+  if (!info->delta_encoder_ && !info->matched_filters_->filtering()) {
+    ser->reference_arrays(rmw_libp2p_cpp::kMinReferencedArray);
+  }
+
+  try {
+    if (!_serialize_ros_message(
+        ros_message, *ser, info->type_support_, info->typesupport_identifier_))
+    {
+      RMW_SET_ERROR_MSG("cannot serialize data");
+    } else if (ser->buffered() != ser->size()) {
+      // A filter matched since the arrays started being referenced sees this message unfiltered
+      const std::vector<rmw_libp2p_cpp::Fragment> & fragments = ser->gather();
+      rs_libp2p_custom_publisher_publish_fragments(
+        info->publisher_handle_, fragments.data(), fragments.size(),
+        static_cast<uint8_t>(encoding));
+      returnedValue = RMW_RET_OK;
+    } else if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL &&
+      !info->matched_filters_->accepts(ser->data(), ser->size(), encoding))
+    {
+      returnedValue = RMW_RET_OK;
+    } else {
+      publish_payload(info, ser->data(), ser->size(), encoding);
+      returnedValue = RMW_RET_OK;
+    }
+  } catch (const std::runtime_error & e) {
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING("cannot serialize data: %s", e.what());
+  }
+
+  // Referenced arrays took no room in the buffer, it doesn't need to grow for them
+  const size_t length = ser->buffered();
+  buffers.release(std::move(ser), length);
+  return returnedValue;
+}
+
+}  // namespace
+
 extern "C"
 {
 rmw_ret_t
@@ -52,25 +143,103 @@ rmw_publish(
   auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
   assert(info);
 
-  rmw_libp2p_cpp::cdr::WriteCDRBuffer ser;
+  info->event_listener_->notify_activity();
+
+  // Nobody would receive the message, don't bother serializing it. Transient local publishers
+  // still need it in their history for late joiners.
+  if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL &&
+    info->subscriptions_matched_count_.load(std::memory_order_relaxed) == 0)
+  {
+    return RMW_RET_OK;
+  }
+
+  switch (info->encoding_) {
+    case rmw_libp2p_cpp::PayloadEncoding::XCDR2:
+      return publish_encoded(info, info->xcdr2_buffers_, info->encoding_, ros_message);
+    case rmw_libp2p_cpp::PayloadEncoding::COMPACT:
+      return publish_encoded(info, info->compact_buffers_, info->encoding_, ros_message);
+    default:
+      break;
+  }
+
+  std::unique_ptr<rmw_libp2p_cpp::cdr::WriteCDRBuffer> ser =
+    info->serialization_buffers_.acquire();
+  size_t length = 0;
 
   if (_serialize_ros_message(
-      ros_message, ser, info->type_support_,
+      ros_message, *ser, info->type_support_,
       info->typesupport_identifier_))
   {
-    uint32_t status = rs_libp2p_custom_publisher_publish(info->publisher_handle_, ser.data());
-    if (status == 0) {  // TODO(esteve): replace with proper error codes
+    const uint8_t * data = ser->bytes(&length);
+    // The content filters of every matched subscription reject the message
+    if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL &&
+      !info->matched_filters_->accepts(data, length))
+    {
+      returnedValue = RMW_RET_OK;
+    } else if (info->delta_encoder_) {
+      publish_payload(info, data, length, rmw_libp2p_cpp::PayloadEncoding::CDR);
+      returnedValue = RMW_RET_OK;
+    } else if (rs_libp2p_custom_publisher_publish(info->publisher_handle_, ser->data()) == 0) {
+      // TODO(esteve): replace with proper error codes
       returnedValue = RMW_RET_OK;
     } else {
       RMW_SET_ERROR_MSG("cannot publish data");
     }
   } else {
+    ser->bytes(&length);
     RMW_SET_ERROR_MSG("cannot serialize data");
   }
 
+  info->serialization_buffers_.release(std::move(ser), length);
+
   return returnedValue;
 }
 
+rmw_ret_t
+rmw_publish_serialized_message(
+  const rmw_publisher_t * publisher,
+  const rmw_serialized_message_t * serialized_message,
+  rmw_publisher_allocation_t * allocation)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s(publisher=%p,serialized_message=%p,allocation=%p)",
+    __FUNCTION__, (void *)publisher, (void *)serialized_message, (void *)allocation);
+
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(publisher, "publisher pointer is null", return RMW_RET_ERROR);
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(
+    serialized_message, "serialized_message pointer is null", return RMW_RET_ERROR);
+
+  if (publisher->implementation_identifier != libp2p_identifier) {
+    RMW_SET_ERROR_MSG("publisher handle not from this implementation");
+    return RMW_RET_ERROR;
+  }
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
+  assert(info);
+
+  info->event_listener_->notify_activity();
+
+  if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL &&
+    info->subscriptions_matched_count_.load(std::memory_order_relaxed) == 0)
+  {
+    return RMW_RET_OK;
+  }
+
+  if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL &&
+    !info->matched_filters_->accepts(
+      serialized_message->buffer, serialized_message->buffer_length))
+  {
+    return RMW_RET_OK;
+  }
+
+  // The bytes are already in the format of rmw_serialize, they only need the header in front
+  publish_payload(
+    info, serialized_message->buffer, serialized_message->buffer_length,
+    rmw_libp2p_cpp::PayloadEncoding::CDR);
+  return RMW_RET_OK;
+}
+
 rmw_ret_t
 rmw_publish_loaned_message(
   const rmw_publisher_t * publisher,
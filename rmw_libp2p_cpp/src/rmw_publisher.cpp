@@ -16,6 +16,8 @@
 
 #include "rmw/allocators.h"
 #include "rmw/error_handling.h"
+#include "rmw/qos_profiles.h"
+#include "rmw/time.h"
 #include "rmw/types.h"
 #include "rmw/validate_full_topic_name.h"
 #include "rmw/rmw.h"
@@ -33,6 +35,11 @@
 #include "impl/identifier.hpp"
 #include "impl/custom_node_info.hpp"
 #include "impl/custom_publisher_info.hpp"
+#include "impl/delta_topics.hpp"
+#include "impl/qos.hpp"
+#include "impl/topic_encodings.hpp"
+#include "impl/topic_priorities.hpp"
+#include "impl/type_support_registry.hpp"
 
 #include "type_support_common.hpp"
 
@@ -103,28 +110,67 @@ rmw_create_publisher(
   }
 
   rmw_libp2p_cpp::CustomPublisherInfo * info = nullptr;
+  const rmw_libp2p_cpp::RegisteredType * registered_type = nullptr;
+  uint32_t keyframe_interval = 0;
   rmw_publisher_t * rmw_publisher = nullptr;
 
   info = new rmw_libp2p_cpp::CustomPublisherInfo();
   info->node_ = node;
   info->typesupport_identifier_ = type_support->typesupport_identifier;
 
-  std::string type_name = _create_type_name(
+  registered_type = node->context->impl->type_support_registry->acquire(
     type_support->data, info->typesupport_identifier_);
-  if (!_get_registered_type(node_data->node_handle_, type_name, &info->type_support_)) {
-    info->type_support_ = _create_message_type_support(
-      type_support->data,
-      info->typesupport_identifier_);
-    _register_type(node_data->node_handle_, info->type_support_, info->typesupport_identifier_);
+  if (!registered_type) {
+    goto fail;
   }
+  info->type_support_ = registered_type->type_support;
+  info->matched_filters_ = new rmw_libp2p_cpp::MatchedFilters(
+    type_support->data, info->typesupport_identifier_);
+  info->encoding_ = node->context->impl->topic_encodings->get(topic_name);
 
   info->qos_ = *qos_policies;
-  // TODO(esteve): Set to best-effort & volatile since QoS features are not supported
   info->qos_.history = RMW_QOS_POLICY_HISTORY_KEEP_LAST;
-  info->qos_.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
-  info->qos_.reliability = RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT;
+  // Anything but transient local (e.g. system default) is served as volatile
+  if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL) {
+    info->qos_.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
+  }
+  // Anything but best effort (e.g. system default) is served as reliable
+  if (info->qos_.reliability != RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT) {
+    info->qos_.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+  }
+  if (info->qos_.depth == RMW_QOS_POLICY_DEPTH_SYSTEM_DEFAULT) {
+    info->qos_.depth = rmw_qos_profile_default.depth;
+  }
+  keyframe_interval = node->context->impl->delta_topics->get(topic_name);
+  if (keyframe_interval > 0) {
+    info->delta_encoder_ = new rmw_libp2p_cpp::DeltaEncoder(
+      keyframe_interval, info->qos_.reliability == RMW_QOS_POLICY_RELIABILITY_RELIABLE,
+      info->qos_.durability == RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL ? info->qos_.depth : 0);
+  }
+  // Manual by node is deprecated, anything but manual by topic is served as automatic
+  if (info->qos_.liveliness != RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC) {
+    info->qos_.liveliness = RMW_QOS_POLICY_LIVELINESS_AUTOMATIC;
+  }
 
-  info->publisher_handle_ = rs_libp2p_custom_publisher_new(node_data->node_handle_, topic_name);
+  info->event_listener_ = new rmw_libp2p_cpp::EventListener(node->context->impl->timer_wheel);
+  if (rmw_libp2p_cpp::qos_duration_ns(info->qos_.deadline) > 0) {
+    info->event_listener_->start_deadline(
+      std::chrono::nanoseconds(rmw_libp2p_cpp::qos_duration_ns(info->qos_.deadline)));
+  }
+  if (info->qos_.liveliness == RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC &&
+    rmw_libp2p_cpp::qos_duration_ns(info->qos_.liveliness_lease_duration) > 0)
+  {
+    info->event_listener_->start_liveliness_lost(
+      std::chrono::nanoseconds(
+        rmw_libp2p_cpp::qos_duration_ns(info->qos_.liveliness_lease_duration)));
+  }
+
+  info->publisher_handle_ = rs_libp2p_custom_publisher_new(
+    node_data->node_handle_, topic_name,
+    info->qos_.reliability == RMW_QOS_POLICY_RELIABILITY_RELIABLE,
+    info->qos_.durability == RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL, info->qos_.depth,
+    rmw_libp2p_cpp::qos_duration_ns(info->qos_.lifespan),
+    static_cast<uint8_t>(node->context->impl->topic_priorities->get(topic_name)));
   if (!info->publisher_handle_) {
     RMW_SET_ERROR_MSG("failed to create libp2p publisher");
     goto fail;
@@ -151,13 +197,33 @@ rmw_create_publisher(
     node_data->publishers_[topic_name].insert(info);
   }
 
+  {
+    rmw_libp2p_cpp::Gid gid;
+    rs_libp2p_custom_publisher_get_gid(info->publisher_handle_, gid.data());
+    node->context->impl->graph_cache->add_publisher(
+      gid, node_data->gid_, topic_name,
+      registered_type->type_name, registered_type->type_hash, info->qos_);
+    node->context->impl->graph_cache->add_match_listener(
+      topic_name, rmw_libp2p_cpp::EntityKind::PUBLISHER, registered_type->type_hash,
+      &info->subscriptions_matched_count_, info->event_listener_, info->matched_filters_);
+    node->context->impl->graph_cache->add_liveliness_publisher(gid, info->event_listener_);
+  }
+
   return rmw_publisher;
 
 fail:
-  _delete_typesupport(info->type_support_, info->typesupport_identifier_);
+  if (info->type_support_) {
+    node->context->impl->type_support_registry->release(info->type_support_);
+  }
   if (info->publisher_handle_) {
     rs_libp2p_custom_publisher_free(info->publisher_handle_);
   }
+  if (info->event_listener_) {
+    info->event_listener_->stop_timers();
+  }
+  delete info->event_listener_;
+  delete info->matched_filters_;
+  delete info->delta_encoder_;
   delete info;
 
   if (rmw_publisher) {
@@ -180,10 +246,53 @@ rmw_destroy_publisher(
     "rmw_libp2p_cpp",
     "%s()", __FUNCTION__);
 
-  (void)node;
-  (void)publisher;
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    node,
+    node->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  return RMW_RET_ERROR;
+  auto node_data = static_cast<rmw_libp2p_cpp::CustomNodeInfo *>(node->data);
+  auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
+  if (info) {
+    if (node_data) {
+      std::lock_guard<std::mutex> lock(node_data->publishers_mutex_);
+      auto it = node_data->publishers_.find(publisher->topic_name);
+      if (it != node_data->publishers_.end()) {
+        it->second.erase(info);
+        if (it->second.empty()) {
+          node_data->publishers_.erase(it);
+        }
+      }
+    }
+    node->context->impl->graph_cache->remove_match_listener(
+      publisher->topic_name, info->event_listener_);
+    delete info->matched_filters_;
+    delete info->delta_encoder_;
+    if (info->publisher_handle_) {
+      rmw_libp2p_cpp::Gid gid;
+      rs_libp2p_custom_publisher_get_gid(info->publisher_handle_, gid.data());
+      node->context->impl->graph_cache->remove_entity(gid);
+      rs_libp2p_custom_publisher_free(info->publisher_handle_);
+    }
+    node->context->impl->type_support_registry->release(info->type_support_);
+    info->event_listener_->stop_timers();
+    delete info->event_listener_;
+    delete info;
+  }
+  if (publisher->topic_name) {
+    rmw_free(const_cast<char *>(publisher->topic_name));
+  }
+  rmw_publisher_free(publisher);
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t
@@ -202,3 +311,80 @@ rmw_publisher_get_actual_qos(
   *qos = info->qos_;
   return RMW_RET_OK;
 }
+
+rmw_ret_t
+rmw_publisher_count_matched_subscriptions(
+  const rmw_publisher_t * publisher,
+  size_t * subscription_count)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription_count, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
+  *subscription_count = info->subscriptions_matched_count_.load();
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_publisher_wait_for_all_acked(
+  const rmw_publisher_t * publisher,
+  rmw_time_t wait_timeout)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
+  // Best effort publishers return right away, nobody acknowledges their messages
+  uint64_t timeout_ns = UINT64_MAX;
+  const rmw_time_t infinite = RMW_DURATION_INFINITE;
+  if (!rmw_time_equal(wait_timeout, infinite)) {
+    timeout_ns = rmw_time_total_nsec(wait_timeout);
+  }
+  if (!rs_libp2p_custom_publisher_wait_for_all_acked(info->publisher_handle_, timeout_ns)) {
+    return RMW_RET_TIMEOUT;
+  }
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_publisher_assert_liveliness(const rmw_publisher_t * publisher)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomPublisherInfo *>(publisher->data);
+  // Automatic liveliness is asserted by the context, there is nothing to do
+  if (info->qos_.liveliness != RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC) {
+    return RMW_RET_OK;
+  }
+  info->event_listener_->assert_liveliness();
+  rmw_libp2p_cpp::Gid gid;
+  rs_libp2p_custom_publisher_get_gid(info->publisher_handle_, gid.data());
+  info->node_->context->impl->graph_cache->assert_liveliness(gid);
+  return RMW_RET_OK;
+}
@@ -0,0 +1,144 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <stdexcept>
+
+#include "rcutils/logging_macros.h"
+
+#include "rmw/error_handling.h"
+#include "rmw/rmw.h"
+#include "rmw/serialized_message.h"
+
+#include "rosidl_typesupport_introspection_cpp/identifier.hpp"
+
+#include "rosidl_typesupport_introspection_c/identifier.h"
+
+#include "impl/cdr_buffer.hpp"
+#include "impl/type_support_registry.hpp"
+#include "ros_message_serialization.hpp"
+
+namespace
+{
+
+// rmw_serialize and rmw_deserialize have no context to share the type supports of, so they get
+// their own registry. Their references are never released, the type supports live as long as the
+// introspection members they wrap.
+const rmw_libp2p_cpp::RegisteredType *
+acquire_type_support(const rosidl_message_type_support_t * type_supports)
+{
+  static auto registry = new rmw_libp2p_cpp::TypeSupportRegistry();
+
+  const rosidl_message_type_support_t * type_support = get_message_typesupport_handle(
+    type_supports, rosidl_typesupport_introspection_c__identifier);
+  if (!type_support) {
+    type_support = get_message_typesupport_handle(
+      type_supports, rosidl_typesupport_introspection_cpp::typesupport_identifier);
+    if (!type_support) {
+      RMW_SET_ERROR_MSG("type support not from this implementation");
+      return nullptr;
+    }
+  }
+  return registry->acquire(type_support->data, type_support->typesupport_identifier);
+}
+
+}  // namespace
+
+extern "C"
+{
+rmw_ret_t
+rmw_serialize(
+  const void * ros_message,
+  const rosidl_message_type_support_t * type_support,
+  rmw_serialized_message_t * serialized_message)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_support, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(serialized_message, RMW_RET_INVALID_ARGUMENT);
+
+  const rmw_libp2p_cpp::RegisteredType * registered_type = acquire_type_support(type_support);
+  if (!registered_type) {
+    // error already set
+    return RMW_RET_ERROR;
+  }
+
+  // Same encoding as the payload of the messages of rmw_publish
+  rmw_libp2p_cpp::cdr::WriteCDRBuffer ser;
+  if (!_serialize_ros_message(
+      ros_message, ser, registered_type->type_support,
+      registered_type->typesupport_identifier))
+  {
+    RMW_SET_ERROR_MSG("cannot serialize data");
+    return RMW_RET_ERROR;
+  }
+
+  size_t length = 0;
+  const uint8_t * data = ser.bytes(&length);
+  // The caller's buffer is reused when it is large enough, it only ever grows
+  if (serialized_message->buffer_capacity < length) {
+    rmw_ret_t ret = rmw_serialized_message_resize(serialized_message, length);
+    if (ret != RMW_RET_OK) {
+      // error already set
+      return ret;
+    }
+  }
+  if (length > 0) {
+    memcpy(serialized_message->buffer, data, length);
+  }
+  serialized_message->buffer_length = length;
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_deserialize(
+  const rmw_serialized_message_t * serialized_message,
+  const rosidl_message_type_support_t * type_support,
+  void * ros_message)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(serialized_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_support, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_message, RMW_RET_INVALID_ARGUMENT);
+
+  const rmw_libp2p_cpp::RegisteredType * registered_type = acquire_type_support(type_support);
+  if (!registered_type) {
+    // error already set
+    return RMW_RET_ERROR;
+  }
+
+  rmw_libp2p_cpp::cdr::ReadCDRBuffer deser(
+    serialized_message->buffer, serialized_message->buffer_length);
+  try {
+    if (!_deserialize_ros_message(
+        deser, ros_message, registered_type->type_support,
+        registered_type->typesupport_identifier))
+    {
+      RMW_SET_ERROR_MSG("cannot deserialize data");
+      return RMW_RET_ERROR;
+    }
+  } catch (const std::runtime_error & e) {
+    // Most likely serialized from another type
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING("cannot deserialize data: %s", e.what());
+    return RMW_RET_ERROR;
+  }
+  return RMW_RET_OK;
+}
+}  // extern "C"
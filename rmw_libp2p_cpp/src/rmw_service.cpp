@@ -12,7 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
 #include <mutex>
+#include <stdexcept>
 
 #include <iostream>
 
@@ -26,8 +28,15 @@
 
 #include "rosidl_typesupport_introspection_c/identifier.h"
 
+#include "impl/cdr_buffer.hpp"
 #include "impl/identifier.hpp"
 #include "impl/custom_node_info.hpp"
+#include "impl/custom_service_info.hpp"
+#include "impl/qos.hpp"
+#include "impl/service_listener.hpp"
+
+#include "ros_message_serialization.hpp"
+#include "type_support_common.hpp"
 
 rmw_service_t *
 rmw_create_service(
@@ -38,12 +47,9 @@ rmw_create_service(
 {
   RCUTILS_LOG_DEBUG_NAMED(
     "rmw_libp2p_cpp",
-    "%s(node=%p,type_supports=%p,service_name=%s,"
-    "qos_policies={history=%d,depth=%zu,reliability=%d,durability=%d})",
-    __FUNCTION__, (void *)node, (void *)type_supports, service_name, qos_policies->history,
-    qos_policies->depth, qos_policies->reliability, qos_policies->durability);
+    "%s(node=%p,type_supports=%p,service_name=%s,qos_policies=%p)",
+    __FUNCTION__, (void *)node, (void *)type_supports, service_name, (void *)qos_policies);
 
-  // TODO(esteve): just boilerplate, services are not supported yet
   if (!node) {
     RMW_SET_ERROR_MSG("node handle is null");
     return nullptr;
@@ -64,35 +70,241 @@ rmw_create_service(
     return nullptr;
   }
 
-  auto impl = static_cast<rmw_libp2p_cpp::CustomNodeInfo *>(node->data);
-  if (!impl) {
-    RMW_SET_ERROR_MSG("node impl is null");
+  auto node_data = static_cast<rmw_libp2p_cpp::CustomNodeInfo *>(node->data);
+  if (!node_data) {
+    RMW_SET_ERROR_MSG("node data is null");
+    return nullptr;
+  }
+
+  if (!node_data->node_handle_) {
+    RMW_SET_ERROR_MSG("node handle is null");
     return nullptr;
   }
 
+  const rosidl_service_type_support_t * type_support = get_service_typesupport_handle(
+    type_supports, rosidl_typesupport_introspection_c__identifier);
+  if (!type_support) {
+    type_support = get_service_typesupport_handle(
+      type_supports, rosidl_typesupport_introspection_cpp::typesupport_identifier);
+    if (!type_support) {
+      RMW_SET_ERROR_MSG("type support not from this implementation");
+      return nullptr;
+    }
+  }
+
+  rmw_libp2p_cpp::CustomServiceInfo * info = nullptr;
   rmw_service_t * rmw_service = nullptr;
 
+  info = new rmw_libp2p_cpp::CustomServiceInfo();
+  info->node_ = node;
+  info->typesupport_identifier_ = type_support->typesupport_identifier;
+  info->qos_ = rmw_libp2p_cpp::service_qos(*qos_policies);
+
+  info->request_type_support_ = _create_request_type_support(
+    type_support->data, info->typesupport_identifier_);
+  info->response_type_support_ = _create_response_type_support(
+    type_support->data, info->typesupport_identifier_);
+  if (!info->request_type_support_ || !info->response_type_support_) {
+    goto fail;
+  }
+
+  info->listener_ = new rmw_libp2p_cpp::ServiceListener;
+  info->service_handle_ = rs_libp2p_custom_service_new(
+    node_data->node_handle_, service_name,
+    info->listener_, rmw_libp2p_cpp::ServiceListener::on_message);
+  if (!info->service_handle_) {
+    RMW_SET_ERROR_MSG("failed to create libp2p service");
+    goto fail;
+  }
+
   rmw_service = rmw_service_allocate();
   if (!rmw_service) {
     RMW_SET_ERROR_MSG("failed to allocate memory for service");
-    // TODO(esteve): replace with goto fail
-    return nullptr;
+    goto fail;
   }
 
   rmw_service->implementation_identifier = libp2p_identifier;
-//   rmw_service->data = info;
+  rmw_service->data = info;
   rmw_service->service_name = reinterpret_cast<const char *>(
     rmw_allocate(strlen(service_name) + 1));
   if (!rmw_service->service_name) {
     RMW_SET_ERROR_MSG("failed to allocate memory for service name");
-    // TODO(esteve): replace with goto fail
-    return nullptr;
+    goto fail;
   }
   memcpy(
     const_cast<char *>(rmw_service->service_name), service_name,
     strlen(service_name) + 1);
 
+  {
+    rmw_libp2p_cpp::Gid gid;
+    rs_libp2p_custom_service_get_gid(info->service_handle_, gid.data());
+    node->context->impl->graph_cache->add_service(
+      gid, node_data->gid_, service_name,
+      _create_ros_service_type_name(type_support->data, info->typesupport_identifier_));
+  }
+
   return rmw_service;
+
+fail:
+  if (info->service_handle_) {
+    rs_libp2p_custom_service_free(info->service_handle_);
+  }
+  delete info->listener_;
+  if (info->request_type_support_) {
+    _delete_typesupport(info->request_type_support_, info->typesupport_identifier_);
+  }
+  if (info->response_type_support_) {
+    _delete_typesupport(info->response_type_support_, info->typesupport_identifier_);
+  }
+  delete info;
+
+  if (rmw_service) {
+    if (rmw_service->service_name) {
+      rmw_free(const_cast<char *>(rmw_service->service_name));
+    }
+    rmw_service_free(rmw_service);
+  }
+
+  return nullptr;
+}
+
+rmw_ret_t
+rmw_destroy_service(
+  rmw_node_t * node,
+  rmw_service_t * service)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    node,
+    node->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    service,
+    service->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(service->data);
+  if (info) {
+    if (info->service_handle_) {
+      rmw_libp2p_cpp::Gid gid;
+      rs_libp2p_custom_service_get_gid(info->service_handle_, gid.data());
+      node->context->impl->graph_cache->remove_entity(gid);
+      // No more requests are delivered to the listener once this returns
+      rs_libp2p_custom_service_free(info->service_handle_);
+    }
+    delete info->listener_;
+    _delete_typesupport(info->request_type_support_, info->typesupport_identifier_);
+    _delete_typesupport(info->response_type_support_, info->typesupport_identifier_);
+    delete info;
+  }
+  if (service->service_name) {
+    rmw_free(const_cast<char *>(service->service_name));
+  }
+  rmw_service_free(service);
+
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_take_request(
+  const rmw_service_t * service,
+  rmw_service_info_t * request_header,
+  void * ros_request,
+  bool * taken)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s(service=%p,request_header=%p,ros_request=%p,taken=%p)", __FUNCTION__,
+    (void *)service, (void *)request_header, ros_request, (void *)taken);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    service,
+    service->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(request_header, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_request, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+
+  *taken = false;
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(service->data);
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(info, "custom service info is null", return RMW_RET_ERROR);
+
+  rmw_libp2p_cpp::ServiceListener::Data data;
+  if (info->listener_->take_next_data(data)) {
+    try {
+      rmw_libp2p_cpp::cdr::ReadCDRBuffer buffer(data.message, data.length);
+      _deserialize_ros_message(
+        buffer, ros_request, info->request_type_support_, info->typesupport_identifier_);
+      *taken = true;
+    } catch (const std::runtime_error & e) {
+      // Most likely sent by a client with an incompatible type, drop it
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_libp2p_cpp",
+        "dropping request that cannot be deserialized: %s", e.what());
+    }
+    rs_libp2p_message_free(data.message, data.length);
+
+    if (*taken) {
+      request_header->source_timestamp = 0;
+      request_header->received_timestamp = 0;
+      // The client GID and the sequence number route the response back to the client
+      rmw_request_id_t & request_id = request_header->request_id;
+      memset(request_id.writer_guid, 0, sizeof(request_id.writer_guid));
+      memcpy(request_id.writer_guid, data.client_gid.data(), data.client_gid.size());
+      request_id.sequence_number = data.sequence_number;
+    }
+  }
+
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_send_response(
+  const rmw_service_t * service,
+  rmw_request_id_t * request_header,
+  void * ros_response)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s(service=%p,request_header=%p,ros_response=%p)", __FUNCTION__,
+    (void *)service, (void *)request_header, ros_response);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    service,
+    service->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(request_header, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_response, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(service->data);
+  RCUTILS_CHECK_FOR_NULL_WITH_MSG(info, "custom service info is null", return RMW_RET_ERROR);
+
+  rmw_libp2p_cpp::cdr::WriteCDRBuffer ser;
+  if (!_serialize_ros_message(
+      ros_response, ser, info->response_type_support_,
+      info->typesupport_identifier_))
+  {
+    RMW_SET_ERROR_MSG("cannot serialize data");
+    return RMW_RET_ERROR;
+  }
+
+  rs_libp2p_custom_service_send_response(
+    info->service_handle_,
+    reinterpret_cast<const uint8_t *>(request_header->writer_guid),
+    request_header->sequence_number, ser.data());
+  return RMW_RET_OK;
 }
 
 rmw_ret_t
@@ -104,9 +316,11 @@ rmw_service_response_publisher_get_actual_qos(
     "rmw_libp2p_cpp",
     "%s()", __FUNCTION__);
 
-  (void)service;
-  (void)qos_policies;
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(qos_policies, RMW_RET_INVALID_ARGUMENT);
 
+  auto info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(service->data);
+  *qos_policies = info->qos_;
   return RMW_RET_OK;
 }
 
@@ -119,8 +333,10 @@ rmw_service_request_subscription_get_actual_qos(
     "rmw_libp2p_cpp",
     "%s()", __FUNCTION__);
 
-  (void)service;
-  (void)qos_policies;
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(qos_policies, RMW_RET_INVALID_ARGUMENT);
 
+  auto info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(service->data);
+  *qos_policies = info->qos_;
   return RMW_RET_OK;
 }
@@ -14,11 +14,15 @@
 
 #include <iostream>
 
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include "rmw/allocators.h"
 #include "rmw/error_handling.h"
 #include "rmw/impl/cpp/macros.hpp"
+#include "rmw/qos_profiles.h"
 #include "rmw/types.h"
 #include "rmw/validate_full_topic_name.h"
 #include "rmw/rmw.h"
@@ -30,12 +34,46 @@
 #include "rosidl_typesupport_introspection_c/identifier.h"
 
 #include "impl/identifier.hpp"
+#include "impl/content_filter.hpp"
 #include "impl/custom_node_info.hpp"
 #include "impl/custom_subscription_info.hpp"
 #include "impl/listener.hpp"
+#include "impl/qos.hpp"
+#include "impl/type_support_registry.hpp"
 
 #include "type_support_common.hpp"
 
+namespace
+{
+
+// An empty filter expression leaves the subscription unfiltered
+bool
+compile_content_filter(
+  const rmw_libp2p_cpp::CustomSubscriptionInfo * info,
+  const rmw_subscription_content_filter_options_t * options,
+  std::shared_ptr<const rmw_libp2p_cpp::ContentFilter> & content_filter)
+{
+  content_filter.reset();
+  if (!options->filter_expression || options->filter_expression[0] == '\0') {
+    return true;
+  }
+  std::vector<std::string> parameters;
+  for (size_t i = 0; i < options->expression_parameters.size; ++i) {
+    parameters.emplace_back(options->expression_parameters.data[i]);
+  }
+  std::string error;
+  content_filter = rmw_libp2p_cpp::ContentFilter::compile(
+    info->untyped_members_, info->typesupport_identifier_, options->filter_expression,
+    parameters, error);
+  if (!content_filter) {
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING("invalid content filter: %s", error.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 // Create and return an rmw subscriber
 rmw_subscription_t *
 rmw_create_subscription(
@@ -92,34 +130,59 @@ rmw_create_subscription(
   }
 
   rmw_libp2p_cpp::CustomSubscriptionInfo * info = nullptr;
+  const rmw_libp2p_cpp::RegisteredType * registered_type = nullptr;
   rmw_subscription_t * rmw_subscription = nullptr;
 
   info = new rmw_libp2p_cpp::CustomSubscriptionInfo();
   info->node_ = node;
   info->typesupport_identifier_ = type_support->typesupport_identifier;
 
-  std::string type_name = _create_type_name(
+  registered_type = node->context->impl->type_support_registry->acquire(
     type_support->data, info->typesupport_identifier_);
-  if (!_get_registered_type(node_data->node_handle_, type_name, &info->type_support_)) {
-    info->type_support_ = _create_message_type_support(
-      type_support->data,
-      info->typesupport_identifier_);
-    _register_type(node_data->node_handle_, info->type_support_, info->typesupport_identifier_);
+  if (!registered_type) {
+    goto fail;
+  }
+  info->type_support_ = registered_type->type_support;
+  info->untyped_members_ = type_support->data;
+
+  if (subscription_options && subscription_options->content_filter_options &&
+    !compile_content_filter(info, subscription_options->content_filter_options,
+    info->content_filter_))
+  {
+    goto fail;
   }
 
   info->qos_ = *qos_policies;
-  // TODO(esteve): Set to best-effort & volatile since QoS features are not supported
   info->qos_.history = RMW_QOS_POLICY_HISTORY_KEEP_LAST;
-  info->qos_.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
-  info->qos_.reliability = RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT;
+  // Anything but transient local (e.g. system default) is served as volatile
+  if (info->qos_.durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL) {
+    info->qos_.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
+  }
+  // Anything but best effort (e.g. system default) is served as reliable
+  if (info->qos_.reliability != RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT) {
+    info->qos_.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+  }
+  if (info->qos_.depth == RMW_QOS_POLICY_DEPTH_SYSTEM_DEFAULT) {
+    info->qos_.depth = rmw_qos_profile_default.depth;
+  }
+  // Manual by node is deprecated, anything but manual by topic is served as automatic
+  if (info->qos_.liveliness != RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC) {
+    info->qos_.liveliness = RMW_QOS_POLICY_LIVELINESS_AUTOMATIC;
+  }
 
-  // TODO(esteve): delete Listener in the destructor
   info->listener_ = new rmw_libp2p_cpp::Listener;
+  info->event_listener_ = new rmw_libp2p_cpp::EventListener(node->context->impl->timer_wheel);
+  if (rmw_libp2p_cpp::qos_duration_ns(info->qos_.deadline) > 0) {
+    info->event_listener_->start_deadline(
+      std::chrono::nanoseconds(rmw_libp2p_cpp::qos_duration_ns(info->qos_.deadline)));
+  }
 
   info->subscription_handle_ =
     rs_libp2p_custom_subscription_new(
     node_data->node_handle_, topic_name,
-    info, rmw_libp2p_cpp::Listener::on_publication);
+    info, rmw_libp2p_cpp::Listener::on_publication,
+    info->qos_.reliability == RMW_QOS_POLICY_RELIABILITY_RELIABLE,
+    info->qos_.durability == RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL);
   if (!info->subscription_handle_) {
     RMW_SET_ERROR_MSG("failed to create libp2p subscription");
     goto fail;
@@ -133,6 +196,7 @@ rmw_create_subscription(
 
   rmw_subscription->implementation_identifier = libp2p_identifier;
   rmw_subscription->data = info;
+  rmw_subscription->is_cft_enabled = info->content_filter_ != nullptr;
   rmw_subscription->topic_name = reinterpret_cast<char *>(
     rmw_allocate(strlen(topic_name) + 1));
   if (!rmw_subscription->topic_name) {
@@ -146,13 +210,35 @@ rmw_create_subscription(
     node_data->subscriptions_[topic_name].insert(info);
   }
 
+  {
+    rmw_libp2p_cpp::Gid gid;
+    rs_libp2p_custom_subscription_get_gid(info->subscription_handle_, gid.data());
+    const auto & content_filter = info->content_filter_;
+    node->context->impl->graph_cache->add_subscription(
+      gid, node_data->gid_, topic_name,
+      registered_type->type_name, registered_type->type_hash, info->qos_,
+      content_filter ? content_filter->expression() : std::string(),
+      content_filter ? content_filter->parameters() : std::vector<std::string>());
+    node->context->impl->graph_cache->add_match_listener(
+      topic_name, rmw_libp2p_cpp::EntityKind::SUBSCRIPTION, registered_type->type_hash,
+      &info->publishers_matched_count_, info->event_listener_, nullptr,
+      info->listener_->delta_decoder());
+  }
+
   return rmw_subscription;
 
 fail:
-  _delete_typesupport(info->type_support_, info->typesupport_identifier_);
+  if (info->type_support_) {
+    node->context->impl->type_support_registry->release(info->type_support_);
+  }
   if (info->subscription_handle_) {
     rs_libp2p_custom_subscription_free(info->subscription_handle_);
   }
+  delete info->listener_;
+  if (info->event_listener_) {
+    info->event_listener_->stop_timers();
+  }
+  delete info->event_listener_;
   delete info;
 
   if (rmw_subscription) {
@@ -175,10 +261,53 @@ rmw_destroy_subscription(
     "rmw_libp2p_cpp",
     "%s()", __FUNCTION__);
 
-  (void)node;
-  (void)subscription;
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    node,
+    node->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto node_data = static_cast<rmw_libp2p_cpp::CustomNodeInfo *>(node->data);
+  auto info = static_cast<rmw_libp2p_cpp::CustomSubscriptionInfo *>(subscription->data);
+  if (info) {
+    if (node_data) {
+      std::lock_guard<std::mutex> lock(node_data->subscriptions_mutex_);
+      auto it = node_data->subscriptions_.find(subscription->topic_name);
+      if (it != node_data->subscriptions_.end()) {
+        it->second.erase(info);
+        if (it->second.empty()) {
+          node_data->subscriptions_.erase(it);
+        }
+      }
+    }
+    node->context->impl->graph_cache->remove_match_listener(
+      subscription->topic_name, info->event_listener_);
+    if (info->subscription_handle_) {
+      rmw_libp2p_cpp::Gid gid;
+      rs_libp2p_custom_subscription_get_gid(info->subscription_handle_, gid.data());
+      node->context->impl->graph_cache->remove_entity(gid);
+      // No more messages are delivered to the listener once this returns
+      rs_libp2p_custom_subscription_free(info->subscription_handle_);
+    }
+    delete info->listener_;
+    info->event_listener_->stop_timers();
+    delete info->event_listener_;
+    node->context->impl->type_support_registry->release(info->type_support_);
+    delete info;
+  }
+  if (subscription->topic_name) {
+    rmw_free(const_cast<char *>(subscription->topic_name));
+  }
+  rmw_subscription_free(subscription);
 
-  return RMW_RET_ERROR;
+  return RMW_RET_OK;
 }
 
 rmw_ret_t
@@ -200,3 +329,101 @@ rmw_subscription_get_actual_qos(
   *qos = info->qos_;
   return RMW_RET_OK;
 }
+
+rmw_ret_t
+rmw_subscription_count_matched_publishers(
+  const rmw_subscription_t * subscription,
+  size_t * publisher_count)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher_count, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomSubscriptionInfo *>(subscription->data);
+  *publisher_count = info->publishers_matched_count_.load();
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+rmw_subscription_get_content_filter(
+  const rmw_subscription_t * subscription,
+  rcutils_allocator_t * allocator,
+  rmw_subscription_content_filter_options_t * options)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(allocator, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(options, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomSubscriptionInfo *>(subscription->data);
+  std::shared_ptr<const rmw_libp2p_cpp::ContentFilter> content_filter;
+  {
+    std::lock_guard<std::mutex> lock(info->content_filter_mutex_);
+    content_filter = info->content_filter_;
+  }
+  if (!content_filter) {
+    RMW_SET_ERROR_MSG("subscription has no content filter");
+    return RMW_RET_ERROR;
+  }
+
+  std::vector<const char *> parameters;
+  for (const std::string & parameter : content_filter->parameters()) {
+    parameters.push_back(parameter.c_str());
+  }
+  return rmw_subscription_content_filter_options_init(
+    content_filter->expression().c_str(), parameters.size(), parameters.data(), allocator,
+    options);
+}
+
+rmw_ret_t
+rmw_subscription_set_content_filter(
+  rmw_subscription_t * subscription,
+  const rmw_subscription_content_filter_options_t * options)
+{
+  RCUTILS_LOG_DEBUG_NAMED(
+    "rmw_libp2p_cpp",
+    "%s()", __FUNCTION__);
+
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    libp2p_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+  RMW_CHECK_ARGUMENT_FOR_NULL(options, RMW_RET_INVALID_ARGUMENT);
+
+  auto info = static_cast<rmw_libp2p_cpp::CustomSubscriptionInfo *>(subscription->data);
+  std::shared_ptr<const rmw_libp2p_cpp::ContentFilter> content_filter;
+  if (!compile_content_filter(info, options, content_filter)) {
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+  {
+    std::lock_guard<std::mutex> lock(info->content_filter_mutex_);
+    info->content_filter_ = content_filter;
+  }
+  subscription->is_cft_enabled = content_filter != nullptr;
+
+  // Matched publishers stop sending what the subscription no longer wants
+  rmw_libp2p_cpp::Gid gid;
+  rs_libp2p_custom_subscription_get_gid(info->subscription_handle_, gid.data());
+  info->node_->context->impl->graph_cache->set_content_filter(
+    gid, content_filter ? content_filter->expression() : std::string(),
+    content_filter ? content_filter->parameters() : std::vector<std::string>());
+  return RMW_RET_OK;
+}
@@ -12,15 +12,24 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
 #include "rmw/error_handling.h"
 #include "rmw/rmw.h"
 
 #include "rcutils/logging_macros.h"
 
 #include "impl/cdr_buffer.hpp"
+#include "impl/compact.hpp"
+#include "impl/content_filter.hpp"
 #include "impl/identifier.hpp"
 #include "impl/custom_subscription_info.hpp"
 #include "impl/listener.hpp"
+#include "impl/message_header.hpp"
+#include "impl/xcdr2.hpp"
 #include "ros_message_serialization.hpp"
 
 rmw_ret_t
@@ -44,12 +53,78 @@ _take(
   uint8_t * message = nullptr;
   uintptr_t length = 0;
 
-  if (info->listener_->take_next_data(&message, length)) {
-    rmw_libp2p_cpp::cdr::ReadCDRBuffer buffer(message, length);
-    _deserialize_ros_message(
-      buffer, ros_message, info->type_support_,
-      info->typesupport_identifier_);
-    *taken = true;
+  std::shared_ptr<const rmw_libp2p_cpp::ContentFilter> content_filter;
+  {
+    std::lock_guard<std::mutex> lock(info->content_filter_mutex_);
+    content_filter = info->content_filter_;
+  }
+
+  while (info->listener_->take_next_data(&message, length)) {
+    rmw_libp2p_cpp::MessageHeader header;
+    if (!rmw_libp2p_cpp::parse_message_header(message, length, header)) {
+      RCUTILS_LOG_WARN_NAMED("rmw_libp2p_cpp", "dropping message without a valid header");
+      rs_libp2p_message_free(message, length);
+      return RMW_RET_OK;
+    }
+    const uint8_t * payload = message + rmw_libp2p_cpp::kMessageHeaderSize;
+    const size_t payload_length = length - rmw_libp2p_cpp::kMessageHeaderSize;
+    const auto encoding = static_cast<rmw_libp2p_cpp::PayloadEncoding>(header.encoding);
+    // Messages rejected by the content filter are skipped before being deserialized
+    if (content_filter && !content_filter->evaluate(payload, payload_length, encoding)) {
+      rs_libp2p_message_free(message, length);
+      continue;
+    }
+    // While every publisher of the topic advertises our type hash, the layout of the
+    // message is known to match and doesn't need to be checked again
+    bool check_schema = info->event_listener_->has_incompatible_types();
+    try {
+      switch (encoding) {
+        case rmw_libp2p_cpp::PayloadEncoding::CDR:
+          {
+            rmw_libp2p_cpp::cdr::ReadCDRBuffer buffer(payload, payload_length);
+            _deserialize_ros_message(
+              buffer, ros_message, info->type_support_,
+              info->typesupport_identifier_, check_schema);
+          }
+          break;
+        case rmw_libp2p_cpp::PayloadEncoding::XCDR2:
+          {
+            rmw_libp2p_cpp::xcdr2::Reader buffer(payload, payload_length);
+            _deserialize_ros_message(
+              buffer, ros_message, info->type_support_, info->typesupport_identifier_);
+          }
+          break;
+        case rmw_libp2p_cpp::PayloadEncoding::COMPACT:
+          {
+            rmw_libp2p_cpp::compact::Reader buffer(payload, payload_length);
+            _deserialize_ros_message(
+              buffer, ros_message, info->type_support_, info->typesupport_identifier_);
+          }
+          break;
+        default:
+          throw std::runtime_error("unknown payload encoding");
+      }
+      *taken = true;
+    } catch (const std::runtime_error & e) {
+      // Most likely sent by a publisher with an incompatible type, drop it
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_libp2p_cpp",
+        "dropping message that cannot be deserialized: %s", e.what());
+    }
+    rs_libp2p_message_free(message, length);
+
+    if (*taken && message_info) {
+      message_info->source_timestamp =
+        static_cast<rcutils_time_point_value_t>(header.secs) * 1000000000LL + header.nsecs;
+      message_info->received_timestamp = 0;
+      message_info->publication_sequence_number = header.sequence_number;
+      message_info->reception_sequence_number = RMW_MESSAGE_INFO_SEQUENCE_NUMBER_UNSUPPORTED;
+      message_info->publisher_gid.implementation_identifier = libp2p_identifier;
+      memset(message_info->publisher_gid.data, 0, RMW_GID_STORAGE_SIZE);
+      memcpy(message_info->publisher_gid.data, header.gid, sizeof(header.gid));
+      message_info->from_intra_process = false;
+    }
+    break;
   }
 
   return RMW_RET_OK;
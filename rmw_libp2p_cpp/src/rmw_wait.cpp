@@ -20,9 +20,14 @@
 #include "rmw/error_handling.h"
 #include "rmw/rmw.h"
 
+#include "impl/custom_client_info.hpp"
+#include "impl/custom_service_info.hpp"
 #include "impl/custom_subscription_info.hpp"
 #include "impl/custom_wait_set_info.hpp"
+#include "impl/event_listener.hpp"
+#include "impl/guard_condition.hpp"
 #include "impl/listener.hpp"
+#include "impl/service_listener.hpp"
 
 // helper function for wait
 bool
@@ -30,7 +35,8 @@ check_wait_set_for_data(
   const rmw_subscriptions_t * subscriptions,
   const rmw_guard_conditions_t * guard_conditions,
   const rmw_services_t * services,
-  const rmw_clients_t * clients)
+  const rmw_clients_t * clients,
+  const rmw_events_t * events)
 {
   if (subscriptions) {
     for (size_t i = 0; i < subscriptions->subscriber_count; ++i) {
@@ -42,6 +48,46 @@ check_wait_set_for_data(
     }
   }
 
+  if (guard_conditions) {
+    for (size_t i = 0; i < guard_conditions->guard_condition_count; ++i) {
+      void * data = guard_conditions->guard_conditions[i];
+      auto guard_condition = static_cast<GuardCondition *>(data);
+      if (guard_condition && guard_condition->hasTriggered()) {
+        return true;
+      }
+    }
+  }
+
+  if (services) {
+    for (size_t i = 0; i < services->service_count; ++i) {
+      void * data = services->services[i];
+      auto custom_service_info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(data);
+      if (custom_service_info && custom_service_info->listener_->has_data()) {
+        return true;
+      }
+    }
+  }
+
+  if (clients) {
+    for (size_t i = 0; i < clients->client_count; ++i) {
+      void * data = clients->clients[i];
+      auto custom_client_info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(data);
+      if (custom_client_info && custom_client_info->listener_->has_data()) {
+        return true;
+      }
+    }
+  }
+
+  if (events) {
+    for (size_t i = 0; i < events->event_count; ++i) {
+      auto event = static_cast<rmw_event_t *>(events->events[i]);
+      auto event_listener = static_cast<rmw_libp2p_cpp::EventListener *>(event->data);
+      if (event_listener->has_event(event->event_type)) {
+        return true;
+      }
+    }
+  }
+
   return false;
 }
 
@@ -59,10 +105,6 @@ rmw_wait(
     "rmw_libp2p_cpp",
     "%s()", __FUNCTION__);
 
-  if (events && events->event_count) {
-    RMW_SET_ERROR_MSG("unimplemented");
-    return RMW_RET_ERROR;
-  }
   if (!wait_set) {
     RMW_SET_ERROR_MSG("wait set handle is null");
     return RMW_RET_ERROR;
@@ -92,6 +134,38 @@ rmw_wait(
     }
   }
 
+  if (guard_conditions) {
+    for (size_t i = 0; i < guard_conditions->guard_condition_count; ++i) {
+      void * data = guard_conditions->guard_conditions[i];
+      auto guard_condition = static_cast<GuardCondition *>(data);
+      guard_condition->attachCondition(condition_mutex, condition_variable);
+    }
+  }
+
+  if (services) {
+    for (size_t i = 0; i < services->service_count; ++i) {
+      void * data = services->services[i];
+      auto custom_service_info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(data);
+      custom_service_info->listener_->attach_condition(condition_mutex, condition_variable);
+    }
+  }
+
+  if (clients) {
+    for (size_t i = 0; i < clients->client_count; ++i) {
+      void * data = clients->clients[i];
+      auto custom_client_info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(data);
+      custom_client_info->listener_->attach_condition(condition_mutex, condition_variable);
+    }
+  }
+
+  if (events) {
+    for (size_t i = 0; i < events->event_count; ++i) {
+      auto event = static_cast<rmw_event_t *>(events->events[i]);
+      auto event_listener = static_cast<rmw_libp2p_cpp::EventListener *>(event->data);
+      event_listener->attach_condition(condition_mutex, condition_variable);
+    }
+  }
+
   // This mutex prevents any of the listeners
   // to change the internal state and notify the condition
   // between the call to has_data() / hasTriggered() and wait()
@@ -99,9 +173,9 @@ rmw_wait(
   std::unique_lock<std::mutex> lock(*condition_mutex);
 
   bool has_data = check_wait_set_for_data(
-    subscriptions, guard_conditions, services, clients);
-  auto predicate = [subscriptions, guard_conditions, services, clients]() {
-      return check_wait_set_for_data(subscriptions, guard_conditions, services, clients);
+    subscriptions, guard_conditions, services, clients, events);
+  auto predicate = [subscriptions, guard_conditions, services, clients, events]() {
+      return check_wait_set_for_data(subscriptions, guard_conditions, services, clients, events);
     };
 
   bool timeout = false;
@@ -136,5 +210,49 @@ rmw_wait(
     }
   }
 
+  if (guard_conditions) {
+    for (size_t i = 0; i < guard_conditions->guard_condition_count; ++i) {
+      void * data = guard_conditions->guard_conditions[i];
+      auto guard_condition = static_cast<GuardCondition *>(data);
+      guard_condition->detachCondition();
+      if (!guard_condition->getHasTriggered()) {
+        guard_conditions->guard_conditions[i] = 0;
+      }
+    }
+  }
+
+  if (services) {
+    for (size_t i = 0; i < services->service_count; ++i) {
+      void * data = services->services[i];
+      auto custom_service_info = static_cast<rmw_libp2p_cpp::CustomServiceInfo *>(data);
+      custom_service_info->listener_->detach_condition();
+      if (!custom_service_info->listener_->has_data()) {
+        services->services[i] = 0;
+      }
+    }
+  }
+
+  if (clients) {
+    for (size_t i = 0; i < clients->client_count; ++i) {
+      void * data = clients->clients[i];
+      auto custom_client_info = static_cast<rmw_libp2p_cpp::CustomClientInfo *>(data);
+      custom_client_info->listener_->detach_condition();
+      if (!custom_client_info->listener_->has_data()) {
+        clients->clients[i] = 0;
+      }
+    }
+  }
+
+  if (events) {
+    for (size_t i = 0; i < events->event_count; ++i) {
+      auto event = static_cast<rmw_event_t *>(events->events[i]);
+      auto event_listener = static_cast<rmw_libp2p_cpp::EventListener *>(event->data);
+      event_listener->detach_condition();
+      if (!event_listener->has_event(event->event_type)) {
+        events->events[i] = nullptr;
+      }
+    }
+  }
+
   return timeout ? RMW_RET_TIMEOUT : RMW_RET_OK;
 }
@@ -18,6 +18,8 @@
 #include "type_support_common.hpp"
 
 #include "impl/cdr_buffer.hpp"
+#include "impl/compact.hpp"
+#include "impl/xcdr2.hpp"
 
 bool
 _serialize_ros_message(
@@ -42,6 +44,79 @@ _deserialize_ros_message(
   rmw_libp2p_cpp::cdr::ReadCDRBuffer & deser,
   void * ros_message,
   void * untyped_typesupport,
+  const char * typesupport_identifier,
+  bool check_schema)
+{
+  if (using_introspection_c_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<TypeSupport_c *>(untyped_typesupport);
+    return typed_typesupport->deserializeROSmessage(deser, ros_message, check_schema);
+  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<TypeSupport_cpp *>(untyped_typesupport);
+    return typed_typesupport->deserializeROSmessage(deser, ros_message, check_schema);
+  }
+  RMW_SET_ERROR_MSG("Unknown typesupport identifier");
+  return false;
+}
+
+bool
+_serialize_ros_message(
+  const void * ros_message,
+  rmw_libp2p_cpp::xcdr2::Writer & ser,
+  void * untyped_typesupport,
+  const char * typesupport_identifier)
+{
+  if (using_introspection_c_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<MessageTypeSupport_c *>(untyped_typesupport);
+    return typed_typesupport->serializeROSmessage(ros_message, ser);
+  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<MessageTypeSupport_cpp *>(untyped_typesupport);
+    return typed_typesupport->serializeROSmessage(ros_message, ser);
+  }
+  RMW_SET_ERROR_MSG("Unknown typesupport identifier");
+  return false;
+}
+
+bool
+_deserialize_ros_message(
+  rmw_libp2p_cpp::xcdr2::Reader & deser,
+  void * ros_message,
+  void * untyped_typesupport,
+  const char * typesupport_identifier)
+{
+  if (using_introspection_c_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<TypeSupport_c *>(untyped_typesupport);
+    return typed_typesupport->deserializeROSmessage(deser, ros_message);
+  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<TypeSupport_cpp *>(untyped_typesupport);
+    return typed_typesupport->deserializeROSmessage(deser, ros_message);
+  }
+  RMW_SET_ERROR_MSG("Unknown typesupport identifier");
+  return false;
+}
+
+bool
+_serialize_ros_message(
+  const void * ros_message,
+  rmw_libp2p_cpp::compact::Writer & ser,
+  void * untyped_typesupport,
+  const char * typesupport_identifier)
+{
+  if (using_introspection_c_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<MessageTypeSupport_c *>(untyped_typesupport);
+    return typed_typesupport->serializeROSmessage(ros_message, ser);
+  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
+    auto typed_typesupport = static_cast<MessageTypeSupport_cpp *>(untyped_typesupport);
+    return typed_typesupport->serializeROSmessage(ros_message, ser);
+  }
+  RMW_SET_ERROR_MSG("Unknown typesupport identifier");
+  return false;
+}
+
+bool
+_deserialize_ros_message(
+  rmw_libp2p_cpp::compact::Reader & deser,
+  void * ros_message,
+  void * untyped_typesupport,
   const char * typesupport_identifier)
 {
   if (using_introspection_c_typesupport(typesupport_identifier)) {
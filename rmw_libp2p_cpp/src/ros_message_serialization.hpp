@@ -16,7 +16,9 @@
 #define ROS_MESSAGE_SERIALIZATION_HPP_
 
 #include "impl/cdr_buffer.hpp"
+#include "impl/compact.hpp"
 #include "impl/rmw_libp2p_rs.hpp"
+#include "impl/xcdr2.hpp"
 
 bool
 _serialize_ros_message(
@@ -30,6 +32,35 @@ _deserialize_ros_message(
   rmw_libp2p_cpp::cdr::ReadCDRBuffer & deser,
   void * ros_message,
   void * untyped_members,
+  const char * typesupport_identifier,
+  bool check_schema = true);
+
+bool
+_serialize_ros_message(
+  const void * ros_message,
+  rmw_libp2p_cpp::xcdr2::Writer & ser,
+  void * untyped_members,
+  const char * typesupport_identifier);
+
+bool
+_deserialize_ros_message(
+  rmw_libp2p_cpp::xcdr2::Reader & deser,
+  void * ros_message,
+  void * untyped_members,
+  const char * typesupport_identifier);
+
+bool
+_serialize_ros_message(
+  const void * ros_message,
+  rmw_libp2p_cpp::compact::Writer & ser,
+  void * untyped_members,
+  const char * typesupport_identifier);
+
+bool
+_deserialize_ros_message(
+  rmw_libp2p_cpp::compact::Reader & deser,
+  void * ros_message,
+  void * untyped_members,
   const char * typesupport_identifier);
 
 #endif  // ROS_MESSAGE_SERIALIZATION_HPP_
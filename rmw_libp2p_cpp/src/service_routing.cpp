@@ -0,0 +1,59 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "impl/name_patterns.hpp"
+#include "impl/service_routing.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+namespace
+{
+
+bool
+parse_routing(const std::string & name, ServiceRouting & routing)
+{
+  if (name == "nearest") {
+    routing = ServiceRouting::NEAREST;
+  } else if (name == "least_loaded") {
+    routing = ServiceRouting::LEAST_LOADED;
+  } else if (name == "hash") {
+    routing = ServiceRouting::HASH;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+ServiceRoutingPolicies::ServiceRoutingPolicies()
+: patterns_(parse_name_patterns("RMW_LIBP2P_SERVICE_ROUTING", parse_routing))
+{
+}
+
+ServiceRouting
+ServiceRoutingPolicies::get(const std::string & service_name) const
+{
+  for (const auto & pattern : patterns_) {
+    if (name_matches(pattern.first, service_name)) {
+      return pattern.second;
+    }
+  }
+  return ServiceRouting::NEAREST;
+}
+
+}  // namespace rmw_libp2p_cpp
@@ -0,0 +1,200 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "impl/timer_wheel.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution)
+: resolution_(resolution), start_(Clock::now()), running_(true), current_tick_(0),
+  next_id_(1), running_timer_(0)
+{
+  worker_ = std::thread(&TimerWheel::run, this);
+}
+
+TimerWheel::~TimerWheel()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  condition_.notify_all();
+  worker_.join();
+}
+
+uint64_t
+TimerWheel::to_tick(Clock::time_point time_point) const
+{
+  if (time_point <= start_) {
+    return 0;
+  }
+  // Round up, timers never fire early
+  return static_cast<uint64_t>(
+    (time_point - start_ + resolution_ - Clock::duration(1)) / resolution_);
+}
+
+uint64_t
+TimerWheel::elapsed_ticks(Clock::time_point time_point) const
+{
+  if (time_point <= start_) {
+    return 0;
+  }
+  return static_cast<uint64_t>((time_point - start_) / resolution_);
+}
+
+TimerWheel::Clock::time_point
+TimerWheel::to_time_point(uint64_t tick) const
+{
+  return start_ + resolution_ * tick;
+}
+
+TimerWheel::TimerId
+TimerWheel::add(Clock::time_point expiration, Callback callback)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (timers_.empty()) {
+    // The worker doesn't count ticks while idle, skip the ticks that elapsed since
+    current_tick_ = std::max(current_tick_, elapsed_ticks(Clock::now()));
+  }
+  TimerId id = next_id_++;
+  Timer & timer = timers_[id];
+  timer.expiration_tick = to_tick(expiration);
+  timer.callback = std::move(callback);
+  insert(id, timer);
+  lock.unlock();
+  // The worker may be sleeping past the expiration of the new timer
+  condition_.notify_all();
+  return id;
+}
+
+void
+TimerWheel::remove(TimerId id)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = timers_.find(id);
+  if (it != timers_.end()) {
+    wheel_[it->second.level][it->second.slot].erase(id);
+    timers_.erase(it);
+  }
+  if (std::this_thread::get_id() != worker_.get_id()) {
+    condition_.wait(lock, [this, id] {return running_timer_ != id;});
+  }
+}
+
+void
+TimerWheel::insert(TimerId id, Timer & timer)
+{
+  // Expired timers go into the next slot of the first level
+  uint64_t expiration_tick = std::max(timer.expiration_tick, current_tick_ + 1);
+  uint64_t delta = expiration_tick - current_tick_;
+  size_t level = 0;
+  while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  // Timers beyond the range of the wheel wait in the furthest slot and are reinserted when it
+  // comes up
+  uint64_t max_delta = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+  if (delta > max_delta) {
+    expiration_tick = current_tick_ + max_delta;
+  }
+  timer.level = level;
+  timer.slot = (expiration_tick >> (kSlotBits * level)) & kSlotMask;
+  wheel_[level][timer.slot].insert(id);
+}
+
+void
+TimerWheel::cascade(size_t level)
+{
+  size_t slot = (current_tick_ >> (kSlotBits * level)) & kSlotMask;
+  std::unordered_set<TimerId> ids;
+  ids.swap(wheel_[level][slot]);
+  for (TimerId id : ids) {
+    insert(id, timers_[id]);
+  }
+}
+
+void
+TimerWheel::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    if (timers_.empty()) {
+      condition_.wait(lock, [this] {return !running_ || !timers_.empty();});
+      continue;
+    }
+
+    auto now = Clock::now();
+    uint64_t now_tick = elapsed_ticks(now);
+    if (current_tick_ >= now_tick) {
+      // Sleep through the empty slots of the first level, up to the next cascade
+      uint64_t next_tick = current_tick_ + 1;
+      uint64_t next_cascade = (current_tick_ | kSlotMask) + 1;
+      while (next_tick < next_cascade && wheel_[0][next_tick & kSlotMask].empty()) {
+        ++next_tick;
+      }
+      condition_.wait_until(lock, to_time_point(next_tick));
+      continue;
+    }
+
+    // Catch up with the ticks that elapsed, one at a time
+    while (current_tick_ < now_tick && running_) {
+      ++current_tick_;
+      for (size_t level = 1; level < kLevels; ++level) {
+        if ((current_tick_ & ((uint64_t(1) << (kSlotBits * level)) - 1)) != 0) {
+          break;
+        }
+        cascade(level);
+      }
+
+      std::unordered_set<TimerId> & slot = wheel_[0][current_tick_ & kSlotMask];
+      std::vector<TimerId> expired(slot.begin(), slot.end());
+      for (TimerId id : expired) {
+        auto it = timers_.find(id);
+        // Removed while another callback was running, or not due yet
+        if (it == timers_.end() || it->second.expiration_tick > current_tick_) {
+          continue;
+        }
+        slot.erase(id);
+        Callback callback = it->second.callback;
+        running_timer_ = id;
+        lock.unlock();
+        Clock::time_point next = callback(now);
+        lock.lock();
+        running_timer_ = 0;
+        condition_.notify_all();
+        it = timers_.find(id);
+        if (it == timers_.end()) {
+          // Removed while running
+          continue;
+        }
+        if (next == Clock::time_point::max()) {
+          timers_.erase(it);
+        } else {
+          it->second.expiration_tick = to_tick(next);
+          insert(id, it->second);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace rmw_libp2p_cpp
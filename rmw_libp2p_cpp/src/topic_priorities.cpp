@@ -0,0 +1,59 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "impl/name_patterns.hpp"
+#include "impl/topic_priorities.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+namespace
+{
+
+bool
+parse_priority(const std::string & name, TopicPriority & priority)
+{
+  if (name == "control") {
+    priority = TopicPriority::CONTROL;
+  } else if (name == "default") {
+    priority = TopicPriority::DEFAULT;
+  } else if (name == "bulk") {
+    priority = TopicPriority::BULK;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+TopicPriorities::TopicPriorities()
+: patterns_(parse_name_patterns("RMW_LIBP2P_TOPIC_PRIORITIES", parse_priority))
+{
+}
+
+TopicPriority
+TopicPriorities::get(const std::string & topic_name) const
+{
+  for (const auto & pattern : patterns_) {
+    if (name_matches(pattern.first, topic_name)) {
+      return pattern.second;
+    }
+  }
+  return TopicPriority::DEFAULT;
+}
+
+}  // namespace rmw_libp2p_cpp
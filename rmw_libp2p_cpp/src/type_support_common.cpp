@@ -83,60 +83,6 @@ _create_response_type_support(const void * untyped_members, const char * typesup
   return nullptr;
 }
 
-void
-_register_type(
-  rs_libp2p_custom_node_t * node,
-  void * untyped_typesupport,
-  const char * typesupport_identifier)
-{
-  (void)node;
-  (void)untyped_typesupport;
-
-  if (using_introspection_c_typesupport(typesupport_identifier)) {
-    // TODO(malsbat): registerType?
-  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
-    // TODO(malsbat): registerType?
-  } else {
-    RMW_SET_ERROR_MSG("Unknown typesupport identifier");
-  }
-}
-
-void
-_unregister_type(
-  rs_libp2p_custom_node_t * node,
-  void * untyped_typesupport,
-  const char * typesupport_identifier)
-{
-  (void)node;
-
-  if (using_introspection_c_typesupport(typesupport_identifier)) {
-    auto typed_typesupport = static_cast<TypeSupport_c *>(untyped_typesupport);
-    if (true) {  // TODO(malsbat): unregisterType?
-      delete typed_typesupport;
-    }
-  } else if (using_introspection_cpp_typesupport(typesupport_identifier)) {
-    auto typed_typesupport = static_cast<TypeSupport_cpp *>(untyped_typesupport);
-    if (true) {  // TODO(malsbat): unregisterType?
-      delete typed_typesupport;
-    }
-  } else {
-    RMW_SET_ERROR_MSG("Unknown typesupport identifier");
-  }
-}
-
-bool
-_get_registered_type(
-  rs_libp2p_custom_node_t * node,
-  const std::string & type_name,
-  void ** untyped_typesupport)
-{
-  // TODO(malsbat): implement
-  (void)node;
-  (void)type_name;
-  (void)untyped_typesupport;
-  return false;
-}
-
 void
 _delete_typesupport(void * untyped_typesupport, const char * typesupport_identifier)
 {
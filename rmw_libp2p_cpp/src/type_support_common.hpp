@@ -15,7 +15,7 @@
 #ifndef TYPE_SUPPORT_COMMON_HPP_
 #define TYPE_SUPPORT_COMMON_HPP_
 
-#include <sstream>
+#include <cstdint>
 #include <string>
 
 #include "rmw/error_handling.h"
@@ -58,10 +58,31 @@ using_introspection_c_typesupport(const char * typesupport_identifier);
 bool
 using_introspection_cpp_typesupport(const char * typesupport_identifier);
 
+inline std::string
+_join_ros_type_name(
+  const char * type_namespace,
+  const char * type_name)
+{
+  // The C typesupport separates namespaces with "__", the C++ one with "::"
+  std::string ros_namespace(type_namespace);
+  for (const char * separator : {"::", "__"}) {
+    size_t position = 0;
+    while ((position = ros_namespace.find(separator, position)) != std::string::npos) {
+      ros_namespace.replace(position, 2, "/");
+      ++position;
+    }
+  }
+  if (ros_namespace.empty()) {
+    return type_name;
+  }
+  return ros_namespace + "/" + type_name;
+}
+
+// Fully qualified ROS type name (e.g. std_msgs/msg/String), as reported by the graph API
 template<typename MembersType>
 ROSIDL_TYPESUPPORT_INTROSPECTION_CPP_LOCAL
 inline std::string
-_create_type_name(
+_create_ros_type_name(
   const void * untyped_members)
 {
   auto members = static_cast<const MembersType *>(untyped_members);
@@ -69,34 +90,120 @@ _create_type_name(
     RMW_SET_ERROR_MSG("members handle is null");
     return "";
   }
-
-  std::ostringstream ss;
-  std::string message_namespace(members->message_namespace_);
-  std::string message_name(members->message_name_);
-  if (!message_namespace.empty()) {
-    ss << message_namespace << "::";
-  }
-  ss << "libp2p_::" << message_name << "_";
-  return ss.str();
+  return _join_ros_type_name(members->message_namespace_, members->message_name_);
 }
 
 ROSIDL_TYPESUPPORT_INTROSPECTION_CPP_LOCAL
 inline std::string
-_create_type_name(
+_create_ros_type_name(
   const void * untyped_members,
   const char * typesupport)
 {
   if (using_introspection_c_typesupport(typesupport)) {
-    return _create_type_name<rosidl_typesupport_introspection_c__MessageMembers>(
+    return _create_ros_type_name<rosidl_typesupport_introspection_c__MessageMembers>(
       untyped_members);
   } else if (using_introspection_cpp_typesupport(typesupport)) {
-    return _create_type_name<rosidl_typesupport_introspection_cpp::MessageMembers>(
+    return _create_ros_type_name<rosidl_typesupport_introspection_cpp::MessageMembers>(
       untyped_members);
   }
   RMW_SET_ERROR_MSG("Unknown typesupport identifier");
   return "";
 }
 
+// Fully qualified ROS service type name (e.g. std_srvs/srv/Trigger)
+ROSIDL_TYPESUPPORT_INTROSPECTION_CPP_LOCAL
+inline std::string
+_create_ros_service_type_name(
+  const void * untyped_members,
+  const char * typesupport)
+{
+  if (using_introspection_c_typesupport(typesupport)) {
+    auto members =
+      static_cast<const rosidl_typesupport_introspection_c__ServiceMembers *>(untyped_members);
+    return _join_ros_type_name(members->service_namespace_, members->service_name_);
+  } else if (using_introspection_cpp_typesupport(typesupport)) {
+    auto members =
+      static_cast<const rosidl_typesupport_introspection_cpp::ServiceMembers *>(untyped_members);
+    return _join_ros_type_name(members->service_namespace_, members->service_name_);
+  }
+  RMW_SET_ERROR_MSG("Unknown typesupport identifier");
+  return "";
+}
+
+// FNV-1a, used to hash the layout of message types
+inline uint64_t
+_hash_bytes(uint64_t hash, const void * data, size_t size)
+{
+  auto bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+template<typename T>
+inline uint64_t
+_hash_value(uint64_t hash, T value)
+{
+  return _hash_bytes(hash, &value, sizeof(value));
+}
+
+inline uint64_t
+_hash_string(uint64_t hash, const std::string & value)
+{
+  hash = _hash_value(hash, static_cast<uint32_t>(value.size()));
+  return _hash_bytes(hash, value.data(), value.size());
+}
+
+template<typename MembersType>
+ROSIDL_TYPESUPPORT_INTROSPECTION_CPP_LOCAL
+inline uint64_t
+_hash_members(uint64_t hash, const MembersType * members)
+{
+  // Use the ROS type name so that the C and C++ typesupports of a type hash the same
+  hash = _hash_string(hash, _create_ros_type_name<MembersType>(members));
+  hash = _hash_value(hash, members->member_count_);
+  for (uint32_t i = 0; i < members->member_count_; ++i) {
+    const auto member = members->members_ + i;
+    hash = _hash_string(hash, member->name_);
+    hash = _hash_value(hash, member->type_id_);
+    hash = _hash_value(hash, member->is_array_);
+    hash = _hash_value(hash, static_cast<uint64_t>(member->array_size_));
+    hash = _hash_value(hash, member->is_upper_bound_);
+    hash = _hash_value(hash, static_cast<uint64_t>(member->string_upper_bound_));
+    if (member->type_id_ == ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE) {
+      hash = _hash_members(hash, static_cast<const MembersType *>(member->members_->data));
+    }
+  }
+  return hash;
+}
+
+// Hash of the layout of a message type: names, types and bounds of all its fields, recursively.
+// Endpoints exchange it during discovery to detect incompatible types. Never 0, which stands for
+// an unknown type.
+ROSIDL_TYPESUPPORT_INTROSPECTION_CPP_LOCAL
+inline uint64_t
+_create_type_hash(
+  const void * untyped_members,
+  const char * typesupport)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  if (using_introspection_c_typesupport(typesupport)) {
+    hash = _hash_members(
+      hash, static_cast<const rosidl_typesupport_introspection_c__MessageMembers *>(
+        untyped_members));
+  } else if (using_introspection_cpp_typesupport(typesupport)) {
+    hash = _hash_members(
+      hash, static_cast<const rosidl_typesupport_introspection_cpp::MessageMembers *>(
+        untyped_members));
+  } else {
+    RMW_SET_ERROR_MSG("Unknown typesupport identifier");
+    return 0;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
 void *
 _create_message_type_support(const void * untyped_members, const char * typesupport_identifier);
 
@@ -106,24 +213,6 @@ _create_request_type_support(const void * untyped_members, const char * typesupp
 void *
 _create_response_type_support(const void * untyped_members, const char * typesupport_identifier);
 
-void
-_register_type(
-  rs_libp2p_custom_node_t * node,
-  void * untyped_typesupport,
-  const char * typesupport_identifier);
-
-void
-_unregister_type(
-  rs_libp2p_custom_node_t * node,
-  void * untyped_typesupport,
-  const char * typesupport_identifier);
-
-bool
-_get_registered_type(
-  rs_libp2p_custom_node_t * node,
-  const std::string & type_name,
-  void ** untyped_typesupport);
-
 void
 _delete_typesupport(void * untyped_typesupport, const char * typesupport_identifier);
 
@@ -0,0 +1,84 @@
+// Copyright 2022 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <mutex>
+#include <string>
+
+#include "rcutils/logging_macros.h"
+
+#include "impl/type_support_registry.hpp"
+
+#include "type_support_common.hpp"
+
+namespace rmw_libp2p_cpp
+{
+
+TypeSupportRegistry::~TypeSupportRegistry()
+{
+  for (auto & entry : types_) {
+    RCUTILS_LOG_WARN_NAMED(
+      "rmw_libp2p_cpp",
+      "type support for %s still in use by %zu endpoints",
+      entry.second.type_name.c_str(), entry.second.references);
+    _delete_typesupport(entry.second.type_support, entry.second.typesupport_identifier);
+  }
+}
+
+const RegisteredType *
+TypeSupportRegistry::acquire(const void * untyped_members, const char * typesupport_identifier)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = types_.find(untyped_members);
+  if (it != types_.end()) {
+    it->second.references++;
+    return &it->second;
+  }
+
+  void * type_support = _create_message_type_support(untyped_members, typesupport_identifier);
+  if (!type_support) {
+    return nullptr;
+  }
+
+  RegisteredType & registered_type = types_[untyped_members];
+  registered_type.type_support = type_support;
+  registered_type.typesupport_identifier = typesupport_identifier;
+  registered_type.type_name = _create_ros_type_name(untyped_members, typesupport_identifier);
+  registered_type.type_hash = _create_type_hash(untyped_members, typesupport_identifier);
+  registered_type.references = 1;
+  members_[type_support] = untyped_members;
+  return &registered_type;
+}
+
+void
+TypeSupportRegistry::release(void * untyped_typesupport)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto members_it = members_.find(untyped_typesupport);
+  if (members_it == members_.end()) {
+    RCUTILS_LOG_ERROR_NAMED(
+      "rmw_libp2p_cpp",
+      "releasing unknown type support %p", untyped_typesupport);
+    return;
+  }
+  auto it = types_.find(members_it->second);
+  if (--it->second.references > 0) {
+    return;
+  }
+  _delete_typesupport(it->second.type_support, it->second.typesupport_identifier);
+  types_.erase(it);
+  members_.erase(members_it);
+}
+
+}  // namespace rmw_libp2p_cpp
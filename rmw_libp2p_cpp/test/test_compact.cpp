@@ -0,0 +1,375 @@
+// Copyright 2024 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "impl/compact.hpp"
+
+using rmw_libp2p_cpp::compact::Reader;
+using rmw_libp2p_cpp::compact::Writer;
+using rmw_libp2p_cpp::compact::unzigzag;
+using rmw_libp2p_cpp::compact::zigzag;
+
+namespace
+{
+
+std::vector<uint8_t>
+bytes(const Writer & writer)
+{
+  return std::vector<uint8_t>(writer.data(), writer.data() + writer.size());
+}
+
+template<typename T>
+size_t
+encoded_size(T value)
+{
+  Writer writer;
+  writer << value;
+  return writer.size();
+}
+
+template<typename T>
+T
+decode(const std::vector<uint8_t> & data)
+{
+  Reader reader(data.data(), data.size());
+  T value;
+  reader >> value;
+  EXPECT_EQ(reader.remaining(), 0u);
+  return value;
+}
+
+// Size of a payload in the classic CDR encoding: the 4 byte encapsulation, then every primitive
+// aligned to its size from the start of the data, strings and sequences preceded by a 4 byte
+// length, strings null terminated
+class CdrSize
+{
+public:
+  CdrSize()
+  : size_(0) {}
+
+  void primitive(size_t size, size_t count = 1)
+  {
+    size_ += (size - size_ % size) % size;
+    size_ += size * count;
+  }
+  void string(const std::string & s)
+  {
+    primitive(4);
+    size_ += s.size() + 1;
+  }
+  size_t size() const {return 4 + size_;}
+
+private:
+  size_t size_;
+};
+
+// nav_msgs/Odometry as published by a wheeled base
+struct Odometry
+{
+  int32_t sec;
+  uint32_t nanosec;
+  std::string frame_id;
+  std::string child_frame_id;
+  double pose[7];
+  double pose_covariance[36];
+  double twist[6];
+  double twist_covariance[36];
+};
+
+Odometry
+odometry()
+{
+  Odometry odometry = {1700000000, 123456789, "odom", "base_link", {}, {}, {}, {}};
+  for (size_t i = 0; i < 7; ++i) {
+    odometry.pose[i] = 0.25 * static_cast<double>(i);
+  }
+  odometry.pose_covariance[0] = odometry.pose_covariance[7] = 0.01;
+  odometry.twist[0] = 0.5;
+  odometry.twist_covariance[0] = odometry.twist_covariance[7] = 0.02;
+  return odometry;
+}
+
+void
+write(Writer & writer, const Odometry & odometry)
+{
+  writer << odometry.sec << odometry.nanosec;
+  writer.write_string(odometry.frame_id.data(), odometry.frame_id.size());
+  writer.write_string(odometry.child_frame_id.data(), odometry.child_frame_id.size());
+  writer.write_array(odometry.pose, 7);
+  writer.write_array(odometry.pose_covariance, 36);
+  writer.write_array(odometry.twist, 6);
+  writer.write_array(odometry.twist_covariance, 36);
+}
+
+void
+read(Reader & reader, Odometry & odometry)
+{
+  size_t length = 0;
+  reader >> odometry.sec >> odometry.nanosec;
+  const char * frame_id = reader.read_string(length);
+  odometry.frame_id.assign(frame_id, length);
+  const char * child_frame_id = reader.read_string(length);
+  odometry.child_frame_id.assign(child_frame_id, length);
+  reader.read_array(odometry.pose, 7);
+  reader.read_array(odometry.pose_covariance, 36);
+  reader.read_array(odometry.twist, 6);
+  reader.read_array(odometry.twist_covariance, 36);
+}
+
+size_t
+cdr_size(const Odometry & odometry)
+{
+  CdrSize cdr;
+  cdr.primitive(4, 2);
+  cdr.string(odometry.frame_id);
+  cdr.string(odometry.child_frame_id);
+  cdr.primitive(8, 7 + 36 + 6 + 36);
+  return cdr.size();
+}
+
+// std_msgs/Int32MultiArray holding small readings, e.g. encoder ticks or battery cells
+struct Readings
+{
+  std::string label;
+  uint32_t size;
+  uint32_t stride;
+  uint32_t data_offset;
+  std::vector<int32_t> data;
+};
+
+Readings
+readings()
+{
+  Readings readings = {"cells", 64, 64, 0, {}};
+  for (int32_t i = 0; i < 64; ++i) {
+    readings.data.push_back(i % 2 ? -i : i);
+  }
+  return readings;
+}
+
+void
+write(Writer & writer, const Readings & readings)
+{
+  writer << static_cast<uint32_t>(1);
+  writer.write_string(readings.label.data(), readings.label.size());
+  writer << readings.size << readings.stride << readings.data_offset;
+  writer << static_cast<uint32_t>(readings.data.size());
+  writer.write_array(readings.data.data(), readings.data.size());
+}
+
+size_t
+cdr_size(const Readings & readings)
+{
+  CdrSize cdr;
+  cdr.primitive(4);
+  cdr.string(readings.label);
+  cdr.primitive(4, 3);
+  cdr.primitive(4);
+  cdr.primitive(4, readings.data.size());
+  return cdr.size();
+}
+
+}  // namespace
+
+TEST(Compact, zigzag)
+{
+  const int64_t values[] = {
+    0, -1, 1, -64, 63, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()};
+  for (int64_t value : values) {
+    EXPECT_EQ(unzigzag(zigzag(value)), value);
+  }
+  EXPECT_EQ(zigzag(0), 0u);
+  EXPECT_EQ(zigzag(-1), 1u);
+  EXPECT_EQ(zigzag(1), 2u);
+  EXPECT_EQ(zigzag(std::numeric_limits<int64_t>::min()), std::numeric_limits<uint64_t>::max());
+}
+
+TEST(Compact, varint_sizes)
+{
+  EXPECT_EQ(encoded_size<uint32_t>(0), 1u);
+  EXPECT_EQ(encoded_size<uint32_t>(127), 1u);
+  EXPECT_EQ(encoded_size<uint32_t>(128), 2u);
+  EXPECT_EQ(encoded_size<int32_t>(-64), 1u);
+  EXPECT_EQ(encoded_size<int32_t>(-65), 2u);
+  EXPECT_EQ(encoded_size<uint32_t>(std::numeric_limits<uint32_t>::max()), 5u);
+  EXPECT_EQ(encoded_size<uint64_t>(std::numeric_limits<uint64_t>::max()), 10u);
+  EXPECT_EQ(encoded_size<int64_t>(std::numeric_limits<int64_t>::min()), 10u);
+  EXPECT_EQ(encoded_size<double>(1.0), 8u);
+  EXPECT_EQ(encoded_size<bool>(true), 1u);
+}
+
+TEST(Compact, round_trip_primitives)
+{
+  const auto check = [](auto value) {
+      Writer writer;
+      writer << value;
+      EXPECT_EQ(decode<decltype(value)>(bytes(writer)), value);
+    };
+  check(true);
+  check('x');
+  check(std::numeric_limits<int8_t>::min());
+  check(std::numeric_limits<uint8_t>::max());
+  check(std::numeric_limits<int16_t>::min());
+  check(std::numeric_limits<int16_t>::max());
+  check(std::numeric_limits<uint16_t>::max());
+  check(static_cast<char16_t>(0x20ac));
+  check(std::numeric_limits<int32_t>::min());
+  check(std::numeric_limits<int32_t>::max());
+  check(std::numeric_limits<uint32_t>::max());
+  check(std::numeric_limits<int64_t>::min());
+  check(std::numeric_limits<int64_t>::max());
+  check(std::numeric_limits<uint64_t>::max());
+  check(-1.5f);
+  check(std::numeric_limits<double>::lowest());
+  check(std::numeric_limits<double>::infinity());
+}
+
+TEST(Compact, round_trip_messages)
+{
+  Writer writer;
+  const Odometry sent = odometry();
+  write(writer, sent);
+  const std::u16string wide = u"déjà €";
+  writer.write_u16string(reinterpret_cast<const uint16_t *>(wide.data()), wide.size());
+  const bool flags[3] = {true, false, true};
+  writer.write_array(flags, 3);
+
+  const std::vector<uint8_t> data = bytes(writer);
+  Reader reader(data.data(), data.size());
+  Odometry received;
+  read(reader, received);
+  std::u16string received_wide;
+  reader.read_u16string(received_wide);
+  bool received_flags[3] = {};
+  reader.read_array(received_flags, 3);
+  EXPECT_EQ(reader.remaining(), 0u);
+
+  EXPECT_EQ(received.sec, sent.sec);
+  EXPECT_EQ(received.nanosec, sent.nanosec);
+  EXPECT_EQ(received.frame_id, sent.frame_id);
+  EXPECT_EQ(received.child_frame_id, sent.child_frame_id);
+  EXPECT_EQ(0, memcmp(received.pose, sent.pose, sizeof(sent.pose)));
+  EXPECT_EQ(
+    0, memcmp(received.pose_covariance, sent.pose_covariance, sizeof(sent.pose_covariance)));
+  EXPECT_EQ(0, memcmp(received.twist, sent.twist, sizeof(sent.twist)));
+  EXPECT_EQ(
+    0, memcmp(received.twist_covariance, sent.twist_covariance, sizeof(sent.twist_covariance)));
+  EXPECT_EQ(received_wide, wide);
+  EXPECT_TRUE(received_flags[0]);
+  EXPECT_FALSE(received_flags[1]);
+  EXPECT_TRUE(received_flags[2]);
+}
+
+TEST(Compact, rejects_corrupted_payloads)
+{
+  const auto rejects = [](const std::vector<uint8_t> & data, auto read) {
+      Reader reader(data.data(), data.size());
+      EXPECT_THROW(read(reader), std::runtime_error) << data.size() << " bytes";
+    };
+  uint16_t u16;
+  int16_t i16;
+  uint32_t u32;
+  uint64_t u64;
+  double d;
+  // Unterminated varints
+  rejects({}, [&](Reader & reader) {reader >> u32;});
+  rejects({0x80}, [&](Reader & reader) {reader >> u32;});
+  rejects({0xff, 0xff, 0xff}, [&](Reader & reader) {reader >> u64;});
+  // Longer than a 64 bit value
+  rejects(
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00},
+    [&](Reader & reader) {reader >> u64;});
+  rejects(
+    {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02},
+    [&](Reader & reader) {reader >> u64;});
+  // Values that don't fit the type
+  rejects({0x80, 0x80, 0x04}, [&](Reader & reader) {reader >> u16;});
+  rejects({0x80, 0x80, 0x04}, [&](Reader & reader) {reader >> i16;});
+  rejects({0x80, 0x80, 0x80, 0x80, 0x10}, [&](Reader & reader) {reader >> u32;});
+  // Fixed size values and arrays past the end
+  rejects({0, 0, 0, 0, 0, 0, 0}, [&](Reader & reader) {reader >> d;});
+  rejects(
+    {1, 2, 3}, [&](Reader & reader) {
+      uint8_t array[4];
+      reader.read_array(array, 4);
+    });
+  rejects({1, 2, 3}, [&](Reader & reader) {reader.skip(4);});
+  // Lengths past the end
+  rejects(
+    {5, 'o', 'd', 'o', 'm'}, [&](Reader & reader) {
+      size_t length = 0;
+      reader.read_string(length);
+    });
+  rejects(
+    {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01}, [&](Reader & reader) {
+      size_t length = 0;
+      reader.read_string(length);
+    });
+  rejects(
+    {0xff, 0xff, 0xff, 0xff, 0x0f}, [&](Reader & reader) {
+      std::u16string s;
+      reader.read_u16string(s);
+    });
+  // Code units that don't fit
+  rejects(
+    {1, 0x80, 0x80, 0x04}, [&](Reader & reader) {
+      std::u16string s;
+      reader.read_u16string(s);
+    });
+}
+
+TEST(Compact, smaller_than_cdr)
+{
+  Writer odometry_writer;
+  write(odometry_writer, odometry());
+  // Doubles dominate, only the header shrinks
+  EXPECT_EQ(odometry_writer.size(), 704u);
+  EXPECT_EQ(cdr_size(odometry()), 724u);
+
+  Writer readings_writer;
+  write(readings_writer, readings());
+  EXPECT_EQ(readings_writer.size(), 75u);
+  EXPECT_EQ(cdr_size(readings()), 292u);
+}
+
+// Time to encode and decode nav_msgs/Odometry, run with --gtest_also_run_disabled_tests
+TEST(Compact, DISABLED_odometry_throughput)
+{
+  constexpr int kMessages = 100000;
+  const Odometry sent = odometry();
+  Writer writer;
+  Odometry received;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kMessages; ++i) {
+    writer.reset(1024);
+    write(writer, sent);
+    Reader reader(writer.data(), writer.size());
+    read(reader, received);
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+    std::chrono::steady_clock::now() - start;
+  printf(
+    "nav_msgs/Odometry: %zu bytes compact, %zu bytes CDR, %.0f ns to encode and decode\n",
+    writer.size(), cdr_size(sent), elapsed.count() / kMessages);
+  EXPECT_EQ(received.nanosec, sent.nanosec);
+}
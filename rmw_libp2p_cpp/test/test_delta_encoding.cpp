@@ -0,0 +1,224 @@
+// Copyright 2024 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "impl/delta_encoding.hpp"
+#include "impl/message_header.hpp"
+#include "impl/rmw_libp2p_rs.hpp"
+
+using rmw_libp2p_cpp::DeltaDecoder;
+using rmw_libp2p_cpp::DeltaEncoder;
+using rmw_libp2p_cpp::Gid;
+using rmw_libp2p_cpp::kMessageFlagDelta;
+using rmw_libp2p_cpp::kMessageFlagKeyframe;
+using rmw_libp2p_cpp::kMessageHeaderSize;
+using rmw_libp2p_cpp::kMessageHeaderVersion;
+
+namespace
+{
+
+const Gid kPublisher = {{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16}};
+
+// Runs a message of kPublisher through decoder like Listener::on_publication. Returns whether
+// it was accepted, the payload it was reconstructed to in payload.
+bool
+receive(
+  DeltaDecoder & decoder, const uint8_t * data, size_t length, uint8_t flags, uint8_t keyframe,
+  std::vector<uint8_t> & payload)
+{
+  uintptr_t message_length = kMessageHeaderSize + length;
+  uint8_t * message = rs_libp2p_message_new(message_length);
+  message[0] = kMessageHeaderVersion;
+  message[1] = flags;
+  message[3] = keyframe;
+  memcpy(message + 24, kPublisher.data(), kPublisher.size());
+  if (length > 0) {
+    memcpy(message + kMessageHeaderSize, data, length);
+  }
+  if (!decoder.decode(message, message_length)) {
+    return false;
+  }
+  EXPECT_EQ(message[1] & kMessageFlagDelta, 0);
+  payload.assign(message + kMessageHeaderSize, message + message_length);
+  rs_libp2p_message_free(message, message_length);
+  return true;
+}
+
+bool
+receive(
+  DeltaDecoder & decoder, const std::vector<uint8_t> & data, uint8_t flags, uint8_t keyframe,
+  std::vector<uint8_t> & payload)
+{
+  return receive(decoder, data.data(), data.size(), flags, keyframe, payload);
+}
+
+// A slowly changing payload, e.g. the positions of a few joints
+std::vector<uint8_t>
+joint_states(size_t length, uint8_t tick)
+{
+  std::vector<uint8_t> payload(length);
+  for (size_t i = 0; i < length; ++i) {
+    payload[i] = static_cast<uint8_t>(i);
+  }
+  payload[length / 2] = tick;
+  payload[length - 1] = static_cast<uint8_t>(tick * 3);
+  return payload;
+}
+
+}  // namespace
+
+TEST(DeltaEncoding, round_trip)
+{
+  DeltaEncoder encoder(8, true, 0);
+  DeltaDecoder decoder;
+  std::vector<std::vector<uint8_t>> payloads = {
+    joint_states(256, 0),
+    joint_states(256, 1),
+    joint_states(256, 2),
+    // The payload grows past the end of the keyframe, then shrinks below it
+    joint_states(300, 3),
+    joint_states(200, 4),
+    joint_states(256, 5),
+    std::vector<uint8_t>(256, 0),
+  };
+  std::vector<uint8_t> flags_seen;
+  for (const auto & sent : payloads) {
+    encoder.encode(
+      sent.data(), sent.size(),
+      [&](const uint8_t * data, size_t length, uint8_t flags, uint8_t keyframe) {
+        flags_seen.push_back(flags);
+        std::vector<uint8_t> received;
+        ASSERT_TRUE(receive(decoder, data, length, flags, keyframe, received));
+        EXPECT_EQ(received, sent);
+      });
+  }
+  ASSERT_EQ(flags_seen.size(), payloads.size());
+  EXPECT_EQ(flags_seen[0], kMessageFlagKeyframe);
+  EXPECT_EQ(flags_seen[1], kMessageFlagDelta);
+  EXPECT_EQ(flags_seen[3], kMessageFlagDelta);
+  EXPECT_EQ(flags_seen[4], kMessageFlagDelta);
+}
+
+TEST(DeltaEncoding, keyframe_id_wraps)
+{
+  // A keyframe every other message, the ids go around several times
+  DeltaEncoder encoder(2, true, 0);
+  DeltaDecoder decoder;
+  std::vector<uint8_t> ids;
+  for (unsigned i = 0; i < 1200; ++i) {
+    const std::vector<uint8_t> sent = joint_states(128, static_cast<uint8_t>(i));
+    encoder.encode(
+      sent.data(), sent.size(),
+      [&](const uint8_t * data, size_t length, uint8_t flags, uint8_t keyframe) {
+        if (flags == kMessageFlagKeyframe) {
+          ids.push_back(keyframe);
+        }
+        std::vector<uint8_t> received;
+        ASSERT_TRUE(receive(decoder, data, length, flags, keyframe, received));
+        EXPECT_EQ(received, sent);
+      });
+  }
+  ASSERT_EQ(ids.size(), 600u);
+  EXPECT_EQ(ids[0], 1);
+  EXPECT_EQ(ids[254], 255);
+  EXPECT_EQ(ids[255], 0);
+  EXPECT_EQ(ids[256], 1);
+}
+
+TEST(DeltaEncoding, best_effort_and_transient_local_keyframes)
+{
+  // Best effort publishers send keyframes 4 times more often, transient local ones at least
+  // every history depth messages
+  DeltaEncoder best_effort(16, false, 0);
+  DeltaEncoder transient_local(16, true, 3);
+  unsigned best_effort_keyframes = 0;
+  unsigned transient_local_keyframes = 0;
+  for (unsigned i = 0; i < 48; ++i) {
+    const std::vector<uint8_t> sent = joint_states(128, static_cast<uint8_t>(i));
+    best_effort.encode(
+      sent.data(), sent.size(), [&](const uint8_t *, size_t, uint8_t flags, uint8_t) {
+        best_effort_keyframes += flags == kMessageFlagKeyframe;
+      });
+    transient_local.encode(
+      sent.data(), sent.size(), [&](const uint8_t *, size_t, uint8_t flags, uint8_t) {
+        transient_local_keyframes += flags == kMessageFlagKeyframe;
+      });
+  }
+  EXPECT_EQ(best_effort_keyframes, 12u);
+  EXPECT_EQ(transient_local_keyframes, 16u);
+}
+
+TEST(DeltaEncoding, messages_that_are_not_delta_encoded_pass_through)
+{
+  DeltaDecoder decoder;
+  const std::vector<uint8_t> sent = joint_states(64, 0);
+  std::vector<uint8_t> received;
+  ASSERT_TRUE(receive(decoder, sent, 0, 0, received));
+  EXPECT_EQ(received, sent);
+}
+
+TEST(DeltaEncoding, rejects_deltas_without_their_keyframe)
+{
+  DeltaDecoder decoder;
+  std::vector<uint8_t> received;
+  // payload length 4, 0 equal bytes, 1 differing one
+  const std::vector<uint8_t> delta = {4, 0, 1, 0xff};
+  EXPECT_FALSE(receive(decoder, delta, kMessageFlagDelta, 1, received));
+
+  ASSERT_TRUE(receive(decoder, joint_states(4, 0), kMessageFlagKeyframe, 1, received));
+  EXPECT_FALSE(receive(decoder, delta, kMessageFlagDelta, 2, received));
+  ASSERT_TRUE(receive(decoder, delta, kMessageFlagDelta, 1, received));
+  EXPECT_EQ(received[0], 0xff);
+
+  // Publishers that went away are forgotten
+  decoder.remove_publisher(kPublisher);
+  EXPECT_FALSE(receive(decoder, delta, kMessageFlagDelta, 1, received));
+}
+
+TEST(DeltaEncoding, rejects_malformed_deltas)
+{
+  DeltaDecoder decoder;
+  std::vector<uint8_t> received;
+  ASSERT_TRUE(receive(decoder, joint_states(8, 0), kMessageFlagKeyframe, 7, received));
+
+  const std::vector<std::vector<uint8_t>> malformed = {
+    // Empty
+    {},
+    // Truncated varints: payload length, equal run, differing run
+    {0x80},
+    {8, 0x81},
+    {8, 0, 0xff},
+    // Payload length past the keyframe and the bytes of the delta
+    {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01},
+    {12, 0, 1, 0xff},
+    // Runs past the end of the payload
+    {8, 9, 0},
+    {8, 6, 3, 1, 2, 3},
+    // Fewer differing bytes than announced
+    {8, 0, 3, 1},
+    // A varint longer than 64 bits
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01},
+  };
+  for (const auto & delta : malformed) {
+    EXPECT_FALSE(receive(decoder, delta, kMessageFlagDelta, 7, received)) <<
+      "delta of " << delta.size() << " bytes";
+  }
+  // The keyframe is still usable
+  ASSERT_TRUE(receive(decoder, {8, 8, 0}, kMessageFlagDelta, 7, received));
+  EXPECT_EQ(received, joint_states(8, 0));
+}
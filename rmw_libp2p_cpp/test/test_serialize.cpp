@@ -0,0 +1,257 @@
+// Copyright 2024 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rcutils/allocator.h"
+
+#include "rmw/error_handling.h"
+#include "rmw/rmw.h"
+#include "rmw/serialized_message.h"
+
+#include "rosidl_typesupport_cpp/message_type_support.hpp"
+#include "rosidl_typesupport_introspection_cpp/identifier.hpp"
+
+#include "test_msgs/message_fixtures.hpp"
+#include "test_msgs/msg/basic_types.h"
+
+#include "impl/cdr_buffer.hpp"
+#include "impl/type_support_registry.hpp"
+#include "ros_message_serialization.hpp"
+
+namespace
+{
+
+class SerializedMessage
+{
+public:
+  SerializedMessage()
+  : message_(rmw_get_zero_initialized_serialized_message())
+  {
+    rcutils_allocator_t allocator = rcutils_get_default_allocator();
+    EXPECT_EQ(rmw_serialized_message_init(&message_, 0, &allocator), RMW_RET_OK);
+  }
+
+  ~SerializedMessage()
+  {
+    EXPECT_EQ(rmw_serialized_message_fini(&message_), RMW_RET_OK);
+  }
+
+  rmw_serialized_message_t * get() {return &message_;}
+
+  std::vector<uint8_t> bytes() const
+  {
+    return std::vector<uint8_t>(message_.buffer, message_.buffer + message_.buffer_length);
+  }
+
+private:
+  rmw_serialized_message_t message_;
+};
+
+template<typename MessageT>
+const rosidl_message_type_support_t *
+type_support()
+{
+  return rosidl_typesupport_cpp::get_message_type_support_handle<MessageT>();
+}
+
+// Payload rmw_publish writes for a message, through the same type support registry as a
+// publisher. rmw_publish_serialized_message sends the bytes of rmw_serialize as they are, so
+// both paths only interoperate if the two match.
+template<typename MessageT>
+std::vector<uint8_t>
+published_payload(const MessageT & message)
+{
+  const rosidl_message_type_support_t * introspection = get_message_typesupport_handle(
+    type_support<MessageT>(), rosidl_typesupport_introspection_cpp::typesupport_identifier);
+  rmw_libp2p_cpp::TypeSupportRegistry registry;
+  const rmw_libp2p_cpp::RegisteredType * registered_type = registry.acquire(
+    introspection->data, introspection->typesupport_identifier);
+  EXPECT_NE(registered_type, nullptr);
+
+  rmw_libp2p_cpp::cdr::WriteCDRBuffer ser;
+  EXPECT_TRUE(
+    _serialize_ros_message(
+      &message, ser, registered_type->type_support, registered_type->typesupport_identifier));
+  size_t length = 0;
+  const uint8_t * data = ser.bytes(&length);
+  std::vector<uint8_t> payload(data, data + length);
+  registry.release(registered_type->type_support);
+  return payload;
+}
+
+template<typename MessageT>
+void
+check_matches_rmw_publish(const std::vector<std::shared_ptr<MessageT>> & messages)
+{
+  ASSERT_FALSE(messages.empty());
+  SerializedMessage serialized;
+  for (const auto & message : messages) {
+    ASSERT_EQ(
+      rmw_serialize(message.get(), type_support<MessageT>(), serialized.get()), RMW_RET_OK);
+    EXPECT_EQ(serialized.bytes(), published_payload(*message));
+  }
+}
+
+template<typename MessageT>
+void
+check_round_trips(const std::vector<std::shared_ptr<MessageT>> & messages)
+{
+  ASSERT_FALSE(messages.empty());
+  SerializedMessage serialized;
+  for (const auto & message : messages) {
+    ASSERT_EQ(
+      rmw_serialize(message.get(), type_support<MessageT>(), serialized.get()), RMW_RET_OK);
+    MessageT received;
+    ASSERT_EQ(
+      rmw_deserialize(serialized.get(), type_support<MessageT>(), &received), RMW_RET_OK);
+    EXPECT_EQ(received, *message);
+  }
+}
+
+// Time to serialize and deserialize each message of a type, with a reused buffer like rosbag2
+template<typename MessageT>
+void
+time_round_trips(const char * type_name, const std::vector<std::shared_ptr<MessageT>> & messages)
+{
+  constexpr int kRounds = 10000;
+  SerializedMessage serialized;
+  MessageT received;
+  size_t bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRounds; ++i) {
+    for (const auto & message : messages) {
+      rmw_serialize(message.get(), type_support<MessageT>(), serialized.get());
+      rmw_deserialize(serialized.get(), type_support<MessageT>(), &received);
+      bytes += serialized.get()->buffer_length;
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+    std::chrono::steady_clock::now() - start;
+  const size_t count = kRounds * messages.size();
+  printf(
+    "test_msgs/msg/%s: %zu bytes on average, %.0f ns to serialize and deserialize\n",
+    type_name, bytes / count, elapsed.count() / count);
+}
+
+}  // namespace
+
+TEST(Serialize, matches_rmw_publish)
+{
+  check_matches_rmw_publish(get_messages_basic_types());
+  check_matches_rmw_publish(get_messages_arrays());
+  check_matches_rmw_publish(get_messages_bounded_sequences());
+  check_matches_rmw_publish(get_messages_unbounded_sequences());
+  check_matches_rmw_publish(get_messages_strings());
+  check_matches_rmw_publish(get_messages_wstrings());
+  check_matches_rmw_publish(get_messages_nested());
+  check_matches_rmw_publish(get_messages_multi_nested());
+}
+
+// The classic CDR engine leaves strings and arrays of primitives out of the payload, only the
+// types made of primitives and nested messages survive a round trip
+TEST(Serialize, round_trips)
+{
+  check_round_trips(get_messages_basic_types());
+  check_round_trips(get_messages_nested());
+}
+
+TEST(Serialize, c_and_cpp_type_supports_agree)
+{
+  test_msgs__msg__BasicTypes c_message;
+  ASSERT_TRUE(test_msgs__msg__BasicTypes__init(&c_message));
+  c_message.bool_value = true;
+  c_message.float64_value = 1.125;
+  c_message.int32_value = -42;
+  c_message.uint64_value = 1234567890123ull;
+  test_msgs::msg::BasicTypes cpp_message;
+  cpp_message.bool_value = true;
+  cpp_message.float64_value = 1.125;
+  cpp_message.int32_value = -42;
+  cpp_message.uint64_value = 1234567890123ull;
+
+  SerializedMessage c_serialized;
+  SerializedMessage cpp_serialized;
+  ASSERT_EQ(
+    rmw_serialize(
+      &c_message, ROSIDL_GET_MSG_TYPE_SUPPORT(test_msgs, msg, BasicTypes), c_serialized.get()),
+    RMW_RET_OK);
+  ASSERT_EQ(
+    rmw_serialize(
+      &cpp_message, type_support<test_msgs::msg::BasicTypes>(), cpp_serialized.get()),
+    RMW_RET_OK);
+  EXPECT_EQ(c_serialized.bytes(), cpp_serialized.bytes());
+
+  test_msgs__msg__BasicTypes__fini(&c_message);
+  ASSERT_TRUE(test_msgs__msg__BasicTypes__init(&c_message));
+  ASSERT_EQ(
+    rmw_deserialize(
+      cpp_serialized.get(), ROSIDL_GET_MSG_TYPE_SUPPORT(test_msgs, msg, BasicTypes), &c_message),
+    RMW_RET_OK);
+  EXPECT_TRUE(c_message.bool_value);
+  EXPECT_EQ(c_message.float64_value, 1.125);
+  EXPECT_EQ(c_message.int32_value, -42);
+  EXPECT_EQ(c_message.uint64_value, 1234567890123ull);
+  test_msgs__msg__BasicTypes__fini(&c_message);
+}
+
+TEST(Serialize, reuses_the_buffer)
+{
+  test_msgs::msg::UnboundedSequences large;
+  // Sequences of messages are the only thing that grows a classic CDR payload
+  large.basic_types_values.resize(100);
+  test_msgs::msg::UnboundedSequences small;
+  const rosidl_message_type_support_t * ts = type_support<test_msgs::msg::UnboundedSequences>();
+
+  SerializedMessage serialized;
+  ASSERT_EQ(rmw_serialize(&large, ts, serialized.get()), RMW_RET_OK);
+  const uint8_t * buffer = serialized.get()->buffer;
+  const size_t capacity = serialized.get()->buffer_capacity;
+  ASSERT_EQ(rmw_serialize(&small, ts, serialized.get()), RMW_RET_OK);
+  EXPECT_EQ(serialized.get()->buffer, buffer);
+  EXPECT_EQ(serialized.get()->buffer_capacity, capacity);
+  EXPECT_LT(serialized.get()->buffer_length, capacity);
+}
+
+TEST(Serialize, rejects_payloads_of_another_type)
+{
+  test_msgs::msg::Strings strings;
+  strings.string_value = "Hello world!";
+  SerializedMessage serialized;
+  ASSERT_EQ(
+    rmw_serialize(&strings, type_support<test_msgs::msg::Strings>(), serialized.get()),
+    RMW_RET_OK);
+
+  test_msgs::msg::UnboundedSequences sequences;
+  EXPECT_EQ(
+    rmw_deserialize(
+      serialized.get(), type_support<test_msgs::msg::UnboundedSequences>(), &sequences),
+    RMW_RET_ERROR);
+  rmw_reset_error();
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(Serialize, DISABLED_throughput)
+{
+  time_round_trips("BasicTypes", get_messages_basic_types());
+  time_round_trips("Arrays", get_messages_arrays());
+  time_round_trips("UnboundedSequences", get_messages_unbounded_sequences());
+  time_round_trips("Strings", get_messages_strings());
+  time_round_trips("MultiNested", get_messages_multi_nested());
+}
@@ -0,0 +1,206 @@
+// Copyright 2024 Esteve Fernandez All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "rosidl_typesupport_cpp/message_type_support.hpp"
+#include "rosidl_typesupport_introspection_cpp/field_types.hpp"
+#include "rosidl_typesupport_introspection_cpp/identifier.hpp"
+#include "rosidl_typesupport_introspection_cpp/message_introspection.hpp"
+
+#include "test_msgs/message_fixtures.hpp"
+
+#include "impl/cdr_buffer.hpp"
+#include "type_support_common.hpp"
+
+using rmw_libp2p_cpp::cdr::WriteCDRBuffer;
+using rmw_libp2p_cpp::serialize_field;
+using rosidl_typesupport_introspection_cpp::MessageMember;
+using rosidl_typesupport_introspection_cpp::MessageMembers;
+
+namespace
+{
+
+template<typename MessageT>
+const MessageMembers *
+members()
+{
+  const rosidl_message_type_support_t * type_support = get_message_typesupport_handle(
+    rosidl_typesupport_cpp::get_message_type_support_handle<MessageT>(),
+    rosidl_typesupport_introspection_cpp::typesupport_identifier);
+  return static_cast<const MessageMembers *>(type_support->data);
+}
+
+// Walk over the introspection members for every message, which the compiled plans replaced.
+// Kept as the reference of the wire format the plans must not change.
+void
+serialize_recursively(WriteCDRBuffer & ser, const MessageMembers * members, const void * message)
+{
+  ser << members->member_count_;
+  for (uint32_t i = 0; i < members->member_count_; ++i) {
+    const MessageMember * member = members->members_ + i;
+    void * field = const_cast<char *>(static_cast<const char *>(message)) + member->offset_;
+    switch (member->type_id_) {
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN:
+        if (!member->is_array_) {
+          ser << (*static_cast<uint8_t *>(field) ? true : false);
+        } else {
+          serialize_field<bool>(member, field, ser);
+        }
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_OCTET:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT8:
+        serialize_field<uint8_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_CHAR:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT8:
+        serialize_field<char>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_FLOAT:
+        serialize_field<float>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_DOUBLE:
+        serialize_field<double>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT16:
+        serialize_field<int16_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT16:
+        serialize_field<uint16_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT32:
+        serialize_field<int32_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT32:
+        serialize_field<uint32_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_INT64:
+        serialize_field<int64_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_UINT64:
+        serialize_field<uint64_t>(member, field, ser);
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_STRING:
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_WSTRING:
+        // Not part of classic CDR payloads yet
+        break;
+      case ::rosidl_typesupport_introspection_cpp::ROS_TYPE_MESSAGE:
+        {
+          auto sub_members = static_cast<const MessageMembers *>(member->members_->data);
+          if (!member->is_array_) {
+            serialize_recursively(ser, sub_members, field);
+            break;
+          }
+          size_t array_size = member->array_size_;
+          if (!array_size || member->is_upper_bound_) {
+            array_size = member->size_function(field);
+            ser << static_cast<uint32_t>(array_size);
+          }
+          for (size_t index = 0; index < array_size; ++index) {
+            serialize_recursively(ser, sub_members, member->get_function(field, index));
+          }
+        }
+        break;
+      default:
+        throw std::runtime_error("unknown type");
+    }
+  }
+}
+
+std::vector<uint8_t>
+bytes(const WriteCDRBuffer & ser)
+{
+  size_t length = 0;
+  const uint8_t * data = ser.bytes(&length);
+  return std::vector<uint8_t>(data, data + length);
+}
+
+template<typename MessageT>
+void
+check_plan(const std::vector<std::shared_ptr<MessageT>> & messages)
+{
+  ASSERT_FALSE(messages.empty());
+  MessageTypeSupport_cpp type_support(members<MessageT>());
+  for (const auto & message : messages) {
+    WriteCDRBuffer planned;
+    ASSERT_TRUE(type_support.serializeROSmessage(message.get(), planned));
+    WriteCDRBuffer recursive;
+    serialize_recursively(recursive, members<MessageT>(), message.get());
+    EXPECT_EQ(bytes(planned), bytes(recursive));
+  }
+}
+
+// Time to serialize each message of a type with its plan and with the recursive walk
+template<typename MessageT>
+void
+time_plan(const char * type_name, const std::vector<std::shared_ptr<MessageT>> & messages)
+{
+  constexpr int kRounds = 10000;
+  MessageTypeSupport_cpp type_support(members<MessageT>());
+  WriteCDRBuffer ser;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRounds; ++i) {
+    for (const auto & message : messages) {
+      ser.reset(4096);
+      type_support.serializeROSmessage(message.get(), ser);
+    }
+  }
+  const std::chrono::duration<double, std::nano> planned =
+    std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRounds; ++i) {
+    for (const auto & message : messages) {
+      ser.reset(4096);
+      serialize_recursively(ser, members<MessageT>(), message.get());
+    }
+  }
+  const std::chrono::duration<double, std::nano> recursive =
+    std::chrono::steady_clock::now() - start;
+
+  const size_t count = kRounds * messages.size();
+  printf(
+    "test_msgs/msg/%s: %.0f ns with the plan, %.0f ns walking the members\n",
+    type_name, planned.count() / count, recursive.count() / count);
+}
+
+}  // namespace
+
+TEST(TypeSupport, plan_matches_the_recursive_walk)
+{
+  check_plan(get_messages_basic_types());
+  check_plan(get_messages_arrays());
+  check_plan(get_messages_bounded_sequences());
+  check_plan(get_messages_unbounded_sequences());
+  check_plan(get_messages_strings());
+  check_plan(get_messages_wstrings());
+  check_plan(get_messages_nested());
+  check_plan(get_messages_multi_nested());
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(TypeSupport, DISABLED_plan_throughput)
+{
+  time_plan("BasicTypes", get_messages_basic_types());
+  time_plan("Nested", get_messages_nested());
+  time_plan("UnboundedSequences", get_messages_unbounded_sequences());
+  time_plan("MultiNested", get_messages_multi_nested());
+}